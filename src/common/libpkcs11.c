@@ -103,3 +103,18 @@ C_UnloadModule(void *module)
 	free(mod);
 	return CKR_OK;
 }
+
+/*
+ * Look up an additional (vendor specific) symbol in a loaded module.
+ * Returns NULL if the module does not export it.
+ */
+void *
+C_GetModuleSymbol(void *module, const char *name)
+{
+	sc_pkcs11_module_t *mod = (sc_pkcs11_module_t *) module;
+
+	if (!mod || mod->_magic != MAGIC || mod->handle == NULL || name == NULL)
+		return NULL;
+
+	return sc_dlsym(mod->handle, name);
+}
@@ -22,4 +22,5 @@
 #define __LIBPKCS11_H
 void *C_LoadModule(const char *name, CK_FUNCTION_LIST_PTR_PTR);
 CK_RV C_UnloadModule(void *module);
+void *C_GetModuleSymbol(void *module, const char *name);
 #endif
@@ -0,0 +1,148 @@
+/*
+ * lru.c: Least recently used cache keyed by byte strings
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lru.h"
+
+struct lru_entry {
+	unsigned int hash;
+	unsigned char *key;
+	size_t len;
+	void *value;
+	struct lru_entry *next;
+};
+
+unsigned int
+lru_hash(unsigned int hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static void
+lru_entry_free(lru_cache_t *cache, struct lru_entry *entry)
+{
+	if (cache->free_value)
+		cache->free_value(entry->value);
+	free(entry->key);
+	free(entry);
+}
+
+lru_cache_t *
+lru_cache_new(size_t max, void (*free_value)(void *value))
+{
+	lru_cache_t *cache = calloc(1, sizeof(lru_cache_t));
+
+	if (cache == NULL)
+		return NULL;
+	cache->max = max;
+	cache->free_value = free_value;
+	return cache;
+}
+
+void
+lru_cache_free(lru_cache_t *cache)
+{
+	struct lru_entry *entry, *next;
+
+	if (cache == NULL)
+		return;
+	for (entry = cache->head; entry; entry = next) {
+		next = entry->next;
+		lru_entry_free(cache, entry);
+	}
+	free(cache);
+}
+
+void *
+lru_cache_get(lru_cache_t *cache, const void *key, size_t len)
+{
+	struct lru_entry *entry, *prev = NULL;
+	unsigned int hash;
+
+	if (cache == NULL || key == NULL)
+		return NULL;
+
+	hash = lru_hash(LRU_HASH_INIT, key, len);
+	for (entry = cache->head; entry; prev = entry, entry = entry->next) {
+		/* the key is compared in full to rule out hash collisions */
+		if (entry->hash != hash || entry->len != len || memcmp(entry->key, key, len))
+			continue;
+
+		/* move to front */
+		if (prev) {
+			prev->next = entry->next;
+			entry->next = cache->head;
+			cache->head = entry;
+		}
+		return entry->value;
+	}
+	return NULL;
+}
+
+int
+lru_cache_put(lru_cache_t *cache, const void *key, size_t len, void *value)
+{
+	struct lru_entry *entry, *prev = NULL;
+
+	if (cache == NULL || key == NULL || cache->max == 0) {
+		if (cache && cache->free_value)
+			cache->free_value(value);
+		return -1;
+	}
+
+	entry = calloc(1, sizeof(struct lru_entry));
+	if (entry == NULL || (entry->key = malloc(len ? len : 1)) == NULL) {
+		free(entry);
+		if (cache->free_value)
+			cache->free_value(value);
+		return -1;
+	}
+	memcpy(entry->key, key, len);
+	entry->len = len;
+	entry->hash = lru_hash(LRU_HASH_INIT, key, len);
+	entry->value = value;
+
+	entry->next = cache->head;
+	cache->head = entry;
+	cache->count++;
+
+	/* evict the least recently used entry */
+	if (cache->count > cache->max) {
+		for (entry = cache->head; entry->next; prev = entry, entry = entry->next)
+			;
+		prev->next = NULL;
+		cache->count--;
+		lru_entry_free(cache, entry);
+	}
+	return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * lru.h: Least recently used cache keyed by byte strings
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __LRU_H
+#define __LRU_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Start value of lru_hash() */
+#define LRU_HASH_INIT	2166136261U
+
+/* FNV-1a hash of len bytes at data, continued from hash */
+unsigned int lru_hash(unsigned int hash, const void *data, size_t len);
+
+struct lru_entry;
+
+/*
+ * Entries are kept in most recently used order. The key is copied, the
+ * value is owned by the cache and released with free_value. The cache does
+ * no locking of its own.
+ */
+typedef struct lru_cache {
+	struct lru_entry *head;
+	size_t count;
+	size_t max;
+	void (*free_value)(void *value);
+} lru_cache_t;
+
+/* Allocates an empty cache of at most max entries, NULL if out of memory */
+lru_cache_t *lru_cache_new(size_t max, void (*free_value)(void *value));
+/* Releases the cache with all its entries */
+void lru_cache_free(lru_cache_t *cache);
+/* Returns the value stored for the key and makes it the most recently used
+ * entry, or NULL if there is none */
+void *lru_cache_get(lru_cache_t *cache, const void *key, size_t len);
+/* Stores the value as the most recently used entry and drops the least
+ * recently used one when the cache is full. The value is released when it
+ * can not be stored. Returns 0 on success, -1 otherwise */
+int lru_cache_put(lru_cache_t *cache, const void *key, size_t len, void *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -378,6 +378,7 @@ sc_single_transmit(struct sc_card *card, struct sc_apdu *apdu)
 	/* send APDU to the reader driver */
 	rv = card->reader->ops->transmit(card->reader, apdu);
 	LOG_TEST_RET(ctx, rv, "unable to transmit APDU");
+	sc_stats_count_apdu(ctx, apdu);
 
 	LOG_FUNC_RETURN(ctx, rv);
 }
@@ -450,18 +451,24 @@ sc_get_response(struct sc_card *card, struct sc_apdu *apdu, size_t olen)
 	minlen = le;
 
 	do {
-		unsigned char resp[256];
+		unsigned char resp[256], *out = resp;
 		size_t resp_len = le;
 
 		/* call GET RESPONSE to get more date from the card;
-		 * note: GET RESPONSE returns the left amount of data (== SW2) */
-		memset(resp, 0, sizeof(resp));
-		rv = card->ops->get_response(card, &resp_len, resp);
+		 * note: GET RESPONSE returns the left amount of data (== SW2).
+		 * The data is written directly to the caller's buffer unless the
+		 * card may return more than fits in there. */
+		if (buflen >= le)
+			out = buf;
+		else
+			memset(resp, 0, sizeof(resp));
+		SC_STATS_ADD(ctx, get_response, 1);
+		rv = card->ops->get_response(card, &resp_len, out);
 		if (rv < 0)   {
 #ifdef ENABLE_SM
 			if (resp_len)   {
-				sc_log_hex(ctx, "SM response data", resp, resp_len);
-				sc_sm_update_apdu_response(card, resp, resp_len, rv, apdu);
+				sc_log_hex(ctx, "SM response data", out, resp_len);
+				sc_sm_update_apdu_response(card, out, resp_len, rv, apdu);
 			}
 #endif
 			LOG_TEST_RET(ctx, rv, "GET RESPONSE error");
@@ -472,7 +479,8 @@ sc_get_response(struct sc_card *card, struct sc_apdu *apdu, size_t olen)
 		if (buflen < le)
 			le = buflen;
 
-		memcpy(buf, resp, le);
+		if (out != buf)
+			memcpy(buf, resp, le);
 		buf    += le;
 		buflen -= le;
 
@@ -536,6 +544,72 @@ sc_transmit(sc_card_t *card, sc_apdu_t *apdu)
 }
 
 
+/** Sends the intermediate APDUs of a chained command with the reader's
+ *  transmit_chain() operation, i.e. without going through sc_transmit()
+ *  for each of them.
+ *  @param  card  sc_card_t object for the smartcard
+ *  @param  apdu  chained APDU to be sent
+ *  @param  max_send_size  length of the data of each APDU
+ *  @return number of data bytes sent or an error value
+ */
+static int
+sc_transmit_chain(sc_card_t *card, const sc_apdu_t *apdu, size_t max_send_size)
+{
+	struct sc_context *ctx = card->ctx;
+	size_t count = (apdu->datalen - 1) / max_send_size;
+	size_t i, sent = 0;
+	sc_apdu_t *chain;
+	int r;
+
+	LOG_FUNC_CALLED(ctx);
+
+	chain = calloc(count, sizeof *chain);
+	if (chain == NULL)
+		LOG_FUNC_RETURN(ctx, SC_ERROR_OUT_OF_MEMORY);
+	for (i = 0; i < count; i++) {
+		chain[i] = *apdu;
+		chain[i].flags &= ~SC_APDU_FLAGS_CHAINING;
+		if ((chain[i].cse & SC_APDU_SHORT_MASK) == SC_APDU_CASE_4_SHORT)
+			chain[i].cse--;
+		chain[i].cla    |= 0x10;
+		chain[i].le      = 0;
+		chain[i].resplen = 0;
+		chain[i].resp    = NULL;
+		chain[i].data    = apdu->data + i * max_send_size;
+		chain[i].datalen = chain[i].lc = max_send_size;
+	}
+
+	/* all intermediate APDUs have the same form */
+	r = sc_check_apdu(card, &chain[0]);
+	if (r != SC_SUCCESS)
+		sc_log(ctx, "inconsistent APDU while chaining");
+
+	while (r == SC_SUCCESS && sent < count) {
+		const sc_apdu_t *last;
+
+		r = card->reader->ops->transmit_chain(card->reader, chain + sent, count - sent);
+		if (r <= 0) {
+			r = r < 0 ? r : SC_ERROR_INTERNAL;
+			break;
+		}
+		for (i = sent; i < sent + (size_t)r; i++)
+			sc_stats_count_apdu(ctx, &chain[i]);
+		sent += r;
+		r = SC_SUCCESS;
+
+		/* the reader stops at the first APDU not answered with 0x9000;
+		 * 0x61XX is fine as no data is requested (see sc_get_response()) */
+		last = &chain[sent - 1];
+		if (last->sw1 != 0x61)
+			r = sc_check_sw(card, last->sw1, last->sw2);
+	}
+
+	free(chain);
+	LOG_TEST_RET(ctx, r, "cannot transmit chained APDUs");
+	LOG_FUNC_RETURN(ctx, (int)(sent * max_send_size));
+}
+
+
 int sc_transmit_apdu(sc_card_t *card, sc_apdu_t *apdu)
 {
 	int r = SC_SUCCESS;
@@ -565,8 +639,24 @@ int sc_transmit_apdu(sc_card_t *card, sc_apdu_t *apdu)
 		size_t    len  = apdu->datalen;
 		const u8  *buf = apdu->data;
 		size_t    max_send_size = sc_get_max_send_size(card);
+		int       checked = 0;
+
+		/* let the reader send the intermediate APDUs in one go */
+		if (len > max_send_size && card->reader->ops->transmit_chain != NULL
+#ifdef ENABLE_SM
+				&& (card->sm_ctx.sm_mode != SM_MODE_TRANSMIT
+					|| (apdu->flags & SC_APDU_FLAGS_NO_SM) != 0)
+#endif
+				) {
+			r = sc_transmit_chain(card, apdu, max_send_size);
+			if (r >= 0) {
+				len -= r;
+				buf += r;
+				r = SC_SUCCESS;
+			}
+		}
 
-		while (len != 0) {
+		while (r == SC_SUCCESS && len != 0) {
 			size_t    plen;
 			sc_apdu_t tapdu;
 			int       last = 0;
@@ -595,10 +685,14 @@ int sc_transmit_apdu(sc_card_t *card, sc_apdu_t *apdu)
 			tapdu.data    = buf;
 			tapdu.datalen = tapdu.lc = plen;
 
-			r = sc_check_apdu(card, &tapdu);
-			if (r != SC_SUCCESS) {
-				sc_log(card->ctx, "inconsistent APDU while chaining");
-				break;
+			/* the intermediate APDUs only differ in their data */
+			if (last != 0 || checked == 0) {
+				r = sc_check_apdu(card, &tapdu);
+				if (r != SC_SUCCESS) {
+					sc_log(card->ctx, "inconsistent APDU while chaining");
+					break;
+				}
+				checked = 1;
 			}
 
 			r = sc_transmit(card, &tapdu);
@@ -511,41 +511,47 @@ const u8 *sc_asn1_find_tag(sc_context_t *ctx, const u8 * buf,
 	return NULL;
 }
 
-const u8 *sc_asn1_skip_tag(sc_context_t *ctx, const u8 ** buf, size_t *buflen,
-			   unsigned int tag_in, size_t *taglen_out)
+/* compare a tag read by sc_asn1_read_tag() with a template tag */
+static int asn1_tag_matches(unsigned int cla, unsigned int tag, unsigned int tag_in)
 {
-	const u8 *p = *buf;
-	size_t len = *buflen, taglen;
-	unsigned int cla = 0, tag;
-
-	if (sc_asn1_read_tag((const u8 **) &p, len, &cla, &tag, &taglen) != SC_SUCCESS
-			|| p == NULL)
-		return NULL;
 	switch (cla & 0xC0) {
 	case SC_ASN1_TAG_UNIVERSAL:
 		if ((tag_in & SC_ASN1_CLASS_MASK) != SC_ASN1_UNI)
-			return NULL;
+			return 0;
 		break;
 	case SC_ASN1_TAG_APPLICATION:
 		if ((tag_in & SC_ASN1_CLASS_MASK) != SC_ASN1_APP)
-			return NULL;
+			return 0;
 		break;
 	case SC_ASN1_TAG_CONTEXT:
 		if ((tag_in & SC_ASN1_CLASS_MASK) != SC_ASN1_CTX)
-			return NULL;
+			return 0;
 		break;
 	case SC_ASN1_TAG_PRIVATE:
 		if ((tag_in & SC_ASN1_CLASS_MASK) != SC_ASN1_PRV)
-			return NULL;
+			return 0;
 		break;
 	}
 	if (cla & SC_ASN1_TAG_CONSTRUCTED) {
 		if ((tag_in & SC_ASN1_CONS) == 0)
-			return NULL;
+			return 0;
 	} else
 		if (tag_in & SC_ASN1_CONS)
-			return NULL;
-	if ((tag_in & SC_ASN1_TAG_MASK) != tag)
+			return 0;
+	return (tag_in & SC_ASN1_TAG_MASK) == tag;
+}
+
+const u8 *sc_asn1_skip_tag(sc_context_t *ctx, const u8 ** buf, size_t *buflen,
+			   unsigned int tag_in, size_t *taglen_out)
+{
+	const u8 *p = *buf;
+	size_t len = *buflen, taglen;
+	unsigned int cla = 0, tag;
+
+	if (sc_asn1_read_tag((const u8 **) &p, len, &cla, &tag, &taglen) != SC_SUCCESS
+			|| p == NULL)
+		return NULL;
+	if (!asn1_tag_matches(cla, tag, tag_in))
 		return NULL;
 	len -= (p - *buf);	/* header size */
 	if (taglen > len) {
@@ -1372,6 +1378,41 @@ static const struct sc_asn1_entry c_asn1_p15_obj[5] = {
 	{ NULL, 0, 0, 0, NULL, NULL }
 };
 
+static const struct sc_asn1_compiled c_asn1_compiled_access_control_rule[] = {
+	SC_ASN1_COMPILED_BUFFER("accessMode", SC_ASN1_BIT_FIELD, SC_ASN1_TAG_BIT_STRING, SC_ASN1_OPTIONAL,
+		SC_ASN1_BASE_P15_OBJECT, offsetof(struct sc_pkcs15_object, access_rules)
+			+ offsetof(struct sc_pkcs15_accessrule, access_mode),
+		SC_ASN1_NO_OUTPUT, sizeof(unsigned)),
+	SC_ASN1_COMPILED_VALUE("securityCondition", SC_ASN1_PKCS15_ID, SC_ASN1_TAG_OCTET_STRING, SC_ASN1_OPTIONAL,
+		SC_ASN1_BASE_P15_OBJECT, offsetof(struct sc_pkcs15_object, access_rules)
+			+ offsetof(struct sc_pkcs15_accessrule, auth_id)),
+	SC_ASN1_COMPILED_END
+};
+
+static const struct sc_asn1_compiled c_asn1_compiled_access_control_rules[] = {
+	{ "accessControlRule", SC_ASN1_STRUCT, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, SC_ASN1_OPTIONAL,
+		c_asn1_compiled_access_control_rule, 0, SC_ASN1_NO_OUTPUT, SC_ASN1_NO_OUTPUT, 0,
+		SC_PKCS15_MAX_ACCESS_RULES, sizeof(struct sc_pkcs15_accessrule), 0 },
+	SC_ASN1_COMPILED_END
+};
+
+/* same as c_asn1_com_obj_attr */
+const struct sc_asn1_compiled sc_asn1_compiled_com_obj_attr[] = {
+	SC_ASN1_COMPILED_BUFFER("label", SC_ASN1_UTF8STRING, SC_ASN1_TAG_UTF8STRING, SC_ASN1_OPTIONAL,
+		SC_ASN1_BASE_P15_OBJECT, offsetof(struct sc_pkcs15_object, label),
+		SC_ASN1_NO_OUTPUT, SC_PKCS15_MAX_LABEL_SIZE),
+	SC_ASN1_COMPILED_BUFFER("flags", SC_ASN1_BIT_FIELD, SC_ASN1_TAG_BIT_STRING, SC_ASN1_OPTIONAL,
+		SC_ASN1_BASE_P15_OBJECT, offsetof(struct sc_pkcs15_object, flags),
+		SC_ASN1_NO_OUTPUT, sizeof(unsigned int)),
+	SC_ASN1_COMPILED_VALUE("authId", SC_ASN1_PKCS15_ID, SC_ASN1_TAG_OCTET_STRING, SC_ASN1_OPTIONAL,
+		SC_ASN1_BASE_P15_OBJECT, offsetof(struct sc_pkcs15_object, auth_id)),
+	SC_ASN1_COMPILED_VALUE("userConsent", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, SC_ASN1_OPTIONAL,
+		SC_ASN1_BASE_P15_OBJECT, offsetof(struct sc_pkcs15_object, user_consent)),
+	SC_ASN1_COMPILED_STRUCT("accessControlRules", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, SC_ASN1_OPTIONAL,
+		c_asn1_compiled_access_control_rules),
+	SC_ASN1_COMPILED_END
+};
+
 static int asn1_decode_p15_object(sc_context_t *ctx, const u8 *in,
 				  size_t len, struct sc_asn1_pkcs15_object *obj,
 				  int depth)
@@ -1555,6 +1596,14 @@ static int asn1_decode_entry(sc_context_t *ctx,struct sc_asn1_entry *entry,
 				obj++;
 			}
 
+			/* Reference the input if the caller keeps it alive */
+			if ((entry->flags & (SC_ASN1_ALLOC | SC_ASN1_BORROW)) == (SC_ASN1_ALLOC | SC_ASN1_BORROW)) {
+				if (objlen > 0)
+					*(const u8 **) parm = obj;
+				*len = objlen;
+				break;
+			}
+
 			/* Allocate buffer if needed */
 			if (entry->flags & SC_ASN1_ALLOC) {
 				u8 **buf = (u8 **) parm;
@@ -1761,6 +1810,149 @@ int sc_asn1_decode_choice(sc_context_t *ctx, struct sc_asn1_entry *asn1,
 	return asn1_decode(ctx, asn1, in, len, newp, len_left, 1, 0);
 }
 
+static int asn1_decode_compiled(sc_context_t *ctx, const struct sc_asn1_compiled *asn1,
+		void * const *bases, size_t delta, unsigned int flags, unsigned int *present,
+		const u8 *in, size_t len, const u8 **newp, size_t *len_left,
+		int choice, int depth);
+
+static int asn1_decode_compiled_entry(sc_context_t *ctx, const struct sc_asn1_compiled *entry,
+		void * const *bases, size_t delta, unsigned int flags, unsigned int *present,
+		const u8 *obj, size_t objlen, int depth)
+{
+	u8 *base = bases != NULL ? (u8 *) bases[entry->base] : NULL;
+	struct sc_asn1_entry leaf;
+	size_t len = entry->size;
+	int r;
+
+	if (entry->type == SC_ASN1_STRUCT) {
+		if (entry->children != NULL) {
+			r = asn1_decode_compiled(ctx, entry->children, bases, delta, flags, present,
+					obj, objlen, NULL, NULL, 0, depth + 1);
+			if (r)
+				return r;
+		}
+	} else {
+		/* the primitive types are shared with the interpreted decoder */
+		leaf.name = entry->name;
+		leaf.type = entry->type;
+		leaf.tag = entry->tag;
+		leaf.flags = entry->flags;
+		if (entry->flags & SC_ASN1_ALLOC)
+			leaf.flags |= flags & SC_ASN1_BORROW;
+		leaf.parm = NULL;
+		leaf.arg = &len;
+		if (base != NULL && entry->offset != SC_ASN1_NO_OUTPUT)
+			leaf.parm = base + delta + entry->offset;
+		r = asn1_decode_entry(ctx, &leaf, obj, objlen, depth);
+		if (r)
+			return r;
+		if (leaf.parm != NULL && entry->len_offset != SC_ASN1_NO_OUTPUT)
+			*(size_t *) (base + delta + entry->len_offset) = len;
+	}
+
+	if (present != NULL)
+		*present |= entry->present;
+	return 0;
+}
+
+static int asn1_decode_compiled(sc_context_t *ctx, const struct sc_asn1_compiled *asn1,
+		void * const *bases, size_t delta, unsigned int flags, unsigned int *present,
+		const u8 *in, size_t len, const u8 **newp, size_t *len_left,
+		int choice, int depth)
+{
+	const u8 *p = in, *header = NULL, *obj = NULL;
+	size_t left = len, objlen = 0;
+	unsigned int cla = 0, tag = 0, n, repeat;
+	int r, idx, header_ok = 0;
+
+	if (!p)
+		return SC_ERROR_ASN1_OBJECT_NOT_FOUND;
+	if (left < 2) {
+		while (asn1->name && (asn1->flags & SC_ASN1_OPTIONAL))
+			asn1++;
+		/* If all elements were optional, there's nothing
+		 * to complain about */
+		if (asn1->name == NULL)
+			return 0;
+		sc_debug(ctx, SC_LOG_DEBUG_ASN1, "End of ASN.1 stream, "
+			      "non-optional field \"%s\" not found\n",
+			      asn1->name);
+		return SC_ERROR_ASN1_OBJECT_NOT_FOUND;
+	}
+	if (p[0] == 0 || p[0] == 0xFF || len == 0)
+		return SC_ERROR_ASN1_END_OF_CONTENTS;
+
+	for (idx = 0; asn1[idx].name != NULL; idx++) {
+		const struct sc_asn1_compiled *entry = &asn1[idx];
+
+		/* Special case CHOICE has no tag */
+		if (entry->type == SC_ASN1_CHOICE) {
+			r = asn1_decode_compiled(ctx, entry->children, bases, delta, flags, present,
+					p, left, &p, &left, 1, depth + 1);
+			if (r < 0)
+				return r;
+			if (present != NULL)
+				*present |= entry->present;
+			if (choice)
+				break;
+			continue;
+		}
+
+		repeat = entry->repeat ? entry->repeat : 1;
+		for (n = 0; n < repeat; n++) {
+			/* the header of each element is parsed only once,
+			 * whatever the number of entries tried against it */
+			if (header != p) {
+				obj = p;
+				header = p;
+				header_ok = sc_asn1_read_tag(&obj, left, &cla, &tag, &objlen) == SC_SUCCESS
+					&& obj != NULL;
+			}
+			if (!header_ok || !asn1_tag_matches(cla, tag, entry->tag))
+				break;
+
+			left -= (obj - p) + objlen;
+			p = obj + objlen;
+			r = asn1_decode_compiled_entry(ctx, entry, bases, delta + n * entry->stride,
+					flags, present, obj, objlen, depth);
+			if (r) {
+				sc_debug(ctx, SC_LOG_DEBUG_ASN1, "decoding of ASN.1 object '%s' failed: %s\n",
+						entry->name, sc_strerror(r));
+				return r;
+			}
+		}
+		if (n == 0) {
+			if (choice || (entry->flags & SC_ASN1_OPTIONAL))
+				continue;
+			sc_debug(ctx, SC_LOG_DEBUG_ASN1, "mandatory ASN.1 object '%s' not found\n", entry->name);
+			return SC_ERROR_ASN1_OBJECT_NOT_FOUND;
+		}
+		if (choice)
+			break;
+	}
+	if (choice && asn1[idx].name == NULL) /* No match */
+		return SC_ERROR_ASN1_OBJECT_NOT_FOUND;
+	if (newp != NULL)
+		*newp = p;
+	if (len_left != NULL)
+		*len_left = left;
+	return choice ? idx : 0;
+}
+
+int sc_asn1_decode_compiled(sc_context_t *ctx, const struct sc_asn1_compiled *asn1,
+		void * const *bases, unsigned int flags, unsigned int *present,
+		const u8 *in, size_t len, const u8 **newp, size_t *len_left)
+{
+	return asn1_decode_compiled(ctx, asn1, bases, 0, flags, present, in, len, newp, len_left, 0, 0);
+}
+
+int sc_asn1_decode_compiled_choice(sc_context_t *ctx, const struct sc_asn1_compiled *asn1,
+		void * const *bases, unsigned int flags, unsigned int *present,
+		const u8 *in, size_t len, const u8 **newp, size_t *len_left)
+{
+	return asn1_decode_compiled(ctx, asn1, bases, 0, flags, present, in, len, newp, len_left, 1, 0);
+}
+
 static int asn1_encode_entry(sc_context_t *ctx, const struct sc_asn1_entry *entry,
 			     u8 **obj, size_t *objlen, int depth)
 {
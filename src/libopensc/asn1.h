@@ -52,6 +52,56 @@ struct sc_asn1_pkcs15_algorithm_info {
 	void (*free)(void *);
 };
 
+/*
+ * Pre-compiled decoder templates
+ *
+ * Unlike struct sc_asn1_entry these are immutable: nested structures
+ * are linked at compile time through 'children' and the decoded values
+ * are stored at fixed offsets from one of the output base pointers
+ * given to sc_asn1_decode_compiled(), so nothing has to be copied or
+ * formatted before decoding. SC_ASN1_CALLBACK is not supported.
+ * The 'flags' given to the decoder (SC_ASN1_BORROW) apply to all the
+ * SC_ASN1_ALLOC values of the template.
+ */
+#define SC_ASN1_NO_OUTPUT	((size_t) -1)
+
+struct sc_asn1_compiled {
+	const char *name;
+	unsigned int type;
+	unsigned int tag;
+	unsigned int flags;
+	/* members of a SC_ASN1_STRUCT or alternatives of a SC_ASN1_CHOICE */
+	const struct sc_asn1_compiled *children;
+	/* value: bases[base] + offset, length (size_t): bases[base] + len_offset */
+	unsigned int base;
+	size_t offset;
+	size_t len_offset;
+	/* capacity of a value that is not allocated (SC_ASN1_ALLOC) */
+	size_t size;
+	/* SEQUENCE OF: decoded up to 'repeat' times, 'stride' bytes apart */
+	unsigned int repeat;
+	size_t stride;
+	/* bits set in the 'present' mask when the element was decoded */
+	unsigned int present;
+};
+
+#define SC_ASN1_COMPILED_STRUCT(name, tag, flags, children) \
+	{ name, SC_ASN1_STRUCT, tag, flags, children, 0, SC_ASN1_NO_OUTPUT, SC_ASN1_NO_OUTPUT, 0, 0, 0, 0 }
+#define SC_ASN1_COMPILED_CHOICE(name, flags, children) \
+	{ name, SC_ASN1_CHOICE, 0, flags, children, 0, SC_ASN1_NO_OUTPUT, SC_ASN1_NO_OUTPUT, 0, 0, 0, 0 }
+#define SC_ASN1_COMPILED_VALUE(name, type, tag, flags, base, offset) \
+	{ name, type, tag, flags, NULL, base, offset, SC_ASN1_NO_OUTPUT, 0, 0, 0, 0 }
+#define SC_ASN1_COMPILED_BUFFER(name, type, tag, flags, base, offset, len_offset, size) \
+	{ name, type, tag, flags, NULL, base, offset, len_offset, size, 0, 0, 0 }
+#define SC_ASN1_COMPILED_END \
+	{ NULL, 0, 0, 0, NULL, 0, 0, 0, 0, 0, 0, 0 }
+
+/* Output base of the sc_pkcs15_object in sc_asn1_compiled_com_obj_attr */
+#define SC_ASN1_BASE_P15_OBJECT	0
+
+/* CommonObjectAttributes of a PKCS#15 object */
+extern const struct sc_asn1_compiled sc_asn1_compiled_com_obj_attr[];
+
 
 /* Utility functions */
 void sc_format_asn1_entry(struct sc_asn1_entry *entry, void *parm, void *arg,
@@ -64,6 +114,12 @@ int sc_asn1_decode(struct sc_context *ctx, struct sc_asn1_entry *asn1,
 		   const u8 *in, size_t len, const u8 **newp, size_t *left);
 int sc_asn1_decode_choice(struct sc_context *ctx, struct sc_asn1_entry *asn1,
 		   const u8 *in, size_t len, const u8 **newp, size_t *left);
+int sc_asn1_decode_compiled(struct sc_context *ctx, const struct sc_asn1_compiled *asn1,
+		   void * const *bases, unsigned int flags, unsigned int *present,
+		   const u8 *in, size_t len, const u8 **newp, size_t *left);
+int sc_asn1_decode_compiled_choice(struct sc_context *ctx, const struct sc_asn1_compiled *asn1,
+		   void * const *bases, unsigned int flags, unsigned int *present,
+		   const u8 *in, size_t len, const u8 **newp, size_t *left);
 int sc_asn1_encode(struct sc_context *ctx, const struct sc_asn1_entry *asn1,
 		   u8 **buf, size_t *bufsize);
 int _sc_asn1_decode(struct sc_context *, struct sc_asn1_entry *,
@@ -142,6 +198,9 @@ int sc_asn1_sig_value_sequence_to_rs(struct sc_context *ctx,
 #define SC_ASN1_ALLOC			0x00000004
 #define SC_ASN1_UNSIGNED		0x00000008
 #define SC_ASN1_EMPTY_ALLOWED           0x00000010
+/* With SC_ASN1_ALLOC, point into the input instead of copying the value.
+ * The caller has to keep the input alive as long as the value is used */
+#define SC_ASN1_BORROW			0x00000020
 
 #define SC_ASN1_BOOLEAN                 1
 #define SC_ASN1_INTEGER                 2
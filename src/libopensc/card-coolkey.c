@@ -2015,7 +2015,7 @@ coolkey_process_combined_object(sc_card_t *card, coolkey_private_data_t *priv, u
 
 	if (compressed_type == COOLKEY_COMPRESSION_ZLIB) {
 #ifdef ENABLE_ZLIB
-		r = sc_decompress_alloc(&decompressed_object, &decompressed_object_len, &object[compressed_offset], compressed_length, COMPRESSION_AUTO);
+		r = sc_decompress_alloc_cached(card->ctx, &decompressed_object, &decompressed_object_len, &object[compressed_offset], compressed_length, COMPRESSION_AUTO, 0);
 		if (r)
 			goto done;
 		free_decompressed = 1;
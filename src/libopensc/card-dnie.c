@@ -823,6 +823,36 @@ err:
 	LOG_FUNC_RETURN(ctx, rv);
 }
 
+/**
+ * Check whether the secure channel survived a card reset.
+ *
+ * Sends the serial number command through the channel: the card only
+ * answers with a valid MAC if it still holds the session keys. Otherwise
+ * cwa_decode_response() disables SM, as for any other failed command.
+ *
+ * @param card Pointer to card structure
+ * @return SC_SUCCESS if the channel can be used; else error code
+ */
+static int dnie_sm_resume(struct sc_card *card)
+{
+	int result;
+	sc_apdu_t apdu;
+	u8 rbuf[MAX_RESP_BUFFER_SIZE];
+
+	LOG_FUNC_CALLED(card->ctx);
+	if (card->sm_ctx.sm_mode != SM_MODE_TRANSMIT)
+		LOG_FUNC_RETURN(card->ctx, SC_ERROR_SM_NOT_INITIALIZED);
+
+	dnie_format_apdu(card, &apdu, SC_APDU_CASE_2_SHORT, 0xb8, 0x00, 0x00, 0x07, 0,
+					rbuf, sizeof(rbuf), NULL, 0);
+	apdu.cla = 0x90;	/* proprietary cmd */
+	result = sc_transmit_apdu(card, &apdu);
+	LOG_TEST_RET(card->ctx, result, "APDU transmit failed");
+	if (apdu.sw1 != 0x90 || apdu.sw2 != 0x00)
+		LOG_FUNC_RETURN(card->ctx, SC_ERROR_SM_NOT_INITIALIZED);
+	LOG_FUNC_RETURN(card->ctx, SC_SUCCESS);
+}
+
 /**
  * OpenDNIe card structures initialization.
  *
@@ -854,6 +884,7 @@ static int dnie_init(struct sc_card *card)
 	memset(&(card->sm_ctx), 0, sizeof(sm_context_t));
 	card->sm_ctx.ops.get_sm_apdu = dnie_sm_get_wrapped_apdu;
 	card->sm_ctx.ops.free_sm_apdu = dnie_sm_free_wrapped_apdu;
+	card->sm_ctx.ops.resume = dnie_sm_resume;
 	card->sm_ctx.sm_mode = SM_MODE_NONE;
 
 	res=cwa_create_secure_channel(card,provider,CWA_SM_OFF);
@@ -98,6 +98,7 @@ typedef struct epass2003_exdata_st {
 	unsigned char sk_enc[16];	/* encrypt session key */
 	unsigned char sk_mac[16];	/* mac session key */
 	unsigned char icv_mac[16];	/* instruction counter vector(for sm) */
+	struct sm_crypt_ctx *sm_crypt;	/* ciphers keyed with the session keys */
 	unsigned char currAlg;		/* current Alg */
 	unsigned int  ecAlgFlags; 	/* Ec Alg mechanism type*/
 } epass2003_exdata;
@@ -240,36 +241,6 @@ out:
 	return r;
 }
 
-static int
-openssl_dec(const EVP_CIPHER * cipher, const unsigned char *key, const unsigned char *iv,
-		const unsigned char *input, size_t length, unsigned char *output)
-{
-	int r = SC_ERROR_INTERNAL;
-	EVP_CIPHER_CTX * ctx = NULL;
-	int outl = 0;
-	int outl_tmp = 0;
-	unsigned char iv_tmp[EVP_MAX_IV_LENGTH] = { 0 };
-
-	memcpy(iv_tmp, iv, EVP_MAX_IV_LENGTH);
-	ctx = EVP_CIPHER_CTX_new();
-	if (ctx == NULL)
-		goto out;
-	EVP_DecryptInit_ex(ctx, cipher, NULL, key, iv_tmp);
-	EVP_CIPHER_CTX_set_padding(ctx, 0);
-
-	if (!EVP_DecryptUpdate(ctx, output, &outl, input, length))
-		goto out;
-
-	if (!EVP_DecryptFinal_ex(ctx, output + outl, &outl_tmp))
-		goto out;
-
-	r = SC_SUCCESS;
-out:
-	if (ctx)
-		EVP_CIPHER_CTX_free(ctx);
-	return r;
-}
-
 
 static int
 aes128_encrypt_ecb(const unsigned char *key, int keysize,
@@ -288,14 +259,6 @@ aes128_encrypt_cbc(const unsigned char *key, int keysize, unsigned char iv[16],
 }
 
 
-static int
-aes128_decrypt_cbc(const unsigned char *key, int keysize, unsigned char iv[16],
-		const unsigned char *input, size_t length, unsigned char *output)
-{
-	return openssl_dec(EVP_aes_128_cbc(), key, iv, input, length, output);
-}
-
-
 static int
 des3_encrypt_ecb(const unsigned char *key, int keysize,
 		const unsigned char *input, int length, unsigned char *output)
@@ -333,39 +296,6 @@ des3_encrypt_cbc(const unsigned char *key, int keysize, unsigned char iv[EVP_MAX
 }
 
 
-static int
-des3_decrypt_cbc(const unsigned char *key, int keysize, unsigned char iv[EVP_MAX_IV_LENGTH],
-		const unsigned char *input, size_t length, unsigned char *output)
-{
-	unsigned char bKey[24] = { 0 };
-	if (keysize == 16) {
-		memcpy(&bKey[0], key, 16);
-		memcpy(&bKey[16], key, 8);
-	}
-	else {
-		memcpy(&bKey[0], key, 24);
-	}
-
-	return openssl_dec(EVP_des_ede3_cbc(), bKey, iv, input, length, output);
-}
-
-
-static int
-des_encrypt_cbc(const unsigned char *key, int keysize, unsigned char iv[EVP_MAX_IV_LENGTH],
-		const unsigned char *input, size_t length, unsigned char *output)
-{
-	return openssl_enc(EVP_des_cbc(), key, iv, input, length, output);
-}
-
-
-static int
-des_decrypt_cbc(const unsigned char *key, int keysize, unsigned char iv[EVP_MAX_IV_LENGTH],
-		const unsigned char *input, size_t length, unsigned char *output)
-{
-	return openssl_dec(EVP_des_cbc(), key, iv, input, length, output);
-}
-
-
 static int
 openssl_dig(const EVP_MD * digest, const unsigned char *input, size_t length,
 		unsigned char *output)
@@ -581,6 +511,16 @@ mutual_auth(struct sc_card *card, unsigned char *key_enc,
 	r = verify_init_key(card, ran_key, exdata->smtype);
 	LOG_TEST_RET(ctx, r, "verify_init_key failed");
 
+	sc_sm_crypt_free(exdata->sm_crypt);
+	if (KEY_TYPE_AES == exdata->smtype)
+		exdata->sm_crypt = sc_sm_crypt_create(SM_CRYPT_AES128_CBC, exdata->sk_enc,
+				SM_MAC_AES128_CBC, exdata->sk_mac);
+	else
+		exdata->sm_crypt = sc_sm_crypt_create(SM_CRYPT_DES3_CBC, exdata->sk_enc,
+				SM_MAC_DES_RETAIL, exdata->sk_mac);
+	if (!exdata->sm_crypt)
+		LOG_TEST_RET(ctx, SC_ERROR_INTERNAL, "cannot create SM session ciphers");
+
 	LOG_FUNC_RETURN(ctx, r);
 }
 
@@ -607,6 +547,42 @@ epass2003_refresh(struct sc_card *card)
 }
 
 
+/* Check with a protected GET DATA whether the card still has the session
+ * keys after the reader reported a reset. Unlike sc_transmit_apdu_t(), the
+ * session is not refreshed here if the card rejects the command. */
+static int
+epass2003_sm_resume(struct sc_card *card)
+{
+	int r;
+	struct sc_apdu apdu;
+	unsigned char resp[SC_MAX_APDU_BUFFER_SIZE] = { 0 };
+	epass2003_exdata *exdata = NULL;
+
+	if (!card->drv_data)
+		return SC_ERROR_INVALID_ARGUMENTS;
+
+	exdata = (epass2003_exdata *)card->drv_data;
+
+	LOG_FUNC_CALLED(card->ctx);
+
+	if (!exdata->sm)
+		LOG_FUNC_RETURN(card->ctx, SC_SUCCESS);
+	if (!exdata->sm_crypt)
+		LOG_FUNC_RETURN(card->ctx, SC_ERROR_SM_NOT_INITIALIZED);
+
+	sc_format_apdu(card, &apdu, SC_APDU_CASE_2_SHORT, 0xca, 0x01, 0x80);
+	apdu.resp = resp;
+	apdu.le = 0;
+	apdu.resplen = sizeof(resp);
+	r = sc_transmit_apdu(card, &apdu);
+	LOG_TEST_RET(card->ctx, r, "APDU get_data failed");
+	r = sc_check_sw(card, apdu.sw1, apdu.sw2);
+	LOG_TEST_RET(card->ctx, r, "SM session lost");
+
+	LOG_FUNC_RETURN(card->ctx, SC_SUCCESS);
+}
+
+
 /* Data(TLV)=0x87|L|0x01+Cipher */
 static int
 construct_data_tlv(struct sc_card *card, struct sc_apdu *apdu, unsigned char *apdu_buf,
@@ -616,7 +592,6 @@ construct_data_tlv(struct sc_card *card, struct sc_apdu *apdu, unsigned char *ap
 	unsigned char pad[4096] = { 0 };
 	size_t pad_len;
 	size_t tlv_more;	/* increased tlv length */
-	unsigned char iv[16] = { 0 };
 	epass2003_exdata *exdata = NULL;
 
 	if (!card->drv_data) 
@@ -650,10 +625,9 @@ construct_data_tlv(struct sc_card *card, struct sc_apdu *apdu, unsigned char *ap
 	memcpy(data_tlv, &apdu_buf[block_size], tlv_more);
 
 	/* encrypt Data */
-	if (KEY_TYPE_AES == key_type)
-		aes128_encrypt_cbc(exdata->sk_enc, 16, iv, pad, pad_len, apdu_buf + block_size + tlv_more);
-	else
-		des3_encrypt_cbc(exdata->sk_enc, 16, iv, pad, pad_len, apdu_buf + block_size + tlv_more);
+	if (sc_sm_crypt_encrypt(exdata->sm_crypt, NULL, pad, pad_len,
+				apdu_buf + block_size + tlv_more) != SC_SUCCESS)
+		return -1;
 
 	memcpy(data_tlv + tlv_more, apdu_buf + block_size + tlv_more, pad_len);
 	*data_tlv_len = tlv_more + pad_len;
@@ -693,9 +667,8 @@ construct_mac_tlv(struct sc_card *card, unsigned char *apdu_buf, size_t data_tlv
 		unsigned char *mac_tlv, size_t * mac_tlv_len, const unsigned char key_type)
 {
 	size_t block_size = (KEY_TYPE_AES == key_type ? 16 : 8);
-	unsigned char mac[4096] = { 0 };
+	unsigned char mac[16] = { 0 };
 	size_t mac_len;
-	unsigned char icv[16] = { 0 };
 	int i = (KEY_TYPE_AES == key_type ? 15 : 7);
 	epass2003_exdata *exdata = NULL;
 
@@ -732,21 +705,10 @@ construct_mac_tlv(struct sc_card *card, unsigned char *apdu_buf, size_t data_tlv
 		}
 	}
 
-	/* calculate MAC */
-	memset(icv, 0, sizeof(icv));
-	memcpy(icv, exdata->icv_mac, 16);
-	if (KEY_TYPE_AES == key_type) {
-		aes128_encrypt_cbc(exdata->sk_mac, 16, icv, apdu_buf, mac_len, mac);
-		memcpy(mac_tlv + 2, &mac[mac_len - 16], 8);
-	}
-	else {
-		unsigned char iv[EVP_MAX_IV_LENGTH] = { 0 };
-		unsigned char tmp[8] = { 0 };
-		des_encrypt_cbc(exdata->sk_mac, 8, icv, apdu_buf, mac_len, mac);
-		des_decrypt_cbc(&exdata->sk_mac[8], 8, iv, &mac[mac_len - 8], 8, tmp);
-		memset(iv, 0x00, sizeof iv);
-		des_encrypt_cbc(exdata->sk_mac, 8, iv, tmp, 8, mac_tlv + 2);
-	}
+	/* calculate MAC: CBC-MAC with AES, retail MAC with DES */
+	if (sc_sm_crypt_mac(exdata->sm_crypt, exdata->icv_mac, apdu_buf, mac_len, mac) < 0)
+		return -1;
+	memcpy(mac_tlv + 2, mac, 8);
 
 	*mac_tlv_len = 2 + 8;
 	return 0;
@@ -907,7 +869,6 @@ decrypt_response(struct sc_card *card, unsigned char *in, size_t inlen, unsigned
 {
 	size_t cipher_len;
 	size_t i;
-	unsigned char iv[16] = { 0 };
 	unsigned char plaintext[4096] = { 0 };
 	epass2003_exdata *exdata = NULL;
 
@@ -942,10 +903,8 @@ decrypt_response(struct sc_card *card, unsigned char *in, size_t inlen, unsigned
 		return -1;
 
 	/* decrypt */
-	if (KEY_TYPE_AES == exdata->smtype)
-		aes128_decrypt_cbc(exdata->sk_enc, 16, iv, &in[i], cipher_len - 1, plaintext);
-	else
-		des3_decrypt_cbc(exdata->sk_enc, 16, iv, &in[i], cipher_len - 1, plaintext);
+	if (sc_sm_crypt_decrypt(exdata->sm_crypt, NULL, &in[i], cipher_len - 1, plaintext) != SC_SUCCESS)
+		return -1;
 
 	/* unpadding */
 	while (0x80 != plaintext[cipher_len - 2] && (cipher_len - 2 > 0))
@@ -1195,6 +1154,7 @@ epass2003_init(struct sc_card *card)
 	card->max_send_size = 0xE8;
 
 	card->sm_ctx.ops.open = epass2003_refresh;
+	card->sm_ctx.ops.resume = epass2003_sm_resume;
 	card->sm_ctx.ops.get_sm_apdu = epass2003_sm_get_wrapped_apdu;
 	card->sm_ctx.ops.free_sm_apdu = epass2003_sm_free_wrapped_apdu;
 
@@ -1225,8 +1185,10 @@ epass2003_finish(sc_card_t *card)
 {
 	epass2003_exdata *exdata = (epass2003_exdata *)card->drv_data;
 
-	if (exdata)
+	if (exdata) {
+		sc_sm_crypt_free(exdata->sm_crypt);
 		free(exdata);
+	}
 	return SC_SUCCESS;
 }
 
@@ -549,8 +549,8 @@ static int idprime_read_binary(sc_card_t *card, unsigned int offset,
 		if (buffer[0] == 1 && buffer[1] == 0) {
 #ifdef ENABLE_ZLIB
 			size_t expectedsize = buffer[2] + buffer[3] * 0x100;
-			r = sc_decompress_alloc(&priv->cache_buf, &(priv->cache_buf_len),
-				buffer+4, priv->file_size-4, COMPRESSION_AUTO);
+			r = sc_decompress_alloc_cached(card->ctx, &priv->cache_buf, &(priv->cache_buf_len),
+				buffer+4, priv->file_size-4, COMPRESSION_AUTO, expectedsize);
 			if (r != SC_SUCCESS) {
 				sc_log(card->ctx, "Zlib error: %d", r);
 				LOG_FUNC_RETURN(card->ctx, r);
@@ -1076,7 +1076,7 @@ piv_cache_internal_data(sc_card_t *card, int enumtag)
 			size_t len;
 			u8* newBuf = NULL;
 
-			if(SC_SUCCESS != sc_decompress_alloc(&newBuf, &len, tag, taglen, COMPRESSION_AUTO))
+			if(SC_SUCCESS != sc_decompress_alloc_cached(card->ctx, &newBuf, &len, tag, taglen, COMPRESSION_AUTO, 0))
 				LOG_FUNC_RETURN(card->ctx, SC_ERROR_OBJECT_NOT_VALID);
 
 			priv->obj_cache[enumtag].internal_obj_data = newBuf;
@@ -207,7 +207,7 @@ size_t sc_get_max_recv_size(const sc_card_t *card)
 
 	/*  Override card limitations with reader limitations. */
 	if (card->reader->max_recv_size != 0
-			&& (card->reader->max_recv_size < card->max_recv_size))
+			&& (card->reader->max_recv_size < max_recv_size))
 		max_recv_size = card->reader->max_recv_size;
 
 	return max_recv_size;
@@ -235,7 +235,7 @@ size_t sc_get_max_send_size(const sc_card_t *card)
 
 	/*  Override card limitations with reader limitations. */
 	if (card->reader->max_send_size != 0
-			&& (card->reader->max_send_size < card->max_send_size))
+			&& (card->reader->max_send_size < max_send_size))
 		max_send_size = card->reader->max_send_size;
 
 	return max_send_size;
@@ -375,6 +375,18 @@ int sc_connect_card(sc_reader_t *reader, sc_card_t **card_out)
 	if (card->name == NULL)
 		card->name = card->driver->name;
 
+	/* Enable extended length APDUs on request, if the driver did not
+	 * configure the transfer sizes itself and both the card and the reader
+	 * (PC/SC v2 part 10 dwMaxAPDUDataSize) announce support for them */
+	if ((ctx->flags & SC_CTX_FLAG_DETECT_EXTENDED_APDU)
+			&& !(card->caps & SC_CARD_CAP_APDU_EXT)
+			&& card->max_recv_size == 0 && card->max_send_size == 0
+			&& reader->max_recv_size > 256 && reader->max_send_size > 255
+			&& _sc_hist_bytes_apdu_ext(reader)) {
+		sc_log(ctx, "card and reader support extended length APDUs");
+		card->caps |= SC_CARD_CAP_APDU_EXT;
+	}
+
 	/* initialize max_send_size/max_recv_size to a meaningful value */
 	card->max_recv_size = sc_get_max_recv_size(card);
 	card->max_send_size = sc_get_max_send_size(card);
@@ -451,6 +463,7 @@ int sc_reset(sc_card_t *card, int do_cold_reset)
 
 	r = card->reader->ops->reset(card->reader, do_cold_reset);
 	sc_invalidate_cache(card);
+	card->reset_count++;
 
 	r2 = sc_mutex_unlock(card->ctx, card->mutex);
 	if (r2 != SC_SUCCESS) {
@@ -466,12 +479,14 @@ int sc_lock(sc_card_t *card)
 	int r = 0, r2 = 0;
 	int was_reset = 0;
 	int reader_lock_obtained  = 0;
+	unsigned long long start;
 
 	if (card == NULL)
 		return SC_ERROR_INVALID_ARGUMENTS;
 
 	LOG_FUNC_CALLED(card->ctx);
 
+	start = sc_stats_timestamp();
 	r = sc_mutex_lock(card->ctx, card->mutex);
 	if (r != SC_SUCCESS)
 		return r;
@@ -484,19 +499,34 @@ int sc_lock(sc_card_t *card)
 					break;
 				r = card->reader->ops->lock(card->reader);
 			}
+			if (was_reset > 0)
+				card->reset_count++;
 			if (r == 0)
 				reader_lock_obtained = 1;
 		}
-		if (r == 0)
+		if (r == 0) {
+			card->transaction_count++;
 			card->cache.valid = 1;
+			card->lock_acquired = sc_stats_timestamp();
+			SC_STATS_ADD(card->ctx, lock_count, 1);
+			SC_STATS_ADD(card->ctx, lock_wait_us, card->lock_acquired - start);
+		}
 	}
 	if (r == 0)
 		card->lock_count++;
 
 	if (r == 0 && was_reset > 0) {
 #ifdef ENABLE_SM
-		if (card->sm_ctx.ops.open)
+		/* the reset may have been reported without the card losing
+		 * the SM session, e.g. when the reader was re-attached */
+		if (card->sm_ctx.ops.resume && card->sm_ctx.ops.resume(card) == SC_SUCCESS) {
+			sc_log(card->ctx, "SM session resumed after card reset");
+			SC_STATS_ADD(card->ctx, sm_resumed, 1);
+		}
+		else if (card->sm_ctx.ops.open) {
 			card->sm_ctx.ops.open(card);
+			SC_STATS_ADD(card->ctx, sm_reopened, 1);
+		}
 #endif
 	}
 
@@ -539,6 +569,7 @@ int sc_unlock(sc_card_t *card)
 		/* release reader lock */
 		if (card->reader->ops->unlock != NULL)
 			r = card->reader->ops->unlock(card->reader);
+		SC_STATS_ADD(card->ctx, lock_hold_us, sc_stats_timestamp() - card->lock_acquired);
 	}
 	r2 = sc_mutex_unlock(card->ctx, card->mutex);
 	if (r2 != SC_SUCCESS) {
@@ -549,6 +580,33 @@ int sc_unlock(sc_card_t *card)
 	return r;
 }
 
+int sc_card_reinit_after_fork(sc_card_t *card)
+{
+	int r;
+
+	if (card == NULL)
+		return SC_ERROR_INVALID_ARGUMENTS;
+	LOG_FUNC_CALLED(card->ctx);
+
+#ifdef ENABLE_SM
+	/* the session keys and the send sequence counter are shared with the
+	 * parent, so the secure channel can not be continued from here */
+	if (card->sm_ctx.sm_mode == SM_MODE_TRANSMIT)
+		LOG_TEST_RET(card->ctx, SC_ERROR_NOT_SUPPORTED,
+				"Secure messaging session can not be reused after fork");
+#endif
+
+	/* like the mutex of the context, see sc_ctx_reinit_after_fork() */
+	r = sc_mutex_create(card->ctx, &card->mutex);
+	LOG_TEST_RET(card->ctx, r, "Failed to create mutex");
+
+	/* the transaction, if any, belongs to the handle of the parent */
+	card->lock_count = 0;
+	sc_invalidate_cache(card);
+
+	LOG_FUNC_RETURN(card->ctx, SC_SUCCESS);
+}
+
 int sc_list_files(sc_card_t *card, u8 *buf, size_t buflen)
 {
 	int r;
@@ -620,6 +678,7 @@ int sc_read_binary(sc_card_t *card, unsigned int idx,
 		   unsigned char *buf, size_t count, unsigned long flags)
 {
 	size_t max_le = sc_get_max_recv_size(card);
+	unsigned long long start;
 	int r;
 
 	if (card == NULL || card->ops == NULL || buf == NULL) {
@@ -644,11 +703,16 @@ int sc_read_binary(sc_card_t *card, unsigned int idx,
 		int bytes_read = 0;
 		unsigned char *p = buf;
 
+		/* Read in chunks of the largest Le supported by card and reader,
+		 * calling the driver directly for every chunk */
 		r = sc_lock(card);
 		LOG_TEST_RET(card->ctx, r, "sc_lock() failed");
 		while (count > 0) {
 			size_t n = count > max_le ? max_le : count;
-			r = sc_read_binary(card, idx, p, n, flags);
+			unsigned long long t_start = sc_stats_timestamp();
+
+			r = card->ops->read_binary(card, idx, p, n, flags);
+			sc_stats_record_op(card->ctx, SC_STATS_OP_READ_BINARY, t_start);
 			if (r < 0) {
 				sc_unlock(card);
 				LOG_TEST_RET(card->ctx, r, "sc_read_binary() failed");
@@ -670,7 +734,9 @@ int sc_read_binary(sc_card_t *card, unsigned int idx,
 		sc_unlock(card);
 		LOG_FUNC_RETURN(card->ctx, bytes_read);
 	}
+	start = sc_stats_timestamp();
 	r = card->ops->read_binary(card, idx, buf, count, flags);
+	sc_stats_record_op(card->ctx, SC_STATS_OP_READ_BINARY, start);
 	LOG_FUNC_RETURN(card->ctx, r);
 }
 
@@ -724,6 +790,7 @@ int sc_update_binary(sc_card_t *card, unsigned int idx,
 		     const u8 *buf, size_t count, unsigned long flags)
 {
 	size_t max_lc = sc_get_max_send_size(card);
+	unsigned long long start;
 	int r;
 
 	if (card == NULL || card->ops == NULL || buf == NULL) {
@@ -771,7 +838,9 @@ int sc_update_binary(sc_card_t *card, unsigned int idx,
 		LOG_FUNC_RETURN(card->ctx, bytes_written);
 	}
 
+	start = sc_stats_timestamp();
 	r = card->ops->update_binary(card, idx, buf, count, flags);
+	sc_stats_record_op(card->ctx, SC_STATS_OP_UPDATE_BINARY, start);
 	LOG_FUNC_RETURN(card->ctx, r);
 }
 
@@ -797,6 +866,7 @@ int sc_erase_binary(struct sc_card *card, unsigned int offs, size_t count,  unsi
 
 int sc_select_file(sc_card_t *card, const sc_path_t *in_path,  sc_file_t **file)
 {
+	unsigned long long start;
 	int r;
 	char pbuf[SC_MAX_PATH_STRING_SIZE];
 
@@ -835,7 +905,10 @@ int sc_select_file(sc_card_t *card, const sc_path_t *in_path,  sc_file_t **file)
 	}
 	if (card->ops->select_file == NULL)
 		LOG_FUNC_RETURN(card->ctx, SC_ERROR_NOT_SUPPORTED);
+	SC_STATS_ADD(card->ctx, select_calls, 1);
+	start = sc_stats_timestamp();
 	r = card->ops->select_file(card, in_path, file);
+	sc_stats_record_op(card->ctx, SC_STATS_OP_SELECT_FILE, start);
 	LOG_TEST_RET(card->ctx, r, "'SELECT' error");
 
 	if (file) {
@@ -900,7 +973,10 @@ int sc_get_challenge(sc_card_t *card, u8 *rnd, size_t len)
 		LOG_FUNC_RETURN(card->ctx, r);
 
 	while (len > 0 && retry > 0) {
+		unsigned long long start = sc_stats_timestamp();
+
 		r = card->ops->get_challenge(card, rnd, len);
+		sc_stats_record_op(card->ctx, SC_STATS_OP_GET_CHALLENGE, start);
 		if (r < 0) {
 			sc_unlock(card);
 			LOG_FUNC_RETURN(card->ctx, r);
@@ -922,6 +998,7 @@ int sc_get_challenge(sc_card_t *card, u8 *rnd, size_t len)
 int sc_read_record(sc_card_t *card, unsigned int rec_nr, u8 *buf,
 		   size_t count, unsigned long flags)
 {
+	unsigned long long start;
 	int r;
 
 	if (card == NULL) {
@@ -931,7 +1008,9 @@ int sc_read_record(sc_card_t *card, unsigned int rec_nr, u8 *buf,
 
 	if (card->ops->read_record == NULL)
 		LOG_FUNC_RETURN(card->ctx, SC_ERROR_NOT_SUPPORTED);
+	start = sc_stats_timestamp();
 	r = card->ops->read_record(card, rec_nr, buf, count, flags);
+	sc_stats_record_op(card->ctx, SC_STATS_OP_READ_RECORD, start);
 
 	LOG_FUNC_RETURN(card->ctx, r);
 }
@@ -1397,6 +1476,15 @@ sc_card_sm_unload(struct sc_card *card)
 	if (card->sm_ctx.module.handle)
 		sc_dlclose(card->sm_ctx.module.handle);
 	card->sm_ctx.module.handle = NULL;
+
+	if (card->sm_ctx.info.sm_type == SM_TYPE_GP_SCP01) {
+		sc_sm_crypt_free(card->sm_ctx.info.session.gp.crypt);
+		card->sm_ctx.info.session.gp.crypt = NULL;
+	}
+	else if (card->sm_ctx.info.sm_type == SM_TYPE_CWA14890) {
+		sc_sm_crypt_free(card->sm_ctx.info.session.cwa.crypt);
+		card->sm_ctx.info.session.cwa.crypt = NULL;
+	}
 	return 0;
 }
 
@@ -179,7 +179,26 @@ int sc_decompress(u8* out, size_t* outLen, const u8* in, size_t inLen, int metho
 	}
 }
 
-static int sc_decompress_zlib_alloc(u8** out, size_t* outLen, const u8* in, size_t inLen, int gzip) {
+/*
+ * The deflate format cannot expand data more than about 1032 times, so a
+ * size hint above that is certainly wrong. Bound it further so a forged
+ * hint cannot make us allocate much more than certificates need.
+ */
+#define DECOMPRESS_MAX_RATIO	1032
+#define DECOMPRESS_MAX_HINT	(1024 * 1024)
+
+/* Returns the uncompressed length stored in the gzip ISIZE trailer or 0 */
+static size_t gzip_isize(const u8* in, size_t inLen) {
+	const u8 *p;
+
+	/* 10 bytes header, an empty deflate block and the 8 bytes trailer */
+	if (inLen < 20 || in[0] != 0x1f || in[1] != 0x8b)
+		return 0;
+	p = in + inLen - 4;
+	return (size_t)p[0] | (size_t)p[1] << 8 | (size_t)p[2] << 16 | (size_t)p[3] << 24;
+}
+
+static int sc_decompress_zlib_alloc(u8** out, size_t* outLen, const u8* in, size_t inLen, int gzip, size_t sizeHint) {
 	/* Since uncompress does not offer a way to make it uncompress gzip... manually set it up */
 	z_stream gz;
 	int err;
@@ -193,7 +212,15 @@ static int sc_decompress_zlib_alloc(u8** out, size_t* outLen, const u8* in, size
 
 	if (!out || !outLen)
 		return SC_ERROR_INVALID_ARGUMENTS;
-	
+
+	/* With a plausible hint the data is inflated in one pass into a buffer
+	 * of the right size. A wrong hint only costs some reallocations. */
+	if (sizeHint == 0 && gzip)
+		sizeHint = gzip_isize(in, inLen);
+	if (sizeHint > 0 && sizeHint <= DECOMPRESS_MAX_HINT
+			&& sizeHint / DECOMPRESS_MAX_RATIO <= inLen)
+		bufferSize = sizeHint;
+
 	gz.next_in = (u8*)in;
 	gz.avail_in = inLen;
 
@@ -205,48 +232,51 @@ static int sc_decompress_zlib_alloc(u8** out, size_t* outLen, const u8* in, size
 
 	while (1) {
 		/* Setup buffer... */
-		size_t num;
 		u8* buf = realloc(*out, bufferSize);
 		if (!buf) {
 			free(*out);
 			*out = NULL;
-			return SC_ERROR_OUT_OF_MEMORY;
+			err = Z_MEM_ERROR;
+			break;
 		}
 		*out = buf;
 		gz.next_out = buf + *outLen;
 		gz.avail_out = bufferSize - *outLen;
 
 		err = inflate(&gz, Z_FULL_FLUSH);
+		*outLen = bufferSize - gz.avail_out;
+		if (err == Z_OK && gz.avail_in == 0) {
+			/* all input consumed, but the stream is not complete */
+			err = Z_BUF_ERROR;
+		}
 		if (err != Z_STREAM_END && err != Z_OK) {
 			free(*out);
 			*out = NULL;
+			*outLen = 0;
 			break;
 		}
-		num = *outLen + gz.avail_out;
-		if (bufferSize > num) {
-			*outLen += bufferSize - num;
-			bufferSize += bufferSize - num + blockSize;
-		}
 		if (err == Z_STREAM_END) {
-			if (*outLen > 0) {
+			if (*outLen == 0) {
+				free(*out);
+				*out = NULL;
+				err = Z_DATA_ERROR;
+			} else if (*outLen < bufferSize) {
 				/* Shrink it down, if it fails, just use old data */
 				buf = realloc(buf, *outLen);
 				if (buf) {
 					*out = buf;
 				}
-			} else {
-				free(*out);
-				*out = NULL;
-				err = Z_DATA_ERROR;
 			}
 			break;
 		}
+		/* output buffer is full */
+		bufferSize += blockSize;
 	}
 	inflateEnd(&gz);
 	return zerr_to_opensc(err);
 }
 
-int sc_decompress_alloc(u8** out, size_t* outLen, const u8* in, size_t inLen, int method)
+static int sc_decompress_alloc_hint(u8** out, size_t* outLen, const u8* in, size_t inLen, int method, size_t sizeHint)
 {
 	if (in == NULL || out == NULL) {
 		return SC_ERROR_UNKNOWN_DATA_RECEIVED;
@@ -261,11 +291,122 @@ int sc_decompress_alloc(u8** out, size_t* outLen, const u8* in, size_t inLen, in
 
 	switch (method) {
 	case COMPRESSION_ZLIB:
-		return sc_decompress_zlib_alloc(out, outLen, in, inLen, 0);
+		return sc_decompress_zlib_alloc(out, outLen, in, inLen, 0, sizeHint);
 	case COMPRESSION_GZIP:
-		return sc_decompress_zlib_alloc(out, outLen, in, inLen, 1);
+		return sc_decompress_zlib_alloc(out, outLen, in, inLen, 1, sizeHint);
 	default:
 		return SC_ERROR_INVALID_ARGUMENTS;
 	}
 }
+
+int sc_decompress_alloc(u8** out, size_t* outLen, const u8* in, size_t inLen, int method)
+{
+	return sc_decompress_alloc_hint(out, outLen, in, inLen, method, 0);
+}
+
+/*
+ * Decompressed data cache.
+ *
+ * Cards store the same compressed certificates across re-binds, so the
+ * result is kept per context and looked up by the compressed bytes.
+ */
+#define SC_DECOMPRESS_CACHE_MAX	32
+
+struct sc_decompress_cache_value {
+	u8 *out;
+	size_t outLen;
+};
+
+static void decompress_cache_value_free(void *value)
+{
+	struct sc_decompress_cache_value *v = value;
+
+	if (v) {
+		free(v->out);
+		free(v);
+	}
+}
+
+static int decompress_cache_get(sc_context_t *ctx,
+		u8 **out, size_t *outLen, const u8 *in, size_t inLen)
+{
+	struct sc_decompress_cache_value *v;
+	int r = SC_ERROR_OBJECT_NOT_FOUND;
+
+	sc_mutex_lock(ctx, ctx->mutex);
+	v = lru_cache_get(ctx->decompress_cache, in, inLen);
+	if (v) {
+		free(*out);
+		*out = malloc(v->outLen);
+		if (*out == NULL) {
+			r = SC_ERROR_OUT_OF_MEMORY;
+		} else {
+			memcpy(*out, v->out, v->outLen);
+			*outLen = v->outLen;
+			r = SC_SUCCESS;
+		}
+	}
+	sc_mutex_unlock(ctx, ctx->mutex);
+
+	return r;
+}
+
+static void decompress_cache_put(sc_context_t *ctx,
+		const u8 *out, size_t outLen, const u8 *in, size_t inLen)
+{
+	struct sc_decompress_cache_value *v;
+
+	v = calloc(1, sizeof(struct sc_decompress_cache_value));
+	if (v == NULL)
+		return;
+	v->out = malloc(outLen);
+	if (v->out == NULL) {
+		free(v);
+		return;
+	}
+	memcpy(v->out, out, outLen);
+	v->outLen = outLen;
+
+	sc_mutex_lock(ctx, ctx->mutex);
+	if (ctx->decompress_cache == NULL)
+		ctx->decompress_cache = lru_cache_new(SC_DECOMPRESS_CACHE_MAX,
+				decompress_cache_value_free);
+	if (ctx->decompress_cache == NULL)
+		decompress_cache_value_free(v);
+	else
+		lru_cache_put(ctx->decompress_cache, in, inLen, v);
+	sc_mutex_unlock(ctx, ctx->mutex);
+}
+
+int sc_decompress_alloc_cached(sc_context_t *ctx, u8** out, size_t* outLen,
+		const u8* in, size_t inLen, int method, size_t sizeHint)
+{
+	int r;
+
+	if (ctx == NULL)
+		return sc_decompress_alloc_hint(out, outLen, in, inLen, method, sizeHint);
+	if (in == NULL || out == NULL || outLen == NULL)
+		return SC_ERROR_UNKNOWN_DATA_RECEIVED;
+
+	r = decompress_cache_get(ctx, out, outLen, in, inLen);
+	if (r == SC_SUCCESS) {
+		SC_STATS_ADD(ctx, decompress_cache_hits, 1);
+		sc_log(ctx, "Decompressed data found in cache");
+		return r;
+	}
+	SC_STATS_ADD(ctx, decompress_cache_misses, 1);
+
+	r = sc_decompress_alloc_hint(out, outLen, in, inLen, method, sizeHint);
+	if (r == SC_SUCCESS)
+		decompress_cache_put(ctx, *out, *outLen, in, inLen);
+	return r;
+}
+
+void sc_decompress_free_cache(sc_context_t *ctx)
+{
+	if (ctx == NULL)
+		return;
+	lru_cache_free(ctx->decompress_cache);
+	ctx->decompress_cache = NULL;
+}
 #endif /* ENABLE_ZLIB */
@@ -33,5 +33,16 @@ int sc_compress(u8* out, size_t* outLen, const u8* in, size_t inLen, int method)
 int sc_decompress_alloc(u8** out, size_t* outLen, const u8* in, size_t inLen, int method);
 int sc_decompress(u8* out, size_t* outLen, const u8* in, size_t inLen, int method);
 
+/**
+ * Decompresses @in like sc_decompress_alloc(), keeping the result in a cache
+ * of @ctx so the same compressed data is inflated only once per context.
+ *
+ * @sizeHint is the expected uncompressed length, as reported by the card,
+ * or 0 if unknown. Gzip streams carry their own length in the trailer.
+ */
+int sc_decompress_alloc_cached(sc_context_t *ctx, u8** out, size_t* outLen,
+		const u8* in, size_t inLen, int method, size_t sizeHint);
+void sc_decompress_free_cache(sc_context_t *ctx);
+
 #endif
 
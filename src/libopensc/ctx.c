@@ -29,6 +29,14 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <limits.h>
+#include <time.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
 
 #ifdef _WIN32
 #include <windows.h>
@@ -40,6 +48,8 @@
 #include "common/libscdl.h"
 #include "common/compat_strlcpy.h"
 #include "internal.h"
+#include "pkcs15.h"
+#include "compression.h"
 #include "sc-ossl-compat.h"
 
 static int ignored_reader(sc_context_t *ctx, sc_reader_t *reader)
@@ -406,6 +416,10 @@ load_parameters(sc_context_t *ctx, scconf_block *block, struct _sc_ctx_options *
 				ctx->flags & SC_CTX_FLAG_ENABLE_DEFAULT_DRIVER))
 		ctx->flags |= SC_CTX_FLAG_ENABLE_DEFAULT_DRIVER;
 
+	if (scconf_get_bool (block, "detect_extended_apdu",
+				ctx->flags & SC_CTX_FLAG_DETECT_EXTENDED_APDU))
+		ctx->flags |= SC_CTX_FLAG_DETECT_EXTENDED_APDU;
+
 	list = scconf_find_list(block, "card_drivers");
 	set_drivers(opts, list);
 
@@ -664,9 +678,243 @@ static int load_card_atrs(sc_context_t *ctx)
 	return SC_SUCCESS;
 }
 
+static int get_default_cache_dir(char *buf, size_t bufsize);
+static int make_dir(sc_context_t *ctx, char *dirname);
+
+/*
+ * Configuration snapshots
+ *
+ * With OPENSC_CONF_SNAPSHOT set in the environment, the parsed configuration
+ * file is stored in a binary image in the default cache directory, so that
+ * following contexts map the image instead of parsing the file. The image
+ * starts with a line naming the OpenSC version and the path, modification
+ * time, size and inode of the configuration file; any change of these
+ * invalidates the image. The switch and the "file_cache_dir" option can not
+ * be a part of the configuration, which is not read when an image is used.
+ *
+ * An image is only used when it belongs to the effective user and nobody
+ * else can write it, and never by set-uid programs.
+ */
+#define CONF_SNAPSHOT_FORMAT	1
+
+static int conf_snapshot_enabled(void)
+{
+	const char *enabled = getenv("OPENSC_CONF_SNAPSHOT");
+
+	if (enabled == NULL || *enabled == '\0' || !strcmp(enabled, "0"))
+		return 0;
+#ifndef _WIN32
+	if (getuid() != geteuid())
+		return 0;
+#endif
+	return 1;
+}
+
+#ifndef _WIN32
+static int conf_snapshot_trusted(int fd)
+{
+	struct stat st;
+
+	return fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+		&& st.st_uid == geteuid()
+		&& !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+#endif
+
+static int conf_snapshot_path(const char *conf_path, char *buf, size_t bufsize)
+{
+	char dirname[PATH_MAX];
+	unsigned int hash;
+	int r;
+
+	r = get_default_cache_dir(dirname, sizeof(dirname));
+	if (r != SC_SUCCESS)
+		return r;
+	hash = lru_hash(LRU_HASH_INIT, conf_path, strlen(conf_path));
+	r = snprintf(buf, bufsize, "%s/opensc-conf-%08x.snapshot", dirname, hash);
+	if (r < 0 || (size_t) r >= bufsize)
+		return SC_ERROR_BUFFER_TOO_SMALL;
+	return SC_SUCCESS;
+}
+
+static int conf_snapshot_header(const char *conf_path, char *buf, size_t bufsize,
+		time_t *mtime)
+{
+	struct stat st;
+	int r;
+
+	if (stat(conf_path, &st) != 0)
+		return SC_ERROR_FILE_NOT_FOUND;
+	if (mtime)
+		*mtime = st.st_mtime;
+	r = snprintf(buf, bufsize, "OpenSC config snapshot %d %s %llu %llu %llu %s\n",
+			CONF_SNAPSHOT_FORMAT, sc_get_version(),
+			(unsigned long long) st.st_mtime, (unsigned long long) st.st_size,
+			(unsigned long long) st.st_ino, conf_path);
+	if (r < 0 || (size_t) r >= bufsize)
+		return SC_ERROR_BUFFER_TOO_SMALL;
+	return SC_SUCCESS;
+}
+
+/* Replaces the configuration of ctx by a valid snapshot of conf_path */
+static int load_conf_snapshot(sc_context_t *ctx, const char *conf_path)
+{
+	char path[PATH_MAX], header[PATH_MAX + 128];
+	unsigned char *data = NULL;
+	size_t len = 0, header_len;
+	int r = SC_ERROR_FILE_NOT_FOUND;
+#ifdef HAVE_SYS_MMAN_H
+	struct stat st;
+	int fd;
+#else
+	FILE *f;
+	long size;
+#endif
+
+	if (conf_snapshot_path(conf_path, path, sizeof(path)) != SC_SUCCESS
+			|| conf_snapshot_header(conf_path, header, sizeof(header), NULL) != SC_SUCCESS)
+		return r;
+	header_len = strlen(header);
+
+#ifdef HAVE_SYS_MMAN_H
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return r;
+	if (!conf_snapshot_trusted(fd)) {
+		sc_log(ctx, "Ignoring configuration snapshot '%s' of another user", path);
+		close(fd);
+		return SC_ERROR_NOT_ALLOWED;
+	}
+	if (fstat(fd, &st) == 0 && (size_t) st.st_size > header_len) {
+		len = st.st_size;
+		data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+	}
+	close(fd);
+#else
+	f = fopen(path, "rb");
+	if (f == NULL)
+		return r;
+#ifndef _WIN32
+	if (!conf_snapshot_trusted(fileno(f))) {
+		sc_log(ctx, "Ignoring configuration snapshot '%s' of another user", path);
+		fclose(f);
+		return SC_ERROR_NOT_ALLOWED;
+	}
+#endif
+	if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0
+			&& (size_t) size > header_len && fseek(f, 0, SEEK_SET) == 0) {
+		data = malloc(size);
+		if (data != NULL && fread(data, 1, size, f) == (size_t) size) {
+			len = size;
+		} else {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(f);
+#endif
+	if (data == NULL)
+		return r;
+
+	if (memcmp(data, header, header_len) == 0
+			&& scconf_snapshot_load(ctx->conf, data + header_len, len - header_len))
+		r = SC_SUCCESS;
+	else
+		r = SC_ERROR_CORRUPTED_DATA;
+
+#ifdef HAVE_SYS_MMAN_H
+	munmap(data, len);
+#else
+	free(data);
+#endif
+	return r;
+}
+
+/* Stores the configuration of ctx, parsed from conf_path, as snapshot */
+static int save_conf_snapshot(sc_context_t *ctx, const char *conf_path)
+{
+	char path[PATH_MAX], tmp_path[PATH_MAX + 16], header[PATH_MAX + 128];
+	unsigned char *data = NULL;
+	size_t len = 0;
+	time_t mtime;
+	FILE *f;
+	int r;
+#ifndef _WIN32
+	int fd;
+#endif
+
+	r = conf_snapshot_path(conf_path, path, sizeof(path));
+	if (r == SC_SUCCESS)
+		r = conf_snapshot_header(conf_path, header, sizeof(header), &mtime);
+	if (r != SC_SUCCESS)
+		return r;
+	/* The modification time has a resolution of seconds. A file changed
+	 * just now could be changed again without a new time, so it is not
+	 * stored until the next context is created. */
+	if (mtime >= time(NULL) - 1)
+		return SC_ERROR_NOT_ALLOWED;
+	if (!scconf_snapshot_save(ctx->conf, &data, &len))
+		return SC_ERROR_OUT_OF_MEMORY;
+
+	/* write to a temporary file, so that no other process maps a partial image */
+#ifdef _WIN32
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%lu", path, (unsigned long) GetCurrentProcessId());
+	f = fopen(tmp_path, "wb");
+	if (f == NULL && errno == ENOENT) {
+		char dirname[PATH_MAX];
+
+		if (get_default_cache_dir(dirname, sizeof(dirname)) == SC_SUCCESS
+				&& make_dir(ctx, dirname) == SC_SUCCESS)
+			f = fopen(tmp_path, "wb");
+	}
+#else
+	snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+	fd = mkstemp(tmp_path);
+	if (fd < 0 && errno == ENOENT) {
+		char dirname[PATH_MAX];
+
+		if (get_default_cache_dir(dirname, sizeof(dirname)) == SC_SUCCESS
+				&& make_dir(ctx, dirname) == SC_SUCCESS) {
+			snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+			fd = mkstemp(tmp_path);
+		}
+	}
+	f = NULL;
+	if (fd >= 0) {
+		f = fdopen(fd, "wb");
+		if (f == NULL) {
+			close(fd);
+			remove(tmp_path);
+		}
+	}
+#endif
+	if (f == NULL) {
+		free(data);
+		return SC_ERROR_FILE_NOT_FOUND;
+	}
+	if (fputs(header, f) == EOF || fwrite(data, 1, len, f) != len)
+		r = SC_ERROR_INTERNAL;
+	if (fclose(f) != 0)
+		r = SC_ERROR_INTERNAL;
+	free(data);
+
+#ifdef _WIN32
+	if (r == SC_SUCCESS)
+		remove(path);
+#endif
+	if (r != SC_SUCCESS || rename(tmp_path, path) != 0) {
+		remove(tmp_path);
+		return SC_ERROR_INTERNAL;
+	}
+	sc_log(ctx, "Stored configuration snapshot '%s'", path);
+	return SC_SUCCESS;
+}
+
 static void process_config_file(sc_context_t *ctx, struct _sc_ctx_options *opts)
 {
-	int i, r, count = 0;
+	int i, r, count = 0, use_snapshot, snapshot = 0, from_snapshot = 0;
 	scconf_block **blocks;
 	const char *conf_path = NULL;
 	const char *debug = NULL;
@@ -699,7 +947,15 @@ static void process_config_file(sc_context_t *ctx, struct _sc_ctx_options *opts)
 	ctx->conf = scconf_new(conf_path);
 	if (ctx->conf == NULL)
 		return;
-	r = scconf_parse(ctx->conf);
+	use_snapshot = conf_snapshot_enabled();
+	if (use_snapshot && load_conf_snapshot(ctx, conf_path) == SC_SUCCESS) {
+		from_snapshot = 1;
+		r = 1;
+	} else {
+		r = scconf_parse(ctx->conf);
+		if (r > 0 && use_snapshot)
+			snapshot = 1;
+	}
 #ifdef OPENSC_CONFIG_STRING
 	/* Parse the string if config file didn't exist */
 	if (r < 0)
@@ -717,8 +973,6 @@ static void process_config_file(sc_context_t *ctx, struct _sc_ctx_options *opts)
 		ctx->conf = NULL;
 		return;
 	}
-	/* needs to be after the log file is known */
-	sc_log(ctx, "Used configuration file '%s'", conf_path);
 	blocks = scconf_find_blocks(ctx->conf, NULL, "app", ctx->app_name);
 	if (blocks && blocks[0])
 		ctx->conf_blocks[count++] = blocks[0];
@@ -733,6 +987,17 @@ static void process_config_file(sc_context_t *ctx, struct _sc_ctx_options *opts)
 	 * so at least one is NULL */
 	for (i = 0; ctx->conf_blocks[i]; i++)
 		load_parameters(ctx, ctx->conf_blocks[i], opts);
+
+	/* needs to be after the log file is known */
+	if (from_snapshot) {
+		sc_log(ctx, "Used configuration snapshot of '%s'", conf_path);
+		return;
+	}
+	sc_log(ctx, "Used configuration file '%s'", conf_path);
+
+	/* only a configuration file that could be parsed is stored */
+	if (snapshot)
+		save_conf_snapshot(ctx, conf_path);
 }
 
 int sc_ctx_detect_readers(sc_context_t *ctx)
@@ -742,6 +1007,8 @@ int sc_ctx_detect_readers(sc_context_t *ctx)
 
 	sc_mutex_lock(ctx, ctx->mutex);
 
+	/* set before, as the reader driver itself walks the list of readers */
+	ctx->readers_detected = 1;
 	if (drv->ops->detect_readers != NULL)
 		r = drv->ops->detect_readers(ctx);
 
@@ -750,24 +1017,55 @@ int sc_ctx_detect_readers(sc_context_t *ctx)
 	return r;
 }
 
+/* Readers are detected when they are needed for the first time */
+static void detect_readers_once(sc_context_t *ctx)
+{
+	if (!ctx->readers_detected)
+		sc_ctx_detect_readers(ctx);
+}
+
+/*
+ * The list of readers may grow in a thread waiting for reader events, so it
+ * is only accessed with the mutex of the context held. Readers are never
+ * freed before the context, so the returned pointers stay valid. Reader
+ * drivers run with the mutex held and use the list directly.
+ */
 sc_reader_t *sc_ctx_get_reader(sc_context_t *ctx, unsigned int i)
 {
-	return list_get_at(&ctx->readers, i);
+	sc_reader_t *reader;
+
+	detect_readers_once(ctx);
+	sc_mutex_lock(ctx, ctx->mutex);
+	reader = list_get_at(&ctx->readers, i);
+	sc_mutex_unlock(ctx, ctx->mutex);
+	return reader;
 }
 
 sc_reader_t *sc_ctx_get_reader_by_id(sc_context_t *ctx, unsigned int id)
 {
-	return list_get_at(&ctx->readers, id);
+	return sc_ctx_get_reader(ctx, id);
 }
 
 sc_reader_t *sc_ctx_get_reader_by_name(sc_context_t *ctx, const char * name)
 {
-	return list_seek(&ctx->readers, name);
+	sc_reader_t *reader;
+
+	detect_readers_once(ctx);
+	sc_mutex_lock(ctx, ctx->mutex);
+	reader = list_seek(&ctx->readers, name);
+	sc_mutex_unlock(ctx, ctx->mutex);
+	return reader;
 }
 
 unsigned int sc_ctx_get_reader_count(sc_context_t *ctx)
 {
-	return list_size(&ctx->readers);
+	unsigned int count;
+
+	detect_readers_once(ctx);
+	sc_mutex_lock(ctx, ctx->mutex);
+	count = list_size(&ctx->readers);
+	sc_mutex_unlock(ctx, ctx->mutex);
+	return count;
 }
 
 int sc_establish_context(sc_context_t **ctx_out, const char *app_name)
@@ -881,7 +1179,6 @@ int sc_context_create(sc_context_t **ctx_out, const sc_context_param_t *parm)
 	load_card_atrs(ctx);
 
 	del_drvs(&opts);
-	sc_ctx_detect_readers(ctx);
 	*ctx_out = ctx;
 
 	return SC_SUCCESS;
@@ -907,6 +1204,24 @@ int sc_cancel(sc_context_t *ctx)
 	return SC_ERROR_NOT_SUPPORTED;
 }
 
+int sc_ctx_reinit_after_fork(sc_context_t *ctx)
+{
+	int r;
+
+	if (ctx == NULL)
+		return SC_ERROR_INVALID_ARGUMENTS;
+	LOG_FUNC_CALLED(ctx);
+	if (ctx->reader_driver->ops->reinit == NULL)
+		LOG_FUNC_RETURN(ctx, SC_ERROR_NOT_SUPPORTED);
+
+	/* The mutex may have been held by a thread of the parent, which does
+	 * not exist in the child, so it is replaced without destroying it */
+	r = sc_mutex_create(ctx, &ctx->mutex);
+	LOG_TEST_RET(ctx, r, "Failed to create mutex");
+
+	r = ctx->reader_driver->ops->reinit(ctx);
+	LOG_FUNC_RETURN(ctx, r);
+}
 
 int sc_wait_for_event(sc_context_t *ctx, unsigned int event_mask, sc_reader_t **event_reader, unsigned int *event, int timeout, void **reader_states)
 {
@@ -944,6 +1259,10 @@ int sc_release_context(sc_context_t *ctx)
 	}
 	if (ctx->preferred_language != NULL)
 		free(ctx->preferred_language);
+	sc_pkcs15_free_cert_cache(ctx);
+#ifdef ENABLE_ZLIB
+	sc_decompress_free_cache(ctx);
+#endif
 	if (ctx->mutex != NULL) {
 		int r = sc_mutex_destroy(ctx, ctx->mutex);
 		if (r != SC_SUCCESS) {
@@ -989,20 +1308,13 @@ int sc_set_card_driver(sc_context_t *ctx, const char *short_name)
 	return SC_SUCCESS;
 }
 
-int sc_get_cache_dir(sc_context_t *ctx, char *buf, size_t bufsize)
+static int get_default_cache_dir(char *buf, size_t bufsize)
 {
 	char *homedir;
 	const char *cache_dir;
-        scconf_block *conf_block = NULL;
 #ifdef _WIN32
 	char temp_path[PATH_MAX];
 #endif
-	conf_block = sc_get_conf_block(ctx, "framework", "pkcs15", 1);
-	cache_dir = scconf_get_str(conf_block, "file_cache_dir", NULL);
-	if (cache_dir != NULL) {
-		strlcpy(buf, cache_dir, bufsize);
-		return SC_SUCCESS;
-	}
 
 #ifndef _WIN32
 	cache_dir = ".eid/cache";
@@ -1024,14 +1336,27 @@ int sc_get_cache_dir(sc_context_t *ctx, char *buf, size_t bufsize)
 	return SC_SUCCESS;
 }
 
-int sc_make_cache_dir(sc_context_t *ctx)
+int sc_get_cache_dir(sc_context_t *ctx, char *buf, size_t bufsize)
 {
-	char dirname[PATH_MAX], *sp;
-	int    r, mkdir_checker;
+	const char *cache_dir;
+        scconf_block *conf_block = NULL;
+
+	conf_block = sc_get_conf_block(ctx, "framework", "pkcs15", 1);
+	cache_dir = scconf_get_str(conf_block, "file_cache_dir", NULL);
+	if (cache_dir != NULL) {
+		strlcpy(buf, cache_dir, bufsize);
+		return SC_SUCCESS;
+	}
+
+	return get_default_cache_dir(buf, bufsize);
+}
+
+static int make_dir(sc_context_t *ctx, char *dirname)
+{
+	char *sp;
+	int    mkdir_checker;
 	size_t j, namelen;
 
-	if ((r = sc_get_cache_dir(ctx, dirname, sizeof(dirname))) < 0)
-		return r;
 	namelen = strlen(dirname);
 
 	while (1) {
@@ -1071,3 +1396,13 @@ failed:
 	sc_log(ctx, "failed to create cache directory");
 	return SC_ERROR_INTERNAL;
 }
+
+int sc_make_cache_dir(sc_context_t *ctx)
+{
+	char dirname[PATH_MAX];
+	int r;
+
+	if ((r = sc_get_cache_dir(ctx, dirname, sizeof(dirname))) < 0)
+		return r;
+	return make_dir(ctx, dirname);
+}
@@ -39,7 +39,6 @@
 #include <openssl/rsa.h>
 #include <openssl/bn.h>
 #include <openssl/x509.h>
-#include <openssl/des.h>
 #include <openssl/rand.h>
 #include "cwa14890.h"
 #include "cwa-dnie.h"
@@ -764,6 +763,17 @@ static int cwa_compute_session_keys(sc_card_t * card)
 	memcpy(sm->ssc, sm->icc.rnd + 4, 4);	/* 4 least significant bytes of rndicc */
 	memcpy(sm->ssc + 4, sm->ifd.rnd + 4, 4);	/* 4 least significant bytes of rndifd */
 
+	/* key the ciphers once for the whole session; the MAC is a retail
+	 * MAC chained from the encrypted SSC (cwa-14890-1 sect 9.6) */
+	sc_sm_crypt_free(sm->crypt);
+	sm->crypt = sc_sm_crypt_create(SM_CRYPT_DES3_CBC, sm->session_enc,
+			SM_MAC_DES_RETAIL | SM_MAC_ENCRYPTED_ICV, sm->session_mac);
+	if (!sm->crypt) {
+		msg = "Compute Session Keys: cannot create session ciphers";
+		res = SC_ERROR_INTERNAL;
+		goto compute_session_keys_end;
+	}
+
 	/* arriving here means process ok */
 	res = SC_SUCCESS;
 
@@ -1036,6 +1046,8 @@ int cwa_create_secure_channel(sc_card_t * card,
 	switch (flag) {
 	case CWA_SM_OFF:	/* disable SM */
 		card->sm_ctx.sm_mode = SM_MODE_NONE;
+		sc_sm_crypt_free(card->sm_ctx.info.session.cwa.crypt);
+		card->sm_ctx.info.session.cwa.crypt = NULL;
 		sc_log(ctx, "Setting CWA SM status to none");
 		LOG_FUNC_RETURN(ctx, SC_SUCCESS);
 	case CWA_SM_ON:	/* force sm initialization process */
@@ -1376,11 +1388,8 @@ int cwa_encode_apdu(sc_card_t * card,
 	u8 *ccbuf = NULL;		/* where to store data to eval cryptographic checksum CC */
 	size_t cclen = 0;
 	u8 macbuf[8];		/* to store and compute CC */
-	DES_key_schedule k1;
-	DES_key_schedule k2;
 	char *msg = NULL;
 
-	size_t i, j;		/* for xor loops */
 	int res = SC_SUCCESS;
 	sc_context_t *ctx = NULL;
 	struct sm_cwa_session * sm_session = &card->sm_ctx.info.session.cwa;
@@ -1458,13 +1467,6 @@ int cwa_encode_apdu(sc_card_t * card,
 	if (from->lc != 0) {
 		size_t dlen = from->lc;
 
-		/* prepare keys */
-		DES_cblock iv = { 0, 0, 0, 0, 0, 0, 0, 0 };
-		DES_set_key_unchecked((const_DES_cblock *) & (sm_session->session_enc[0]),
-				      &k1);
-		DES_set_key_unchecked((const_DES_cblock *) & (sm_session->session_enc[8]),
-				      &k2);
-
 		/* pad message */
 		memcpy(msgbuf, from->data, dlen);
 		cwa_iso7816_padding(msgbuf, &dlen);
@@ -1472,8 +1474,11 @@ int cwa_encode_apdu(sc_card_t * card,
 		/* start kriptbuff with iso padding indicator */
 		*cryptbuf = 0x01;
 		/* apply TDES + CBC with kenc and iv=(0,..,0) */
-		DES_ede3_cbc_encrypt(msgbuf, cryptbuf + 1, dlen, &k1, &k2, &k1,
-				     &iv, DES_ENCRYPT);
+		res = sc_sm_crypt_encrypt(sm_session->crypt, NULL, msgbuf, dlen, cryptbuf + 1);
+		if (res != SC_SUCCESS) {
+			msg = "Error in encrypting APDU data";
+			goto encode_end;
+		}
 		/* compose data TLV and add to result buffer */
 		res =
 		    cwa_compose_tlv(card, 0x87, dlen + 1, cryptbuf, &ccbuf,
@@ -1513,22 +1518,13 @@ int cwa_encode_apdu(sc_card_t * card,
 		msg = "Error in computing SSC";
 		goto encode_end;
 	}
-	/* set up keys for mac computing */
-	DES_set_key_unchecked((const_DES_cblock *) & (sm_session->session_mac[0]),&k1);
-	DES_set_key_unchecked((const_DES_cblock *) & (sm_session->session_mac[8]),&k2);
-
-	memcpy(macbuf, sm_session->ssc, 8);	/* start with computed SSC */
-	for (i = 0; i < cclen; i += 8) {	/* divide data in 8 byte blocks */
-		/* compute DES */
-		DES_ecb_encrypt((const_DES_cblock *) macbuf,
-				(DES_cblock *) macbuf, &k1, DES_ENCRYPT);
-		/* XOR with next data and repeat */
-		for (j = 0; j < 8; j++)
-			macbuf[j] ^= ccbuf[i + j];
+	/* retail MAC with kmac, chained from the encrypted SSC */
+	res = sc_sm_crypt_mac(sm_session->crypt, sm_session->ssc, ccbuf, cclen, macbuf);
+	if (res < 0) {
+		msg = "Error in computing MAC";
+		goto encode_end;
 	}
-	/* and apply 3DES to result */
-	DES_ecb2_encrypt((const_DES_cblock *) macbuf, (DES_cblock *) macbuf,
-			 &k1, &k2, DES_ENCRYPT);
+	res = SC_SUCCESS;
 
 	/* compose and add computed MAC TLV to result buffer */
 	tlv_len = (card->atr.value[15] >= DNIE_30_VERSION)? 8 : 4;
@@ -1581,7 +1577,7 @@ int cwa_decode_response(sc_card_t * card,
 			cwa_provider_t * provider,
 			sc_apdu_t * apdu)
 {
-	size_t i, j, tlv_len;
+	size_t tlv_len;
 	cwa_tlv_t tlv_array[4];
 	cwa_tlv_t *p_tlv = &tlv_array[0];	/* to store plain data (Tag 0x81) */
 	cwa_tlv_t *e_tlv = &tlv_array[1];	/* to store pad encoded data (Tag 0x87) */
@@ -1592,8 +1588,6 @@ int cwa_decode_response(sc_card_t * card,
 	size_t cclen = 0;	/* ccbuf len */
 	u8 macbuf[8];		/* where to calculate mac */
 	size_t resplen = 0;	/* respbuf length */
-	DES_key_schedule k1;
-	DES_key_schedule k2;
 	int res = SC_SUCCESS;
 	char *msg = NULL;	/* to store error messages */
 	sc_context_t *ctx = NULL;
@@ -1718,22 +1712,12 @@ int cwa_decode_response(sc_card_t * card,
 		msg = "Error in computing SSC";
 		goto response_decode_end;
 	}
-	/* set up keys for mac computing */
-	DES_set_key_unchecked((const_DES_cblock *) & (sm_session->session_mac[0]), &k1);
-	DES_set_key_unchecked((const_DES_cblock *) & (sm_session->session_mac[8]), &k2);
-
-	memcpy(macbuf, sm_session->ssc, 8);	/* start with computed SSC */
-	for (i = 0; i < cclen; i += 8) {	/* divide data in 8 byte blocks */
-		/* compute DES */
-		DES_ecb_encrypt((const_DES_cblock *) macbuf,
-				(DES_cblock *) macbuf, &k1, DES_ENCRYPT);
-		/* XOR with data and repeat */
-		for (j = 0; j < 8; j++)
-			macbuf[j] ^= ccbuf[i + j];
+	/* retail MAC with kmac, chained from the encrypted SSC */
+	res = sc_sm_crypt_mac(sm_session->crypt, sm_session->ssc, ccbuf, cclen, macbuf);
+	if (res < 0) {
+		msg = "Error in computing MAC";
+		goto response_decode_end;
 	}
-	/* finally apply 3DES to result */
-	DES_ecb2_encrypt((const_DES_cblock *) macbuf, (DES_cblock *) macbuf,
-			 &k1, &k2, DES_ENCRYPT);
 
 	/* check evaluated mac with provided by apdu response */
 
@@ -1763,7 +1747,6 @@ int cwa_decode_response(sc_card_t * card,
 
 	/* if encoded data, decode and store into apdu response */
 	else if (e_tlv->buf) {	/* encoded data */
-		DES_cblock iv = { 0, 0, 0, 0, 0, 0, 0, 0 };
 		/* check data len */
 		if ((e_tlv->len < 9) || ((e_tlv->len - 1) % 8) != 0) {
 			msg = "Invalid length for Encoded data TLV";
@@ -1776,15 +1759,14 @@ int cwa_decode_response(sc_card_t * card,
 			res = SC_ERROR_INVALID_DATA;
 			goto response_decode_end;
 		}
-		/* prepare keys to decode */
-		DES_set_key_unchecked((const_DES_cblock *) & (sm_session->session_enc[0]),
-				      &k1);
-		DES_set_key_unchecked((const_DES_cblock *) & (sm_session->session_enc[8]),
-				      &k2);
 		/* decrypt into response buffer
 		 * by using 3DES CBC by mean of kenc and iv={0,...0} */
-		DES_ede3_cbc_encrypt(&e_tlv->data[1], apdu->resp, e_tlv->len - 1,
-				     &k1, &k2, &k1, &iv, DES_DECRYPT);
+		res = sc_sm_crypt_decrypt(sm_session->crypt, NULL, &e_tlv->data[1],
+				e_tlv->len - 1, apdu->resp);
+		if (res != SC_SUCCESS) {
+			msg = "Error in decrypting response data";
+			goto response_decode_end;
+		}
 		apdu->resplen = e_tlv->len - 1;
 		/* remove iso padding from response length */
 		for (; (apdu->resplen > 0) && *(apdu->resp + apdu->resplen - 1) == 0x00; apdu->resplen--) ;	/* empty loop */
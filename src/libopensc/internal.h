@@ -79,6 +79,8 @@ struct sc_atr_table {
 /* Internal use only */
 int _sc_add_reader(struct sc_context *ctx, struct sc_reader *reader);
 int _sc_parse_atr(struct sc_reader *reader);
+/* Whether the ATR historical bytes announce extended Lc/Le */
+int _sc_hist_bytes_apdu_ext(const struct sc_reader *reader);
 
 /* Add an ATR to the card driver's struct sc_atr_table */
 int _sc_add_atr(struct sc_context *ctx, struct sc_card_driver *driver, struct sc_atr_table *src);
@@ -227,6 +229,51 @@ int sc_mutex_destroy(const sc_context_t *ctx, void *mutex);
  */
 unsigned long sc_thread_id(const sc_context_t *ctx);
 
+/*
+ * Storage class for per-thread data such as the formatting buffers
+ * returned by sc_print_path() and sc_dump_hex(). Without compiler
+ * support the data is shared by all threads.
+ */
+#if defined(_MSC_VER)
+#define SC_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define SC_THREAD_LOCAL __thread
+#else
+#define SC_THREAD_LOCAL
+#endif
+
+/* number of results of sc_print_path() etc. that stay valid per thread */
+#define SC_FORMAT_BUFFERS 4
+
+/********************************************************************/
+/*                 performance counters                             */
+/********************************************************************/
+
+/* Counters are updated without taking a lock */
+#if defined(__GNUC__)
+#define SC_STATS_ADD(ctx, field, n) \
+	((void) __atomic_fetch_add(&(ctx)->stats.field, (unsigned long long) (n), __ATOMIC_RELAXED))
+#elif defined(_WIN32)
+#define SC_STATS_ADD(ctx, field, n) \
+	((void) InterlockedExchangeAdd64((volatile LONG64 *) &(ctx)->stats.field, (LONG64) (n)))
+#else
+#define SC_STATS_ADD(ctx, field, n) ((void) ((ctx)->stats.field += (n)))
+#endif
+
+/**
+ * Returns a monotonic timestamp in microseconds.
+ */
+unsigned long long sc_stats_timestamp(void);
+/**
+ * Adds the latency of a card operation started at @a start
+ * (a value of sc_stats_timestamp()) to the histogram of @a op.
+ */
+void sc_stats_record_op(sc_context_t *ctx, int op, unsigned long long start);
+/**
+ * Counts an APDU that was passed to the reader driver.
+ */
+void sc_stats_count_apdu(sc_context_t *ctx, const sc_apdu_t *apdu);
+
 /********************************************************************/
 /*             internal APDU handling functions                     */
 /********************************************************************/
@@ -283,7 +283,12 @@ void _sc_debug_hex(sc_context_t *ctx, int type, const char *file, int line,
 		const char *func, const char *label, const u8 *data, size_t len)
 {
 	size_t blen = len * 5 + 128;
-	char *buf = malloc(blen);
+	char *buf;
+
+	if (!ctx || ctx->debug < type)
+		return;
+
+	buf = malloc(blen);
 	if (buf == NULL)
 		return;
 
@@ -342,11 +347,14 @@ void sc_hex_dump(const u8 * in, size_t count, char *buf, size_t len)
 const char *
 sc_dump_hex(const u8 * in, size_t count)
 {
-	static char dump_buf[0x1000];
-	size_t ii, size = sizeof(dump_buf) - 0x10;
+	/* per-thread, with room for two dumps in one log line */
+	static SC_THREAD_LOCAL char dump_bufs[2][0x1000];
+	static SC_THREAD_LOCAL unsigned int next;
+	char *dump_buf = dump_bufs[next++ % 2];
+	size_t ii, size = sizeof(dump_bufs[0]) - 0x10;
 	size_t offs = 0;
 
-	memset(dump_buf, 0, sizeof(dump_buf));
+	dump_buf[0] = '\0';
 	if (in == NULL)
 		return dump_buf;
 
@@ -367,7 +375,7 @@ sc_dump_hex(const u8 * in, size_t count)
 	}
 
 	if (ii<count)
-		snprintf(dump_buf + offs, sizeof(dump_buf) - offs, "....\n");
+		snprintf(dump_buf + offs, sizeof(dump_bufs[0]) - offs, "....\n");
 
 	return dump_buf;
 }
@@ -375,7 +383,7 @@ sc_dump_hex(const u8 * in, size_t count)
 const char *
 sc_dump_oid(const struct sc_object_id *oid)
 {
-	static char dump_buf[SC_MAX_OBJECT_ID_OCTETS * 20];
+	static SC_THREAD_LOCAL char dump_buf[SC_MAX_OBJECT_ID_OCTETS * 20];
         size_t ii;
 
 	memset(dump_buf, 0, sizeof(dump_buf));
@@ -59,9 +59,44 @@ enum {
 #define __FUNCTION__ NULL
 #endif
 
+/*
+ * Debug messages of a level above SC_LOG_MAX_LEVEL are removed at compile
+ * time, e.g. build with -DSC_LOG_MAX_LEVEL=0 to strip all debug logging
+ * or with -DSC_LOG_MAX_LEVEL=SC_LOG_DEBUG_NORMAL to keep only the normal
+ * messages. By default nothing is removed.
+ */
+#ifdef SC_LOG_MAX_LEVEL
+#define SC_LOG_COMPILED(level) ((level) <= SC_LOG_MAX_LEVEL)
+#else
+#define SC_LOG_COMPILED(level) 1
+#endif
+
+/*
+ * True if a message of this level would be written. The logging macros
+ * test this before their arguments are evaluated, so that disabled
+ * logging does not cost the formatting of hex dumps, paths, etc.
+ */
+#define SC_LOG_ENABLED(ctx, level) \
+	(SC_LOG_COMPILED(level) && (ctx) != NULL && (ctx)->debug >= (level))
+
 #if defined(__GNUC__)
-#define sc_debug(ctx, level, format, args...)	sc_do_log(ctx, level, __FILE__, __LINE__, __FUNCTION__, format , ## args)
-#define sc_log(ctx, format, args...)   sc_do_log(ctx, SC_LOG_DEBUG_NORMAL, __FILE__, __LINE__, __FUNCTION__, format , ## args)
+#define sc_debug(ctx, level, format, args...) do { \
+	if (SC_LOG_ENABLED(ctx, level)) \
+		sc_do_log(ctx, level, __FILE__, __LINE__, __FUNCTION__, format , ## args); \
+} while (0)
+#define sc_log(ctx, format, args...) do { \
+	if (SC_LOG_ENABLED(ctx, SC_LOG_DEBUG_NORMAL)) \
+		sc_do_log(ctx, SC_LOG_DEBUG_NORMAL, __FILE__, __LINE__, __FUNCTION__, format , ## args); \
+} while (0)
+#elif defined(_MSC_VER) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
+#define sc_debug(ctx, level, ...) do { \
+	if (SC_LOG_ENABLED(ctx, level)) \
+		_sc_debug(ctx, level, __VA_ARGS__); \
+} while (0)
+#define sc_log(ctx, ...) do { \
+	if (SC_LOG_ENABLED(ctx, SC_LOG_DEBUG_NORMAL)) \
+		_sc_log(ctx, __VA_ARGS__); \
+} while (0)
 #else
 #define sc_debug _sc_debug
 #define sc_log _sc_log
@@ -108,8 +143,10 @@ int sc_color_fprintf(int colors, struct sc_context *ctx, FILE * stream, const ch
  * @param[in] data  Binary data
  * @param[in] len   Length of \a data
  */
-#define sc_debug_hex(ctx, level, label, data, len) \
-    _sc_debug_hex(ctx, level, __FILE__, __LINE__, __FUNCTION__, label, data, len)
+#define sc_debug_hex(ctx, level, label, data, len) do { \
+	if (SC_LOG_ENABLED(ctx, level)) \
+		_sc_debug_hex(ctx, level, __FILE__, __LINE__, __FUNCTION__, label, data, len); \
+} while (0)
 #define sc_log_hex(ctx, label, data, len) \
     sc_debug_hex(ctx, SC_LOG_DEBUG_NORMAL, label, data, len)
 /** 
@@ -131,18 +168,20 @@ void sc_hex_dump(const u8 *buf, size_t len, char *out, size_t outlen);
 const char * sc_dump_hex(const u8 * in, size_t count);
 const char * sc_dump_oid(const struct sc_object_id *oid);
 #define SC_FUNC_CALLED(ctx, level) do { \
-	 sc_do_log(ctx, level, __FILE__, __LINE__, __FUNCTION__, "called\n"); \
+	if (SC_LOG_ENABLED(ctx, level)) \
+		sc_do_log(ctx, level, __FILE__, __LINE__, __FUNCTION__, "called\n"); \
 } while (0)
 #define LOG_FUNC_CALLED(ctx) SC_FUNC_CALLED((ctx), SC_LOG_DEBUG_NORMAL)
 
 #define SC_FUNC_RETURN(ctx, level, r) do { \
 	int _ret = r; \
-	if (_ret <= 0) { \
-		sc_do_log_color(ctx, level, __FILE__, __LINE__, __FUNCTION__, _ret ? SC_COLOR_FG_RED : 0, \
-			"returning with: %d (%s)\n", _ret, sc_strerror(_ret)); \
-	} else { \
-		sc_do_log(ctx, level, __FILE__, __LINE__, __FUNCTION__, \
-			"returning with: %d\n", _ret); \
+	if (SC_LOG_ENABLED(ctx, level)) { \
+		if (_ret <= 0) \
+			sc_do_log_color(ctx, level, __FILE__, __LINE__, __FUNCTION__, _ret ? SC_COLOR_FG_RED : 0, \
+				"returning with: %d (%s)\n", _ret, sc_strerror(_ret)); \
+		else \
+			sc_do_log(ctx, level, __FILE__, __LINE__, __FUNCTION__, \
+				"returning with: %d\n", _ret); \
 	} \
 	return _ret; \
 } while(0)
@@ -151,8 +190,9 @@ const char * sc_dump_oid(const struct sc_object_id *oid);
 #define SC_TEST_RET(ctx, level, r, text) do { \
 	int _ret = (r); \
 	if (_ret < 0) { \
-		sc_do_log_color(ctx, level, __FILE__, __LINE__, __FUNCTION__, SC_COLOR_FG_RED, \
-			"%s: %d (%s)\n", (text), _ret, sc_strerror(_ret)); \
+		if (SC_LOG_ENABLED(ctx, level)) \
+			sc_do_log_color(ctx, level, __FILE__, __LINE__, __FUNCTION__, SC_COLOR_FG_RED, \
+				"%s: %d (%s)\n", (text), _ret, sc_strerror(_ret)); \
 		return _ret; \
 	} \
 } while(0)
@@ -161,8 +201,9 @@ const char * sc_dump_oid(const struct sc_object_id *oid);
 #define SC_TEST_GOTO_ERR(ctx, level, r, text) do { \
 	int _ret = (r); \
 	if (_ret < 0) { \
-		sc_do_log_color(ctx, level, __FILE__, __LINE__, __FUNCTION__, SC_COLOR_FG_RED, \
-			"%s: %d (%s)\n", (text), _ret, sc_strerror(_ret)); \
+		if (SC_LOG_ENABLED(ctx, level)) \
+			sc_do_log_color(ctx, level, __FILE__, __LINE__, __FUNCTION__, SC_COLOR_FG_RED, \
+				"%s: %d (%s)\n", (text), _ret, sc_strerror(_ret)); \
 		goto err; \
 	} \
 } while(0)
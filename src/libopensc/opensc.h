@@ -37,6 +37,7 @@ extern "C" {
 #endif
 
 #include "common/simclist.h"
+#include "common/lru.h"
 #include "scconf/scconf.h"
 #include "libopensc/errors.h"
 #include "libopensc/types.h"
@@ -504,6 +505,14 @@ struct sc_reader_operations {
 	int (*reset)(struct sc_reader *, int);
 	/* Used to pass in PC/SC handles to minidriver */
 	int (*use_reader)(struct sc_context *ctx, void *pcsc_context_handle, void *pcsc_card_handle);
+	/* Optional: transmits the intermediate APDUs of a chained command
+	 * back-to-back. Stops after the first APDU not answered with 0x9000
+	 * and returns the number of APDUs sent. */
+	int (*transmit_chain)(struct sc_reader *reader, sc_apdu_t *apdus, size_t count);
+	/* Optional: called in the child after fork(). Forgets the handles
+	 * inherited from the parent without releasing them and establishes
+	 * new ones; cards are connected again when they are locked next. */
+	int (*reinit)(struct sc_context *ctx);
 };
 
 /*
@@ -584,6 +593,9 @@ typedef struct sc_card {
 	int algorithm_count;
 
 	int lock_count;
+	unsigned long long lock_acquired;	/* for sc_stats_t.lock_hold_us */
+	unsigned int reset_count;	/* card resets noticed by sc_lock() */
+	unsigned int transaction_count;	/* reader transactions started by sc_lock() */
 
 	struct sc_card_driver *driver;
 	struct sc_card_operations *ops;
@@ -775,6 +787,52 @@ typedef struct {
 #define SC_CTX_FLAG_ENABLE_DEFAULT_DRIVER	0x00000008
 #define SC_CTX_FLAG_DISABLE_POPUPS			0x00000010
 #define SC_CTX_FLAG_DISABLE_COLORS			0x00000020
+#define SC_CTX_FLAG_DETECT_EXTENDED_APDU	0x00000040
+
+/* Card operations with latency histograms in struct sc_stats */
+#define SC_STATS_OP_SELECT_FILE		0
+#define SC_STATS_OP_READ_BINARY		1
+#define SC_STATS_OP_UPDATE_BINARY	2
+#define SC_STATS_OP_READ_RECORD		3
+#define SC_STATS_OP_PIN_CMD		4
+#define SC_STATS_OP_COMPUTE_SIGNATURE	5
+#define SC_STATS_OP_DECIPHER		6
+#define SC_STATS_OP_GET_CHALLENGE	7
+#define SC_STATS_OP_MAX			8
+
+/* Histogram bucket i counts calls that took less than 2^i microseconds,
+ * the last bucket counts all slower calls */
+#define SC_STATS_HIST_BUCKETS		24
+
+struct sc_stats_histogram {
+	unsigned long long count;
+	unsigned long long total_us;
+	unsigned long long max_us;
+	unsigned long long buckets[SC_STATS_HIST_BUCKETS];
+};
+
+/** Performance counters of a context, see sc_ctx_get_stats() */
+typedef struct sc_stats {
+	unsigned long long apdus_sent;		/* APDUs passed to the reader */
+	unsigned long long bytes_sent;		/* command data bytes */
+	unsigned long long bytes_received;	/* response data bytes */
+	unsigned long long get_response;	/* GET RESPONSE commands */
+	unsigned long long select_calls;	/* calls to sc_select_file() */
+	unsigned long long select_apdus;	/* SELECT commands sent */
+	unsigned long long lock_count;		/* reader transactions started */
+	unsigned long long lock_wait_us;	/* time spent obtaining the reader lock */
+	unsigned long long lock_hold_us;	/* time the reader lock was held */
+	unsigned long long file_cache_hits;	/* PKCS#15 files read from cache */
+	unsigned long long file_cache_misses;	/* PKCS#15 files read from card */
+	unsigned long long sm_reopened;		/* SM sessions re-established after a card reset */
+	unsigned long long sm_resumed;		/* SM sessions kept after a card reset */
+	unsigned long long decompress_cache_hits;	/* decompressed data found in cache */
+	unsigned long long decompress_cache_misses;	/* compressed data inflated */
+	unsigned long long pin_state_probes;	/* PIN status queries before a key operation */
+	unsigned long long pin_verify_early;	/* cached PINs verified before a key operation */
+	unsigned long long pin_apdus_saved;	/* SELECT, MSE and key commands not repeated */
+	struct sc_stats_histogram ops[SC_STATS_OP_MAX];
+} sc_stats_t;
 
 typedef struct sc_context {
 	scconf_context *conf;
@@ -798,6 +856,15 @@ typedef struct sc_context {
 	sc_thread_context_t	*thread_ctx;
 	void *mutex;
 
+	/* parsed X.509 certificates, shared by all cards of this context */
+	lru_cache_t *cert_cache;
+	/* decompressed card objects, keyed by the compressed data */
+	lru_cache_t *decompress_cache;
+	/* readers are detected on first use, see sc_ctx_detect_readers() */
+	int readers_detected;
+
+	sc_stats_t stats;
+
 	unsigned int magic;
 } sc_context_t;
 
@@ -917,13 +984,53 @@ int sc_context_create(sc_context_t **ctx, const sc_context_param_t *parm);
  */
 int sc_release_context(sc_context_t *ctx);
 
+/**
+ * Prepares a context inherited from the parent process for the use in a
+ * child after fork(). The mutex of the context is created again and the
+ * reader driver establishes new handles, while readers, card drivers and
+ * the configuration are kept. The handles of the parent are not released.
+ * @param  ctx  OpenSC context
+ * @return SC_SUCCESS on success, SC_ERROR_NOT_SUPPORTED if the reader
+ *         driver can not do this, or another error code
+ */
+int sc_ctx_reinit_after_fork(sc_context_t *ctx);
+
 /**
  * Detect new readers available on system.
+ *
+ * A new context does not detect readers until one of the sc_ctx_get_reader*
+ * functions is called for the first time. Applications that want to pay
+ * the cost of the detection up front may call this function right after
+ * creating the context.
  * @param  ctx  OpenSC context
  * @return SC_SUCCESS on success and an error code otherwise.
  */
 int sc_ctx_detect_readers(sc_context_t *ctx);
 
+/**
+ * Returns a snapshot of the performance counters of the context.
+ * @param  ctx    OpenSC context
+ * @param  stats  receives the counters
+ * @return SC_SUCCESS on success and an error code otherwise.
+ */
+int sc_ctx_get_stats(sc_context_t *ctx, sc_stats_t *stats);
+
+/**
+ * Resets the performance counters of the context.
+ * @param  ctx  OpenSC context
+ */
+void sc_ctx_reset_stats(sc_context_t *ctx);
+
+/**
+ * Formats performance counters as text, one "name: value" per line.
+ * @param  stats   counters to print
+ * @param  buf     output buffer (may be NULL if buflen is 0)
+ * @param  buflen  size of buf
+ * @return the length of the full text (excluding the terminating NUL),
+ *         which is larger than buflen - 1 if the output was truncated
+ */
+size_t sc_stats_print(const sc_stats_t *stats, char *buf, size_t buflen);
+
 /**
  * In windows: get configuration option from environment or from registers.
  * @param env name of environment variable
@@ -1075,6 +1182,17 @@ int sc_cancel(sc_context_t *ctx);
  * @retval SC_SUCCESS on success
  */
 int sc_lock(struct sc_card *card);
+
+/**
+ * Prepares a card connected in the parent process for the use in a child
+ * after fork(), once sc_ctx_reinit_after_fork() was called for its
+ * context. The mutex of the card is created again and the lock of the
+ * parent is forgotten, so that the card is connected again on the next
+ * sc_lock(), which also restores the state of the card driver.
+ * @param  card  struct sc_card object
+ * @return SC_SUCCESS on success and an error code otherwise
+ */
+int sc_card_reinit_after_fork(struct sc_card *card);
 /**
  * Unlocks a previously acquired reader lock.
  * @param  card  The card to unlock
@@ -1332,8 +1450,8 @@ int sc_path_set(sc_path_t *path, int type, const u8 *id, size_t id_len,
 void sc_format_path(const char *path_in, sc_path_t *path_out);
 /**
  * Return string representation of the given sc_path_t object
- * Warning: as static memory is used for the return value
- *          this function is not thread-safe !!!
+ * The result is stored in a per-thread buffer which is reused by
+ * later calls: use sc_path_print() to keep it.
  * @param  path  sc_path_t object of the path to be printed
  * @return pointer to a const buffer with the string representation
  *         of the path
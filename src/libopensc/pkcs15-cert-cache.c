@@ -0,0 +1,174 @@
+/*
+ * pkcs15-cert-cache.c: Parsed X.509 certificate cache
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+#include "pkcs15.h"
+
+/*
+ * Parsed certificate cache.
+ *
+ * Certificates are looked up by their DER encoding, so the cache
+ * is shared by all cards, slots and re-binds of one context. Entries are
+ * kept in most-recently-used order and never handed out directly: callers
+ * always get their own copy.
+ */
+#define SC_PKCS15_CERT_CACHE_MAX	256
+
+/* Honour use_certificate_cache where no card (and so no options) is at hand */
+int
+sc_pkcs15_cert_cache_enabled(struct sc_context *ctx)
+{
+	scconf_block *conf_block;
+
+	conf_block = sc_get_conf_block(ctx, "framework", "pkcs15", 1);
+	if (conf_block == NULL)
+		return 1;
+	return scconf_get_bool(conf_block, "use_certificate_cache", 1);
+}
+
+/* Only keys that sc_pkcs15_dup_pubkey() copies in full can be served from the cache */
+static int
+cert_cache_key_ok(const struct sc_pkcs15_pubkey *key)
+{
+	if (key == NULL)
+		return 1;
+	switch (key->algorithm) {
+	case SC_ALGORITHM_RSA:
+	case SC_ALGORITHM_DSA:
+		return 1;
+	case SC_ALGORITHM_EC:
+		return key->u.ec.params.named_curve != NULL;
+	default:
+		return 0;
+	}
+}
+
+static void
+cert_cache_free_value(void *value)
+{
+	sc_pkcs15_free_certificate(value);
+}
+
+static u8 *
+cert_mem_dup(const u8 *data, size_t len)
+{
+	u8 *p = malloc(len);
+
+	if (p != NULL)
+		memcpy(p, data, len);
+	return p;
+}
+
+static int
+cert_dup(struct sc_context *ctx, const struct sc_pkcs15_cert *in, struct sc_pkcs15_cert **out)
+{
+	struct sc_pkcs15_cert *cert;
+	int r = SC_ERROR_OUT_OF_MEMORY;
+
+	cert = calloc(1, sizeof(struct sc_pkcs15_cert));
+	if (cert == NULL)
+		return SC_ERROR_OUT_OF_MEMORY;
+
+	cert->version = in->version;
+	if (in->serial && (cert->serial = cert_mem_dup(in->serial, in->serial_len)) == NULL)
+		goto err;
+	cert->serial_len = in->serial_len;
+	if (in->issuer && (cert->issuer = cert_mem_dup(in->issuer, in->issuer_len)) == NULL)
+		goto err;
+	cert->issuer_len = in->issuer_len;
+	if (in->subject && (cert->subject = cert_mem_dup(in->subject, in->subject_len)) == NULL)
+		goto err;
+	cert->subject_len = in->subject_len;
+	if (in->extensions && (cert->extensions = cert_mem_dup(in->extensions, in->extensions_len)) == NULL)
+		goto err;
+	cert->extensions_len = in->extensions_len;
+	if ((cert->data.value = cert_mem_dup(in->data.value, in->data.len)) == NULL)
+		goto err;
+	cert->data.len = in->data.len;
+	if (in->key) {
+		r = sc_pkcs15_dup_pubkey(ctx, in->key, &cert->key);
+		if (r < 0)
+			goto err;
+	}
+
+	*out = cert;
+	return SC_SUCCESS;
+err:
+	sc_pkcs15_free_certificate(cert);
+	return r;
+}
+
+/* Look up a parsed copy of the certificate encoded in @der */
+int
+sc_pkcs15_cert_cache_get(struct sc_context *ctx, const struct sc_pkcs15_der *der, struct sc_pkcs15_cert **out)
+{
+	struct sc_pkcs15_cert *cert;
+	int r = SC_ERROR_OBJECT_NOT_FOUND;
+
+	if (ctx->cert_cache == NULL || der->value == NULL)
+		return SC_ERROR_OBJECT_NOT_FOUND;
+
+	sc_mutex_lock(ctx, ctx->mutex);
+	cert = lru_cache_get(ctx->cert_cache, der->value, der->len);
+	if (cert)
+		r = cert_dup(ctx, cert, out);
+	sc_mutex_unlock(ctx, ctx->mutex);
+
+	if (r == SC_SUCCESS)
+		sc_log(ctx, "Parsed certificate found in cache");
+	return r;
+}
+
+void
+sc_pkcs15_cert_cache_put(struct sc_context *ctx, const struct sc_pkcs15_der *der, const struct sc_pkcs15_cert *cert)
+{
+	struct sc_pkcs15_cert *copy;
+
+	if (der->value == NULL || !cert_cache_key_ok(cert->key))
+		return;
+	if (cert_dup(ctx, cert, &copy) != SC_SUCCESS)
+		return;
+
+	sc_mutex_lock(ctx, ctx->mutex);
+	if (ctx->cert_cache == NULL)
+		ctx->cert_cache = lru_cache_new(SC_PKCS15_CERT_CACHE_MAX, cert_cache_free_value);
+	/* key on the bytes as they come from the card, trailing data included */
+	if (ctx->cert_cache == NULL)
+		sc_pkcs15_free_certificate(copy);
+	else
+		lru_cache_put(ctx->cert_cache, der->value, der->len, copy);
+	sc_mutex_unlock(ctx, ctx->mutex);
+}
+
+void
+sc_pkcs15_free_cert_cache(struct sc_context *ctx)
+{
+	if (ctx == NULL)
+		return;
+	lru_cache_free(ctx->cert_cache);
+	ctx->cert_cache = NULL;
+}
@@ -22,6 +22,7 @@
 #include "config.h"
 #endif
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -135,6 +136,7 @@ err:
 }
 
 
+
 /* Get a component of Distinguished Name (e.i. subject or issuer) USING the oid tag.
  * dn can be either cert->subject or cert->issuer.
  * dn_len would be cert->subject_len or cert->issuer_len.
@@ -344,13 +346,23 @@ sc_pkcs15_pubkey_from_cert(struct sc_context *ctx,
 		struct sc_pkcs15_der *cert_blob, struct sc_pkcs15_pubkey **out)
 {
 	int rv;
+	int use_cache = sc_pkcs15_cert_cache_enabled(ctx);
 	struct sc_pkcs15_cert * cert;
 
+	if (use_cache && sc_pkcs15_cert_cache_get(ctx, cert_blob, &cert) == SC_SUCCESS) {
+		*out = cert->key;
+		cert->key = NULL;
+		sc_pkcs15_free_certificate(cert);
+		LOG_FUNC_RETURN(ctx, *out ? SC_SUCCESS : SC_ERROR_INVALID_ASN1_OBJECT);
+	}
+
 	cert =  calloc(1, sizeof(struct sc_pkcs15_cert));
 	if (cert == NULL)
 		return SC_ERROR_OUT_OF_MEMORY;
 
 	rv = parse_x509_cert(ctx, cert_blob, cert);
+	if (rv == SC_SUCCESS && use_cache)
+		sc_pkcs15_cert_cache_put(ctx, cert_blob, cert);
 
 	*out = cert->key;
 	cert->key = NULL;
@@ -386,6 +398,12 @@ sc_pkcs15_read_certificate(struct sc_pkcs15_card *p15card, const struct sc_pkcs1
 		LOG_FUNC_RETURN(ctx, SC_ERROR_OBJECT_NOT_FOUND);
 	}
 
+	if (p15card->opts.use_cert_cache && sc_pkcs15_cert_cache_get(ctx, &der, &cert) == SC_SUCCESS) {
+		free(der.value);
+		*cert_out = cert;
+		LOG_FUNC_RETURN(ctx, SC_SUCCESS);
+	}
+
 	cert = malloc(sizeof(struct sc_pkcs15_cert));
 	if (cert == NULL) {
 		free(der.value);
@@ -397,6 +415,8 @@ sc_pkcs15_read_certificate(struct sc_pkcs15_card *p15card, const struct sc_pkcs1
 		sc_pkcs15_free_certificate(cert);
 		LOG_FUNC_RETURN(ctx, SC_ERROR_INVALID_ASN1_OBJECT);
 	}
+	if (p15card->opts.use_cert_cache)
+		sc_pkcs15_cert_cache_put(ctx, &der, cert);
 	free(der.value);
 
 	*cert_out = cert;
@@ -434,6 +454,70 @@ static const struct sc_asn1_entry c_asn1_cert[] = {
 	{ NULL, 0, 0, 0, NULL, NULL }
 };
 
+/*
+ * Compiled form of the templates above used to decode CDF entries.
+ * The outputs are relative to the bases set up in
+ * sc_pkcs15_decode_cdf_entry().
+ */
+enum { CDF_BASE_OBJECT = SC_ASN1_BASE_P15_OBJECT, CDF_BASE_INFO, CDF_BASE_CRED_IDENT };
+
+struct cdf_cred_ident {
+	int id_type;
+	u8 id_value[128];
+	size_t id_value_len;
+};
+
+static const struct sc_asn1_compiled c_asn1_compiled_cred_ident[] = {
+	SC_ASN1_COMPILED_VALUE("idType", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, 0,
+		CDF_BASE_CRED_IDENT, offsetof(struct cdf_cred_ident, id_type)),
+	SC_ASN1_COMPILED_BUFFER("idValue", SC_ASN1_OCTET_STRING, SC_ASN1_TAG_OCTET_STRING, 0,
+		CDF_BASE_CRED_IDENT, offsetof(struct cdf_cred_ident, id_value),
+		offsetof(struct cdf_cred_ident, id_value_len), sizeof(((struct cdf_cred_ident *) 0)->id_value)),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_com_cert_attr[] = {
+	SC_ASN1_COMPILED_VALUE("iD", SC_ASN1_PKCS15_ID, SC_ASN1_TAG_OCTET_STRING, 0,
+		CDF_BASE_INFO, offsetof(struct sc_pkcs15_cert_info, id)),
+	SC_ASN1_COMPILED_VALUE("authority", SC_ASN1_BOOLEAN, SC_ASN1_TAG_BOOLEAN, SC_ASN1_OPTIONAL,
+		CDF_BASE_INFO, offsetof(struct sc_pkcs15_cert_info, authority)),
+	SC_ASN1_COMPILED_STRUCT("identifier", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, SC_ASN1_OPTIONAL,
+		c_asn1_compiled_cred_ident),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_x509_cert_value_choice[] = {
+	SC_ASN1_COMPILED_VALUE("path", SC_ASN1_PATH, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, SC_ASN1_OPTIONAL,
+		CDF_BASE_INFO, offsetof(struct sc_pkcs15_cert_info, path)),
+	SC_ASN1_COMPILED_BUFFER("direct", SC_ASN1_OCTET_STRING, SC_ASN1_CTX | 0 | SC_ASN1_CONS,
+		SC_ASN1_OPTIONAL | SC_ASN1_ALLOC,
+		CDF_BASE_INFO, offsetof(struct sc_pkcs15_cert_info, value.value),
+		offsetof(struct sc_pkcs15_cert_info, value.len), 0),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_x509_cert_attr[] = {
+	SC_ASN1_COMPILED_CHOICE("value", 0, c_asn1_compiled_x509_cert_value_choice),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_type_cert_attr[] = {
+	SC_ASN1_COMPILED_STRUCT("x509CertificateAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0,
+		c_asn1_compiled_x509_cert_attr),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_cert_obj[] = {
+	SC_ASN1_COMPILED_STRUCT("commonObjectAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0,
+		sc_asn1_compiled_com_obj_attr),
+	SC_ASN1_COMPILED_STRUCT("classAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0,
+		c_asn1_compiled_com_cert_attr),
+	SC_ASN1_COMPILED_STRUCT("subClassAttributes", SC_ASN1_CTX | 0 | SC_ASN1_CONS, SC_ASN1_OPTIONAL, NULL),
+	SC_ASN1_COMPILED_STRUCT("typeAttributes", SC_ASN1_CTX | 1 | SC_ASN1_CONS, 0,
+		c_asn1_compiled_type_cert_attr),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_cert[] = {
+	SC_ASN1_COMPILED_STRUCT("x509Certificate", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0,
+		c_asn1_compiled_cert_obj),
+	SC_ASN1_COMPILED_END
+};
+
 
 int
 sc_pkcs15_decode_cdf_entry(struct sc_pkcs15_card *p15card, struct sc_pkcs15_object *obj,
@@ -441,43 +525,26 @@ sc_pkcs15_decode_cdf_entry(struct sc_pkcs15_card *p15card, struct sc_pkcs15_obje
 {
 	sc_context_t *ctx = p15card->card->ctx;
 	struct sc_pkcs15_cert_info info;
-	struct sc_asn1_entry	asn1_cred_ident[3], asn1_com_cert_attr[4],
-				asn1_x509_cert_attr[2], asn1_type_cert_attr[2],
-				asn1_cert[2], asn1_x509_cert_value_choice[3];
-	struct sc_asn1_pkcs15_object cert_obj = {
-		obj, asn1_com_cert_attr, NULL,
-		asn1_type_cert_attr };
+	struct cdf_cred_ident cred_ident;
+	void *bases[] = { obj, &info, &cred_ident };
 	sc_pkcs15_der_t *der = &info.value;
-	u8 id_value[128];
-	int id_type;
-	size_t id_value_len = sizeof(id_value);
+	unsigned int flags = 0;
 	int r;
 
-	sc_copy_asn1_entry(c_asn1_cred_ident, asn1_cred_ident);
-	sc_copy_asn1_entry(c_asn1_com_cert_attr, asn1_com_cert_attr);
-	sc_copy_asn1_entry(c_asn1_x509_cert_attr, asn1_x509_cert_attr);
-	sc_copy_asn1_entry(c_asn1_x509_cert_value_choice, asn1_x509_cert_value_choice);
-	sc_copy_asn1_entry(c_asn1_type_cert_attr, asn1_type_cert_attr);
-	sc_copy_asn1_entry(c_asn1_cert, asn1_cert);
-
-	sc_format_asn1_entry(asn1_cred_ident + 0, &id_type, NULL, 0);
-	sc_format_asn1_entry(asn1_cred_ident + 1, &id_value, &id_value_len, 0);
-	sc_format_asn1_entry(asn1_com_cert_attr + 0, &info.id, NULL, 0);
-	sc_format_asn1_entry(asn1_com_cert_attr + 1, &info.authority, NULL, 0);
-	sc_format_asn1_entry(asn1_com_cert_attr + 2, asn1_cred_ident, NULL, 0);
-	sc_format_asn1_entry(asn1_x509_cert_attr + 0, asn1_x509_cert_value_choice, NULL, 0);
-	sc_format_asn1_entry(asn1_x509_cert_value_choice + 0, &info.path, NULL, 0);
-	sc_format_asn1_entry(asn1_x509_cert_value_choice + 1, &der->value, &der->len, 0);
-	sc_format_asn1_entry(asn1_type_cert_attr + 0, asn1_x509_cert_attr, NULL, 0);
-	sc_format_asn1_entry(asn1_cert + 0, &cert_obj, NULL, 0);
-
 	/* Fill in defaults */
 	memset(&info, 0, sizeof(info));
 	info.authority = 0;
 
-	r = sc_asn1_decode(ctx, asn1_cert, *buf, *buflen, buf, buflen);
+	/* a direct value can stay in the DF content */
+	if (sc_pkcs15_can_borrow(p15card, *buf))
+		flags = SC_ASN1_BORROW;
+	r = sc_asn1_decode_compiled(ctx, c_asn1_compiled_cert, bases, flags, NULL,
+			*buf, *buflen, buf, buflen);
+	/* a borrowed value is not ours to free */
+	if (flags & SC_ASN1_BORROW)
+		der = NULL;
 	/* In case of error, trash the cert value (direct coding) */
-	if (r < 0 && der->value)
+	if (r < 0 && der && der->value)
 		free(der->value);
 	if (r == SC_ERROR_ASN1_END_OF_CONTENTS)
 		return r;
@@ -485,7 +552,8 @@ sc_pkcs15_decode_cdf_entry(struct sc_pkcs15_card *p15card, struct sc_pkcs15_obje
 
 	if (!p15card->app || !p15card->app->ddo.aid.len) {
 		if (!p15card->file_app) {
-			free(der->value);
+			if (der)
+				free(der->value);
 			return SC_ERROR_INTERNAL;
 		}
 		r = sc_pkcs15_make_absolute_path(&p15card->file_app->path, &info.path);
@@ -503,7 +571,8 @@ sc_pkcs15_decode_cdf_entry(struct sc_pkcs15_card *p15card, struct sc_pkcs15_obje
 			break;
 		case SC_PKCS15_CARD_OPTS_PRIV_CERT_IGNORE:
 			sc_log(ctx, "Ignoring certificate");
-			free(der->value);
+			if (der)
+				free(der->value);
 			return 0;
 	}
 
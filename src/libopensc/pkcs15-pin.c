@@ -754,6 +754,11 @@ void sc_pkcs15_pincache_add(struct sc_pkcs15_card *p15card, struct sc_pkcs15_obj
 		return;
 	}
 
+	/* the callers add a PIN that was just verified, changed or unblocked,
+	 * see sc_pkcs15_pincache_refresh() */
+	auth_info->verified_resets = p15card->card->reset_count;
+	auth_info->verified_transaction = p15card->card->transaction_count;
+
 	/* If the PIN protects an object with user consent, don't cache it */
 
 	obj = p15card->obj_list;
@@ -786,15 +791,15 @@ void sc_pkcs15_pincache_add(struct sc_pkcs15_card *p15card, struct sc_pkcs15_obj
 	sc_log(ctx, "PIN(%s) cached", pin_obj->label);
 }
 
-/* Validate the PIN code associated with an object */
-int
-sc_pkcs15_pincache_revalidate(struct sc_pkcs15_card *p15card, const sc_pkcs15_object_t *obj)
+/* Find the cached PIN that may be used to validate an object */
+static int
+pincache_find(struct sc_pkcs15_card *p15card, const sc_pkcs15_object_t *obj,
+		sc_pkcs15_object_t **pin_obj_out)
 {
 	struct sc_context *ctx = p15card->card->ctx;
 	sc_pkcs15_object_t *pin_obj;
 	int r;
 
-	LOG_FUNC_CALLED(ctx);
 	if (!p15card->opts.use_pin_cache)
 		return SC_ERROR_SECURITY_STATUS_NOT_SATISFIED;
 
@@ -823,6 +828,23 @@ sc_pkcs15_pincache_revalidate(struct sc_pkcs15_card *p15card, const sc_pkcs15_ob
 	if (!pin_obj->content.value || !pin_obj->content.len)
 		return SC_ERROR_SECURITY_STATUS_NOT_SATISFIED;
 
+	*pin_obj_out = pin_obj;
+	return SC_SUCCESS;
+}
+
+/* Validate the PIN code associated with an object */
+int
+sc_pkcs15_pincache_revalidate(struct sc_pkcs15_card *p15card, const sc_pkcs15_object_t *obj)
+{
+	struct sc_context *ctx = p15card->card->ctx;
+	sc_pkcs15_object_t *pin_obj;
+	int r;
+
+	LOG_FUNC_CALLED(ctx);
+	r = pincache_find(p15card, obj, &pin_obj);
+	if (r != SC_SUCCESS)
+		return r;
+
 	pin_obj->usage_counter++;
 	r = _sc_pkcs15_verify_pin(p15card, pin_obj, pin_obj->content.value, pin_obj->content.len);
 	if (r != SC_SUCCESS) {
@@ -836,6 +858,63 @@ sc_pkcs15_pincache_revalidate(struct sc_pkcs15_card *p15card, const sc_pkcs15_ob
 	LOG_FUNC_RETURN(ctx, SC_SUCCESS);
 }
 
+/*
+ * Validate the cached PIN of an object before the object is used, if the
+ * card is known to have lost the verification: because the card was reset
+ * since, or, with the pin_state_probe option, because the card says so
+ * after the reader was released to other applications in between.
+ * Must be called with the card locked. Returns 1 if the PIN was verified
+ * and 0 if the object should just be used.
+ */
+int
+sc_pkcs15_pincache_refresh(struct sc_pkcs15_card *p15card, const sc_pkcs15_object_t *obj)
+{
+	struct sc_card *card = p15card->card;
+	struct sc_context *ctx = card->ctx;
+	struct sc_pkcs15_auth_info *auth_info;
+	struct sc_pin_cmd_data data;
+	sc_pkcs15_object_t *pin_obj;
+	int r;
+
+	if (obj->auth_id.len == 0 || pincache_find(p15card, obj, &pin_obj) != SC_SUCCESS)
+		return 0;
+	auth_info = (struct sc_pkcs15_auth_info *)pin_obj->data;
+	if (auth_info->auth_type != SC_PKCS15_PIN_AUTH_TYPE_PIN)
+		return 0;
+
+	if (auth_info->verified_resets != card->reset_count) {
+		sc_log(ctx, "PIN(%s) lost by card reset", pin_obj->label);
+	} else if (auth_info->verified_transaction == card->transaction_count
+			|| !p15card->opts.pin_state_probe) {
+		return 0;
+	} else {
+		memset(&data, 0, sizeof(data));
+		data.cmd = SC_PIN_CMD_GET_INFO;
+		data.pin_type = auth_info->auth_method;
+		data.pin_reference = auth_info->attrs.pin.reference;
+		data.pin1.logged_in = SC_PIN_STATE_UNKNOWN;
+
+		SC_STATS_ADD(ctx, pin_state_probes, 1);
+		r = sc_pin_cmd(card, &data, NULL);
+		if (r == SC_ERROR_NOT_SUPPORTED) {
+			sc_log(ctx, "PIN state not available, probing disabled");
+			p15card->opts.pin_state_probe = 0;
+			return 0;
+		}
+		if (r != SC_SUCCESS || data.pin1.logged_in != SC_PIN_STATE_LOGGED_OUT) {
+			if (r == SC_SUCCESS && data.pin1.logged_in == SC_PIN_STATE_LOGGED_IN)
+				auth_info->verified_transaction = card->transaction_count;
+			return 0;
+		}
+		sc_log(ctx, "PIN(%s) lost while the reader was released", pin_obj->label);
+	}
+
+	if (sc_pkcs15_pincache_revalidate(p15card, obj) != SC_SUCCESS)
+		return 0;
+	SC_STATS_ADD(ctx, pin_verify_early, 1);
+	return 1;
+}
+
 void sc_pkcs15_pincache_clear(struct sc_pkcs15_card *p15card)
 {
 	struct sc_pkcs15_object *objs[32];
@@ -22,6 +22,7 @@
 #include "config.h"
 #endif
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -165,6 +166,144 @@ static const struct sc_asn1_entry c_asn1_prkey[C_ASN1_PRKEY_SIZE] = {
 };
 
 
+/*
+ * Compiled form of the templates above used to decode PrKDF entries.
+ * The outputs are relative to the bases set up in
+ * sc_pkcs15_decode_prkdf_entry().
+ */
+enum { PRKDF_BASE_OBJECT = SC_ASN1_BASE_P15_OBJECT, PRKDF_BASE_INFO, PRKDF_BASE_GOST_PARAMS };
+
+#define PRKDF_PRESENT_RSA		0x01
+#define PRKDF_PRESENT_ECC		0x02
+#define PRKDF_PRESENT_DSA		0x04
+#define PRKDF_PRESENT_GOSTR3410		0x08
+#define PRKDF_PRESENT_DSA_PROTECTED	0x10
+
+#define PRKDF_INFO(name, type, tag, flags, field) \
+	SC_ASN1_COMPILED_VALUE(name, type, tag, flags, PRKDF_BASE_INFO, \
+		offsetof(struct sc_pkcs15_prkey_info, field))
+
+static const struct sc_asn1_compiled c_asn1_compiled_supported_algorithms[] = {
+	{ "algorithmReference", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, SC_ASN1_OPTIONAL, NULL,
+		PRKDF_BASE_INFO, offsetof(struct sc_pkcs15_prkey_info, algo_refs), SC_ASN1_NO_OUTPUT, 0,
+		SC_MAX_SUPPORTED_ALGORITHMS, sizeof(unsigned int), 0 },
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_com_key_attr[] = {
+	PRKDF_INFO("iD", SC_ASN1_PKCS15_ID, SC_ASN1_TAG_OCTET_STRING, 0, id),
+	SC_ASN1_COMPILED_BUFFER("usage", SC_ASN1_BIT_FIELD, SC_ASN1_TAG_BIT_STRING, 0,
+		PRKDF_BASE_INFO, offsetof(struct sc_pkcs15_prkey_info, usage),
+		SC_ASN1_NO_OUTPUT, sizeof(unsigned int)),
+	PRKDF_INFO("native", SC_ASN1_BOOLEAN, SC_ASN1_TAG_BOOLEAN, SC_ASN1_OPTIONAL, native),
+	SC_ASN1_COMPILED_BUFFER("accessFlags", SC_ASN1_BIT_FIELD, SC_ASN1_TAG_BIT_STRING, SC_ASN1_OPTIONAL,
+		PRKDF_BASE_INFO, offsetof(struct sc_pkcs15_prkey_info, access_flags),
+		SC_ASN1_NO_OUTPUT, sizeof(unsigned int)),
+	PRKDF_INFO("keyReference", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, SC_ASN1_OPTIONAL, key_reference),
+	SC_ASN1_COMPILED_STRUCT("algReference", SC_ASN1_CONS | SC_ASN1_CTX | 1, SC_ASN1_OPTIONAL,
+		c_asn1_compiled_supported_algorithms),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_com_prkey_attr[] = {
+	SC_ASN1_COMPILED_BUFFER("subjectName", SC_ASN1_OCTET_STRING, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS,
+		SC_ASN1_EMPTY_ALLOWED | SC_ASN1_ALLOC | SC_ASN1_OPTIONAL,
+		PRKDF_BASE_INFO, offsetof(struct sc_pkcs15_prkey_info, subject.value),
+		offsetof(struct sc_pkcs15_prkey_info, subject.len), 0),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_rsakey_attr[] = {
+	PRKDF_INFO("value", SC_ASN1_PATH, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, SC_ASN1_EMPTY_ALLOWED, path),
+	PRKDF_INFO("modulusLength", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, 0, modulus_length),
+	SC_ASN1_COMPILED_VALUE("keyInfo", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, SC_ASN1_OPTIONAL,
+		PRKDF_BASE_INFO, SC_ASN1_NO_OUTPUT),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_prk_rsa_attr[] = {
+	SC_ASN1_COMPILED_STRUCT("privateRSAKeyAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0,
+		c_asn1_compiled_rsakey_attr),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_gostr3410key_attr[] = {
+	PRKDF_INFO("value", SC_ASN1_PATH, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0, path),
+	SC_ASN1_COMPILED_VALUE("params_r3410", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, 0,
+		PRKDF_BASE_GOST_PARAMS, 0 * sizeof(int)),
+	SC_ASN1_COMPILED_VALUE("params_r3411", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, SC_ASN1_OPTIONAL,
+		PRKDF_BASE_GOST_PARAMS, 1 * sizeof(int)),
+	SC_ASN1_COMPILED_VALUE("params_28147", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, SC_ASN1_OPTIONAL,
+		PRKDF_BASE_GOST_PARAMS, 2 * sizeof(int)),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_prk_gostr3410_attr[] = {
+	SC_ASN1_COMPILED_STRUCT("privateGOSTR3410KeyAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0,
+		c_asn1_compiled_gostr3410key_attr),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_dsakey_i_p_attr[] = {
+	{ "path", SC_ASN1_PATH, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0, NULL,
+		PRKDF_BASE_INFO, offsetof(struct sc_pkcs15_prkey_info, path), SC_ASN1_NO_OUTPUT, 0,
+		0, 0, PRKDF_PRESENT_DSA_PROTECTED },
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_dsakey_value_attr[] = {
+	PRKDF_INFO("path", SC_ASN1_PATH, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0, path),
+	SC_ASN1_COMPILED_STRUCT("pathProtected", SC_ASN1_CTX | 1 | SC_ASN1_CONS, 0,
+		c_asn1_compiled_dsakey_i_p_attr),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_dsakey_attr[] = {
+	SC_ASN1_COMPILED_CHOICE("value", 0, c_asn1_compiled_dsakey_value_attr),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_prk_dsa_attr[] = {
+	SC_ASN1_COMPILED_STRUCT("privateDSAKeyAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0,
+		c_asn1_compiled_dsakey_attr),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_ecckey_attr[] = {
+	PRKDF_INFO("value", SC_ASN1_PATH, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, SC_ASN1_EMPTY_ALLOWED, path),
+	PRKDF_INFO("fieldSize", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, SC_ASN1_OPTIONAL, field_length),
+	SC_ASN1_COMPILED_VALUE("keyInfo", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, SC_ASN1_OPTIONAL,
+		PRKDF_BASE_INFO, SC_ASN1_NO_OUTPUT),
+	SC_ASN1_COMPILED_END
+};
+static const struct sc_asn1_compiled c_asn1_compiled_prk_ecc_attr[] = {
+	SC_ASN1_COMPILED_STRUCT("privateECCKeyAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0,
+		c_asn1_compiled_ecckey_attr),
+	SC_ASN1_COMPILED_END
+};
+
+#define PRKDF_OBJECT(type_attr) { \
+	SC_ASN1_COMPILED_STRUCT("commonObjectAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0, \
+		sc_asn1_compiled_com_obj_attr), \
+	SC_ASN1_COMPILED_STRUCT("commonKeyAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0, \
+		c_asn1_compiled_com_key_attr), \
+	SC_ASN1_COMPILED_STRUCT("commonPrivateKeyAttributes", SC_ASN1_CTX | 0 | SC_ASN1_CONS, SC_ASN1_OPTIONAL, \
+		c_asn1_compiled_com_prkey_attr), \
+	SC_ASN1_COMPILED_STRUCT("typeAttributes", SC_ASN1_CTX | 1 | SC_ASN1_CONS, 0, \
+		type_attr), \
+	SC_ASN1_COMPILED_END \
+}
+static const struct sc_asn1_compiled c_asn1_compiled_rsa_prkey_obj[] = PRKDF_OBJECT(c_asn1_compiled_prk_rsa_attr);
+static const struct sc_asn1_compiled c_asn1_compiled_ecc_prkey_obj[] = PRKDF_OBJECT(c_asn1_compiled_prk_ecc_attr);
+static const struct sc_asn1_compiled c_asn1_compiled_dsa_prkey_obj[] = PRKDF_OBJECT(c_asn1_compiled_prk_dsa_attr);
+static const struct sc_asn1_compiled c_asn1_compiled_gostr3410_prkey_obj[] = PRKDF_OBJECT(c_asn1_compiled_prk_gostr3410_attr);
+
+static const struct sc_asn1_compiled c_asn1_compiled_prkey[] = {
+	{ "privateRSAKey", SC_ASN1_STRUCT, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, SC_ASN1_OPTIONAL,
+		c_asn1_compiled_rsa_prkey_obj, 0, SC_ASN1_NO_OUTPUT, SC_ASN1_NO_OUTPUT, 0, 0, 0,
+		PRKDF_PRESENT_RSA },
+	{ "privateECCKey", SC_ASN1_STRUCT, 0 | SC_ASN1_CTX | SC_ASN1_CONS, SC_ASN1_OPTIONAL,
+		c_asn1_compiled_ecc_prkey_obj, 0, SC_ASN1_NO_OUTPUT, SC_ASN1_NO_OUTPUT, 0, 0, 0,
+		PRKDF_PRESENT_ECC },
+	{ "privateDSAKey", SC_ASN1_STRUCT, 2 | SC_ASN1_CTX | SC_ASN1_CONS, SC_ASN1_OPTIONAL,
+		c_asn1_compiled_dsa_prkey_obj, 0, SC_ASN1_NO_OUTPUT, SC_ASN1_NO_OUTPUT, 0, 0, 0,
+		PRKDF_PRESENT_DSA },
+	{ "privateGOSTR3410Key", SC_ASN1_STRUCT, 4 | SC_ASN1_CTX | SC_ASN1_CONS, SC_ASN1_OPTIONAL,
+		c_asn1_compiled_gostr3410_prkey_obj, 0, SC_ASN1_NO_OUTPUT, SC_ASN1_NO_OUTPUT, 0, 0, 0,
+		PRKDF_PRESENT_GOSTR3410 },
+	SC_ASN1_COMPILED_END
+};
+
+
 int sc_pkcs15_decode_prkdf_entry(struct sc_pkcs15_card *p15card,
 				 struct sc_pkcs15_object *obj,
 				 const u8 ** buf, size_t *buflen)
@@ -173,81 +312,8 @@ int sc_pkcs15_decode_prkdf_entry(struct sc_pkcs15_card *p15card,
 	struct sc_pkcs15_prkey_info info;
 	int r, i, gostr3410_params[3];
 	struct sc_pkcs15_keyinfo_gostparams *keyinfo_gostparams;
-	size_t usage_len = sizeof(info.usage);
-	size_t af_len = sizeof(info.access_flags);
-	struct sc_asn1_entry asn1_com_key_attr[C_ASN1_COM_KEY_ATTR_SIZE];
-	struct sc_asn1_entry asn1_com_prkey_attr[C_ASN1_COM_PRKEY_ATTR_SIZE];
-	struct sc_asn1_entry asn1_rsakey_attr[C_ASN1_RSAKEY_ATTR_SIZE];
-	struct sc_asn1_entry asn1_prk_rsa_attr[C_ASN1_PRK_RSA_ATTR_SIZE];
-	struct sc_asn1_entry asn1_dsakey_attr[C_ASN1_DSAKEY_ATTR_SIZE];
-	struct sc_asn1_entry asn1_prk_dsa_attr[C_ASN1_PRK_DSA_ATTR_SIZE];
-	struct sc_asn1_entry asn1_dsakey_i_p_attr[C_ASN1_DSAKEY_I_P_ATTR_SIZE];
-	struct sc_asn1_entry asn1_dsakey_value_attr[C_ASN1_DSAKEY_VALUE_ATTR_SIZE];
-	struct sc_asn1_entry asn1_gostr3410key_attr[C_ASN1_GOSTR3410KEY_ATTR_SIZE];
-	struct sc_asn1_entry asn1_prk_gostr3410_attr[C_ASN1_PRK_GOSTR3410_ATTR_SIZE];
-	struct sc_asn1_entry asn1_ecckey_attr[C_ASN1_ECCKEY_ATTR];
-	struct sc_asn1_entry asn1_prk_ecc_attr[C_ASN1_PRK_ECC_ATTR];
-	struct sc_asn1_entry asn1_prkey[C_ASN1_PRKEY_SIZE];
-	struct sc_asn1_entry asn1_supported_algorithms[C_ASN1_SUPPORTED_ALGORITHMS_SIZE];
-	struct sc_asn1_pkcs15_object rsa_prkey_obj = {obj, asn1_com_key_attr, asn1_com_prkey_attr, asn1_prk_rsa_attr};
-	struct sc_asn1_pkcs15_object dsa_prkey_obj = {obj, asn1_com_key_attr, asn1_com_prkey_attr, asn1_prk_dsa_attr};
-	struct sc_asn1_pkcs15_object gostr3410_prkey_obj = {obj, asn1_com_key_attr, asn1_com_prkey_attr, asn1_prk_gostr3410_attr};
-	struct sc_asn1_pkcs15_object ecc_prkey_obj = { obj, asn1_com_key_attr, asn1_com_prkey_attr, asn1_prk_ecc_attr };
-
-	sc_copy_asn1_entry(c_asn1_prkey, asn1_prkey);
-	sc_copy_asn1_entry(c_asn1_supported_algorithms, asn1_supported_algorithms);
-
-	sc_copy_asn1_entry(c_asn1_prk_rsa_attr, asn1_prk_rsa_attr);
-	sc_copy_asn1_entry(c_asn1_rsakey_attr, asn1_rsakey_attr);
-	sc_copy_asn1_entry(c_asn1_prk_dsa_attr, asn1_prk_dsa_attr);
-	sc_copy_asn1_entry(c_asn1_dsakey_attr, asn1_dsakey_attr);
-	sc_copy_asn1_entry(c_asn1_dsakey_value_attr, asn1_dsakey_value_attr);
-	sc_copy_asn1_entry(c_asn1_dsakey_i_p_attr, asn1_dsakey_i_p_attr);
-	sc_copy_asn1_entry(c_asn1_prk_gostr3410_attr, asn1_prk_gostr3410_attr);
-	sc_copy_asn1_entry(c_asn1_gostr3410key_attr, asn1_gostr3410key_attr);
-	sc_copy_asn1_entry(c_asn1_prk_ecc_attr, asn1_prk_ecc_attr);
-	sc_copy_asn1_entry(c_asn1_ecckey_attr, asn1_ecckey_attr);
-
-	sc_copy_asn1_entry(c_asn1_com_prkey_attr, asn1_com_prkey_attr);
-	sc_copy_asn1_entry(c_asn1_com_key_attr, asn1_com_key_attr);
-
-	sc_format_asn1_entry(asn1_prkey + 0, &rsa_prkey_obj, NULL, 0);
-	sc_format_asn1_entry(asn1_prkey + 1, &ecc_prkey_obj, NULL, 0);
-	sc_format_asn1_entry(asn1_prkey + 2, &dsa_prkey_obj, NULL, 0);
-	sc_format_asn1_entry(asn1_prkey + 3, &gostr3410_prkey_obj, NULL, 0);
-
-	sc_format_asn1_entry(asn1_prk_rsa_attr + 0, asn1_rsakey_attr, NULL, 0);
-	sc_format_asn1_entry(asn1_prk_dsa_attr + 0, asn1_dsakey_attr, NULL, 0);
-	sc_format_asn1_entry(asn1_prk_gostr3410_attr + 0, asn1_gostr3410key_attr, NULL, 0);
-	sc_format_asn1_entry(asn1_prk_ecc_attr + 0, asn1_ecckey_attr, NULL, 0);
-
-	sc_format_asn1_entry(asn1_rsakey_attr + 0, &info.path, NULL, 0);
-	sc_format_asn1_entry(asn1_rsakey_attr + 1, &info.modulus_length, NULL, 0);
-
-	sc_format_asn1_entry(asn1_dsakey_attr + 0, asn1_dsakey_value_attr, NULL, 0);
-	sc_format_asn1_entry(asn1_dsakey_value_attr + 0, &info.path, NULL, 0);
-	sc_format_asn1_entry(asn1_dsakey_value_attr + 1, asn1_dsakey_i_p_attr, NULL, 0);
-	sc_format_asn1_entry(asn1_dsakey_i_p_attr + 0, &info.path, NULL, 0);
-
-	sc_format_asn1_entry(asn1_gostr3410key_attr + 0, &info.path, NULL, 0);
-	sc_format_asn1_entry(asn1_gostr3410key_attr + 1, &gostr3410_params[0], NULL, 0);
-	sc_format_asn1_entry(asn1_gostr3410key_attr + 2, &gostr3410_params[1], NULL, 0);
-	sc_format_asn1_entry(asn1_gostr3410key_attr + 3, &gostr3410_params[2], NULL, 0);
-
-	sc_format_asn1_entry(asn1_ecckey_attr + 0, &info.path, NULL, 0);
-	sc_format_asn1_entry(asn1_ecckey_attr + 1, &info.field_length, NULL, 0);
-
-	sc_format_asn1_entry(asn1_com_key_attr + 0, &info.id, NULL, 0);
-	sc_format_asn1_entry(asn1_com_key_attr + 1, &info.usage, &usage_len, 0);
-	sc_format_asn1_entry(asn1_com_key_attr + 2, &info.native, NULL, 0);
-	sc_format_asn1_entry(asn1_com_key_attr + 3, &info.access_flags, &af_len, 0);
-	sc_format_asn1_entry(asn1_com_key_attr + 4, &info.key_reference, NULL, 0);
-
-	for (i=0; i<SC_MAX_SUPPORTED_ALGORITHMS && (asn1_supported_algorithms + i)->name; i++)
-		sc_format_asn1_entry(asn1_supported_algorithms + i, &info.algo_refs[i], NULL, 0);
-	sc_format_asn1_entry(asn1_com_key_attr + 5, asn1_supported_algorithms, NULL, 0);
-
-	sc_format_asn1_entry(asn1_com_prkey_attr + 0, &info.subject.value, &info.subject.len, 0);
+	void *bases[] = { obj, &info, gostr3410_params };
+	unsigned int present = 0, flags = 0;
 
 	/* Fill in defaults */
 	memset(&info, 0, sizeof(info));
@@ -255,23 +321,26 @@ int sc_pkcs15_decode_prkdf_entry(struct sc_pkcs15_card *p15card,
 	info.native = 1;
 	memset(gostr3410_params, 0, sizeof(gostr3410_params));
 
-	r = sc_asn1_decode_choice(ctx, asn1_prkey, *buf, *buflen, buf, buflen);
+	if (sc_pkcs15_can_borrow(p15card, *buf))
+		flags = SC_ASN1_BORROW;
+	r = sc_asn1_decode_compiled_choice(ctx, c_asn1_compiled_prkey, bases, flags, &present,
+			*buf, *buflen, buf, buflen);
 	if (r == SC_ERROR_ASN1_END_OF_CONTENTS)
 		goto err;
 	LOG_TEST_GOTO_ERR(ctx, r, "PrKey DF ASN.1 decoding failed");
-	if (asn1_prkey[0].flags & SC_ASN1_PRESENT) {
+	if (present & PRKDF_PRESENT_RSA) {
 		obj->type = SC_PKCS15_TYPE_PRKEY_RSA;
 	}
-	else if (asn1_prkey[1].flags & SC_ASN1_PRESENT) {
+	else if (present & PRKDF_PRESENT_ECC) {
 		obj->type = SC_PKCS15_TYPE_PRKEY_EC;
 	}
-	else if (asn1_prkey[2].flags & SC_ASN1_PRESENT) {
+	else if (present & PRKDF_PRESENT_DSA) {
 		obj->type = SC_PKCS15_TYPE_PRKEY_DSA;
 		/* If the value was indirect-protected, mark the path */
-		if (asn1_dsakey_i_p_attr[0].flags & SC_ASN1_PRESENT)
+		if (present & PRKDF_PRESENT_DSA_PROTECTED)
 			info.path.type = SC_PATH_TYPE_PATH_PROT;
 	}
-	else if (asn1_prkey[3].flags & SC_ASN1_PRESENT) {
+	else if (present & PRKDF_PRESENT_GOSTR3410) {
 		/* FIXME proper handling of gost parameters without the need of
 		 * allocating data here. this would also make sc_pkcs15_free_key_params
 		 * obsolete */
@@ -360,7 +429,8 @@ int sc_pkcs15_decode_prkdf_entry(struct sc_pkcs15_card *p15card,
 err:
 	if (r < 0) {
 		/* This might have allocated something. If so, clear it now */
-		free(info.subject.value);
+		if (!(flags & SC_ASN1_BORROW))
+			free(info.subject.value);
 		sc_pkcs15_free_key_params(&info.params);
 	}
 
@@ -263,6 +263,8 @@ int sc_pkcs15_decode_pukdf_entry(struct sc_pkcs15_card *p15card,
 	sc_copy_asn1_entry(c_asn1_com_key_attr, asn1_com_key_attr);
 
 	sc_format_asn1_entry(asn1_com_pubkey_attr + 0, &info->subject.value, &info->subject.len, 0);
+	if (sc_pkcs15_can_borrow(p15card, *buf))
+		asn1_com_pubkey_attr[0].flags |= SC_ASN1_BORROW;
 
 	sc_format_asn1_entry(asn1_pubkey_choice + 0, &rsakey_obj, NULL, 0);
 	sc_format_asn1_entry(asn1_pubkey_choice + 1, &dsakey_obj, NULL, 0);
@@ -371,6 +373,8 @@ int sc_pkcs15_decode_pukdf_entry(struct sc_pkcs15_card *p15card,
 
 err:
 	if (r < 0) {
+		if (info && (asn1_com_pubkey_attr[0].flags & SC_ASN1_BORROW))
+			info->subject.value = NULL;
 		sc_pkcs15_free_pubkey_info(info);
 	}
 
@@ -133,25 +133,36 @@ static int use_key(struct sc_pkcs15_card *p15card,
 {
 	int r = SC_SUCCESS;
 	int revalidated_cached_pin = 0;
+	int early_verified;
+	unsigned int commands = 0;
 	sc_path_t path;
 	LOG_TEST_RET(p15card->card->ctx, get_file_path(obj, &path), "Failed to get key file path.");
 
 	r = sc_lock(p15card->card);
 	LOG_TEST_RET(p15card->card->ctx, r, "sc_lock() failed");
 
+	/* rather verify a PIN that is known to be lost now than after the
+	 * card refused the operation */
+	early_verified = sc_pkcs15_pincache_refresh(p15card, obj);
+
 	do {
 		if (path.len != 0 || path.aid.len != 0) {
 			r = select_key_file(p15card, obj, senv);
+			commands++;
 			if (r < 0) {
 				sc_log(p15card->card->ctx,
 						"Unable to select private key file");
 			}
 		}
-		if (r == SC_SUCCESS)
+		if (r == SC_SUCCESS) {
 			r = sc_set_security_env(p15card->card, senv, 0);
+			commands++;
+		}
 
-		if (r == SC_SUCCESS)
+		if (r == SC_SUCCESS) {
 			r = card_command(p15card->card, in, inlen, out, outlen);
+			commands++;
+		}
 
 		if (revalidated_cached_pin)
 			/* only re-validate once */
@@ -164,6 +175,11 @@ static int use_key(struct sc_pkcs15_card *p15card,
 		}
 	} while (revalidated_cached_pin);
 
+	/* without the early verification, the commands of this pass would
+	 * have been sent twice, once failing with the lost PIN */
+	if (early_verified && r >= 0 && !revalidated_cached_pin)
+		SC_STATS_ADD(p15card->card->ctx, pin_apdus_saved, commands);
+
 	sc_unlock(p15card->card);
 
 	return r;
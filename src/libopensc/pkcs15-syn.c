@@ -400,6 +400,7 @@ int sc_pkcs15emu_object_add(sc_pkcs15_card_t *p15card, unsigned int type,
 
 	memcpy(obj, in_obj, sizeof(*obj));
 	obj->type = type;
+	obj->df_buffer = NULL;
 
 	switch (type & SC_PKCS15_TYPE_CLASS_MASK) {
 	case SC_PKCS15_TYPE_AUTH:
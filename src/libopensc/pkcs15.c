@@ -1217,6 +1217,9 @@ sc_pkcs15_bind(struct sc_card *card, struct sc_aid *aid,
 	p15card->opts.use_pin_cache = 1;
 	p15card->opts.pin_cache_counter = 10;
 	p15card->opts.pin_cache_ignore_user_consent = 0;
+	p15card->opts.use_cert_cache = 1;
+	p15card->opts.prefetch = 0;
+	p15card->opts.pin_state_probe = 0;
 	if(0 == strcmp(ctx->app_name, "tokend")) {
 		private_certificate = "ignore";
 		p15card->opts.private_certificate = SC_PKCS15_CARD_OPTS_PRIV_CERT_IGNORE;
@@ -1233,6 +1236,9 @@ sc_pkcs15_bind(struct sc_card *card, struct sc_aid *aid,
 		p15card->opts.pin_cache_ignore_user_consent = scconf_get_bool(conf_block, "pin_cache_ignore_user_consent",
 				p15card->opts.pin_cache_ignore_user_consent);
 		private_certificate = scconf_get_str(conf_block, "private_certificate", private_certificate);
+		p15card->opts.use_cert_cache = scconf_get_bool(conf_block, "use_certificate_cache", p15card->opts.use_cert_cache);
+		p15card->opts.prefetch = scconf_get_bool(conf_block, "prefetch", p15card->opts.prefetch);
+		p15card->opts.pin_state_probe = scconf_get_bool(conf_block, "pin_state_probe", p15card->opts.pin_state_probe);
 	}
 	if (0 == strcmp(private_certificate, "protect")) {
 		p15card->opts.private_certificate = SC_PKCS15_CARD_OPTS_PRIV_CERT_PROTECT;
@@ -1241,9 +1247,10 @@ sc_pkcs15_bind(struct sc_card *card, struct sc_aid *aid,
 	} else if (0 == strcmp(private_certificate, "declassify")) {
 		p15card->opts.private_certificate = SC_PKCS15_CARD_OPTS_PRIV_CERT_DECLASSIFY;
 	}
-	sc_log(ctx, "PKCS#15 options: use_file_cache=%d use_pin_cache=%d pin_cache_counter=%d pin_cache_ignore_user_consent=%d private_certificate=%d",
+	sc_log(ctx, "PKCS#15 options: use_file_cache=%d use_pin_cache=%d pin_cache_counter=%d pin_cache_ignore_user_consent=%d private_certificate=%d use_cert_cache=%d prefetch=%d pin_state_probe=%d",
 			p15card->opts.use_file_cache, p15card->opts.use_pin_cache,p15card->opts.pin_cache_counter,
-			p15card->opts.pin_cache_ignore_user_consent, p15card->opts.private_certificate);
+			p15card->opts.pin_cache_ignore_user_consent, p15card->opts.private_certificate,
+			p15card->opts.use_cert_cache, p15card->opts.prefetch, p15card->opts.pin_state_probe);
 
 	r = sc_lock(card);
 	if (r) {
@@ -1278,6 +1285,12 @@ sc_pkcs15_bind(struct sc_card *card, struct sc_aid *aid,
 			goto error;
 	}
 done:
+	if (p15card->opts.prefetch) {
+		/* best effort, the objects are read on demand otherwise */
+		r = sc_pkcs15_prefetch(p15card);
+		if (r < 0)
+			sc_log(ctx, "Prefetch failed: %s", sc_strerror(r));
+	}
 	*p15card_out = p15card;
 	sc_unlock(card);
 	LOG_FUNC_RETURN(ctx, SC_SUCCESS);
@@ -1885,11 +1898,72 @@ sc_pkcs15_remove_objects(struct sc_pkcs15_card *p15card)
 }
 
 
+/* The value an object may borrow from the DF content it was decoded from */
+static u8 **
+df_entry_value(struct sc_pkcs15_object *obj)
+{
+	if (obj->data == NULL)
+		return NULL;
+	switch (obj->type & SC_PKCS15_TYPE_CLASS_MASK) {
+	case SC_PKCS15_TYPE_PRKEY:
+		return &((struct sc_pkcs15_prkey_info *) obj->data)->subject.value;
+	case SC_PKCS15_TYPE_PUBKEY:
+		return &((struct sc_pkcs15_pubkey_info *) obj->data)->subject.value;
+	case SC_PKCS15_TYPE_CERT:
+		return &((struct sc_pkcs15_cert_info *) obj->data)->value.value;
+	}
+	return NULL;
+}
+
+
+static int
+df_buffer_owns(const struct sc_pkcs15_df_buffer *buffer, const u8 *value)
+{
+	return buffer != NULL && value != NULL
+		&& value >= buffer->value && value < buffer->value + buffer->len;
+}
+
+
+static void
+df_buffer_release(struct sc_pkcs15_df_buffer *buffer)
+{
+	if (buffer == NULL || --buffer->refs > 0)
+		return;
+	free(buffer->value);
+	free(buffer);
+}
+
+
+int
+sc_pkcs15_can_borrow(struct sc_pkcs15_card *p15card, const u8 *in)
+{
+	return p15card != NULL && df_buffer_owns(p15card->parsing_df, in);
+}
+
+
+void
+sc_pkcs15_free_object_value(struct sc_pkcs15_object *obj, u8 **value)
+{
+	if (obj == NULL || value == NULL)
+		return;
+	if (!df_buffer_owns(obj->df_buffer, *value))
+		free(*value);
+	*value = NULL;
+}
+
+
 void
 sc_pkcs15_free_object(struct sc_pkcs15_object *obj)
 {
+	u8 **value;
+
 	if (!obj)
 		return;
+	/* the DF content is released below, not with the object data */
+	value = df_entry_value(obj);
+	if (value != NULL && df_buffer_owns(obj->df_buffer, *value))
+		*value = NULL;
+
 	switch (obj->type & SC_PKCS15_TYPE_CLASS_MASK) {
 	case SC_PKCS15_TYPE_PRKEY:
 		sc_pkcs15_free_prkey_info((sc_pkcs15_prkey_info_t *)obj->data);
@@ -1911,6 +1985,7 @@ sc_pkcs15_free_object(struct sc_pkcs15_object *obj)
 	}
 
 	sc_pkcs15_free_object_content(obj);
+	df_buffer_release(obj->df_buffer);
 
 	free(obj);
 }
@@ -1946,8 +2021,19 @@ static void
 sc_pkcs15_remove_dfs(struct sc_pkcs15_card *p15card)
 {
 	struct sc_pkcs15_df *cur = NULL, *next = NULL;
+	struct sc_pkcs15_df_buffer *buffer, *next_buffer;
 
-	if (!p15card || !p15card->df_list)
+	if (!p15card)
+		return;
+
+	/* objects still borrowing from the DF contents hold their own reference */
+	for (buffer = p15card->df_buffers; buffer; buffer = next_buffer) {
+		next_buffer = buffer->next;
+		df_buffer_release(buffer);
+	}
+	p15card->df_buffers = NULL;
+
+	if (!p15card->df_list)
 		return;
 
 	for (cur = p15card->df_list; cur; cur = next)   {
@@ -2040,6 +2126,8 @@ sc_pkcs15_parse_df(struct sc_pkcs15_card *p15card, struct sc_pkcs15_df *df)
 	size_t bufsize;
 	int r;
 	struct sc_pkcs15_object *obj = NULL;
+	struct sc_pkcs15_df_buffer *buffer;
+	u8 **value;
 	int (* func)(struct sc_pkcs15_card *, struct sc_pkcs15_object *,
 		     const u8 **nbuf, size_t *nbufsize) = NULL;
 
@@ -2077,6 +2165,18 @@ sc_pkcs15_parse_df(struct sc_pkcs15_card *p15card, struct sc_pkcs15_df *df)
 	r = sc_pkcs15_read_file(p15card, &df->path, &buf, &bufsize);
 	LOG_TEST_RET(ctx, r, "pkcs15 read file failed");
 
+	/* The decoders reference the values of the entries in the DF
+	 * content instead of copying them out of it */
+	buffer = calloc(1, sizeof(struct sc_pkcs15_df_buffer));
+	if (buffer == NULL) {
+		free(buf);
+		LOG_FUNC_RETURN(ctx, SC_ERROR_OUT_OF_MEMORY);
+	}
+	buffer->value = buf;
+	buffer->len = bufsize;
+	buffer->refs = 1;
+	p15card->parsing_df = buffer;
+
 	p = buf;
 	while (bufsize && *p != 0x00) {
 
@@ -2096,12 +2196,16 @@ sc_pkcs15_parse_df(struct sc_pkcs15_card *p15card, struct sc_pkcs15_df *df)
 			goto ret;
 		}
 
+		value = df_entry_value(obj);
+		if (value != NULL && df_buffer_owns(buffer, *value)) {
+			obj->df_buffer = buffer;
+			buffer->refs++;
+		}
+
 		obj->df = df;
 		r = sc_pkcs15_add_object(p15card, obj);
 		if (r) {
-			if (obj->data)
-				free(obj->data);
-			free(obj);
+			sc_pkcs15_free_object(obj);
 			sc_log(ctx, "%s: Error adding object", sc_strerror(r));
 			goto ret;
 		}
@@ -2110,12 +2214,104 @@ sc_pkcs15_parse_df(struct sc_pkcs15_card *p15card, struct sc_pkcs15_df *df)
 	if (r > 0)
 		r = 0;
 ret:
+	p15card->parsing_df = NULL;
 	df->enumerated = 1;
-	free(buf);
+	if (buffer->refs > 1) {
+		buffer->next = p15card->df_buffers;
+		p15card->df_buffers = buffer;
+	} else {
+		df_buffer_release(buffer);
+	}
 	LOG_FUNC_RETURN(ctx, r);
 }
 
 
+static int
+cert_path_order(const void *a, const void *b)
+{
+	const struct sc_pkcs15_cert_info *ia = (*(struct sc_pkcs15_object * const *) a)->data;
+	const struct sc_pkcs15_cert_info *ib = (*(struct sc_pkcs15_object * const *) b)->data;
+	size_t len = ia->path.len < ib->path.len ? ia->path.len : ib->path.len;
+	int r;
+
+	r = memcmp(ia->path.aid.value, ib->path.aid.value, sizeof(ia->path.aid.value));
+	if (r == 0)
+		r = memcmp(ia->path.value, ib->path.value, len);
+	if (r == 0)
+		r = (int) ia->path.len - (int) ib->path.len;
+	return r;
+}
+
+
+/*
+ * Eagerly enumerate all DFs and read the content of all public certificates
+ * while holding the card lock once, instead of doing it lazily on first
+ * access. The certificates are read in path order, so that files sharing
+ * a parent DF are read one after another.
+ */
+int
+sc_pkcs15_prefetch(struct sc_pkcs15_card *p15card)
+{
+	struct sc_context *ctx;
+	struct sc_pkcs15_df *df;
+	struct sc_pkcs15_object **objs = NULL;
+	int r, i, count;
+
+	if (p15card == NULL || p15card->card == NULL)
+		return SC_ERROR_INVALID_ARGUMENTS;
+	ctx = p15card->card->ctx;
+	LOG_FUNC_CALLED(ctx);
+
+	r = sc_lock(p15card->card);
+	LOG_TEST_RET(ctx, r, "sc_lock() failed");
+
+	for (df = p15card->df_list; df != NULL; df = df->next) {
+		if (df->enumerated)
+			continue;
+		if (p15card->ops.parse_df)
+			r = p15card->ops.parse_df(p15card, df);
+		else
+			r = sc_pkcs15_parse_df(p15card, df);
+		if (r != SC_SUCCESS)
+			sc_log(ctx, "Failed to prefetch DF %s: %s", sc_print_path(&df->path), sc_strerror(r));
+	}
+
+	count = sc_pkcs15_get_objects(p15card, SC_PKCS15_TYPE_CERT_X509, NULL, 0);
+	if (count > 0)
+		objs = calloc(count, sizeof(struct sc_pkcs15_object *));
+	if (objs != NULL)
+		count = sc_pkcs15_get_objects(p15card, SC_PKCS15_TYPE_CERT_X509, objs, count);
+	else
+		count = 0;
+	if (count > 1)
+		qsort(objs, count, sizeof(objs[0]), cert_path_order);
+
+	for (i = 0; i < count; i++) {
+		struct sc_pkcs15_cert_info *info = (struct sc_pkcs15_cert_info *) objs[i]->data;
+		unsigned char *buf = NULL;
+		size_t buflen = 0;
+
+		/* private certificates need a PIN, read them on demand */
+		if (objs[i]->flags & SC_PKCS15_CO_FLAG_PRIVATE)
+			continue;
+		if (info->value.value || !info->path.len)
+			continue;
+
+		r = sc_pkcs15_read_file(p15card, &info->path, &buf, &buflen);
+		if (r != SC_SUCCESS) {
+			sc_log(ctx, "Failed to prefetch certificate %s: %s", sc_print_path(&info->path), sc_strerror(r));
+			continue;
+		}
+		info->value.value = buf;
+		info->value.len = buflen;
+	}
+	free(objs);
+
+	sc_unlock(p15card->card);
+	LOG_FUNC_RETURN(ctx, SC_SUCCESS);
+}
+
+
 int
 sc_pkcs15_add_unusedspace(struct sc_pkcs15_card *p15card, const struct sc_path *path,
 		const struct sc_pkcs15_id *auth_id)
@@ -2334,6 +2530,10 @@ sc_pkcs15_read_file(struct sc_pkcs15_card *p15card, const struct sc_path *in_pat
 	r = -1; /* file state: not in cache */
 	if (p15card->opts.use_file_cache) {
 		r = sc_pkcs15_read_cached_file(p15card, in_path, &data, &len);
+		if (r == SC_SUCCESS)
+			SC_STATS_ADD(ctx, file_cache_hits, 1);
+		else
+			SC_STATS_ADD(ctx, file_cache_misses, 1);
 
 		if (!r && in_path->aid.len > 0 && in_path->len >= 2)   {
 			struct sc_path parent = *in_path;
@@ -2465,9 +2665,11 @@ sc_pkcs15_format_id(const char *str, struct sc_pkcs15_id *id)
 const char *
 sc_pkcs15_print_id(const struct sc_pkcs15_id *id)
 {
-	static char buffer[256];
+	static SC_THREAD_LOCAL char buffers[SC_FORMAT_BUFFERS][256];
+	static SC_THREAD_LOCAL unsigned int next;
+	char *buffer = buffers[next++ % SC_FORMAT_BUFFERS];
 
-	sc_bin_to_hex(id->value, id->len, buffer, sizeof(buffer), '\0');
+	sc_bin_to_hex(id->value, id->len, buffer, sizeof(buffers[0]), '\0');
 	return buffer;
 }
 
@@ -131,6 +131,10 @@ struct sc_pkcs15_auth_info {
 
 	int tries_left, max_tries, logged_in;
 	int max_unlocks;
+
+	/* card->reset_count and card->transaction_count when the cached
+	 * PIN was last verified, see sc_pkcs15_pincache_refresh() */
+	unsigned int verified_resets, verified_transaction;
  };
 typedef struct sc_pkcs15_auth_info sc_pkcs15_auth_info_t;
 
@@ -472,6 +476,16 @@ typedef struct sc_pkcs15_skey_info sc_pkcs15_skey_info_t;
 #define SC_PKCS15_SEARCH_CLASS_DATA		0x0020U
 #define SC_PKCS15_SEARCH_CLASS_AUTH		0x0040U
 
+/* Content of a DF that the objects decoded from it reference instead of
+ * holding copies of their values. It is kept alive by the card and by
+ * every object that borrows from it. */
+struct sc_pkcs15_df_buffer {
+	u8 *value;
+	size_t len;
+	unsigned int refs;
+	struct sc_pkcs15_df_buffer *next;
+};
+
 struct sc_pkcs15_object {
 	unsigned int type;
 	/* CommonObjectAttributes */
@@ -495,6 +509,8 @@ struct sc_pkcs15_object {
 	struct sc_pkcs15_der content;
 
 	int session_object;	/* used internally. if nonzero, object is a session object. */
+
+	struct sc_pkcs15_df_buffer *df_buffer;	/* DF content the values are borrowed from */
 };
 typedef struct sc_pkcs15_object sc_pkcs15_object_t;
 
@@ -594,6 +610,9 @@ typedef struct sc_pkcs15_card {
 		int pin_cache_counter;
 		int pin_cache_ignore_user_consent;
 		int private_certificate;
+		int use_cert_cache;
+		int prefetch;
+		int pin_state_probe;
 	} opts;
 
 	unsigned int magic;
@@ -603,6 +622,9 @@ typedef struct sc_pkcs15_card {
 
 	struct sc_pkcs15_operations ops;
 
+	/* DF contents referenced by the objects, and the one being parsed */
+	struct sc_pkcs15_df_buffer *df_buffers;
+	struct sc_pkcs15_df_buffer *parsing_df;
 } sc_pkcs15_card_t;
 
 /* flags suitable for sc_pkcs15_tokeninfo_t */
@@ -747,6 +769,12 @@ int sc_pkcs15_read_certificate(struct sc_pkcs15_card *card,
 			       const struct sc_pkcs15_cert_info *info,
 			       struct sc_pkcs15_cert **cert);
 void sc_pkcs15_free_certificate(struct sc_pkcs15_cert *cert);
+void sc_pkcs15_free_cert_cache(struct sc_context *ctx);
+int sc_pkcs15_cert_cache_enabled(struct sc_context *ctx);
+int sc_pkcs15_cert_cache_get(struct sc_context *ctx, const struct sc_pkcs15_der *der,
+			     struct sc_pkcs15_cert **out);
+void sc_pkcs15_cert_cache_put(struct sc_context *ctx, const struct sc_pkcs15_der *der,
+			      const struct sc_pkcs15_cert *cert);
 int sc_pkcs15_find_cert_by_id(struct sc_pkcs15_card *card,
 			      const struct sc_pkcs15_id *id,
 			      struct sc_pkcs15_object **out);
@@ -828,6 +856,8 @@ void sc_pkcs15_pincache_add(struct sc_pkcs15_card *, struct sc_pkcs15_object *,
 			const u8 *, size_t);
 int sc_pkcs15_pincache_revalidate(struct sc_pkcs15_card *p15card,
 			const struct sc_pkcs15_object *obj);
+int sc_pkcs15_pincache_refresh(struct sc_pkcs15_card *p15card,
+			const struct sc_pkcs15_object *obj);
 void sc_pkcs15_pincache_clear(struct sc_pkcs15_card *p15card);
 
 int sc_pkcs15_encode_dir(struct sc_context *ctx,
@@ -869,6 +899,9 @@ int sc_pkcs15_parse_df(struct sc_pkcs15_card *p15card,
 		       struct sc_pkcs15_df *df);
 int sc_pkcs15_read_df(struct sc_pkcs15_card *p15card,
 		      struct sc_pkcs15_df *df);
+/* sc_pkcs15_prefetch:  Enumerates all DFs and reads all public
+ * certificates in one card transaction. */
+int sc_pkcs15_prefetch(struct sc_pkcs15_card *p15card);
 int sc_pkcs15_decode_cdf_entry(struct sc_pkcs15_card *p15card,
 			       struct sc_pkcs15_object *obj,
 			       const u8 **buf, size_t *bufsize);
@@ -912,6 +945,10 @@ void sc_pkcs15_free_cert_info(sc_pkcs15_cert_info_t *cert);
 void sc_pkcs15_free_data_info(sc_pkcs15_data_info_t *data);
 void sc_pkcs15_free_auth_info(sc_pkcs15_auth_info_t *auth_info);
 void sc_pkcs15_free_object(struct sc_pkcs15_object *obj);
+/* Free a value of the object unless it is borrowed from the DF content */
+void sc_pkcs15_free_object_value(struct sc_pkcs15_object *obj, u8 **value);
+/* Nonzero if a DF entry decoded from 'in' may borrow its values from it */
+int sc_pkcs15_can_borrow(struct sc_pkcs15_card *p15card, const u8 *in);
 
 /* Generic file i/o */
 int sc_pkcs15_read_file(struct sc_pkcs15_card *p15card,
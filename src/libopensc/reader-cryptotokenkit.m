@@ -560,9 +560,10 @@ static int cryptotokenkit_detect_readers(sc_context_t *ctx)
 
 	slotNames = [[mngr slotNames] mutableCopy];
 
-	/* check if existing readers were returned in the list */
-	for (i = 0; i < sc_ctx_get_reader_count(ctx); i++) {
-		sc_reader_t *reader = sc_ctx_get_reader(ctx, i);
+	/* check if existing readers were returned in the list; the mutex of
+	 * the context is held by sc_ctx_detect_readers() */
+	for (i = 0; i < list_size(&ctx->readers); i++) {
+		sc_reader_t *reader = list_get_at(&ctx->readers, i);
 
 		if (reader == NULL) {
 			r = SC_ERROR_INTERNAL;
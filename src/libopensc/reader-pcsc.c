@@ -34,6 +34,8 @@
 #include <winsock2.h>
 #else
 #include <arpa/inet.h>
+#include <sys/types.h>
+#include <unistd.h>
 #endif
 
 #include "common/libscdl.h"
@@ -130,6 +132,10 @@ struct pcsc_global_private_data {
 
 	sc_reader_t *attached_reader;
 	sc_reader_t *removed_reader;
+#ifndef _WIN32
+	/* process that established pcsc_ctx in pcsc_reinit() */
+	pid_t reinit_pid;
+#endif
 };
 
 struct pcsc_private_data {
@@ -348,6 +354,58 @@ out:
 	return r;
 }
 
+static int pcsc_transmit_chain(sc_reader_t *reader, sc_apdu_t *apdus, size_t count)
+{
+	/* see pcsc_transmit() for the size of the return buffer */
+	u8 rbuf[258], *sbuf = NULL;
+	size_t ssize, rsize, sbuflen = 0, i;
+	int r = SC_SUCCESS;
+
+	for (i = 0; i < count; i++) {
+		ssize = sc_apdu_get_length(&apdus[i], reader->active_protocol);
+		if (ssize > sbuflen)
+			sbuflen = ssize;
+	}
+	sbuf = malloc(sbuflen);
+	if (sbuf == NULL)
+		return SC_ERROR_OUT_OF_MEMORY;
+
+	if (reader->name)
+		sc_log(reader->ctx, "reader '%s': %"SC_FORMAT_LEN_SIZE_T"u chained APDUs",
+				reader->name, count);
+	for (i = 0; i < count; ) {
+		sc_apdu_t *apdu = &apdus[i];
+
+		ssize = sc_apdu_get_length(apdu, reader->active_protocol);
+		r = sc_apdu2bytes(reader->ctx, apdu, reader->active_protocol, sbuf, ssize);
+		if (r != SC_SUCCESS)
+			break;
+		sc_apdu_log(reader->ctx, sbuf, ssize, 1);
+
+		rsize = sizeof rbuf;
+		r = pcsc_internal_transmit(reader, sbuf, ssize, rbuf, &rsize, apdu->control);
+		if (r < 0) {
+			sc_log(reader->ctx, "unable to transmit");
+			break;
+		}
+		sc_apdu_log(reader->ctx, rbuf, rsize, 0);
+		APDU_LOG(rbuf, (uint16_t)rsize);
+		r = sc_apdu_set_resp(reader->ctx, apdu, rbuf, rsize);
+		if (r != SC_SUCCESS)
+			break;
+
+		i++;
+		if (apdu->sw1 != 0x90 || apdu->sw2 != 0x00)
+			break;
+	}
+
+	sc_mem_clear(sbuf, sbuflen);
+	free(sbuf);
+	sc_mem_clear(rbuf, sizeof rbuf);
+
+	return r < 0 ? r : (int)i;
+}
+
 /* Calls SCardGetStatusChange on the reader to set ATR and associated flags
  * (card present/changed) */
 static int refresh_attributes(sc_reader_t *reader)
@@ -807,6 +865,48 @@ static int pcsc_cancel(sc_context_t *ctx)
 	return SC_SUCCESS;
 }
 
+static int pcsc_reinit(sc_context_t *ctx)
+{
+	struct pcsc_global_private_data *gpriv = (struct pcsc_global_private_data *)ctx->reader_drv_data;
+	unsigned int i;
+	LONG rv;
+
+	LOG_FUNC_CALLED(ctx);
+
+	if (!gpriv)
+		LOG_FUNC_RETURN(ctx, SC_ERROR_NO_READERS_FOUND);
+	if (gpriv->cardmod)
+		LOG_FUNC_RETURN(ctx, SC_ERROR_NOT_ALLOWED);
+
+	/* The contexts and card handles belong to the parent. Releasing them
+	 * here would close them for the parent as well. */
+	gpriv->pcsc_ctx = -1;
+	gpriv->pcsc_wait_ctx = -1;
+
+	rv = gpriv->SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, &gpriv->pcsc_ctx);
+	if (rv != SCARD_S_SUCCESS) {
+		PCSC_LOG(ctx, "SCardEstablishContext failed", rv);
+		gpriv->pcsc_ctx = -1;
+		LOG_FUNC_RETURN(ctx, pcsc_to_opensc_error(rv));
+	}
+#ifndef _WIN32
+	gpriv->reinit_pid = getpid();
+#endif
+
+	for (i = 0; i < sc_ctx_get_reader_count(ctx); i++) {
+		sc_reader_t *reader = sc_ctx_get_reader(ctx, i);
+		struct pcsc_private_data *priv = reader ? reader->drv_data : NULL;
+
+		if (!priv)
+			continue;
+		/* pcsc_lock() connects again when it finds the invalid handle */
+		priv->pcsc_card = 0;
+		priv->locked = 0;
+	}
+
+	LOG_FUNC_RETURN(ctx, SC_SUCCESS);
+}
+
 static struct sc_reader_operations pcsc_ops;
 
 static struct sc_reader_driver pcsc_drv = {
@@ -966,6 +1066,17 @@ out:
 }
 
 
+/* Whether this process established the context after fork(), in which case
+ * it is released even when the handles of the parent must not be touched */
+static int pcsc_reinit_by_self(struct pcsc_global_private_data *gpriv)
+{
+#ifndef _WIN32
+	return gpriv->reinit_pid == getpid();
+#else
+	return 0;
+#endif
+}
+
 static int pcsc_finish(sc_context_t *ctx)
 {
 	struct pcsc_global_private_data *gpriv = (struct pcsc_global_private_data *) ctx->reader_drv_data;
@@ -974,7 +1085,7 @@ static int pcsc_finish(sc_context_t *ctx)
 
 	if (gpriv) {
 		if (!gpriv->cardmod && gpriv->pcsc_ctx != (SCARDCONTEXT)-1 &&
-				!(ctx->flags & SC_CTX_FLAG_TERMINATE))
+				(!(ctx->flags & SC_CTX_FLAG_TERMINATE) || pcsc_reinit_by_self(gpriv)))
 			gpriv->SCardReleaseContext(gpriv->pcsc_ctx);
 		if (gpriv->dlhandle != NULL)
 			sc_dlclose(gpriv->dlhandle);
@@ -1409,8 +1520,8 @@ static int pcsc_detect_readers(sc_context_t *ctx)
 					|| rv == (LONG)SCARD_E_NO_READERS_AVAILABLE
 #endif
 					|| rv == (LONG)SCARD_E_SERVICE_STOPPED) {
-				for (i = 0; i < sc_ctx_get_reader_count(ctx); i++) {
-					sc_reader_t *reader = sc_ctx_get_reader(ctx, i);
+				for (i = 0; i < list_size(&ctx->readers); i++) {
+					sc_reader_t *reader = list_get_at(&ctx->readers, i);
 
 					if (!reader) {
 						ret = SC_ERROR_INTERNAL;
@@ -1464,9 +1575,10 @@ static int pcsc_detect_readers(sc_context_t *ctx)
 		goto out;
 	}
 
-	/* check if existing readers were returned in the list */
-	for (i = 0; i < sc_ctx_get_reader_count(ctx); i++) {
-		sc_reader_t *reader = sc_ctx_get_reader(ctx, i);
+	/* check if existing readers were returned in the list, the context
+	 * mutex is held by the caller */
+	for (i = 0; i < list_size(&ctx->readers); i++) {
+		sc_reader_t *reader = list_get_at(&ctx->readers, i);
 
 		if (!reader) {
 			ret = SC_ERROR_INTERNAL;
@@ -1717,6 +1829,15 @@ static int pcsc_wait_for_event(sc_context_t *ctx, unsigned int event_mask, sc_re
 						*event |= SC_EVENT_CARD_REMOVED;
 					}
 
+					/* The high word counts insertions and removals, a
+					 * card may have been swapped between two calls */
+					if ((prev_state & SCARD_STATE_PRESENT) && (state & SCARD_STATE_PRESENT)
+							&& (prev_state & 0xFFFF0000) != (state & 0xFFFF0000)
+							&& (prev_state & 0xFFFF0000) != 0) {
+						sc_log(ctx, "card replaced event");
+						*event |= SC_EVENT_CARD_REMOVED | SC_EVENT_CARD_INSERTED;
+					}
+
 					if ((state & SCARD_STATE_UNKNOWN) && !(prev_state & SCARD_STATE_UNKNOWN)) {
 						sc_log(ctx, "reader detached event");
 						*event |= SC_EVENT_READER_DETACHED;
@@ -1779,7 +1900,11 @@ out:
 		detect_readers = 1;
 
 	if (detect_readers) {
+		/* may run in a different thread than sc_ctx_detect_readers() or
+		 * the accessors of the reader list */
+		sc_mutex_lock(ctx, ctx->mutex);
 		pcsc_detect_readers(ctx);
+		sc_mutex_unlock(ctx, ctx->mutex);
 	}
 
 	if (detected_hotplug) {
@@ -2566,6 +2691,7 @@ struct sc_reader_driver * sc_get_pcsc_driver(void)
 	pcsc_ops.finish = pcsc_finish;
 	pcsc_ops.detect_readers = pcsc_detect_readers;
 	pcsc_ops.transmit = pcsc_transmit;
+	pcsc_ops.transmit_chain = pcsc_transmit_chain;
 	pcsc_ops.detect_card_presence = pcsc_detect_card_presence;
 	pcsc_ops.lock = pcsc_lock;
 	pcsc_ops.unlock = pcsc_unlock;
@@ -2578,6 +2704,7 @@ struct sc_reader_driver * sc_get_pcsc_driver(void)
 	pcsc_ops.reset = pcsc_reset;
 	pcsc_ops.use_reader = pcsc_use_reader;
 	pcsc_ops.perform_pace = pcsc_perform_pace;
+	pcsc_ops.reinit = pcsc_reinit;
 
 	return &pcsc_drv;
 }
@@ -417,9 +417,12 @@ int sc_concatenate_path(sc_path_t *d, const sc_path_t *p1, const sc_path_t *p2)
 
 const char *sc_print_path(const sc_path_t *path)
 {
-	static char buffer[SC_MAX_PATH_STRING_SIZE + SC_MAX_AID_STRING_SIZE];
+	/* a few buffers, so that one log line can print several paths */
+	static SC_THREAD_LOCAL char buffers[SC_FORMAT_BUFFERS][SC_MAX_PATH_STRING_SIZE + SC_MAX_AID_STRING_SIZE];
+	static SC_THREAD_LOCAL unsigned int next;
+	char *buffer = buffers[next++ % SC_FORMAT_BUFFERS];
 
-	if (sc_path_print(buffer, sizeof(buffer), path) != SC_SUCCESS)
+	if (sc_path_print(buffer, sizeof(buffers[0]), path) != SC_SUCCESS)
 		buffer[0] = '\0';
 
 	return buffer;
@@ -876,6 +879,40 @@ int _sc_parse_atr(sc_reader_t *reader)
 	return SC_SUCCESS;
 }
 
+
+/*
+ * Check the card capabilities in the historical bytes of the ATR
+ * (ISO 7816-4, 8.1.1.2.7) for support of extended Lc/Le fields.
+ */
+int _sc_hist_bytes_apdu_ext(const sc_reader_t *reader)
+{
+	const u8 *hist_bytes = reader->atr_info.hist_bytes;
+	size_t hist_bytes_len = reader->atr_info.hist_bytes_len;
+	const u8 *ptr;
+	size_t len = 0;
+
+	if (hist_bytes == NULL || hist_bytes_len < 2)
+		return 0;
+
+	/* category indicator 0x00 and 0x80 => compact TLV */
+	switch (hist_bytes[0]) {
+	case 0x00:
+		/* status indicator in the last three bytes */
+		if (hist_bytes_len < 4)
+			return 0;
+		ptr = sc_compacttlv_find_tag(hist_bytes + 1, hist_bytes_len - 4, 0x73, &len);
+		break;
+	case 0x80:
+		ptr = sc_compacttlv_find_tag(hist_bytes + 1, hist_bytes_len - 1, 0x73, &len);
+		break;
+	default:
+		return 0;
+	}
+
+	/* bit 0x40 in the third software function table means "extended Lc/Le" */
+	return ptr != NULL && len >= 3 && (ptr[2] & 0x40);
+}
+
 static void init_page_size()
 {
 	if (page_size == 0) {
@@ -1020,39 +1057,6 @@ void sc_remote_data_init(struct sc_remote_data *rdata)
 	rdata->free = sc_remote_apdu_free;
 }
 
-static unsigned long  sc_CRC_tab32[256];
-static int sc_CRC_tab32_initialized = 0;
-unsigned sc_crc32(const unsigned char *value, size_t len)
-{
-	size_t ii, jj;
-	unsigned long crc;
-	unsigned long index, long_c;
-
-	if (!sc_CRC_tab32_initialized)   {
-		for (ii=0; ii<256; ii++) {
-			crc = (unsigned long) ii;
-			for (jj=0; jj<8; jj++) {
-				if ( crc & 0x00000001L )
-					crc = ( crc >> 1 ) ^ 0xEDB88320l;
-				else
-					crc =   crc >> 1;
-			}
-			sc_CRC_tab32[ii] = crc;
-		}
-		sc_CRC_tab32_initialized = 1;
-	}
-
-	crc = 0xffffffffL;
-	for (ii=0; ii<len; ii++)   {
-		long_c = 0x000000ffL & (unsigned long) (*(value + ii));
-		index = crc ^ long_c;
-		crc = (crc >> 8) ^ sc_CRC_tab32[ index & 0xff ];
-	}
-
-	crc ^= 0xffffffff;
-	return  crc%0xffff;
-}
-
 const u8 *sc_compacttlv_find_tag(const u8 *buf, size_t len, u8 tag, size_t *outlen)
 {
 	if (buf != NULL) {
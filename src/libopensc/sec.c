@@ -35,6 +35,7 @@
 int sc_decipher(sc_card_t *card,
 		const u8 * crgram, size_t crgram_len, u8 * out, size_t outlen)
 {
+	unsigned long long start;
 	int r;
 
 	if (card == NULL || crgram == NULL || out == NULL) {
@@ -43,7 +44,9 @@ int sc_decipher(sc_card_t *card,
 	LOG_FUNC_CALLED(card->ctx);
 	if (card->ops->decipher == NULL)
 		SC_FUNC_RETURN(card->ctx, SC_LOG_DEBUG_VERBOSE, SC_ERROR_NOT_SUPPORTED);
+	start = sc_stats_timestamp();
 	r = card->ops->decipher(card, crgram, crgram_len, out, outlen);
+	sc_stats_record_op(card->ctx, SC_STATS_OP_DECIPHER, start);
         SC_FUNC_RETURN(card->ctx, SC_LOG_DEBUG_VERBOSE, r);
 }
 
@@ -51,6 +54,7 @@ int sc_compute_signature(sc_card_t *card,
 			 const u8 * data, size_t datalen,
 			 u8 * out, size_t outlen)
 {
+	unsigned long long start;
 	int r;
 
 	if (card == NULL) {
@@ -59,7 +63,9 @@ int sc_compute_signature(sc_card_t *card,
 	LOG_FUNC_CALLED(card->ctx);
 	if (card->ops->compute_signature == NULL)
 		SC_FUNC_RETURN(card->ctx, SC_LOG_DEBUG_VERBOSE, SC_ERROR_NOT_SUPPORTED);
+	start = sc_stats_timestamp();
 	r = card->ops->compute_signature(card, data, datalen, out, outlen);
+	sc_stats_record_op(card->ctx, SC_STATS_OP_COMPUTE_SIGNATURE, start);
         SC_FUNC_RETURN(card->ctx, SC_LOG_DEBUG_VERBOSE, r);
 }
 
@@ -192,6 +198,7 @@ int sc_reset_retry_counter(sc_card_t *card, unsigned int type, int ref,
 int sc_pin_cmd(sc_card_t *card, struct sc_pin_cmd_data *data,
 		int *tries_left)
 {
+	unsigned long long start;
 	int r, debug;
 
 	if (card == NULL) {
@@ -205,6 +212,7 @@ int sc_pin_cmd(sc_card_t *card, struct sc_pin_cmd_data *data,
 		card->ctx->debug = 0;
 	}
 
+	start = sc_stats_timestamp();
 	if (card->ops->pin_cmd) {
 		r = card->ops->pin_cmd(card, data, tries_left);
 	} else if (!(data->flags & SC_PIN_CMD_USE_PINPAD)) {
@@ -251,6 +259,7 @@ int sc_pin_cmd(sc_card_t *card, struct sc_pin_cmd_data *data,
 		sc_log(card->ctx,  "Use of pin pad not supported by card driver");
 		r = SC_ERROR_NOT_SUPPORTED;
 	}
+	sc_stats_record_op(card->ctx, SC_STATS_OP_PIN_CMD, start);
 	card->ctx->debug = debug;
 
 	SC_FUNC_RETURN(card->ctx, SC_LOG_DEBUG_VERBOSE, r);
@@ -26,11 +26,17 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
 
 #include "internal.h"
 #include "asn1.h"
 #include "sm.h"
 
+#if defined(ENABLE_SM) && defined(ENABLE_OPENSSL)
+#include <openssl/evp.h>
+#include <openssl/err.h>
+#endif
+
 #ifdef ENABLE_SM
 static const struct sc_asn1_entry c_asn1_sm_response[4] = {
 	{ "encryptedData",	SC_ASN1_OCTET_STRING,   SC_ASN1_CTX | 7,        SC_ASN1_OPTIONAL,       NULL, NULL },
@@ -141,6 +147,8 @@ sc_sm_single_transmit(struct sc_card *card, struct sc_apdu *apdu)
 		/* SM wrap of this APDU is ignored by card driver.
 		 * Send plain APDU to the reader driver */
 		rv = card->reader->ops->transmit(card->reader, apdu);
+		if (rv == SC_SUCCESS)
+			sc_stats_count_apdu(ctx, apdu);
 		LOG_FUNC_RETURN(ctx, rv);
 	} else {
 		if (rv < 0)
@@ -216,3 +224,255 @@ sc_sm_stop(struct sc_card *card)
     return SC_ERROR_NOT_SUPPORTED;
 }
 #endif
+
+#if defined(ENABLE_SM) && defined(ENABLE_OPENSSL)
+struct sm_crypt_ctx {
+	/* keyed with the ENC session key */
+	EVP_CIPHER_CTX *enc, *dec;
+	size_t block_size;
+
+	/* CBC chain of the MAC and, for the retail MAC, its last block */
+	EVP_CIPHER_CTX *mac, *mac_final;
+	size_t mac_block_size;
+	unsigned int mac_alg;
+};
+
+static EVP_CIPHER_CTX *
+sm_crypt_cipher_new(const EVP_CIPHER *cipher, const unsigned char *key, int enc)
+{
+	EVP_CIPHER_CTX *cctx = EVP_CIPHER_CTX_new();
+
+	if (!cctx)
+		return NULL;
+	if (!EVP_CipherInit_ex(cctx, cipher, NULL, key, NULL, enc)
+			|| !EVP_CIPHER_CTX_set_padding(cctx, 0)) {
+		EVP_CIPHER_CTX_free(cctx);
+		return NULL;
+	}
+
+	return cctx;
+}
+
+/* K1 || K2 || K1 of a two key 3DES key */
+static void
+sm_crypt_des3_key(unsigned char *key, const unsigned char *key16)
+{
+	memcpy(key, key16, 16);
+	memcpy(key + 16, key16, 8);
+}
+
+static int
+sm_crypt_cbc(EVP_CIPHER_CTX *cctx, size_t block_size, const unsigned char *iv,
+		const unsigned char *in, size_t in_len, unsigned char *out)
+{
+	static const unsigned char zero_iv[EVP_MAX_IV_LENGTH];
+	int out_len;
+
+	if (!cctx || in_len % block_size || in_len > INT_MAX)
+		return SC_ERROR_INVALID_ARGUMENTS;
+
+	/* only the IV is reset, the key schedule is kept */
+	if (!EVP_CipherInit_ex(cctx, NULL, NULL, NULL, iv ? iv : zero_iv, -1)
+			|| !EVP_CipherUpdate(cctx, out, &out_len, in, (int) in_len))
+		return SC_ERROR_INTERNAL;
+
+	return SC_SUCCESS;
+}
+
+struct sm_crypt_ctx *
+sc_sm_crypt_create(unsigned int enc_alg, const unsigned char *enc_key,
+		unsigned int mac_alg, const unsigned char *mac_key)
+{
+	struct sm_crypt_ctx *crypt;
+	const EVP_CIPHER *cipher;
+	unsigned char key[24];
+
+	if (!enc_key || !mac_key)
+		return NULL;
+
+	crypt = calloc(1, sizeof *crypt);
+	if (!crypt)
+		return NULL;
+
+	switch (enc_alg) {
+	case SM_CRYPT_DES3_CBC:
+		sm_crypt_des3_key(key, enc_key);
+		cipher = EVP_des_ede3_cbc();
+		crypt->block_size = 8;
+		break;
+	case SM_CRYPT_AES128_CBC:
+		memcpy(key, enc_key, 16);
+		cipher = EVP_aes_128_cbc();
+		crypt->block_size = 16;
+		break;
+	default:
+		goto err;
+	}
+	crypt->enc = sm_crypt_cipher_new(cipher, key, 1);
+	crypt->dec = sm_crypt_cipher_new(cipher, key, 0);
+	if (!crypt->enc || !crypt->dec)
+		goto err;
+
+	crypt->mac_alg = mac_alg;
+	switch (mac_alg & SM_MAC_ALG_MASK) {
+	case SM_MAC_DES_RETAIL:
+		crypt->mac = sm_crypt_cipher_new(EVP_des_cbc(), mac_key, 1);
+		if (!crypt->mac) {
+			/* single DES may only be available from the legacy
+			 * provider, 3DES with K1 || K1 || K1 is equivalent */
+			ERR_clear_error();
+			memcpy(key, mac_key, 8);
+			memcpy(key + 8, mac_key, 8);
+			memcpy(key + 16, mac_key, 8);
+			crypt->mac = sm_crypt_cipher_new(EVP_des_ede3_cbc(), key, 1);
+		}
+		sm_crypt_des3_key(key, mac_key);
+		crypt->mac_final = sm_crypt_cipher_new(EVP_des_ede3_ecb(), key, 1);
+		if (!crypt->mac_final)
+			goto err;
+		crypt->mac_block_size = 8;
+		break;
+	case SM_MAC_DES3_CBC:
+		sm_crypt_des3_key(key, mac_key);
+		crypt->mac = sm_crypt_cipher_new(EVP_des_ede3_cbc(), key, 1);
+		crypt->mac_block_size = 8;
+		break;
+	case SM_MAC_AES128_CBC:
+		crypt->mac = sm_crypt_cipher_new(EVP_aes_128_cbc(), mac_key, 1);
+		crypt->mac_block_size = 16;
+		break;
+	default:
+		goto err;
+	}
+	if (!crypt->mac)
+		goto err;
+
+	sc_mem_clear(key, sizeof key);
+	return crypt;
+
+err:
+	sc_mem_clear(key, sizeof key);
+	sc_sm_crypt_free(crypt);
+	return NULL;
+}
+
+void
+sc_sm_crypt_free(struct sm_crypt_ctx *crypt)
+{
+	if (!crypt)
+		return;
+
+	EVP_CIPHER_CTX_free(crypt->enc);
+	EVP_CIPHER_CTX_free(crypt->dec);
+	EVP_CIPHER_CTX_free(crypt->mac);
+	EVP_CIPHER_CTX_free(crypt->mac_final);
+	free(crypt);
+}
+
+int
+sc_sm_crypt_encrypt(struct sm_crypt_ctx *crypt, const unsigned char *iv,
+		const unsigned char *in, size_t in_len, unsigned char *out)
+{
+	if (!crypt)
+		return SC_ERROR_INVALID_ARGUMENTS;
+
+	return sm_crypt_cbc(crypt->enc, crypt->block_size, iv, in, in_len, out);
+}
+
+int
+sc_sm_crypt_decrypt(struct sm_crypt_ctx *crypt, const unsigned char *iv,
+		const unsigned char *in, size_t in_len, unsigned char *out)
+{
+	if (!crypt)
+		return SC_ERROR_INVALID_ARGUMENTS;
+
+	return sm_crypt_cbc(crypt->dec, crypt->block_size, iv, in, in_len, out);
+}
+
+int
+sc_sm_crypt_mac(struct sm_crypt_ctx *crypt, const unsigned char *icv,
+		const unsigned char *in, size_t in_len, unsigned char *mac)
+{
+	unsigned char chain[EVP_MAX_BLOCK_LENGTH], buf[256];
+	size_t block_size, chain_len, offs, len, i;
+	int r;
+
+	if (!crypt || !in || !mac)
+		return SC_ERROR_INVALID_ARGUMENTS;
+	block_size = crypt->mac_block_size;
+	if (!in_len || in_len % block_size)
+		return SC_ERROR_INVALID_ARGUMENTS;
+
+	memset(chain, 0, sizeof chain);
+	if (icv)
+		memcpy(chain, icv, block_size);
+	if (crypt->mac_alg & SM_MAC_ENCRYPTED_ICV) {
+		r = sm_crypt_cbc(crypt->mac, block_size, NULL, chain, block_size, chain);
+		if (r < 0)
+			goto err;
+	}
+
+	/* the retail MAC chains all but the last block with the first key */
+	chain_len = in_len - (crypt->mac_final ? block_size : 0);
+	for (offs = 0; offs < chain_len; offs += len) {
+		len = chain_len - offs;
+		if (len > sizeof buf)
+			len = sizeof buf;
+		r = sm_crypt_cbc(crypt->mac, block_size, chain, in + offs, len, buf);
+		if (r < 0)
+			goto err;
+		memcpy(chain, buf + len - block_size, block_size);
+	}
+
+	if (crypt->mac_final) {
+		for (i = 0; i < block_size; i++)
+			chain[i] ^= in[chain_len + i];
+		r = sm_crypt_cbc(crypt->mac_final, block_size, NULL, chain, block_size, mac);
+		if (r < 0)
+			goto err;
+	} else {
+		memcpy(mac, chain, block_size);
+	}
+	r = (int) block_size;
+
+err:
+	sc_mem_clear(chain, sizeof chain);
+	sc_mem_clear(buf, sizeof buf);
+	return r;
+}
+
+#else
+
+struct sm_crypt_ctx *
+sc_sm_crypt_create(unsigned int enc_alg, const unsigned char *enc_key,
+		unsigned int mac_alg, const unsigned char *mac_key)
+{
+	return NULL;
+}
+
+void
+sc_sm_crypt_free(struct sm_crypt_ctx *crypt)
+{
+}
+
+int
+sc_sm_crypt_encrypt(struct sm_crypt_ctx *crypt, const unsigned char *iv,
+		const unsigned char *in, size_t in_len, unsigned char *out)
+{
+	return SC_ERROR_NOT_SUPPORTED;
+}
+
+int
+sc_sm_crypt_decrypt(struct sm_crypt_ctx *crypt, const unsigned char *iv,
+		const unsigned char *in, size_t in_len, unsigned char *out)
+{
+	return SC_ERROR_NOT_SUPPORTED;
+}
+
+int
+sc_sm_crypt_mac(struct sm_crypt_ctx *crypt, const unsigned char *icv,
+		const unsigned char *in, size_t in_len, unsigned char *mac)
+{
+	return SC_ERROR_NOT_SUPPORTED;
+}
+#endif
@@ -88,6 +88,20 @@ extern "C" {
 #define SM_GP_SECURITY_MAC		0x01
 #define SM_GP_SECURITY_ENC		0x03
 
+/* Ciphers of the SM session crypto context */
+#define SM_CRYPT_DES3_CBC		0x01	/* two key 3DES */
+#define SM_CRYPT_AES128_CBC		0x02
+
+/* MAC algorithms (ISO/IEC 9797-1) of the SM session crypto context */
+#define SM_MAC_DES_RETAIL		0x01	/* algorithm 3 with DES */
+#define SM_MAC_DES3_CBC			0x02	/* algorithm 1 with two key 3DES */
+#define SM_MAC_AES128_CBC		0x03	/* algorithm 1 with AES-128 */
+#define SM_MAC_ALG_MASK			0xFF
+/* the ICV is encrypted with the (first) MAC key before use */
+#define SM_MAC_ENCRYPTED_ICV		0x100
+
+struct sm_crypt_ctx;
+
 /* Global Platform (SCP01) data types */
 /*
  * @struct sm_type_params_gp
@@ -133,6 +147,8 @@ struct sm_gp_session {
 
 	unsigned char *session_enc, *session_mac, *session_kek;
 	unsigned char mac_icv[8];
+
+	struct sm_crypt_ctx *crypt;
 };
 
 
@@ -196,6 +212,8 @@ struct sm_cwa_session {
 
 	unsigned char mdata[0x48];
 	size_t mdata_len;
+
+	struct sm_crypt_ctx *crypt;
 };
 
 /*
@@ -278,12 +296,15 @@ struct sc_card;
  * @struct sm_card_operations
  *	card driver handlers related to secure messaging (in 'APDU TRANSMIT' mode)
  *	- 'open' - initialize SM session;
+ *	- 'resume' - check that the SM session survived a card reset reported
+ *	  by the reader, \c SC_SUCCESS if it can be used without 'open';
  *	- 'encode apdu' - SM encoding of the raw APDU;
  *	- 'decrypt response' - decode card answer;
  *	- 'close' - close SM session.
  */
 struct sm_card_operations {
 	int (*open)(struct sc_card *card);
+	int (*resume)(struct sc_card *card);
 	int (*get_sm_apdu)(struct sc_card *card, struct sc_apdu *apdu, struct sc_apdu **sm_apdu);
 	int (*free_sm_apdu)(struct sc_card *card, struct sc_apdu *apdu, struct sc_apdu **sm_apdu);
 	int (*close)(struct sc_card *card);
@@ -362,6 +383,49 @@ int sc_sm_single_transmit(struct sc_card *, struct sc_apdu *);
  */
 int sc_sm_stop(struct sc_card *card);
 
+/**
+ * @brief Creates the crypto context of a SM session.
+ *
+ * The ciphers are keyed once with the 16 byte session keys, so that only
+ * the IV is reset for each APDU.
+ *
+ * @param[in] enc_alg cipher, \c SM_CRYPT_*
+ * @param[in] enc_key encryption key
+ * @param[in] mac_alg MAC algorithm, \c SM_MAC_* and flags
+ * @param[in] mac_key MAC key
+ *
+ * @return the context or \c NULL if the algorithms are not supported or
+ * an error occurred
+ */
+struct sm_crypt_ctx *sc_sm_crypt_create(unsigned int enc_alg,
+		const unsigned char *enc_key, unsigned int mac_alg,
+		const unsigned char *mac_key);
+void sc_sm_crypt_free(struct sm_crypt_ctx *crypt);
+
+/**
+ * @brief En-/decrypts block aligned data in CBC mode.
+ *
+ * @param[in] iv IV of the cipher's block size, \c NULL for zeros
+ *
+ * @return \c SC_SUCCESS or error code if an error occurred
+ */
+int sc_sm_crypt_encrypt(struct sm_crypt_ctx *crypt, const unsigned char *iv,
+		const unsigned char *in, size_t in_len, unsigned char *out);
+int sc_sm_crypt_decrypt(struct sm_crypt_ctx *crypt, const unsigned char *iv,
+		const unsigned char *in, size_t in_len, unsigned char *out);
+
+/**
+ * @brief Calculates the MAC of padded data.
+ *
+ * @param[in] icv initial chaining value of the MAC's block size, \c NULL
+ * for zeros
+ * @param[out] mac MAC of the MAC's block size
+ *
+ * @return the length of the MAC or error code if an error occurred
+ */
+int sc_sm_crypt_mac(struct sm_crypt_ctx *crypt, const unsigned char *icv,
+		const unsigned char *in, size_t in_len, unsigned char *mac);
+
 #ifdef __cplusplus
 }
 #endif
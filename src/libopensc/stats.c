@@ -0,0 +1,193 @@
+/*
+ * stats.c: Performance counters
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#include "internal.h"
+
+static const char *op_names[SC_STATS_OP_MAX] = {
+	"select_file",
+	"read_binary",
+	"update_binary",
+	"read_record",
+	"pin_cmd",
+	"compute_signature",
+	"decipher",
+	"get_challenge",
+};
+
+unsigned long long sc_stats_timestamp(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	/* split the conversion, so that it neither overflows nor needs a
+	 * frequency of at least 1 MHz */
+	return (unsigned long long) (now.QuadPart / freq.QuadPart * 1000000
+			+ now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+	return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+void sc_stats_record_op(sc_context_t *ctx, int op, unsigned long long start)
+{
+	struct sc_stats_histogram *hist;
+	unsigned long long now, elapsed;
+	unsigned int bucket = 0;
+
+	if (ctx == NULL || op < 0 || op >= SC_STATS_OP_MAX)
+		return;
+
+	now = sc_stats_timestamp();
+	elapsed = now > start ? now - start : 0;
+	while (bucket < SC_STATS_HIST_BUCKETS - 1 && elapsed >= (1ULL << bucket))
+		bucket++;
+
+	hist = &ctx->stats.ops[op];
+	SC_STATS_ADD(ctx, ops[op].count, 1);
+	SC_STATS_ADD(ctx, ops[op].total_us, elapsed);
+	SC_STATS_ADD(ctx, ops[op].buckets[bucket], 1);
+	/* racy, but good enough for a statistic */
+	if (elapsed > hist->max_us)
+		hist->max_us = elapsed;
+}
+
+void sc_stats_count_apdu(sc_context_t *ctx, const sc_apdu_t *apdu)
+{
+	if (ctx == NULL || apdu == NULL)
+		return;
+
+	SC_STATS_ADD(ctx, apdus_sent, 1);
+	SC_STATS_ADD(ctx, bytes_sent, apdu->datalen);
+	SC_STATS_ADD(ctx, bytes_received, apdu->resplen);
+	if (apdu->ins == 0xA4)
+		SC_STATS_ADD(ctx, select_apdus, 1);
+}
+
+int sc_ctx_get_stats(sc_context_t *ctx, sc_stats_t *stats)
+{
+	if (ctx == NULL || stats == NULL)
+		return SC_ERROR_INVALID_ARGUMENTS;
+
+	memcpy(stats, &ctx->stats, sizeof *stats);
+	return SC_SUCCESS;
+}
+
+void sc_ctx_reset_stats(sc_context_t *ctx)
+{
+	if (ctx != NULL)
+		memset(&ctx->stats, 0, sizeof ctx->stats);
+}
+
+static void stats_append(char *buf, size_t buflen, size_t *pos, const char *format, ...)
+{
+	va_list args;
+	int r;
+
+	va_start(args, format);
+	r = vsnprintf(*pos < buflen ? buf + *pos : NULL,
+			*pos < buflen ? buflen - *pos : 0, format, args);
+	va_end(args);
+	if (r > 0)
+		*pos += r;
+}
+
+size_t sc_stats_print(const sc_stats_t *stats, char *buf, size_t buflen)
+{
+	size_t pos = 0;
+	unsigned long long elided;
+	int i, j;
+
+	if (buf != NULL && buflen > 0)
+		buf[0] = '\0';
+	else
+		buflen = 0;
+	if (stats == NULL)
+		return 0;
+
+	elided = stats->select_calls > stats->select_apdus
+		? stats->select_calls - stats->select_apdus : 0;
+
+	stats_append(buf, buflen, &pos, "apdus_sent: %llu\n", stats->apdus_sent);
+	stats_append(buf, buflen, &pos, "bytes_sent: %llu\n", stats->bytes_sent);
+	stats_append(buf, buflen, &pos, "bytes_received: %llu\n", stats->bytes_received);
+	stats_append(buf, buflen, &pos, "get_response: %llu\n", stats->get_response);
+	stats_append(buf, buflen, &pos, "select_calls: %llu\n", stats->select_calls);
+	stats_append(buf, buflen, &pos, "select_apdus: %llu\n", stats->select_apdus);
+	stats_append(buf, buflen, &pos, "select_elided: %llu\n", elided);
+	stats_append(buf, buflen, &pos, "lock_count: %llu\n", stats->lock_count);
+	stats_append(buf, buflen, &pos, "lock_wait_us: %llu\n", stats->lock_wait_us);
+	stats_append(buf, buflen, &pos, "lock_hold_us: %llu\n", stats->lock_hold_us);
+	stats_append(buf, buflen, &pos, "file_cache_hits: %llu\n", stats->file_cache_hits);
+	stats_append(buf, buflen, &pos, "file_cache_misses: %llu\n", stats->file_cache_misses);
+	stats_append(buf, buflen, &pos, "sm_reopened: %llu\n", stats->sm_reopened);
+	stats_append(buf, buflen, &pos, "sm_resumed: %llu\n", stats->sm_resumed);
+	stats_append(buf, buflen, &pos, "decompress_cache_hits: %llu\n", stats->decompress_cache_hits);
+	stats_append(buf, buflen, &pos, "decompress_cache_misses: %llu\n", stats->decompress_cache_misses);
+	stats_append(buf, buflen, &pos, "pin_state_probes: %llu\n", stats->pin_state_probes);
+	stats_append(buf, buflen, &pos, "pin_verify_early: %llu\n", stats->pin_verify_early);
+	stats_append(buf, buflen, &pos, "pin_apdus_saved: %llu\n", stats->pin_apdus_saved);
+
+	for (i = 0; i < SC_STATS_OP_MAX; i++) {
+		const struct sc_stats_histogram *hist = &stats->ops[i];
+		const char *sep = "";
+
+		if (hist->count == 0)
+			continue;
+		stats_append(buf, buflen, &pos, "%s: count=%llu avg_us=%llu max_us=%llu hist=",
+				op_names[i], hist->count, hist->total_us / hist->count, hist->max_us);
+		for (j = 0; j < SC_STATS_HIST_BUCKETS; j++) {
+			if (hist->buckets[j] == 0)
+				continue;
+			if (j == SC_STATS_HIST_BUCKETS - 1)
+				stats_append(buf, buflen, &pos, "%s>=%llu:%llu",
+						sep, 1ULL << (j - 1), hist->buckets[j]);
+			else
+				stats_append(buf, buflen, &pos, "%s<%llu:%llu",
+						sep, 1ULL << j, hist->buckets[j]);
+			sep = ",";
+		}
+		stats_append(buf, buflen, &pos, "\n");
+	}
+
+	return pos;
+}
@@ -2754,6 +2754,10 @@ pkcs15_create_object(struct sc_pkcs11_slot *slot, CK_ATTRIBUTE_PTR pTemplate, CK
 		except when the card supports temporary on card session objects */
 	p15init_create_object = _token == TRUE || (p11card->card->caps & SC_CARD_CAP_ONCARD_SESSION_OBJECTS) == SC_CARD_CAP_ONCARD_SESSION_OBJECTS;
 
+	/* only secret keys can be kept in memory, the others need the profile */
+	if (!p15init_create_object && _class != CKO_SECRET_KEY)
+		return CKR_TEMPLATE_INCONSISTENT;
+
 	if (p15init_create_object) {
 		struct sc_aid *aid = NULL;
 
@@ -3298,6 +3302,31 @@ pkcs15_get_random(struct sc_pkcs11_slot *slot, CK_BYTE_PTR p, CK_ULONG len)
 }
 
 
+static CK_RV
+pkcs15_reinit_after_fork(struct sc_pkcs11_card *p11card)
+{
+	unsigned int idx;
+
+	if (!p11card)
+		return CKR_TOKEN_NOT_RECOGNIZED;
+	for (idx = 0; idx < SC_PKCS11_FRAMEWORK_DATA_MAX_NUM; idx++) {
+		struct pkcs15_fw_data *fw_data = (struct pkcs15_fw_data *) p11card->fws_data[idx];
+
+		if (!fw_data)
+			break;
+		/* the locks were taken by the parent and are already dropped
+		 * by sc_card_reinit_after_fork() */
+		fw_data->locked = 0;
+		memset(fw_data->user_puk, 0, sizeof(fw_data->user_puk));
+		fw_data->user_puk_len = 0;
+		if (fw_data->p15_card)
+			sc_pkcs15_pincache_clear(fw_data->p15_card);
+	}
+
+	return CKR_OK;
+}
+
+
 struct sc_pkcs11_framework_ops framework_pkcs15 = {
 	pkcs15_bind,
 	pkcs15_unbind,
@@ -3317,7 +3346,8 @@ struct sc_pkcs11_framework_ops framework_pkcs15 = {
 	NULL,
 	NULL,
 #endif
-	pkcs15_get_random
+	pkcs15_get_random,
+	pkcs15_reinit_after_fork
 };
 
 
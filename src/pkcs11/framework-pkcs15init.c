@@ -191,7 +191,8 @@ struct sc_pkcs11_framework_ops framework_pkcs15init = {
 	NULL, /* init_pin */
 	NULL, /* create_object */
 	NULL, /* gen_keypair */
-	NULL  /* get_random */
+	NULL, /* get_random */
+	NULL  /* reinit_after_fork */
 };
 
 #else /* ifdef USE_PKCS15_INIT */
@@ -208,7 +209,8 @@ struct sc_pkcs11_framework_ops framework_pkcs15init = {
 	NULL,	/* init_pin */
 	NULL,	/* create_object */
 	NULL,	/* gen_keypair */
-	NULL	/* get_random */
+	NULL,	/* get_random */
+	NULL	/* reinit_after_fork */
 };
 
 #endif
@@ -262,6 +262,60 @@ BOOL APIENTRY DllMain( HINSTANCE hinstDLL,
 }
 #endif
 
+#if !defined(_WIN32)
+/* In a child of a process that initialized the module, keeps the bound
+ * cards, slots and objects of the parent and only replaces the locks and the
+ * reader handles, which can not be shared. Sessions and logins are dropped
+ * without touching the card, as they still belong to the parent, together
+ * with the cached PINs. Cards using secure messaging are not reused. */
+static CK_RV reinit_after_fork(CK_C_INITIALIZE_ARGS_PTR args)
+{
+	sc_pkcs11_slot_t *slot, *other;
+	unsigned int i, j;
+	void *p;
+	CK_RV rv;
+
+	/* the lock may have been held by a thread of the parent */
+	global_lock = NULL;
+	rv = sc_pkcs11_init_lock(args);
+	if (rv != CKR_OK)
+		return rv;
+
+	slot_monitor_stop();
+	if (sc_ctx_reinit_after_fork(context) != SC_SUCCESS)
+		return CKR_GENERAL_ERROR;
+
+	while ((p = list_fetch(&sessions)))
+		free(p);
+
+	for (i = 0; i < list_size(&virtual_slots); i++) {
+		slot = (sc_pkcs11_slot_t *) list_get_at(&virtual_slots, i);
+		slot->nsessions = 0;
+		slot->login_user = -1;
+		if (!slot->p11card || !slot->p11card->card)
+			continue;
+		/* several slots share the card */
+		for (j = 0; j < i; j++) {
+			other = (sc_pkcs11_slot_t *) list_get_at(&virtual_slots, j);
+			if (other->p11card == slot->p11card)
+				break;
+		}
+		if (j < i)
+			continue;
+		if (sc_card_reinit_after_fork(slot->p11card->card) != SC_SUCCESS)
+			return CKR_GENERAL_ERROR;
+		if (slot->p11card->framework && slot->p11card->framework->reinit_after_fork) {
+			rv = slot->p11card->framework->reinit_after_fork(slot->p11card);
+			if (rv != CKR_OK)
+				return rv;
+		}
+	}
+
+	slot_monitor_start();
+	return CKR_OK;
+}
+#endif
+
 CK_RV C_Initialize(CK_VOID_PTR pInitArgs)
 {
 	CK_RV rv;
@@ -274,6 +328,15 @@ CK_RV C_Initialize(CK_VOID_PTR pInitArgs)
 #if !defined(_WIN32)
 	/* Handle fork() exception */
 	if (current_pid != initialized_pid) {
+		if (context && sc_pkcs11_conf.reuse_tokens_after_fork
+				&& reinit_after_fork((CK_C_INITIALIZE_ARGS_PTR) pInitArgs) == CKR_OK) {
+			initialized_pid = current_pid;
+			in_finalize = 0;
+			sc_log(context, "C_Initialize() = CKR_OK, reused the tokens of the parent");
+			return CKR_OK;
+		}
+		/* the handles of the parent are left alone, but the reader
+		 * driver releases a context the child established already */
 		if (context)
 			context->flags |= SC_CTX_FLAG_TERMINATE;
 		C_Finalize(NULL_PTR);
@@ -320,7 +383,9 @@ CK_RV C_Initialize(CK_VOID_PTR pInitArgs)
 	}
 	list_attributes_seeker(&virtual_slots, slot_list_seeker);
 
-	card_detect_all();
+	/* Readers and cards are detected when the slots are used for the
+	 * first time, usually by C_GetSlotList() */
+	slot_monitor_start();
 
 out:
 	if (context != NULL)
@@ -364,6 +429,7 @@ CK_RV C_Finalize(CK_VOID_PTR pReserved)
 	/* cancel pending calls */
 	in_finalize = 1;
 	sc_cancel(context);
+	slot_monitor_stop();
 	/* remove all cards from readers */
 	for (i=0; i < (int)sc_ctx_get_reader_count(context); i++)
 		card_removed(sc_ctx_get_reader(context, i));
@@ -417,6 +483,50 @@ CK_RV C_GetInfo(CK_INFO_PTR pInfo)
 	return rv;
 }
 
+CK_RV CK_SPEC C_OpenSC_GetStatistics(CK_UTF8CHAR_PTR pStats, CK_ULONG_PTR pulStatsLen)
+{
+	sc_stats_t stats;
+	size_t len;
+	CK_RV rv;
+
+	if (pulStatsLen == NULL_PTR)
+		return CKR_ARGUMENTS_BAD;
+
+	rv = sc_pkcs11_lock();
+	if (rv != CKR_OK)
+		return rv;
+
+	if (context == NULL || sc_ctx_get_stats(context, &stats) != SC_SUCCESS) {
+		rv = CKR_CRYPTOKI_NOT_INITIALIZED;
+		goto out;
+	}
+
+	/* length without the terminating NUL */
+	len = sc_stats_print(&stats, NULL, 0);
+	if (pStats != NULL_PTR) {
+		char *buf;
+
+		if (*pulStatsLen < len) {
+			*pulStatsLen = len;
+			rv = CKR_BUFFER_TOO_SMALL;
+			goto out;
+		}
+		buf = malloc(len + 1);
+		if (buf == NULL) {
+			rv = CKR_HOST_MEMORY;
+			goto out;
+		}
+		sc_stats_print(&stats, buf, len + 1);
+		memcpy(pStats, buf, len);
+		free(buf);
+	}
+	*pulStatsLen = len;
+
+out:
+	sc_pkcs11_unlock();
+	return rv;
+}
+
 CK_RV C_GetFunctionList(CK_FUNCTION_LIST_PTR_PTR ppFunctionList)
 {
 	if (ppFunctionList == NULL_PTR)
@@ -449,12 +559,14 @@ CK_RV C_GetSlotList(CK_BBOOL       tokenPresent,  /* only slots with token prese
 	DEBUG_VSS(NULL, "C_GetSlotList before ctx_detect_detect");
 
 	/* Slot list can only change in v2.20 */
-	if (pSlotList == NULL_PTR)
+	if (pSlotList == NULL_PTR) {
 		sc_ctx_detect_readers(context);
+		slot_monitor_start();
+	}
 
 	DEBUG_VSS(NULL, "C_GetSlotList after ctx_detect_readers");
 
-	card_detect_all();
+	card_detect_all_changed();
 
 	if (list_empty(&virtual_slots)) {
 		sc_log(context, "returned 0 slots\n");
@@ -548,6 +660,8 @@ CK_RV C_GetSlotInfo(CK_SLOT_ID slotID, CK_SLOT_INFO_PTR pInfo)
 {
 	struct sc_pkcs11_slot *slot = NULL;
 	sc_timestamp_t now;
+	unsigned int generation;
+	int detect;
 	CK_RV rv;
 
 	if (pInfo == NULL_PTR)
@@ -565,7 +679,7 @@ CK_RV C_GetSlotInfo(CK_SLOT_ID slotID, CK_SLOT_INFO_PTR pInfo)
 		 * before C_GetSlotInfo, as required by PKCS#11.  Initialize
 		 * virtual_slots to make things work and hope the caller knows what
 		 * it's doing... */
-		card_detect_all();
+		card_detect_all_changed();
 	}
 
 	rv = slot_get_slot(slotID, &slot);
@@ -576,7 +690,15 @@ CK_RV C_GetSlotInfo(CK_SLOT_ID slotID, CK_SLOT_INFO_PTR pInfo)
 			rv = CKR_TOKEN_NOT_PRESENT;
 		} else {
 			now = get_current_time();
-			if (now >= slot->slot_state_expires || now == 0) {
+			if (slot_monitor_generation(&generation))
+				/* The monitor reports card events. Only retry a
+				 * failed detection after a second */
+				detect = slot->monitor_generation != generation
+					&& (slot->monitor_generation != 0
+						|| now >= slot->slot_state_expires || now == 0);
+			else
+				detect = now >= slot->slot_state_expires || now == 0;
+			if (detect) {
 				/* Update slot status */
 				rv = card_detect(slot->reader);
 				sc_log(context, "C_GetSlotInfo() card detect rv 0x%lX", rv);
@@ -586,6 +708,11 @@ CK_RV C_GetSlotInfo(CK_SLOT_ID slotID, CK_SLOT_INFO_PTR pInfo)
 
 				/* Don't ask again within the next second */
 				slot->slot_state_expires = now + 1000;
+				if (rv == CKR_OK || rv == CKR_TOKEN_NOT_PRESENT
+						|| rv == CKR_TOKEN_NOT_RECOGNIZED)
+					slot->monitor_generation = generation;
+				else
+					slot->monitor_generation = 0;
 			}
 		}
 	}
@@ -700,11 +827,11 @@ CK_RV C_WaitForSlotEvent(CK_FLAGS flags,   /* blocking/nonblocking flag */
 			 CK_VOID_PTR pReserved) /* reserved.  Should be NULL_PTR */
 {
 	sc_reader_t *found;
-	unsigned int mask, events;
+	unsigned int mask, events, generation;
 	void *reader_states = NULL;
 	CK_SLOT_ID slot_id;
 	CK_RV rv;
-	int r;
+	int r, monitored;
 
 	if (pReserved != NULL_PTR)
 		return  CKR_ARGUMENTS_BAD;
@@ -722,10 +849,27 @@ CK_RV C_WaitForSlotEvent(CK_FLAGS flags,   /* blocking/nonblocking flag */
 	mask = SC_EVENT_CARD_EVENTS | SC_EVENT_READER_EVENTS;
 	/* Detect and add new slots for added readers v2.20 */
 
+	monitored = slot_monitor_generation(&generation);
 	rv = slot_find_changed(&slot_id, mask);
 	if ((rv == CKR_OK) || (flags & CKF_DONT_BLOCK))
 		goto out;
 
+	/* Let the slot event monitor wake us up, if it is running */
+	while (monitored) {
+		sc_pkcs11_unlock();
+		slot_monitor_wait(generation);
+		/* Was C_Finalize called ? */
+		if (in_finalize == 1)
+			return CKR_CRYPTOKI_NOT_INITIALIZED;
+		if ((rv = sc_pkcs11_lock()) != CKR_OK)
+			return rv;
+
+		monitored = slot_monitor_generation(&generation);
+		rv = slot_find_changed(&slot_id, mask);
+		if (rv == CKR_OK)
+			goto out;
+	}
+
 again:
 	sc_log(context, "C_WaitForSlotEvent() reader_states:%p", reader_states);
 	sc_pkcs11_unlock();
@@ -883,6 +1027,192 @@ void sc_pkcs11_free_lock(void)
 	global_locking = NULL;
 }
 
+/*
+ * Slot event monitor
+ *
+ * With slot_event_monitor enabled, a thread waits for card and reader events
+ * of all readers and counts them in a generation number. Slot queries only
+ * detect cards again when the generation changed and C_WaitForSlotEvent()
+ * sleeps until it does, without holding the global lock.
+ */
+#if defined(PKCS11_THREAD_LOCKING) && defined(HAVE_PTHREAD)
+
+static pthread_mutex_t monitor_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t monitor_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t monitor_thread;
+static pid_t monitor_pid = (pid_t)-1;	/* process of the thread, if not joined */
+static int monitor_running = 0;		/* the thread is waiting for events */
+static int monitor_stop = 0;
+static unsigned int monitor_generation = 1;
+
+/* Called with monitor_lock held. Zero marks slots with a failed detection. */
+static void slot_monitor_next_generation(void)
+{
+	if (++monitor_generation == 0)
+		monitor_generation = 1;
+	pthread_cond_broadcast(&monitor_cond);
+}
+
+static void *slot_monitor_main(void *arg)
+{
+	unsigned int mask = SC_EVENT_CARD_EVENTS | SC_EVENT_READER_EVENTS;
+	void *reader_states = NULL;
+	sc_reader_t *found;
+	unsigned int events;
+	int r = SC_SUCCESS;
+
+	(void) arg;
+
+	for (;;) {
+		pthread_mutex_lock(&monitor_lock);
+		if (monitor_stop) {
+			pthread_mutex_unlock(&monitor_lock);
+			break;
+		}
+		pthread_mutex_unlock(&monitor_lock);
+
+		r = sc_wait_for_event(context, mask, &found, &events, -1, &reader_states);
+		if (r != SC_SUCCESS && r != SC_ERROR_EVENT_TIMEOUT)
+			break;
+
+		pthread_mutex_lock(&monitor_lock);
+		slot_monitor_next_generation();
+		pthread_mutex_unlock(&monitor_lock);
+	}
+
+	if (reader_states)
+		sc_wait_for_event(context, 0, NULL, NULL, -1, &reader_states);
+	sc_log(context, "Slot event monitor stopped: %s", sc_strerror(r));
+
+	pthread_mutex_lock(&monitor_lock);
+	monitor_running = 0;
+	slot_monitor_next_generation();
+	pthread_mutex_unlock(&monitor_lock);
+
+	return NULL;
+}
+
+void slot_monitor_start(void)
+{
+	if (!sc_pkcs11_conf.slot_event_monitor || context == NULL
+			|| sc_ctx_get_reader_count(context) == 0)
+		return;
+
+	pthread_mutex_lock(&monitor_lock);
+	if (monitor_pid == getpid()) {
+		if (monitor_running) {
+			pthread_mutex_unlock(&monitor_lock);
+			return;
+		}
+		/* the previous thread gave up, collect it */
+		pthread_mutex_unlock(&monitor_lock);
+		pthread_join(monitor_thread, NULL);
+		pthread_mutex_lock(&monitor_lock);
+		monitor_pid = (pid_t)-1;
+	}
+
+	monitor_stop = 0;
+	monitor_running = 1;
+	/* events before the start were not seen */
+	slot_monitor_next_generation();
+	if (pthread_create(&monitor_thread, NULL, slot_monitor_main, NULL) == 0) {
+		monitor_pid = getpid();
+		sc_log(context, "Slot event monitor started");
+	} else {
+		monitor_running = 0;
+		sc_log(context, "Failed to start the slot event monitor");
+	}
+	pthread_mutex_unlock(&monitor_lock);
+}
+
+void slot_monitor_stop(void)
+{
+	if (monitor_pid != getpid()) {
+		/* no thread, or it did not survive fork() */
+		if (monitor_pid != (pid_t)-1) {
+			pthread_mutex_init(&monitor_lock, NULL);
+			pthread_cond_init(&monitor_cond, NULL);
+			monitor_pid = (pid_t)-1;
+			monitor_running = 0;
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&monitor_lock);
+	monitor_stop = 1;
+	while (monitor_running) {
+		struct timeval now;
+		struct timespec deadline;
+
+		/* the thread may have missed the first cancellation while
+		 * it was not waiting, yet */
+		pthread_mutex_unlock(&monitor_lock);
+		sc_cancel(context);
+		pthread_mutex_lock(&monitor_lock);
+
+		gettimeofday(&now, NULL);
+		deadline.tv_sec = now.tv_sec + (now.tv_usec + 100000) / 1000000;
+		deadline.tv_nsec = ((now.tv_usec + 100000) % 1000000) * 1000;
+		if (monitor_running)
+			pthread_cond_timedwait(&monitor_cond, &monitor_lock, &deadline);
+	}
+	pthread_mutex_unlock(&monitor_lock);
+
+	pthread_join(monitor_thread, NULL);
+	monitor_pid = (pid_t)-1;
+}
+
+/* Returns whether the monitor is running and the current generation */
+int slot_monitor_generation(unsigned int *generation)
+{
+	int running;
+
+	pthread_mutex_lock(&monitor_lock);
+	*generation = monitor_generation;
+	running = monitor_running;
+	pthread_mutex_unlock(&monitor_lock);
+
+	return running;
+}
+
+/* Waits until the generation differs from the given one. Returns whether
+ * the monitor is still running */
+int slot_monitor_wait(unsigned int generation)
+{
+	int running;
+
+	pthread_mutex_lock(&monitor_lock);
+	while (monitor_running && monitor_generation == generation)
+		pthread_cond_wait(&monitor_cond, &monitor_lock);
+	running = monitor_running;
+	pthread_mutex_unlock(&monitor_lock);
+
+	return running;
+}
+
+#else
+
+void slot_monitor_start(void)
+{
+}
+
+void slot_monitor_stop(void)
+{
+}
+
+int slot_monitor_generation(unsigned int *generation)
+{
+	*generation = 0;
+	return 0;
+}
+
+int slot_monitor_wait(unsigned int generation)
+{
+	return 0;
+}
+
+#endif
+
 CK_FUNCTION_LIST pkcs11_function_list = {
 	{ 2, 11 }, /* Note: NSS/Firefox ignores this version number and uses C_GetInfo() */
 	C_Initialize,
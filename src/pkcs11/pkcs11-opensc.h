@@ -25,5 +25,15 @@
  * to set userConsent=1 for other objects than private keys via PKCS#11. */
 #define CKA_OPENSC_ALWAYS_AUTH_ANY_OBJECT (CKA_VENDOR_DEFINED | SC_VENDOR_DEFINED | 3UL)
 
+/*
+ * Vendor function exported by the OpenSC PKCS#11 module to be looked up
+ * with dlsym()/GetProcAddress(). It returns the performance counters of
+ * the module as text, one "name: value" pair per line. As usual in
+ * PKCS#11, call it with pStats == NULL to get the required length.
+ */
+#define C_OPENSC_GET_STATISTICS_NAME "C_OpenSC_GetStatistics"
+typedef CK_RV (*CK_C_OpenSC_GetStatistics)(CK_UTF8CHAR_PTR pStats, CK_ULONG_PTR pulStatsLen);
+CK_RV CK_SPEC C_OpenSC_GetStatistics(CK_UTF8CHAR_PTR pStats, CK_ULONG_PTR pulStatsLen);
+
 
 #endif
@@ -21,6 +21,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <signal.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -33,6 +35,7 @@
 
 #define CRYPTOKI_EXPORTS
 #include "pkcs11-display.h"
+#include "pkcs11-opensc.h"
 #include "common/libpkcs11.h"
 
 #define __PASTE(x,y)      x##y
@@ -48,11 +51,453 @@ static void *modhandle = NULL;
 /* Spy module output */
 static FILE *spy_output = NULL;
 
+/*
+ * Statistics mode (PKCS11SPY_MODE=stats)
+ *
+ * Instead of tracing every call, the function list handed out to the
+ * application points to thin wrappers which only count the calls and
+ * errors and record the latency in a log-linear (HDR style) histogram.
+ * Every thread updates its own buffer, so the hot path takes no lock.
+ * The aggregated summary is written to the spy output at C_Finalize or,
+ * where available, when SIGUSR1 is received between C_Initialize and
+ * C_Finalize.
+ */
+#define SPY_FUNCTIONS(X) \
+	X(C_Initialize, (CK_VOID_PTR pInitArgs), \
+		(pInitArgs)) \
+	X(C_Finalize, (CK_VOID_PTR pReserved), \
+		(pReserved)) \
+	X(C_GetInfo, (CK_INFO_PTR pInfo), \
+		(pInfo)) \
+	X(C_GetSlotList, (CK_BBOOL tokenPresent, CK_SLOT_ID_PTR pSlotList, CK_ULONG_PTR pulCount), \
+		(tokenPresent, pSlotList, pulCount)) \
+	X(C_GetSlotInfo, (CK_SLOT_ID slotID, CK_SLOT_INFO_PTR pInfo), \
+		(slotID, pInfo)) \
+	X(C_GetTokenInfo, (CK_SLOT_ID slotID, CK_TOKEN_INFO_PTR pInfo), \
+		(slotID, pInfo)) \
+	X(C_GetMechanismList, (CK_SLOT_ID slotID, CK_MECHANISM_TYPE_PTR pMechanismList, CK_ULONG_PTR pulCount), \
+		(slotID, pMechanismList, pulCount)) \
+	X(C_GetMechanismInfo, (CK_SLOT_ID slotID, CK_MECHANISM_TYPE type, CK_MECHANISM_INFO_PTR pInfo), \
+		(slotID, type, pInfo)) \
+	X(C_InitToken, (CK_SLOT_ID slotID, CK_UTF8CHAR_PTR pPin, CK_ULONG ulPinLen, CK_UTF8CHAR_PTR pLabel), \
+		(slotID, pPin, ulPinLen, pLabel)) \
+	X(C_InitPIN, (CK_SESSION_HANDLE hSession, CK_UTF8CHAR_PTR pPin, CK_ULONG ulPinLen), \
+		(hSession, pPin, ulPinLen)) \
+	X(C_SetPIN, (CK_SESSION_HANDLE hSession, CK_UTF8CHAR_PTR pOldPin, CK_ULONG ulOldLen, CK_UTF8CHAR_PTR pNewPin, CK_ULONG ulNewLen), \
+		(hSession, pOldPin, ulOldLen, pNewPin, ulNewLen)) \
+	X(C_OpenSession, (CK_SLOT_ID slotID, CK_FLAGS flags, CK_VOID_PTR pApplication, CK_NOTIFY Notify, CK_SESSION_HANDLE_PTR phSession), \
+		(slotID, flags, pApplication, Notify, phSession)) \
+	X(C_CloseSession, (CK_SESSION_HANDLE hSession), \
+		(hSession)) \
+	X(C_CloseAllSessions, (CK_SLOT_ID slotID), \
+		(slotID)) \
+	X(C_GetSessionInfo, (CK_SESSION_HANDLE hSession, CK_SESSION_INFO_PTR pInfo), \
+		(hSession, pInfo)) \
+	X(C_GetOperationState, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pOperationState, CK_ULONG_PTR pulOperationStateLen), \
+		(hSession, pOperationState, pulOperationStateLen)) \
+	X(C_SetOperationState, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pOperationState, CK_ULONG ulOperationStateLen, CK_OBJECT_HANDLE hEncryptionKey, CK_OBJECT_HANDLE hAuthenticationKey), \
+		(hSession, pOperationState, ulOperationStateLen, hEncryptionKey, hAuthenticationKey)) \
+	X(C_Login, (CK_SESSION_HANDLE hSession, CK_USER_TYPE userType, CK_UTF8CHAR_PTR pPin, CK_ULONG ulPinLen), \
+		(hSession, userType, pPin, ulPinLen)) \
+	X(C_Logout, (CK_SESSION_HANDLE hSession), \
+		(hSession)) \
+	X(C_CreateObject, (CK_SESSION_HANDLE hSession, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, CK_OBJECT_HANDLE_PTR phObject), \
+		(hSession, pTemplate, ulCount, phObject)) \
+	X(C_CopyObject, (CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, CK_OBJECT_HANDLE_PTR phNewObject), \
+		(hSession, hObject, pTemplate, ulCount, phNewObject)) \
+	X(C_DestroyObject, (CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject), \
+		(hSession, hObject)) \
+	X(C_GetObjectSize, (CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject, CK_ULONG_PTR pulSize), \
+		(hSession, hObject, pulSize)) \
+	X(C_GetAttributeValue, (CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount), \
+		(hSession, hObject, pTemplate, ulCount)) \
+	X(C_SetAttributeValue, (CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount), \
+		(hSession, hObject, pTemplate, ulCount)) \
+	X(C_FindObjectsInit, (CK_SESSION_HANDLE hSession, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount), \
+		(hSession, pTemplate, ulCount)) \
+	X(C_FindObjects, (CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE_PTR phObject, CK_ULONG ulMaxObjectCount, CK_ULONG_PTR pulObjectCount), \
+		(hSession, phObject, ulMaxObjectCount, pulObjectCount)) \
+	X(C_FindObjectsFinal, (CK_SESSION_HANDLE hSession), \
+		(hSession)) \
+	X(C_EncryptInit, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey), \
+		(hSession, pMechanism, hKey)) \
+	X(C_Encrypt, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pEncryptedData, CK_ULONG_PTR pulEncryptedDataLen), \
+		(hSession, pData, ulDataLen, pEncryptedData, pulEncryptedDataLen)) \
+	X(C_EncryptUpdate, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pEncryptedPart, CK_ULONG_PTR pulEncryptedPartLen), \
+		(hSession, pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen)) \
+	X(C_EncryptFinal, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pLastEncryptedPart, CK_ULONG_PTR pulLastEncryptedPartLen), \
+		(hSession, pLastEncryptedPart, pulLastEncryptedPartLen)) \
+	X(C_DecryptInit, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey), \
+		(hSession, pMechanism, hKey)) \
+	X(C_Decrypt, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedData, CK_ULONG ulEncryptedDataLen, CK_BYTE_PTR pData, CK_ULONG_PTR pulDataLen), \
+		(hSession, pEncryptedData, ulEncryptedDataLen, pData, pulDataLen)) \
+	X(C_DecryptUpdate, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedPart, CK_ULONG ulEncryptedPartLen, CK_BYTE_PTR pPart, CK_ULONG_PTR pulPartLen), \
+		(hSession, pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen)) \
+	X(C_DecryptFinal, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pLastPart, CK_ULONG_PTR pulLastPartLen), \
+		(hSession, pLastPart, pulLastPartLen)) \
+	X(C_DigestInit, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism), \
+		(hSession, pMechanism)) \
+	X(C_Digest, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen), \
+		(hSession, pData, ulDataLen, pDigest, pulDigestLen)) \
+	X(C_DigestUpdate, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen), \
+		(hSession, pPart, ulPartLen)) \
+	X(C_DigestKey, (CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey), \
+		(hSession, hKey)) \
+	X(C_DigestFinal, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen), \
+		(hSession, pDigest, pulDigestLen)) \
+	X(C_SignInit, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey), \
+		(hSession, pMechanism, hKey)) \
+	X(C_Sign, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen), \
+		(hSession, pData, ulDataLen, pSignature, pulSignatureLen)) \
+	X(C_SignUpdate, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen), \
+		(hSession, pPart, ulPartLen)) \
+	X(C_SignFinal, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen), \
+		(hSession, pSignature, pulSignatureLen)) \
+	X(C_SignRecoverInit, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey), \
+		(hSession, pMechanism, hKey)) \
+	X(C_SignRecover, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen), \
+		(hSession, pData, ulDataLen, pSignature, pulSignatureLen)) \
+	X(C_VerifyInit, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey), \
+		(hSession, pMechanism, hKey)) \
+	X(C_Verify, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen), \
+		(hSession, pData, ulDataLen, pSignature, ulSignatureLen)) \
+	X(C_VerifyUpdate, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen), \
+		(hSession, pPart, ulPartLen)) \
+	X(C_VerifyFinal, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen), \
+		(hSession, pSignature, ulSignatureLen)) \
+	X(C_VerifyRecoverInit, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey), \
+		(hSession, pMechanism, hKey)) \
+	X(C_VerifyRecover, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen, CK_BYTE_PTR pData, CK_ULONG_PTR pulDataLen), \
+		(hSession, pSignature, ulSignatureLen, pData, pulDataLen)) \
+	X(C_DigestEncryptUpdate, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pEncryptedPart, CK_ULONG_PTR pulEncryptedPartLen), \
+		(hSession, pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen)) \
+	X(C_DecryptDigestUpdate, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedPart, CK_ULONG ulEncryptedPartLen, CK_BYTE_PTR pPart, CK_ULONG_PTR pulPartLen), \
+		(hSession, pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen)) \
+	X(C_SignEncryptUpdate, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pEncryptedPart, CK_ULONG_PTR pulEncryptedPartLen), \
+		(hSession, pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen)) \
+	X(C_DecryptVerifyUpdate, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedPart, CK_ULONG ulEncryptedPartLen, CK_BYTE_PTR pPart, CK_ULONG_PTR pulPartLen), \
+		(hSession, pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen)) \
+	X(C_GenerateKey, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, CK_OBJECT_HANDLE_PTR phKey), \
+		(hSession, pMechanism, pTemplate, ulCount, phKey)) \
+	X(C_GenerateKeyPair, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_ATTRIBUTE_PTR pPublicKeyTemplate, CK_ULONG ulPublicKeyAttributeCount, CK_ATTRIBUTE_PTR pPrivateKeyTemplate, CK_ULONG ulPrivateKeyAttributeCount, CK_OBJECT_HANDLE_PTR phPublicKey, CK_OBJECT_HANDLE_PTR phPrivateKey), \
+		(hSession, pMechanism, pPublicKeyTemplate, ulPublicKeyAttributeCount, pPrivateKeyTemplate, ulPrivateKeyAttributeCount, phPublicKey, phPrivateKey)) \
+	X(C_WrapKey, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hWrappingKey, CK_OBJECT_HANDLE hKey, CK_BYTE_PTR pWrappedKey, CK_ULONG_PTR pulWrappedKeyLen), \
+		(hSession, pMechanism, hWrappingKey, hKey, pWrappedKey, pulWrappedKeyLen)) \
+	X(C_UnwrapKey, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hUnwrappingKey, CK_BYTE_PTR pWrappedKey, CK_ULONG ulWrappedKeyLen, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulAttributeCount, CK_OBJECT_HANDLE_PTR phKey), \
+		(hSession, pMechanism, hUnwrappingKey, pWrappedKey, ulWrappedKeyLen, pTemplate, ulAttributeCount, phKey)) \
+	X(C_DeriveKey, (CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hBaseKey, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulAttributeCount, CK_OBJECT_HANDLE_PTR phKey), \
+		(hSession, pMechanism, hBaseKey, pTemplate, ulAttributeCount, phKey)) \
+	X(C_SeedRandom, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSeed, CK_ULONG ulSeedLen), \
+		(hSession, pSeed, ulSeedLen)) \
+	X(C_GenerateRandom, (CK_SESSION_HANDLE hSession, CK_BYTE_PTR RandomData, CK_ULONG ulRandomLen), \
+		(hSession, RandomData, ulRandomLen)) \
+	X(C_GetFunctionStatus, (CK_SESSION_HANDLE hSession), \
+		(hSession)) \
+	X(C_CancelFunction, (CK_SESSION_HANDLE hSession), \
+		(hSession)) \
+	X(C_WaitForSlotEvent, (CK_FLAGS flags, CK_SLOT_ID_PTR pSlot, CK_VOID_PTR pRserved), \
+		(flags, pSlot, pRserved))
+
+#define SPY_FN_ENUM(name, decl, args) SPY_FN_##name,
+enum {
+	SPY_FUNCTIONS(SPY_FN_ENUM)
+	SPY_FN_MAX
+};
+
+#define SPY_FN_NAME(name, decl, args) #name,
+static const char *spy_fn_names[SPY_FN_MAX] = {
+	SPY_FUNCTIONS(SPY_FN_NAME)
+};
+
+/* 2^SPY_HIST_SUB_BITS linear sub-buckets per power of two, microseconds */
+#define SPY_HIST_SUB_BITS	3
+#define SPY_HIST_SUB		(1 << SPY_HIST_SUB_BITS)
+#define SPY_HIST_MAX_BIT	32
+#define SPY_HIST_BUCKETS	((SPY_HIST_MAX_BIT - SPY_HIST_SUB_BITS + 1) * SPY_HIST_SUB)
+
+struct spy_fn_stats {
+	unsigned long long count;
+	unsigned long long errors;
+	unsigned long long total_us;
+	unsigned long long max_us;
+	unsigned int hist[SPY_HIST_BUCKETS];
+};
+
+struct spy_thread_stats {
+	struct spy_thread_stats *next;
+	struct spy_fn_stats fn[SPY_FN_MAX];
+};
+
+#if defined(_MSC_VER)
+#define SPY_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define SPY_THREAD_LOCAL __thread
+#endif
+
+static int spy_stats_mode = 0;
+/* all per-thread buffers, never freed while the spy is loaded */
+static struct spy_thread_stats *spy_stats_list = NULL;
+#ifdef SPY_THREAD_LOCAL
+static SPY_THREAD_LOCAL struct spy_thread_stats *spy_stats_own = NULL;
+#else
+static struct spy_thread_stats *spy_stats_own = NULL;
+#endif
+#ifdef SIGUSR1
+static volatile sig_atomic_t spy_stats_dump_requested = 0;
+/* handler of the application, restored at C_Finalize */
+static void (*spy_stats_prev_handler)(int) = SIG_ERR;
+#endif
+
+static void spy_stats_dump(void);
+static void spy_stats_signal_install(void);
+static void spy_stats_signal_restore(void);
+
+static unsigned long long
+spy_timestamp(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (unsigned long long) (now.QuadPart / (double) freq.QuadPart * 1000000);
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+	return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static unsigned int
+spy_hist_bucket(unsigned long long us)
+{
+	unsigned int msb = 0;
+
+	if (us < SPY_HIST_SUB)
+		return (unsigned int) us;
+	if (us >= (1ULL << SPY_HIST_MAX_BIT))
+		return SPY_HIST_BUCKETS - 1;
+	while ((us >> (msb + 1)) != 0)
+		msb++;
+	return (msb - SPY_HIST_SUB_BITS + 1) * SPY_HIST_SUB
+		+ (unsigned int) ((us >> (msb - SPY_HIST_SUB_BITS)) & (SPY_HIST_SUB - 1));
+}
+
+/* highest value which still falls into the given bucket */
+static unsigned long long
+spy_hist_value(unsigned int bucket)
+{
+	unsigned int msb, sub;
+
+	if (bucket < SPY_HIST_SUB)
+		return bucket;
+	msb = bucket / SPY_HIST_SUB + SPY_HIST_SUB_BITS - 1;
+	sub = bucket % SPY_HIST_SUB;
+	return (((unsigned long long) SPY_HIST_SUB + sub + 1) << (msb - SPY_HIST_SUB_BITS)) - 1;
+}
+
+static struct spy_thread_stats *
+spy_stats_thread(void)
+{
+	struct spy_thread_stats *ts = spy_stats_own;
+
+	if (ts != NULL)
+		return ts;
+
+	ts = calloc(1, sizeof(*ts));
+	if (ts == NULL)
+		return NULL;
+	/* lock-free push onto the list of buffers */
+#if defined(_WIN32)
+	do {
+		ts->next = spy_stats_list;
+	} while (InterlockedCompareExchangePointer((PVOID volatile *) &spy_stats_list,
+				ts, ts->next) != ts->next);
+#elif defined(__GNUC__)
+	ts->next = __atomic_load_n(&spy_stats_list, __ATOMIC_ACQUIRE);
+	while (!__atomic_compare_exchange_n(&spy_stats_list, &ts->next, ts,
+				0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+		;
+#else
+	ts->next = spy_stats_list;
+	spy_stats_list = ts;
+#endif
+	spy_stats_own = ts;
+	return ts;
+}
+
+static CK_RV
+spy_stats_record(int fn, unsigned long long start, CK_RV rv)
+{
+	struct spy_thread_stats *ts = spy_stats_thread();
+	unsigned long long now = spy_timestamp(), elapsed;
+	struct spy_fn_stats *s;
+
+	if (ts != NULL) {
+		elapsed = now > start ? now - start : 0;
+		s = &ts->fn[fn];
+		s->count++;
+		if (rv != CKR_OK)
+			s->errors++;
+		s->total_us += elapsed;
+		if (elapsed > s->max_us)
+			s->max_us = elapsed;
+		s->hist[spy_hist_bucket(elapsed)]++;
+	}
+
+#ifdef SIGUSR1
+	if (spy_stats_dump_requested) {
+		spy_stats_dump_requested = 0;
+		spy_stats_dump();
+	}
+#endif
+	if (fn == SPY_FN_C_Initialize && rv == CKR_OK)
+		spy_stats_signal_install();
+	if (fn == SPY_FN_C_Finalize) {
+		spy_stats_dump();
+		spy_stats_signal_restore();
+	}
+	return rv;
+}
+
+#define SPY_FN_STATS(name, decl, args) \
+static CK_RV \
+stats_##name decl \
+{ \
+	unsigned long long start = spy_timestamp(); \
+	return spy_stats_record(SPY_FN_##name, start, po->name args); \
+}
+SPY_FUNCTIONS(SPY_FN_STATS)
+
+static unsigned long long
+spy_hist_percentile(const struct spy_fn_stats *s, double percentile)
+{
+	unsigned long long seen = 0, wanted;
+	unsigned int i;
+
+	wanted = (unsigned long long) (s->count * percentile / 100.0 + 0.5);
+	if (wanted == 0)
+		wanted = 1;
+	for (i = 0; i < SPY_HIST_BUCKETS; i++) {
+		seen += s->hist[i];
+		if (seen >= wanted)
+			break;
+	}
+	if (i == SPY_HIST_BUCKETS)
+		return s->max_us;
+	return spy_hist_value(i) < s->max_us ? spy_hist_value(i) : s->max_us;
+}
+
+static void
+spy_stats_dump(void)
+{
+	struct spy_fn_stats *sum;
+	struct spy_thread_stats *ts;
+	unsigned int threads = 0;
+	int fn, i;
+
+	sum = calloc(SPY_FN_MAX, sizeof(*sum));
+	if (sum == NULL)
+		return;
+
+	/* the other threads may still be running: the totals are approximate */
+	for (ts = spy_stats_list; ts != NULL; ts = ts->next) {
+		threads++;
+		for (fn = 0; fn < SPY_FN_MAX; fn++) {
+			sum[fn].count += ts->fn[fn].count;
+			sum[fn].errors += ts->fn[fn].errors;
+			sum[fn].total_us += ts->fn[fn].total_us;
+			if (ts->fn[fn].max_us > sum[fn].max_us)
+				sum[fn].max_us = ts->fn[fn].max_us;
+			for (i = 0; i < SPY_HIST_BUCKETS; i++)
+				sum[fn].hist[i] += ts->fn[fn].hist[i];
+		}
+	}
+
+	fprintf(spy_output, "\n*************** PKCS#11 spy statistics *****************\n");
+	fprintf(spy_output, "threads: %u, times in microseconds\n", threads);
+	fprintf(spy_output, "%-24s %10s %8s %10s %10s %10s %10s %10s\n",
+			"function", "calls", "errors", "avg", "p50", "p90", "p99", "max");
+	for (fn = 0; fn < SPY_FN_MAX; fn++) {
+		const struct spy_fn_stats *s = &sum[fn];
+
+		if (s->count == 0)
+			continue;
+		fprintf(spy_output, "%-24s %10llu %8llu %10llu %10llu %10llu %10llu %10llu\n",
+				spy_fn_names[fn], s->count, s->errors, s->total_us / s->count,
+				spy_hist_percentile(s, 50), spy_hist_percentile(s, 90),
+				spy_hist_percentile(s, 99), s->max_us);
+	}
+	fflush(spy_output);
+	free(sum);
+}
+
+#ifdef SIGUSR1
+static void
+spy_stats_signal(int sig)
+{
+	(void) sig;
+	/* dumped by the next call returning through the spy */
+	spy_stats_dump_requested = 1;
+}
+#endif
+
+static void
+spy_stats_signal_install(void)
+{
+#ifdef SIGUSR1
+	void (*prev)(int);
+
+	if (spy_stats_prev_handler != SIG_ERR)
+		return;
+	/* do not steal the signal from an application handling it */
+	prev = signal(SIGUSR1, spy_stats_signal);
+	if (prev != SIG_DFL && prev != SIG_ERR)
+		signal(SIGUSR1, prev);
+	else if (prev == SIG_DFL)
+		spy_stats_prev_handler = prev;
+#endif
+}
+
+static void
+spy_stats_signal_restore(void)
+{
+#ifdef SIGUSR1
+	void (*cur)(int);
+
+	if (spy_stats_prev_handler == SIG_ERR)
+		return;
+	/* leave a handler installed by the application meanwhile alone */
+	cur = signal(SIGUSR1, spy_stats_prev_handler);
+	if (cur != spy_stats_signal && cur != SIG_ERR)
+		signal(SIGUSR1, cur);
+	spy_stats_prev_handler = SIG_ERR;
+	spy_stats_dump_requested = 0;
+#endif
+}
+
+static void
+spy_stats_init(void)
+{
+	spy_stats_mode = 1;
+#define SPY_FN_INSTALL(name, decl, args) pkcs11_spy->name = stats_##name;
+	SPY_FUNCTIONS(SPY_FN_INSTALL)
+}
+
 /* Inits the spy. If successful, po != NULL */
 static CK_RV
 init_spy(void)
 {
-	const char *output, *module;
+	const char *output, *module, *mode;
 	CK_RV rv = CKR_OK;
 #ifdef _WIN32
         char temp_path[PATH_MAX], expanded_path[PATH_MAX];
@@ -183,6 +628,10 @@ init_spy(void)
 
 	fprintf(spy_output, "\n\n*************** OpenSC PKCS#11 spy *****************\n");
 
+	mode = getenv("PKCS11SPY_MODE");
+	if (mode && !strcmp(mode, "stats"))
+		spy_stats_init();
+
 	module = getenv("PKCS11SPY");
 #ifdef _WIN32
 	if (!module) {
@@ -245,6 +694,9 @@ enter(const char *function)
 	char time_string[40];
 #endif
 
+	if (spy_stats_mode)
+		return;
+
 	fprintf(spy_output, "\n%d: %s\n", count++, function);
 #ifdef _WIN32
         GetLocalTime(&st);
@@ -262,6 +714,8 @@ enter(const char *function)
 static CK_RV
 retne(CK_RV rv)
 {
+	if (spy_stats_mode)
+		return rv;
 	fprintf(spy_output, "Returned:  %ld %s\n", (unsigned long) rv, lookup_enum ( RV_T, rv ));
 	fflush(spy_output);
 	return rv;
@@ -361,6 +815,9 @@ C_Initialize(CK_VOID_PTR pInitArgs)
 			return rv;
 	}
 
+	if (spy_stats_mode)
+		return stats_C_Initialize(pInitArgs);
+
 	enter("C_Initialize");
 	print_ptr_in("pInitArgs", pInitArgs);
 
@@ -382,6 +839,9 @@ C_Finalize(CK_VOID_PTR pReserved)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_Finalize(pReserved);
+
 	enter("C_Finalize");
 	rv = po->C_Finalize(pReserved);
 	return retne(rv);
@@ -392,6 +852,9 @@ C_GetInfo(CK_INFO_PTR pInfo)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetInfo(pInfo);
+
 	enter("C_GetInfo");
 	rv = po->C_GetInfo(pInfo);
 	if(rv == CKR_OK) {
@@ -407,6 +870,9 @@ C_GetSlotList(CK_BBOOL tokenPresent, CK_SLOT_ID_PTR pSlotList,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetSlotList(tokenPresent, pSlotList, pulCount);
+
 	enter("C_GetSlotList");
 	spy_dump_ulong_in("tokenPresent", tokenPresent);
 	rv = po->C_GetSlotList(tokenPresent, pSlotList, pulCount);
@@ -423,6 +889,9 @@ C_GetSlotInfo(CK_SLOT_ID slotID, CK_SLOT_INFO_PTR pInfo)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetSlotInfo(slotID, pInfo);
+
 	enter("C_GetSlotInfo");
 	spy_dump_ulong_in("slotID", slotID);
 	rv = po->C_GetSlotInfo(slotID, pInfo);
@@ -439,6 +908,9 @@ C_GetTokenInfo(CK_SLOT_ID slotID,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetTokenInfo(slotID, pInfo);
+
 	enter("C_GetTokenInfo");
 	spy_dump_ulong_in("slotID", slotID);
 	rv = po->C_GetTokenInfo(slotID, pInfo);
@@ -455,6 +927,9 @@ C_GetMechanismList(CK_SLOT_ID  slotID, CK_MECHANISM_TYPE_PTR pMechanismList,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetMechanismList(slotID, pMechanismList, pulCount);
+
 	enter("C_GetMechanismList");
 	spy_dump_ulong_in("slotID", slotID);
 	rv = po->C_GetMechanismList(slotID, pMechanismList, pulCount);
@@ -472,6 +947,9 @@ C_GetMechanismInfo(CK_SLOT_ID  slotID, CK_MECHANISM_TYPE type,
 	CK_RV rv;
 	const char *name = lookup_enum(MEC_T, type);
 
+	if (spy_stats_mode)
+		return stats_C_GetMechanismInfo(slotID, type, pInfo);
+
 	enter("C_GetMechanismInfo");
 	spy_dump_ulong_in("slotID", slotID);
 	if (name)
@@ -493,6 +971,9 @@ C_InitToken (CK_SLOT_ID slotID, CK_UTF8CHAR_PTR pPin, CK_ULONG ulPinLen,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_InitToken(slotID, pPin, ulPinLen, pLabel);
+
 	enter("C_InitToken");
 	spy_dump_ulong_in("slotID", slotID);
 	spy_dump_string_in("pPin[ulPinLen]", pPin, ulPinLen);
@@ -506,6 +987,9 @@ C_InitPIN(CK_SESSION_HANDLE hSession, CK_UTF8CHAR_PTR pPin, CK_ULONG  ulPinLen)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_InitPIN(hSession, pPin, ulPinLen);
+
 	enter("C_InitPIN");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pPin[ulPinLen]", pPin, ulPinLen);
@@ -519,6 +1003,9 @@ C_SetPIN(CK_SESSION_HANDLE hSession, CK_UTF8CHAR_PTR pOldPin, CK_ULONG  ulOldLen
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SetPIN(hSession, pOldPin, ulOldLen, pNewPin, ulNewLen);
+
 	enter("C_SetPIN");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pOldPin[ulOldLen]", pOldPin, ulOldLen);
@@ -533,6 +1020,9 @@ C_OpenSession(CK_SLOT_ID  slotID, CK_FLAGS  flags, CK_VOID_PTR  pApplication,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_OpenSession(slotID, flags, pApplication, Notify, phSession);
+
 	enter("C_OpenSession");
 	spy_dump_ulong_in("slotID", slotID);
 	spy_dump_ulong_in("flags", flags);
@@ -548,6 +1038,9 @@ C_CloseSession(CK_SESSION_HANDLE hSession)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_CloseSession(hSession);
+
 	enter("C_CloseSession");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_CloseSession(hSession);
@@ -558,6 +1051,10 @@ CK_RV
 C_CloseAllSessions(CK_SLOT_ID slotID)
 {
 	CK_RV rv;
+
+	if (spy_stats_mode)
+		return stats_C_CloseAllSessions(slotID);
+
 	enter("C_CloseAllSessions");
 	spy_dump_ulong_in("slotID", slotID);
 	rv = po->C_CloseAllSessions(slotID);
@@ -569,6 +1066,9 @@ C_GetSessionInfo(CK_SESSION_HANDLE hSession, CK_SESSION_INFO_PTR pInfo)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetSessionInfo(hSession, pInfo);
+
 	enter("C_GetSessionInfo");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_GetSessionInfo(hSession, pInfo);
@@ -585,6 +1085,9 @@ C_GetOperationState(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pOperationState,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetOperationState(hSession, pOperationState, pulOperationStateLen);
+
 	enter("C_GetOperationState");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_GetOperationState(hSession, pOperationState, pulOperationStateLen);
@@ -599,6 +1102,10 @@ C_SetOperationState(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pOperationState, CK_
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SetOperationState(hSession, pOperationState, ulOperationStateLen,
+				hEncryptionKey, hAuthenticationKey);
+
 	enter("SetOperationState");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pOperationState[ulOperationStateLen]", pOperationState, ulOperationStateLen);
@@ -615,6 +1122,9 @@ C_Login(CK_SESSION_HANDLE hSession, CK_USER_TYPE userType,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_Login(hSession, userType, pPin, ulPinLen);
+
 	enter("C_Login");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "[in] userType = %s\n",
@@ -628,6 +1138,10 @@ CK_RV
 C_Logout(CK_SESSION_HANDLE hSession)
 {
 	CK_RV rv;
+
+	if (spy_stats_mode)
+		return stats_C_Logout(hSession);
+
 	enter("C_Logout");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_Logout(hSession);
@@ -640,6 +1154,9 @@ C_CreateObject(CK_SESSION_HANDLE hSession, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_CreateObject(hSession, pTemplate, ulCount, phObject);
+
 	enter("C_CreateObject");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_attribute_list_in("pTemplate", pTemplate, ulCount);
@@ -658,6 +1175,9 @@ C_CopyObject(CK_SESSION_HANDLE hSession,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_CopyObject(hSession, hObject, pTemplate, ulCount, phNewObject);
+
 	enter("C_CopyObject");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_ulong_in("hObject", hObject);
@@ -674,6 +1194,9 @@ C_DestroyObject(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DestroyObject(hSession, hObject);
+
 	enter("C_DestroyObject");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_ulong_in("hObject", hObject);
@@ -686,6 +1209,9 @@ C_GetObjectSize(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject, CK_ULONG_P
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetObjectSize(hSession, hObject, pulSize);
+
 	enter("C_GetObjectSize");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_ulong_in("hObject", hObject);
@@ -702,6 +1228,9 @@ C_GetAttributeValue(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetAttributeValue(hSession, hObject, pTemplate, ulCount);
+
 	enter("C_GetAttributeValue");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_ulong_in("hObject", hObject);
@@ -726,6 +1255,9 @@ C_SetAttributeValue(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SetAttributeValue(hSession, hObject, pTemplate, ulCount);
+
 	enter("C_SetAttributeValue");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_ulong_in("hObject", hObject);
@@ -739,6 +1271,9 @@ C_FindObjectsInit(CK_SESSION_HANDLE hSession, CK_ATTRIBUTE_PTR pTemplate, CK_ULO
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_FindObjectsInit(hSession, pTemplate, ulCount);
+
 	enter("C_FindObjectsInit");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_attribute_list_in("pTemplate", pTemplate, ulCount);
@@ -752,6 +1287,9 @@ C_FindObjects(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE_PTR phObject, CK_ULON
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_FindObjects(hSession, phObject, ulMaxObjectCount, pulObjectCount);
+
 	enter("C_FindObjects");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_ulong_in("ulMaxObjectCount", ulMaxObjectCount);
@@ -770,6 +1308,9 @@ C_FindObjectsFinal(CK_SESSION_HANDLE hSession)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_FindObjectsFinal(hSession);
+
 	enter("C_FindObjectsFinal");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_FindObjectsFinal(hSession);
@@ -781,6 +1322,9 @@ C_EncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_EncryptInit(hSession, pMechanism, hKey);
+
 	enter("C_EncryptInit");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -815,6 +1359,10 @@ C_Encrypt(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG  ulDataLen,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_Encrypt(hSession, pData, ulDataLen, pEncryptedData,
+				pulEncryptedDataLen);
+
 	enter("C_Encrypt");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pData[ulDataLen]", pData, ulDataLen);
@@ -830,6 +1378,10 @@ C_EncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG  ulPartL
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_EncryptUpdate(hSession, pPart, ulPartLen, pEncryptedPart,
+				pulEncryptedPartLen);
+
 	enter("C_EncryptUpdate");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pPart[ulPartLen]", pPart, ulPartLen);
@@ -844,6 +1396,9 @@ C_EncryptFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pLastEncryptedPart, CK_UL
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_EncryptFinal(hSession, pLastEncryptedPart, pulLastEncryptedPartLen);
+
 	enter("C_EncryptFinal");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_EncryptFinal(hSession, pLastEncryptedPart, pulLastEncryptedPartLen);
@@ -859,6 +1414,9 @@ C_DecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DecryptInit(hSession, pMechanism, hKey);
+
 	enter("C_DecryptInit");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -894,6 +1452,10 @@ C_Decrypt(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedData, CK_ULONG  ulEn
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_Decrypt(hSession, pEncryptedData, ulEncryptedDataLen, pData,
+				pulDataLen);
+
 	enter("C_Decrypt");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pEncryptedData[ulEncryptedDataLen]", pEncryptedData, ulEncryptedDataLen);
@@ -910,6 +1472,10 @@ C_DecryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedPart, CK_ULONG
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DecryptUpdate(hSession, pEncryptedPart, ulEncryptedPartLen,
+				pPart, pulPartLen);
+
 	enter("C_DecryptUpdate");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pEncryptedPart[ulEncryptedPartLen]", pEncryptedPart, ulEncryptedPartLen);
@@ -925,6 +1491,9 @@ C_DecryptFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pLastPart, CK_ULONG_PTR p
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DecryptFinal(hSession, pLastPart, pulLastPartLen);
+
 	enter("C_DecryptFinal");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_DecryptFinal(hSession, pLastPart, pulLastPartLen);
@@ -939,6 +1508,9 @@ C_DigestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DigestInit(hSession, pMechanism);
+
 	enter("C_DigestInit");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -952,6 +1524,9 @@ C_Digest(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG  ulDataLen,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_Digest(hSession, pData, ulDataLen, pDigest, pulDigestLen);
+
 	enter("C_Digest");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pData[ulDataLen]", pData, ulDataLen);
@@ -967,6 +1542,9 @@ C_DigestUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG  ulPartLe
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DigestUpdate(hSession, pPart, ulPartLen);
+
 	enter("C_DigestUpdate");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pPart[ulPartLen]", pPart, ulPartLen);
@@ -979,6 +1557,9 @@ C_DigestKey(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DigestKey(hSession, hKey);
+
 	enter("C_DigestKey");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_ulong_in("hKey", hKey);
@@ -991,6 +1572,9 @@ C_DigestFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pDigest, CK_ULONG_PTR pulD
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DigestFinal(hSession, pDigest, pulDigestLen);
+
 	enter("C_DigestFinal");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_DigestFinal(hSession, pDigest, pulDigestLen);
@@ -1005,6 +1589,9 @@ C_SignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HA
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SignInit(hSession, pMechanism, hKey);
+
 	enter("C_SignInit");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -1040,6 +1627,9 @@ C_Sign(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG  ulDataLen,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_Sign(hSession, pData, ulDataLen, pSignature, pulSignatureLen);
+
 	enter("C_Sign");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pData[ulDataLen]", pData, ulDataLen);
@@ -1055,6 +1645,9 @@ C_SignUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG  ulPartLen)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SignUpdate(hSession, pPart, ulPartLen);
+
 	enter("C_SignUpdate");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pPart[ulPartLen]", pPart, ulPartLen);
@@ -1067,6 +1660,9 @@ C_SignFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG_PTR pul
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SignFinal(hSession, pSignature, pulSignatureLen);
+
 	enter("C_SignFinal");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_SignFinal(hSession, pSignature, pulSignatureLen);
@@ -1081,6 +1677,9 @@ C_SignRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OB
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SignRecoverInit(hSession, pMechanism, hKey);
+
 	enter("C_SignRecoverInit");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n",
@@ -1096,6 +1695,9 @@ C_SignRecover(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG  ulDataLen
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SignRecover(hSession, pData, ulDataLen, pSignature, pulSignatureLen);
+
 	enter("C_SignRecover");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pData[ulDataLen]", pData, ulDataLen);
@@ -1110,6 +1712,9 @@ C_VerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_VerifyInit(hSession, pMechanism, hKey);
+
 	enter("C_VerifyInit");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -1145,6 +1750,9 @@ C_Verify(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG  ulDataLen,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_Verify(hSession, pData, ulDataLen, pSignature, ulSignatureLen);
+
 	enter("C_Verify");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pData[ulDataLen]", pData, ulDataLen);
@@ -1158,6 +1766,9 @@ C_VerifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG  ulPartLe
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_VerifyUpdate(hSession, pPart, ulPartLen);
+
 	enter("C_VerifyUpdate");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pPart[ulPartLen]", pPart, ulPartLen);
@@ -1170,6 +1781,9 @@ C_VerifyFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG  ulSi
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_VerifyFinal(hSession, pSignature, ulSignatureLen);
+
 	enter("C_VerifyFinal");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pSignature[ulSignatureLen]", pSignature, ulSignatureLen);
@@ -1184,6 +1798,9 @@ C_VerifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_VerifyRecoverInit(hSession, pMechanism, hKey);
+
 	enter("C_VerifyRecoverInit");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -1198,6 +1815,10 @@ C_VerifyRecover(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG  ul
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_VerifyRecover(hSession, pSignature, ulSignatureLen, pData,
+				pulDataLen);
+
 	enter("C_VerifyRecover");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pSignature[ulSignatureLen]", pSignature, ulSignatureLen);
@@ -1213,6 +1834,10 @@ C_DigestEncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG  u
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DigestEncryptUpdate(hSession, pPart, ulPartLen, pEncryptedPart,
+				pulEncryptedPartLen);
+
 	enter("C_DigestEncryptUpdate");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pPart[ulPartLen]", pPart, ulPartLen);
@@ -1229,6 +1854,10 @@ C_DecryptDigestUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedPart,CK_
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DecryptDigestUpdate(hSession, pEncryptedPart, ulEncryptedPartLen,
+				pPart, pulPartLen);
+
 	enter("C_DecryptDigestUpdate");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pEncryptedPart[ulEncryptedPartLen]", pEncryptedPart, ulEncryptedPartLen);
@@ -1244,6 +1873,10 @@ C_SignEncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG  ulP
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SignEncryptUpdate(hSession, pPart, ulPartLen, pEncryptedPart,
+				pulEncryptedPartLen);
+
 	enter("C_SignEncryptUpdate");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pPart[ulPartLen]", pPart, ulPartLen);
@@ -1260,6 +1893,10 @@ C_DecryptVerifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedPart, CK
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DecryptVerifyUpdate(hSession, pEncryptedPart, ulEncryptedPartLen,
+				pPart, pulPartLen);
+
 	enter("C_DecryptVerifyUpdate");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pEncryptedPart[ulEncryptedPartLen]", pEncryptedPart, ulEncryptedPartLen);
@@ -1277,6 +1914,9 @@ C_GenerateKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GenerateKey(hSession, pMechanism, pTemplate, ulCount, phKey);
+
 	enter("C_GenerateKey");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -1296,6 +1936,11 @@ C_GenerateKeyPair(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GenerateKeyPair(hSession, pMechanism, pPublicKeyTemplate,
+				ulPublicKeyAttributeCount, pPrivateKeyTemplate,
+				ulPrivateKeyAttributeCount, phPublicKey, phPrivateKey);
+
 	enter("C_GenerateKeyPair");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -1319,6 +1964,10 @@ C_WrapKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_WrapKey(hSession, pMechanism, hWrappingKey, hKey, pWrappedKey,
+				pulWrappedKeyLen);
+
 	enter("C_WrapKey");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -1339,6 +1988,10 @@ C_UnwrapKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism,
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_UnwrapKey(hSession, pMechanism, hUnwrappingKey, pWrappedKey,
+				ulWrappedKeyLen, pTemplate, ulAttributeCount, phKey);
+
 	enter("C_UnwrapKey");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "pMechanism->type=%s\n", lookup_enum(MEC_T, pMechanism->mechanism));
@@ -1358,6 +2011,10 @@ C_DeriveKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_H
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_DeriveKey(hSession, pMechanism, hBaseKey, pTemplate,
+				ulAttributeCount, phKey);
+
 	enter("C_DeriveKey");
 	spy_dump_ulong_in("hSession", hSession);
 	fprintf(spy_output, "[in] pMechanism->type=%s\n",
@@ -1420,6 +2077,9 @@ C_SeedRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSeed, CK_ULONG  ulSeedLen)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_SeedRandom(hSession, pSeed, ulSeedLen);
+
 	enter("C_SeedRandom");
 	spy_dump_ulong_in("hSession", hSession);
 	spy_dump_string_in("pSeed[ulSeedLen]", pSeed, ulSeedLen);
@@ -1432,6 +2092,9 @@ C_GenerateRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR RandomData, CK_ULONG  u
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GenerateRandom(hSession, RandomData, ulRandomLen);
+
 	enter("C_GenerateRandom");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_GenerateRandom(hSession, RandomData, ulRandomLen);
@@ -1445,6 +2108,9 @@ C_GetFunctionStatus(CK_SESSION_HANDLE hSession)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_GetFunctionStatus(hSession);
+
 	enter("C_GetFunctionStatus");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_GetFunctionStatus(hSession);
@@ -1456,6 +2122,9 @@ C_CancelFunction(CK_SESSION_HANDLE hSession)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_CancelFunction(hSession);
+
 	enter("C_CancelFunction");
 	spy_dump_ulong_in("hSession", hSession);
 	rv = po->C_CancelFunction(hSession);
@@ -1467,8 +2136,31 @@ C_WaitForSlotEvent(CK_FLAGS flags, CK_SLOT_ID_PTR pSlot, CK_VOID_PTR pRserved)
 {
 	CK_RV rv;
 
+	if (spy_stats_mode)
+		return stats_C_WaitForSlotEvent(flags, pSlot, pRserved);
+
 	enter("C_WaitForSlotEvent");
 	spy_dump_ulong_in("flags", flags);
 	rv = po->C_WaitForSlotEvent(flags, pSlot, pRserved);
 	return retne(rv);
 }
+
+CK_RV CK_SPEC
+C_OpenSC_GetStatistics(CK_UTF8CHAR_PTR pStats, CK_ULONG_PTR pulStatsLen)
+{
+	CK_C_OpenSC_GetStatistics get_statistics;
+	CK_RV rv;
+
+	if (po == NULL)
+		return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	enter("C_OpenSC_GetStatistics");
+	get_statistics = (CK_C_OpenSC_GetStatistics)
+		C_GetModuleSymbol(modhandle, C_OPENSC_GET_STATISTICS_NAME);
+	if (get_statistics == NULL)
+		return retne(CKR_FUNCTION_NOT_SUPPORTED);
+	rv = get_statistics(pStats, pulStatsLen);
+	if (rv == CKR_OK && pStats != NULL_PTR)
+		spy_dump_string_out("pStats[*pulStatsLen]", pStats, *pulStatsLen);
+	return retne(rv);
+}
@@ -74,6 +74,8 @@ struct sc_pkcs11_config {
 	unsigned int create_puk_slot;
 	unsigned int create_slots_flags;
 	unsigned char ignore_pin_length;
+	unsigned char slot_event_monitor;
+	unsigned char reuse_tokens_after_fork;
 };
 
 /*
@@ -176,6 +178,8 @@ struct sc_pkcs11_framework_ops {
 				CK_OBJECT_HANDLE_PTR, CK_OBJECT_HANDLE_PTR);
 	CK_RV (*get_random)(struct sc_pkcs11_slot *,
 				CK_BYTE_PTR, CK_ULONG);
+	/* Forget the secrets kept for the parent in a forked child */
+	CK_RV (*reinit_after_fork)(struct sc_pkcs11_card *);
 };
 
 /*
@@ -218,6 +222,7 @@ struct sc_pkcs11_slot {
 	list_t objects;			/* Objects in this slot */
 	unsigned int nsessions;		/* Number of sessions using this slot */
 	sc_timestamp_t slot_state_expires;
+	unsigned int monitor_generation;	/* slot event monitor generation of the last detection */
 
 	int fw_data_idx;		/* Index of framework data */
 	struct sc_app_info *app_info;	/* Application associated to slot */
@@ -365,6 +370,7 @@ void sc_pkcs11_print_attrs(int level, const char *file, unsigned int line, const
 /* Slot and card handling functions */
 CK_RV card_removed(sc_reader_t *reader);
 CK_RV card_detect_all(void);
+CK_RV card_detect_all_changed(void);
 CK_RV create_slot(sc_reader_t *reader);
 void init_slot_info(CK_SLOT_INFO_PTR pInfo, sc_reader_t *reader);
 CK_RV card_detect(sc_reader_t *reader);
@@ -474,6 +480,12 @@ CK_RV sc_pkcs11_lock(void);
 void sc_pkcs11_unlock(void);
 void sc_pkcs11_free_lock(void);
 
+/* Background thread waiting for reader events */
+void slot_monitor_start(void);
+void slot_monitor_stop(void);
+int slot_monitor_generation(unsigned int *generation);
+int slot_monitor_wait(unsigned int generation);
+
 #ifdef __cplusplus
 }
 #endif
@@ -424,6 +424,33 @@ card_detect_all(void)
 	return CKR_OK;
 }
 
+/* Like card_detect_all(), but skipped while the slot event monitor did not
+ * report any event and no reader was added since the last detection */
+CK_RV
+card_detect_all_changed(void)
+{
+	static unsigned int detected_generation = 0, detected_readers = 0;
+	unsigned int generation, readers;
+	CK_RV rv;
+
+	readers = sc_ctx_get_reader_count(context);
+	if (slot_monitor_generation(&generation)
+			&& generation == detected_generation
+			&& readers == detected_readers) {
+		sc_log(context, "No slot events since the last detection");
+		return CKR_OK;
+	}
+
+	rv = card_detect_all();
+	if (rv == CKR_OK) {
+		detected_generation = generation;
+		detected_readers = readers;
+	} else {
+		detected_generation = 0;
+	}
+	return rv;
+}
+
 /* Allocates an existing slot to a card */
 CK_RV slot_allocate(struct sc_pkcs11_slot ** slot, struct sc_pkcs11_card * p11card)
 {
@@ -450,6 +477,10 @@ CK_RV slot_get_slot(CK_SLOT_ID id, struct sc_pkcs11_slot ** slot)
 	if (context == NULL)
 		return CKR_CRYPTOKI_NOT_INITIALIZED;
 
+	/* the application did not ask for the slot list before */
+	if (list_empty(&virtual_slots))
+		card_detect_all();
+
 	*slot = list_seek(&virtual_slots, &id);	/* FIXME: check for null? */
 	if (!*slot)
 		return CKR_SLOT_ID_INVALID;
@@ -533,7 +564,7 @@ CK_RV slot_find_changed(CK_SLOT_ID_PTR idp, int mask)
 	unsigned int i;
 	LOG_FUNC_CALLED(context);
 
-	card_detect_all();
+	card_detect_all_changed();
 	for (i=0; i<list_size(&virtual_slots); i++) {
 		sc_pkcs11_slot_t *slot = (sc_pkcs11_slot_t *) list_get_at(&virtual_slots, i);
 		sc_log(context, "slot 0x%lx token: %lu events: 0x%02X",
@@ -3541,6 +3541,14 @@ sc_pkcs15init_update_certificate(struct sc_pkcs15_card *p15card,
 	if (r < 0)
 		goto done;
 
+	/* Forget the old content if it was prefetched at bind time */
+	if (p15card->opts.prefetch) {
+		struct sc_pkcs15_cert_info *info = (struct sc_pkcs15_cert_info *)obj->data;
+
+		sc_pkcs15_free_object_value(obj, &info->value.value);
+		info->value.len = 0;
+	}
+
 	/* Fill the remaining space in the EF (if any) with zeros */
 	if (certlen < file->size) {
 		unsigned char *tmp = calloc(file->size - certlen, 1);
@@ -54,6 +54,11 @@ extern int scconf_lex_parse_string(scconf_parser * parser,
 				   const char *config_string);
 extern void scconf_parse_token(scconf_parser * parser, int token_type, const char *token);
 
+/* Build the lookup tables of block and all its sub-blocks */
+extern void scconf_index_build(scconf_block * block);
+/* Drop the lookup table of block, to be called when its items change */
+extern void scconf_index_free(scconf_block * block);
+
 #ifdef __cplusplus
 }
 #endif
@@ -110,6 +110,7 @@ static scconf_item *scconf_item_add_internal(scconf_parser * parser, int type)
 		return NULL;
 	}
 	item->type = type;
+	scconf_index_free(parser->block);
 
 	item->key = parser->key;
 	parser->key = NULL;
@@ -396,6 +397,8 @@ int scconf_parse(scconf_context * config)
 
 	if (r <= 0)
 		config->errmsg = buffer;
+	else
+		scconf_index_build(config->root);
 	return r;
 }
 
@@ -423,5 +426,7 @@ int scconf_parse_string(scconf_context * config, const char *string)
 
 	if (r <= 0)
 		config->errmsg = buffer;
+	else
+		scconf_index_build(config->root);
 	return r;
 }
@@ -29,7 +29,9 @@
 #endif
 #include <ctype.h>
 
+#include "common/lru.h"
 #include "scconf.h"
+#include "internal.h"
 
 scconf_context *scconf_new(const char *filename)
 {
@@ -62,30 +64,154 @@ void scconf_free(scconf_context * config)
 	}
 }
 
-const scconf_block *scconf_find_block(const scconf_context * config, const scconf_block * block, const char *item_name)
+/*
+ * Lookup tables
+ *
+ * Once a configuration is parsed, the items of each block that has more
+ * than a few of them are put into an open addressing hash table. Items with
+ * the same key are probed in the order of the configuration file, so the
+ * lookups return the same as a walk through the list of items. Any change
+ * of the items of a block drops its table and lookups fall back to the walk.
+ */
+#define SCCONF_INDEX_MIN_ITEMS	8
+
+struct _scconf_index_slot {
+	unsigned int hash;
+	scconf_item *item;
+};
+
+struct _scconf_index {
+	size_t mask;
+	struct _scconf_index_slot *slots;
+};
+
+static unsigned int scconf_index_hash(const char *key)
 {
+	/* hash of the lower case key, as keys are compared case insensitive */
+	unsigned int hash = LRU_HASH_INIT;
+
+	for (; *key; key++) {
+		unsigned char c = (unsigned char) tolower((unsigned char) *key);
+
+		hash = lru_hash(hash, &c, 1);
+	}
+	return hash;
+}
+
+void scconf_index_free(scconf_block * block)
+{
+	if (block && block->index) {
+		free(block->index->slots);
+		free(block->index);
+		block->index = NULL;
+	}
+}
+
+void scconf_index_build(scconf_block * block)
+{
+	struct _scconf_index *index;
 	scconf_item *item;
+	size_t count = 0, size = 1;
 
 	if (!block) {
-		block = config->root;
+		return;
 	}
-	if (!item_name) {
-		return NULL;
+	scconf_index_free(block);
+
+	for (item = block->items; item; item = item->next) {
+		if (item->type == SCCONF_ITEM_TYPE_BLOCK) {
+			scconf_index_build(item->value.block);
+		}
+		if (item->type != SCCONF_ITEM_TYPE_COMMENT && item->key) {
+			count++;
+		}
+	}
+	if (count < SCCONF_INDEX_MIN_ITEMS) {
+		return;
+	}
+
+	/* keep the table at most half full */
+	while (size < 2 * count) {
+		size <<= 1;
 	}
+	index = calloc(1, sizeof(struct _scconf_index));
+	if (!index) {
+		return;
+	}
+	index->slots = calloc(size, sizeof(struct _scconf_index_slot));
+	if (!index->slots) {
+		free(index);
+		return;
+	}
+	index->mask = size - 1;
+
 	for (item = block->items; item; item = item->next) {
-		if (item->type == SCCONF_ITEM_TYPE_BLOCK &&
-		    strcasecmp(item_name, item->key) == 0) {
-			return item->value.block;
+		unsigned int hash;
+		size_t i;
+
+		if (item->type == SCCONF_ITEM_TYPE_COMMENT || !item->key) {
+			continue;
+		}
+		hash = scconf_index_hash(item->key);
+		for (i = hash & index->mask; index->slots[i].item; i = (i + 1) & index->mask)
+			;
+		index->slots[i].hash = hash;
+		index->slots[i].item = item;
+	}
+	block->index = index;
+}
+
+/* Returns the next item of type with the key after prev, or the first one if
+ * prev is NULL. pos keeps the position in the lookup table between calls. */
+static scconf_item *scconf_find_item(const scconf_block * block, int type,
+		const char *key, const scconf_item * prev, size_t *pos)
+{
+	const struct _scconf_index *index = block->index;
+	scconf_item *item;
+
+	if (index) {
+		unsigned int hash = scconf_index_hash(key);
+		size_t i = prev ? (*pos + 1) & index->mask : hash & index->mask;
+
+		for (; (item = index->slots[i].item) != NULL; i = (i + 1) & index->mask) {
+			if (index->slots[i].hash == hash && item->type == type
+					&& strcasecmp(key, item->key) == 0) {
+				*pos = i;
+				return item;
+			}
+		}
+		return NULL;
+	}
+
+	for (item = prev ? prev->next : block->items; item; item = item->next) {
+		if (item->type == type && strcasecmp(key, item->key) == 0) {
+			return item;
 		}
 	}
 	return NULL;
 }
 
+const scconf_block *scconf_find_block(const scconf_context * config, const scconf_block * block, const char *item_name)
+{
+	scconf_item *item;
+	size_t pos = 0;
+
+	if (!block) {
+		block = config->root;
+	}
+	if (!item_name) {
+		return NULL;
+	}
+	item = scconf_find_item(block, SCCONF_ITEM_TYPE_BLOCK, item_name, NULL, &pos);
+	return item ? item->value.block : NULL;
+}
+
 scconf_block **scconf_find_blocks(const scconf_context * config, const scconf_block * block, const char *item_name, const char *key)
 {
 	scconf_block **blocks = NULL, **tmp;
 	int alloc_size, size;
 	scconf_item *item;
+	size_t pos = 0;
 
 	if (!block) {
 		block = config->root;
@@ -102,25 +228,23 @@ scconf_block **scconf_find_blocks(const scconf_context * config, const scconf_bl
 	}
 	blocks = tmp;
 
-	for (item = block->items; item; item = item->next) {
-		if (item->type == SCCONF_ITEM_TYPE_BLOCK &&
-		    strcasecmp(item_name, item->key) == 0) {
-			if (!item->value.block)
-				continue;
-			if (key && strcasecmp(key, item->value.block->name->data)) {
-				continue;
-			}
-			if (size + 1 >= alloc_size) {
-				alloc_size *= 2;
-				tmp = (scconf_block **) realloc(blocks, sizeof(scconf_block *) * alloc_size);
-				if (!tmp) {
-					free(blocks);
-					return NULL;
-				}
-				blocks = tmp;
+	for (item = scconf_find_item(block, SCCONF_ITEM_TYPE_BLOCK, item_name, NULL, &pos);
+	     item; item = scconf_find_item(block, SCCONF_ITEM_TYPE_BLOCK, item_name, item, &pos)) {
+		if (!item->value.block)
+			continue;
+		if (key && strcasecmp(key, item->value.block->name->data)) {
+			continue;
+		}
+		if (size + 1 >= alloc_size) {
+			alloc_size *= 2;
+			tmp = (scconf_block **) realloc(blocks, sizeof(scconf_block *) * alloc_size);
+			if (!tmp) {
+				free(blocks);
+				return NULL;
 			}
-			blocks[size++] = item->value.block;
+			blocks = tmp;
 		}
+		blocks[size++] = item->value.block;
 	}
 	blocks[size] = NULL;
 	return blocks;
@@ -129,14 +253,13 @@ scconf_block **scconf_find_blocks(const scconf_context * config, const scconf_bl
 const scconf_list *scconf_find_list(const scconf_block * block, const char *option)
 {
 	scconf_item *item;
+	size_t pos = 0;
 
 	if (!block)
 		return NULL;
 
-	for (item = block->items; item; item = item->next)
-		if (item->type == SCCONF_ITEM_TYPE_VALUE && strcasecmp(option, item->key) == 0)
-			return item->value.list;
-	return NULL;
+	item = scconf_find_item(block, SCCONF_ITEM_TYPE_VALUE, option, NULL, &pos);
+	return item ? item->value.list : NULL;
 }
 
 const char *scconf_get_str(const scconf_block * block, const char *option, const char *def)
@@ -301,6 +424,7 @@ void scconf_block_destroy(scconf_block * block)
 	if (block) {
 		scconf_list_destroy(block->name);
 		scconf_item_destroy(block->items);
+		scconf_index_free(block);
 		free(block);
 	}
 }
@@ -24,6 +24,8 @@
 #ifndef _SC_CONF_H
 #define _SC_CONF_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -54,10 +56,14 @@ typedef struct _scconf_item {
 	} value;
 } scconf_item;
 
+struct _scconf_index;
+
 struct _scconf_block {
 	scconf_block *parent;
 	scconf_list *name;
 	scconf_item *items;
+	/* lookup table of the items, built after parsing; private */
+	struct _scconf_index *index;
 };
 
 typedef struct {
@@ -92,6 +98,18 @@ extern int scconf_parse_string(scconf_context * config, const char *string);
  */
 extern int scconf_write(scconf_context * config, const char *filename);
 
+/* Store the parsed configuration in an allocated binary image
+ * Comments are not kept. The image must be freed by the caller
+ * Returns 1 = ok, 0 = error
+ */
+extern int scconf_snapshot_save(const scconf_context * config, unsigned char **out, size_t *outlen);
+
+/* Replace the configuration by the one stored in a binary image
+ * made by scconf_snapshot_save(). The image is not referenced afterwards
+ * Returns 1 = ok, 0 = error
+ */
+extern int scconf_snapshot_load(scconf_context * config, const unsigned char *data, size_t len);
+
 /* Find a block by the item_name
  * If the block is NULL, the root block is used
  */
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2026 OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Binary images of a parsed configuration
+ *
+ * The image holds the blocks, keys and values of the configuration in the
+ * order of the file, comments are dropped. Every block is stored as the
+ * number of its names, the names, the number of its items and the items.
+ * An item is its type, its key and either a block or the number of its
+ * values followed by the values. Numbers are 32 bit big endian, strings are
+ * their length followed by the bytes, without terminating zero.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "scconf.h"
+#include "internal.h"
+
+/* Nesting of blocks that is accepted when loading an image */
+#define SCCONF_SNAPSHOT_MAX_DEPTH	32
+
+typedef struct {
+	unsigned char *data;
+	size_t len, size;
+	int error;
+} scconf_snapshot_writer;
+
+typedef struct {
+	const unsigned char *data;
+	size_t len, pos;
+} scconf_snapshot_reader;
+
+static void put_bytes(scconf_snapshot_writer * writer, const void *data, size_t len)
+{
+	if (writer->error || len == 0) {
+		return;
+	}
+	if (writer->size - writer->len < len) {
+		size_t size = writer->size ? writer->size : 1024;
+		unsigned char *p;
+
+		while (size - writer->len < len) {
+			size *= 2;
+		}
+		p = realloc(writer->data, size);
+		if (!p) {
+			writer->error = 1;
+			return;
+		}
+		writer->data = p;
+		writer->size = size;
+	}
+	memcpy(writer->data + writer->len, data, len);
+	writer->len += len;
+}
+
+static void put_u32(scconf_snapshot_writer * writer, size_t value)
+{
+	unsigned char buf[4];
+
+	buf[0] = (value >> 24) & 0xff;
+	buf[1] = (value >> 16) & 0xff;
+	buf[2] = (value >> 8) & 0xff;
+	buf[3] = value & 0xff;
+	put_bytes(writer, buf, sizeof(buf));
+}
+
+static void put_str(scconf_snapshot_writer * writer, const char *str)
+{
+	size_t len = str ? strlen(str) : 0;
+
+	put_u32(writer, len);
+	put_bytes(writer, str, len);
+}
+
+static void put_list(scconf_snapshot_writer * writer, const scconf_list * list)
+{
+	const scconf_list *l;
+	size_t count = 0;
+
+	for (l = list; l; l = l->next) {
+		count++;
+	}
+	put_u32(writer, count);
+	for (l = list; l; l = l->next) {
+		put_str(writer, l->data);
+	}
+}
+
+static void put_block(scconf_snapshot_writer * writer, const scconf_block * block)
+{
+	const scconf_item *item;
+	size_t count = 0;
+
+	put_list(writer, block->name);
+	for (item = block->items; item; item = item->next) {
+		if (item->type != SCCONF_ITEM_TYPE_COMMENT) {
+			count++;
+		}
+	}
+	put_u32(writer, count);
+	for (item = block->items; item; item = item->next) {
+		switch (item->type) {
+		case SCCONF_ITEM_TYPE_BLOCK:
+			put_u32(writer, SCCONF_ITEM_TYPE_BLOCK);
+			put_str(writer, item->key);
+			put_block(writer, item->value.block);
+			break;
+		case SCCONF_ITEM_TYPE_VALUE:
+			put_u32(writer, SCCONF_ITEM_TYPE_VALUE);
+			put_str(writer, item->key);
+			put_list(writer, item->value.list);
+			break;
+		}
+	}
+}
+
+int scconf_snapshot_save(const scconf_context * config, unsigned char **out, size_t *outlen)
+{
+	scconf_snapshot_writer writer;
+
+	if (!config || !config->root || !out || !outlen) {
+		return 0;
+	}
+	memset(&writer, 0, sizeof(writer));
+	put_block(&writer, config->root);
+	if (writer.error) {
+		free(writer.data);
+		return 0;
+	}
+	*out = writer.data;
+	*outlen = writer.len;
+	return 1;
+}
+
+static int get_u32(scconf_snapshot_reader * reader, size_t *value)
+{
+	const unsigned char *p = reader->data + reader->pos;
+
+	if (reader->len - reader->pos < 4) {
+		return 0;
+	}
+	*value = ((size_t) p[0] << 24) | ((size_t) p[1] << 16) | ((size_t) p[2] << 8) | p[3];
+	reader->pos += 4;
+	return 1;
+}
+
+static char *get_str(scconf_snapshot_reader * reader)
+{
+	size_t len;
+	char *str;
+
+	if (!get_u32(reader, &len) || reader->len - reader->pos < len) {
+		return NULL;
+	}
+	str = malloc(len + 1);
+	if (!str) {
+		return NULL;
+	}
+	memcpy(str, reader->data + reader->pos, len);
+	str[len] = '\0';
+	reader->pos += len;
+	return str;
+}
+
+static int get_list(scconf_snapshot_reader * reader, scconf_list ** list)
+{
+	scconf_list **tail = list;
+	size_t count;
+
+	if (!get_u32(reader, &count)) {
+		return 0;
+	}
+	while (count--) {
+		scconf_list *rec = calloc(1, sizeof(scconf_list));
+
+		if (!rec) {
+			return 0;
+		}
+		*tail = rec;
+		tail = &rec->next;
+		rec->data = get_str(reader);
+		if (!rec->data) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int get_block(scconf_snapshot_reader * reader, scconf_block * block, int depth)
+{
+	scconf_item **tail = &block->items;
+	size_t count;
+
+	if (depth > SCCONF_SNAPSHOT_MAX_DEPTH) {
+		return 0;
+	}
+	if (!get_list(reader, &block->name) || !get_u32(reader, &count)) {
+		return 0;
+	}
+	while (count--) {
+		scconf_item *item = calloc(1, sizeof(scconf_item));
+		size_t type;
+
+		if (!item) {
+			return 0;
+		}
+		/* a comment has no value to be freed, in case the item is incomplete */
+		item->type = SCCONF_ITEM_TYPE_COMMENT;
+		*tail = item;
+		tail = &item->next;
+		if (!get_u32(reader, &type)) {
+			return 0;
+		}
+		item->key = get_str(reader);
+		if (!item->key) {
+			return 0;
+		}
+		switch (type) {
+		case SCCONF_ITEM_TYPE_BLOCK:
+			item->value.block = calloc(1, sizeof(scconf_block));
+			if (!item->value.block) {
+				return 0;
+			}
+			item->type = SCCONF_ITEM_TYPE_BLOCK;
+			item->value.block->parent = block;
+			if (!get_block(reader, item->value.block, depth + 1)) {
+				return 0;
+			}
+			break;
+		case SCCONF_ITEM_TYPE_VALUE:
+			item->type = SCCONF_ITEM_TYPE_VALUE;
+			if (!get_list(reader, &item->value.list)) {
+				return 0;
+			}
+			break;
+		default:
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int scconf_snapshot_load(scconf_context * config, const unsigned char *data, size_t len)
+{
+	scconf_snapshot_reader reader;
+	scconf_block *root;
+
+	if (!config || !data) {
+		return 0;
+	}
+	root = calloc(1, sizeof(scconf_block));
+	if (!root) {
+		return 0;
+	}
+	reader.data = data;
+	reader.len = len;
+	reader.pos = 0;
+	if (!get_block(&reader, root, 0) || reader.pos != reader.len) {
+		scconf_block_destroy(root);
+		config->errmsg = (char *) "Malformed configuration snapshot";
+		return 0;
+	}
+	scconf_block_destroy(config->root);
+	config->root = root;
+	scconf_index_build(config->root);
+	return 1;
+}
@@ -30,18 +30,6 @@
 
 #ifdef ENABLE_SM
 
-static const struct sc_asn1_entry c_sm_capdu[] = {
-	{ "Cryptogram",
-		SC_ASN1_OCTET_STRING, SC_ASN1_CTX|0x05, SC_ASN1_OPTIONAL, NULL, NULL },
-	{ "Padding-content indicator followed by cryptogram",
-		SC_ASN1_OCTET_STRING, SC_ASN1_CTX|0x07, SC_ASN1_OPTIONAL, NULL, NULL },
-	{ "Protected Le",
-		SC_ASN1_OCTET_STRING, SC_ASN1_CTX|0x17, SC_ASN1_OPTIONAL, NULL, NULL },
-	{ "Cryptographic Checksum",
-		SC_ASN1_OCTET_STRING, SC_ASN1_CTX|0x0E, SC_ASN1_OPTIONAL, NULL, NULL },
-	{ NULL , 0 , 0 , 0 , NULL , NULL }
-};
-
 static const struct sc_asn1_entry c_sm_rapdu[] = {
 	{ "Cryptogram",
 		SC_ASN1_OCTET_STRING, SC_ASN1_CTX|0x05, SC_ASN1_OPTIONAL, NULL, NULL },
@@ -54,57 +42,71 @@ static const struct sc_asn1_entry c_sm_rapdu[] = {
 	{ NULL, 0, 0, 0, NULL, NULL }
 };
 
+/* Buffers reused for every APDU of a SM session, see iso_sm_start() */
+struct iso_sm_scratch {
+	/* protected APDU handed out by iso_get_sm_apdu() */
+	sc_apdu_t sm_apdu;
+	int in_use;
+	/* freed when the protected APDU is released */
+	int detached;
+	/* padded plain data of the command, MAC input of the response */
+	u8 *plain;
+	size_t plain_size;
+	/* padded header followed by the data objects of the command, which
+	 * are the MAC input and then the data of the protected APDU */
+	u8 *data;
+	size_t data_size;
+	/* response of the protected APDU */
+	u8 *resp;
+	size_t resp_size;
+	/* output of the call backs, which realloc() it as needed */
+	u8 *crypt;
+	size_t crypt_len;
+	u8 *mac;
+};
+
 static int
-add_iso_pad(const u8 *data, size_t datalen, int block_size, u8 **padded)
+reserve(u8 **buf, size_t *size, size_t needed)
 {
 	u8 *p;
-	size_t p_len;
-
-	if (!padded)
-		return SC_ERROR_INVALID_ARGUMENTS;
 
-	/* calculate length of padded message */
-	p_len = (datalen / block_size) * block_size + block_size;
+	if (*size >= needed)
+		return SC_SUCCESS;
 
-	p = realloc(*padded, p_len);
+	p = realloc(*buf, needed);
 	if (!p)
 		return SC_ERROR_OUT_OF_MEMORY;
+	*buf = p;
+	*size = needed;
 
-	if (*padded != data)
-		/* Flawfinder: ignore */
-		memcpy(p, data, datalen);
-
-	*padded = p;
-
-	/* now add iso padding */
-	memset(p + datalen, 0x80, 1);
-	memset(p + datalen + 1, 0, p_len - datalen - 1);
-
-	return p_len;
+	return SC_SUCCESS;
 }
 
+/* Pads the data in place, \a buflen must leave room for one more block */
 static int
-add_padding(const struct iso_sm_ctx *ctx, const u8 *data, size_t datalen,
-		u8 **padded)
+add_padding(const struct iso_sm_ctx *ctx, u8 *data, size_t datalen,
+		size_t buflen)
 {
-	u8 *p;
+	size_t p_len;
 
 	switch (ctx->padding_indicator) {
 		case SM_NO_PADDING:
-			if (*padded != data) {
-				if (datalen != 0) {
-					p = realloc(*padded, datalen);
-					if (!p)
-						return SC_ERROR_OUT_OF_MEMORY;
-					*padded = p;
-					memcpy(*padded, data, datalen);
-				} else {
-					*padded = NULL;
-				}
-			}
 			return datalen;
 		case SM_ISO_PADDING:
-			return add_iso_pad(data, datalen, ctx->block_length, padded);
+			if (!ctx->block_length)
+				return SC_ERROR_INVALID_ARGUMENTS;
+
+			/* calculate length of padded message */
+			p_len = (datalen / ctx->block_length) * ctx->block_length
+				+ ctx->block_length;
+			if (p_len > buflen)
+				return SC_ERROR_BUFFER_TOO_SMALL;
+
+			/* now add iso padding */
+			data[datalen] = 0x80;
+			memset(data + datalen + 1, 0, p_len - datalen - 1);
+
+			return p_len;
 		default:
 			return SC_ERROR_INVALID_ARGUMENTS;
 	}
@@ -144,20 +146,9 @@ rm_padding(u8 padding_indicator, const u8 *data, size_t datalen)
 	return len;
 }
 
-static int format_le(size_t le, struct sc_asn1_entry *le_entry,
-		u8 **lebuf, size_t *le_len)
+static void format_le(size_t le, size_t le_len, u8 *p)
 {
-	u8 *p;
-
-	if (!lebuf || !le_len || !*le_len)
-		return SC_ERROR_INVALID_ARGUMENTS;
-
-	p = realloc(*lebuf, *le_len);
-	if (!p)
-		return SC_ERROR_OUT_OF_MEMORY;
-	*lebuf = p;
-
-	switch (*le_len) {
+	switch (le_len) {
 		case 1:
 			p[0] = le & 0xff;
 			break;
@@ -170,51 +161,25 @@ static int format_le(size_t le, struct sc_asn1_entry *le_entry,
 			p[1] = (le >> 8) & 0xff;
 			p[2] = le & 0xff;
 			break;
-		default:
-			return SC_ERROR_INVALID_ARGUMENTS;
 	}
-
-	sc_format_asn1_entry(le_entry, *lebuf, le_len, SC_ASN1_PRESENT);
-
-	return SC_SUCCESS;
-}
-
-static int prefix_buf(u8 prefix, u8 *buf, size_t buflen, u8 **cat)
-{
-	u8 *p;
-
-	p = realloc(*cat, buflen + 1);
-	if (!p)
-		return SC_ERROR_OUT_OF_MEMORY;
-
-	if (*cat == buf) {
-		memmove(p + 1, p, buflen);
-	} else {
-		/* Flawfinder: ignore */
-		memcpy(p + 1, buf, buflen);
-	}
-	p[0] = prefix;
-
-	*cat = p;
-
-	return buflen + 1;
 }
 
+/* Encrypts the padded data to scratch->crypt */
 static int format_data(sc_card_t *card, const struct iso_sm_ctx *ctx,
-		int prepend_padding_indicator, const u8 *data, size_t datalen,
-		struct sc_asn1_entry *formatted_encrypted_data_entry,
-		u8 **formatted_data, size_t *formatted_data_len)
+		struct iso_sm_scratch *scratch, const u8 *data, size_t datalen)
 {
 	int r;
-	u8 *pad_data = NULL;
 	size_t pad_data_len = 0;
 
-	if (!ctx || !formatted_data || !formatted_data_len) {
-		r = SC_ERROR_INVALID_ARGUMENTS;
-		goto err;
-	}
+	r = reserve(&scratch->plain, &scratch->plain_size, datalen + ctx->block_length);
+	if (r < 0)
+		return r;
+	if (datalen)
+		/* Flawfinder: ignore */
+		memcpy(scratch->plain, data, datalen);
+	pad_data_len = datalen;
 
-	r = add_padding(ctx, data, datalen, &pad_data);
+	r = add_padding(ctx, scratch->plain, datalen, scratch->plain_size);
 	if (r < 0) {
 		sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not add padding to data: %s",
 				sc_strerror(r));
@@ -222,68 +187,30 @@ static int format_data(sc_card_t *card, const struct iso_sm_ctx *ctx,
 	}
 	pad_data_len = r;
 
-	sc_log_hex(card->ctx, "Data to encrypt", pad_data, pad_data_len);
-	r = ctx->encrypt(card, ctx, pad_data, pad_data_len, formatted_data);
+	sc_log_hex(card->ctx, "Data to encrypt", scratch->plain, pad_data_len);
+	r = ctx->encrypt(card, ctx, scratch->plain, pad_data_len, &scratch->crypt);
 	if (r < 0) {
 		sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not encrypt the data");
 		goto err;
 	}
-	sc_log_hex(card->ctx, "Cryptogram", *formatted_data, r);
-
-	if (prepend_padding_indicator) {
-		r = prefix_buf(ctx->padding_indicator, *formatted_data, r, formatted_data);
-		if (r < 0) {
-			sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not prepend padding indicator to formatted "
-					"data: %s", sc_strerror(r));
-			goto err;
-		}
-	}
-
-	*formatted_data_len = r;
-	sc_format_asn1_entry(formatted_encrypted_data_entry,
-			*formatted_data, formatted_data_len, SC_ASN1_PRESENT);
-
-	r = SC_SUCCESS;
+	sc_log_hex(card->ctx, "Cryptogram", scratch->crypt, r);
 
 err:
-	if (pad_data) {
-		sc_mem_clear(pad_data, pad_data_len);
-		free(pad_data);
-	}
+	if (pad_data_len)
+		sc_mem_clear(scratch->plain, pad_data_len);
 
 	return r;
 }
 
-static int format_head(const struct iso_sm_ctx *ctx, const sc_apdu_t *apdu,
-		u8 **formatted_head)
-{
-	u8 *p;
-
-	if (!apdu || !formatted_head)
-		return SC_ERROR_INVALID_ARGUMENTS;
-
-	p = realloc(*formatted_head, 4);
-	if (!p)
-		return SC_ERROR_OUT_OF_MEMORY;
-
-	p[0] = apdu->cla;
-	p[1] = apdu->ins;
-	p[2] = apdu->p1;
-	p[3] = apdu->p2;
-	*formatted_head = p;
-
-	return add_padding(ctx, *formatted_head, 4, formatted_head);
-}
-
 static int sm_encrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
-		const sc_apdu_t *apdu, sc_apdu_t **psm_apdu)
+		struct iso_sm_scratch *scratch, const sc_apdu_t *apdu,
+		sc_apdu_t **psm_apdu)
 {
-	struct sc_asn1_entry sm_capdu[5];
-	u8 *p, *le = NULL, *sm_data = NULL, *fdata = NULL, *mac_data = NULL,
-	   *asn1 = NULL, *mac = NULL, *resp_data = NULL;
-	size_t sm_data_len, fdata_len, mac_data_len, asn1_len, mac_len, le_len;
-	int r;
-	sc_apdu_t *sm_apdu = NULL;
+	sc_apdu_t *sm_apdu = &scratch->sm_apdu;
+	u8 le[3], *p;
+	size_t le_len = 0, crypt_len = 0, head_len, do_len, mac_data_len, mac_len;
+	int r, encrypt = 0, prepend_padding_indicator = 0;
+	unsigned int crypt_tag;
 
 	if (!apdu || !ctx || !card || !card->reader || !psm_apdu) {
 		r = SC_ERROR_INVALID_ARGUMENTS;
@@ -296,130 +223,35 @@ static int sm_encrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
 		goto err;
 	}
 
-	sc_copy_asn1_entry(c_sm_capdu, sm_capdu);
-
-	sm_apdu = malloc(sizeof(sc_apdu_t));
-	if (!sm_apdu) {
-		r = SC_ERROR_OUT_OF_MEMORY;
-		goto err;
-	}
-	sm_apdu->control = apdu->control;
-	sm_apdu->flags = apdu->flags;
-	sm_apdu->cla = apdu->cla|0x0C;
-	sm_apdu->ins = apdu->ins;
-	sm_apdu->p1 = apdu->p1;
-	sm_apdu->p2 = apdu->p2;
-	r = format_head(ctx, sm_apdu, &mac_data);
-	if (r < 0) {
-		sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format header of SM apdu");
-		goto err;
-	}
-	mac_data_len = r;
-
 	switch (apdu->cse) {
 		case SC_APDU_CASE_1:
 			break;
-	case SC_APDU_CASE_2_SHORT:
+		case SC_APDU_CASE_2_SHORT:
 			le_len = 1;
-			r = format_le(apdu->le, sm_capdu + 2, &le, &le_len);
-			if (r < 0) {
-				sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format Le of SM apdu");
-				goto err;
-			}
-			sc_log_hex(card->ctx, "Protected Le (plain)", le, le_len);
 			break;
-	case SC_APDU_CASE_2_EXT:
-			if (card->reader->active_protocol == SC_PROTO_T0) {
-				/* T0 extended APDUs look just like short APDUs */
-				le_len = 1;
-				r = format_le(apdu->le, sm_capdu + 2, &le, &le_len);
-				if (r < 0) {
-					sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format Le of SM apdu");
-					goto err;
-				}
-			} else {
-				/* in case of T1 always use 2 bytes for length */
-				le_len = 2;
-				r = format_le(apdu->le, sm_capdu + 2, &le, &le_len);
-				if (r < 0) {
-					sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format Le of SM apdu");
-					goto err;
-				}
-			}
-			sc_log_hex(card->ctx, "Protected Le (plain)", le, le_len);
+		case SC_APDU_CASE_2_EXT:
+			/* T0 extended APDUs look just like short APDUs, in case
+			 * of T1 always use 2 bytes for length */
+			le_len = card->reader->active_protocol == SC_PROTO_T0 ? 1 : 2;
 			break;
 		case SC_APDU_CASE_3_SHORT:
 		case SC_APDU_CASE_3_EXT:
-			if (apdu->ins & 1) {
-				r = format_data(card, ctx, 0, apdu->data, apdu->datalen,
-						sm_capdu + 0, &fdata, &fdata_len);
-			} else {
-				r = format_data(card, ctx, 1, apdu->data, apdu->datalen,
-						sm_capdu + 1, &fdata, &fdata_len);
-			}
-			if (r < 0) {
-				sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format data of SM apdu");
-				goto err;
-			}
-			sc_log_hex(card->ctx, "Padding-content indicator followed by cryptogram (plain)",
-					fdata, fdata_len);
+			encrypt = 1;
 			break;
 		case SC_APDU_CASE_4_SHORT:
 			/* in case of T0 no Le byte is added */
-			if (card->reader->active_protocol != SC_PROTO_T0) {
+			if (card->reader->active_protocol != SC_PROTO_T0)
 				le_len = 1;
-				r = format_le(apdu->le, sm_capdu + 2, &le, &le_len);
-				if (r < 0) {
-					sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format Le of SM apdu");
-					goto err;
-				}
-				sc_log_hex(card->ctx, "Protected Le (plain)", le, le_len);
-			}
-
-			if (apdu->ins & 1) {
-				r = format_data(card, ctx, 0, apdu->data, apdu->datalen,
-						sm_capdu + 0, &fdata, &fdata_len);
-			} else {
-				r = format_data(card, ctx, 1, apdu->data, apdu->datalen,
-						sm_capdu + 1, &fdata, &fdata_len);
-			}
-			if (r < 0) {
-				sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format data of SM apdu");
-				goto err;
-			}
-			sc_log_hex(card->ctx, "Padding-content indicator followed by cryptogram (plain)",
-					fdata, fdata_len);
+			encrypt = 1;
 			break;
 		case SC_APDU_CASE_4_EXT:
-			if (card->reader->active_protocol == SC_PROTO_T0) {
-				/* again a T0 extended case 4 APDU looks just
-				 * like a short APDU, the additional data is
-				 * transferred using ENVELOPE and GET RESPONSE */
-			} else {
-				/* only 2 bytes are use to specify the length of the
-				 * expected data */
+			/* again a T0 extended case 4 APDU looks just like a
+			 * short APDU, the additional data is transferred using
+			 * ENVELOPE and GET RESPONSE. Otherwise only 2 bytes
+			 * are use to specify the length of the expected data */
+			if (card->reader->active_protocol != SC_PROTO_T0)
 				le_len = 2;
-				r = format_le(apdu->le, sm_capdu + 2, &le, &le_len);
-				if (r < 0) {
-					sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format Le of SM apdu");
-					goto err;
-				}
-				sc_log_hex(card->ctx, "Protected Le (plain)", le, le_len);
-			}
-
-			if (apdu->ins & 1) {
-				r = format_data(card, ctx, 0, apdu->data, apdu->datalen,
-						sm_capdu + 0, &fdata, &fdata_len);
-			} else {
-				r = format_data(card, ctx, 1, apdu->data, apdu->datalen,
-						sm_capdu + 1, &fdata, &fdata_len);
-			}
-			if (r < 0) {
-				sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format data of SM apdu");
-				goto err;
-			}
-			sc_log_hex(card->ctx, "Padding-content indicator followed by cryptogram (plain)",
-					fdata, fdata_len);
+			encrypt = 1;
 			break;
 		default:
 			sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Unhandled apdu case");
@@ -427,47 +259,108 @@ static int sm_encrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
 			goto err;
 	}
 
+	if (le_len) {
+		format_le(apdu->le, le_len, le);
+		sc_log_hex(card->ctx, "Protected Le (plain)", le, le_len);
+	}
+
+	if (encrypt) {
+		r = format_data(card, ctx, scratch, apdu->data, apdu->datalen);
+		if (r < 0) {
+			sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format data of SM apdu");
+			goto err;
+		}
+		crypt_len = r;
+		prepend_padding_indicator = (apdu->ins & 1) == 0;
+		if (!crypt_len && !prepend_padding_indicator) {
+			sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Cryptogram is empty");
+			r = SC_ERROR_INVALID_ASN1_OBJECT;
+			goto err;
+		}
+	}
+	crypt_tag = prepend_padding_indicator ? 0x87 : 0x85;
+
+	/* padded header, data objects and room to pad them */
+	r = reserve(&scratch->data, &scratch->data_size, 4 + ctx->block_length
+			+ (encrypt ? 1 + 4 + prepend_padding_indicator + crypt_len : 0)
+			+ (le_len ? 2 + le_len : 0) + ctx->block_length);
+	if (r < 0)
+		goto err;
 
-	r = sc_asn1_encode(card->ctx, sm_capdu, (u8 **) &asn1, &asn1_len);
+	scratch->data[0] = apdu->cla|0x0C;
+	scratch->data[1] = apdu->ins;
+	scratch->data[2] = apdu->p1;
+	scratch->data[3] = apdu->p2;
+	r = add_padding(ctx, scratch->data, 4, scratch->data_size);
 	if (r < 0) {
+		sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not format header of SM apdu");
 		goto err;
 	}
-	if (asn1_len) {
-		p = realloc(mac_data, mac_data_len + asn1_len);
-		if (!p) {
-			r = SC_ERROR_OUT_OF_MEMORY;
+	head_len = r;
+
+	p = scratch->data + head_len;
+	if (encrypt) {
+		r = sc_asn1_put_tag(crypt_tag, NULL, prepend_padding_indicator + crypt_len,
+				p, scratch->data_size - (p - scratch->data), &p);
+		if (r < 0)
 			goto err;
-		}
-		mac_data = p;
+		if (prepend_padding_indicator)
+			*p++ = ctx->padding_indicator;
 		/* Flawfinder: ignore */
-		memcpy(mac_data + mac_data_len, asn1, asn1_len);
-		mac_data_len += asn1_len;
-		r = add_padding(ctx, mac_data, mac_data_len, &mac_data);
-		if (r < 0) {
+		memcpy(p, scratch->crypt, crypt_len);
+		p += crypt_len;
+		sc_log_hex(card->ctx, "Padding-content indicator followed by cryptogram (plain)",
+				p - crypt_len - prepend_padding_indicator,
+				crypt_len + prepend_padding_indicator);
+	}
+	if (le_len) {
+		r = sc_asn1_put_tag(0x97, le, le_len,
+				p, scratch->data_size - (p - scratch->data), &p);
+		if (r < 0)
+			goto err;
+	}
+	do_len = p - (scratch->data + head_len);
+
+	/* the data objects are padded in place for the MAC and the padding
+	 * is overwritten with the Cryptographic Checksum afterwards */
+	mac_data_len = head_len + do_len;
+	if (do_len) {
+		r = add_padding(ctx, scratch->data, mac_data_len, scratch->data_size);
+		if (r < 0)
 			goto err;
-		}
 		mac_data_len = r;
 	}
-	sc_log_hex(card->ctx, "Data to authenticate", mac_data, mac_data_len);
+	sc_log_hex(card->ctx, "Data to authenticate", scratch->data, mac_data_len);
 
-	r = ctx->authenticate(card, ctx, mac_data, mac_data_len,
-			&mac);
+	r = ctx->authenticate(card, ctx, scratch->data, mac_data_len,
+			&scratch->mac);
 	if (r < 0) {
 		sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not get authentication code");
 		goto err;
 	}
 	mac_len = r;
-	sc_log_hex(card->ctx, "Cryptographic Checksum (plain)", mac, mac_len);
-
+	sc_log_hex(card->ctx, "Cryptographic Checksum (plain)", scratch->mac, mac_len);
 
 	/* format SM apdu */
-	sc_format_asn1_entry(sm_capdu + 3, mac, &mac_len, SC_ASN1_PRESENT);
-	r = sc_asn1_encode(card->ctx, sm_capdu, (u8 **) &sm_data, &sm_data_len);
+	r = reserve(&scratch->data, &scratch->data_size, head_len + do_len + 1 + 4 + mac_len);
+	if (r < 0)
+		goto err;
+	p = scratch->data + head_len + do_len;
+	r = sc_asn1_put_tag(0x8E, scratch->mac, mac_len,
+			p, scratch->data_size - (p - scratch->data), &p);
 	if (r < 0)
 		goto err;
-	sm_apdu->data = sm_data;
-	sm_apdu->datalen = sm_data_len;
-	sm_apdu->lc = sm_data_len;
+
+	memset(sm_apdu, 0, sizeof *sm_apdu);
+	sm_apdu->control = apdu->control;
+	sm_apdu->flags = apdu->flags;
+	sm_apdu->cla = apdu->cla|0x0C;
+	sm_apdu->ins = apdu->ins;
+	sm_apdu->p1 = apdu->p1;
+	sm_apdu->p2 = apdu->p2;
+	sm_apdu->data = scratch->data + head_len;
+	sm_apdu->datalen = p - sm_apdu->data;
+	sm_apdu->lc = sm_apdu->datalen;
 	sm_apdu->le = 0;
 	/* for encrypted APDUs we usually get authenticated status bytes (4B), a
 	 * MAC (2B without data) and a cryptogram with padding indicator (2B tag
@@ -480,46 +373,35 @@ static int sm_encrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
 		sm_apdu->cse = SC_APDU_CASE_4_SHORT;
 		sm_apdu->resplen = 4 + 2 + mac_len + 2 + 2 + ((apdu->resplen+1)/ctx->block_length+1)*ctx->block_length;
 	}
-	resp_data = calloc(sm_apdu->resplen, 1);
-	if (!resp_data) {
-		r = SC_ERROR_OUT_OF_MEMORY;
+	r = reserve(&scratch->resp, &scratch->resp_size, sm_apdu->resplen);
+	if (r < 0)
 		goto err;
-	}
-	sm_apdu->resp = resp_data;
+	sm_apdu->resp = scratch->resp;
 	sc_log_hex(card->ctx, "ASN.1 encoded encrypted APDU data", sm_apdu->data, sm_apdu->datalen);
 
 	*psm_apdu = sm_apdu;
+	r = SC_SUCCESS;
 
 err:
-	free(fdata);
-	free(asn1);
-	free(mac_data);
-	free(mac);
-	free(le);
-	if (r < 0) {
-		free(resp_data);
-		free(sm_apdu);
-		free(sm_data);
-	}
-
 	return r;
 }
 
 static int sm_decrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
-		const sc_apdu_t *sm_apdu, sc_apdu_t *apdu)
+		struct iso_sm_scratch *scratch, const sc_apdu_t *sm_apdu, sc_apdu_t *apdu)
 {
 	int r;
 	struct sc_asn1_entry sm_rapdu[5];
-	struct sc_asn1_entry my_sm_rapdu[5];
-	u8 sw[2], mac[8], fdata[SC_MAX_EXT_APDU_BUFFER_SIZE];
-	size_t sw_len = sizeof sw, mac_len = sizeof mac, fdata_len = sizeof fdata,
-		   buf_len, asn1_len, fdata_offset = 0;
-	const u8 *buf;
-	u8 *data = NULL, *mac_data = NULL, *asn1 = NULL;
+	u8 sw[2], mac[8], *p;
+	size_t sw_len = sizeof sw, mac_len = sizeof mac, fdata_len = 0,
+		   buf_len = 0, plain_len = 0, fdata_offset = 0, i;
+	const u8 *buf, *fdata = NULL;
 
+	/* the cryptogram is decrypted from where it is in the response */
 	sc_copy_asn1_entry(c_sm_rapdu, sm_rapdu);
-	sc_format_asn1_entry(sm_rapdu + 0, fdata, &fdata_len, 0);
-	sc_format_asn1_entry(sm_rapdu + 1, fdata, &fdata_len, 0);
+	sm_rapdu[0].flags |= SC_ASN1_ALLOC | SC_ASN1_BORROW;
+	sm_rapdu[1].flags |= SC_ASN1_ALLOC | SC_ASN1_BORROW;
+	sc_format_asn1_entry(sm_rapdu + 0, &fdata, &fdata_len, 0);
+	sc_format_asn1_entry(sm_rapdu + 1, &fdata, &fdata_len, 0);
 	sc_format_asn1_entry(sm_rapdu + 2, sw, &sw_len, 0);
 	sc_format_asn1_entry(sm_rapdu + 3, mac, &mac_len, 0);
 
@@ -532,22 +414,31 @@ static int sm_decrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
 		goto err;
 	}
 
-
 	if (sm_rapdu[3].flags & SC_ASN1_PRESENT) {
-		/* copy from sm_apdu to my_sm_apdu, but leave mac at default */
-		sc_copy_asn1_entry(sm_rapdu, my_sm_rapdu);
-		sc_copy_asn1_entry(&c_sm_rapdu[3], &my_sm_rapdu[3]);
-
-		r = sc_asn1_encode(card->ctx, my_sm_rapdu, &asn1, &asn1_len);
+		/* the data objects except for the mac, padded */
+		r = reserve(&scratch->plain, &scratch->plain_size,
+				2 * (1 + 4) + fdata_len + 1 + 4 + sw_len + ctx->block_length);
 		if (r < 0)
 			goto err;
-		r = add_padding(ctx, asn1, asn1_len, &mac_data);
+		p = scratch->plain;
+		for (i = 0; i < 3; i++) {
+			const u8 *value = i < 2 ? fdata : sw;
+			size_t value_len = i < 2 ? fdata_len : sw_len;
+
+			if (!(sm_rapdu[i].flags & SC_ASN1_PRESENT))
+				continue;
+			r = sc_asn1_put_tag(0x80 | (sm_rapdu[i].tag & SC_ASN1_TAG_MASK), value, value_len,
+					p, scratch->plain_size - (p - scratch->plain), &p);
+			if (r < 0)
+				goto err;
+		}
+		r = add_padding(ctx, scratch->plain, p - scratch->plain, scratch->plain_size);
 		if (r < 0) {
 			goto err;
 		}
-		
+
 		r = ctx->verify_authentication(card, ctx, mac, mac_len,
-				mac_data, r);
+				scratch->plain, r);
 		if (r < 0)
 			goto err;
 	} else {
@@ -558,7 +449,7 @@ static int sm_decrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
 
 
 	if (sm_rapdu[1].flags & SC_ASN1_PRESENT) {
-		if (ctx->padding_indicator != fdata[0]) {
+		if (!fdata_len || ctx->padding_indicator != fdata[0]) {
 			r = SC_ERROR_UNKNOWN_DATA_RECEIVED;
 			goto err;
 		}
@@ -567,12 +458,12 @@ static int sm_decrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
 	if (sm_rapdu[0].flags & SC_ASN1_PRESENT
 			|| sm_rapdu[1].flags & SC_ASN1_PRESENT) {
 		r = ctx->decrypt(card, ctx, fdata + fdata_offset,
-				fdata_len - fdata_offset, &data);
+				fdata_len - fdata_offset, &scratch->crypt);
 		if (r < 0)
 			goto err;
-		buf_len = r;
+		plain_len = r;
 
-		r = rm_padding(ctx->padding_indicator, data, buf_len);
+		r = rm_padding(ctx->padding_indicator, scratch->crypt, plain_len);
 		if (r < 0) {
 			sc_debug(card->ctx, SC_LOG_DEBUG_VERBOSE, "Could not remove padding");
 			goto err;
@@ -587,7 +478,7 @@ static int sm_decrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
 			goto err;
 		}
 		/* Flawfinder: ignore */
-		memcpy(apdu->resp, data, r);
+		memcpy(apdu->resp, scratch->crypt, r);
 		apdu->resplen = r;
 	} else {
 		apdu->resplen = 0;
@@ -615,19 +506,89 @@ static int sm_decrypt(const struct iso_sm_ctx *ctx, sc_card_t *card,
 	r = SC_SUCCESS;
 
 err:
-	free(asn1);
-	free(mac_data);
-	if (data) {
-		sc_mem_clear(data, buf_len);
-		free(data);
-	}
+	if (plain_len)
+		sc_mem_clear(scratch->crypt, plain_len);
 
 	return r;
 }
 
+static struct iso_sm_scratch *iso_sm_scratch_create(size_t data_size, size_t resp_size)
+{
+	struct iso_sm_scratch *scratch = calloc(1, sizeof *scratch);
+
+	if (!scratch)
+		return NULL;
+
+	if (reserve(&scratch->plain, &scratch->plain_size, data_size) < 0
+			|| reserve(&scratch->data, &scratch->data_size, data_size) < 0
+			|| reserve(&scratch->resp, &scratch->resp_size, resp_size) < 0) {
+		free(scratch->plain);
+		free(scratch->data);
+		free(scratch);
+		return NULL;
+	}
+
+	return scratch;
+}
+
+static void iso_sm_scratch_free(struct iso_sm_scratch *scratch)
+{
+	if (!scratch)
+		return;
+
+	if (scratch->in_use && !scratch->detached) {
+		/* the protected APDU is still in flight */
+		scratch->detached = 1;
+		return;
+	}
+
+	if (scratch->plain) {
+		sc_mem_clear(scratch->plain, scratch->plain_size);
+		free(scratch->plain);
+	}
+	free(scratch->data);
+	free(scratch->resp);
+	free(scratch->crypt);
+	free(scratch->mac);
+	free(scratch);
+}
+
+static struct iso_sm_scratch *iso_sm_scratch_get(struct iso_sm_ctx *sctx)
+{
+	struct iso_sm_scratch *scratch;
+
+	if (!sctx->scratch)
+		sctx->scratch = iso_sm_scratch_create(0, 0);
+	scratch = sctx->scratch;
+
+	if (scratch && scratch->in_use) {
+		/* a nested APDU, such as GET RESPONSE for the one in flight */
+		scratch = iso_sm_scratch_create(0, 0);
+		if (scratch)
+			scratch->detached = 1;
+	}
+	if (scratch)
+		scratch->in_use = 1;
+
+	return scratch;
+}
+
+static void iso_sm_scratch_put(struct iso_sm_scratch *scratch)
+{
+	if (!scratch)
+		return;
+
+	scratch->in_use = 0;
+	if (scratch->detached)
+		iso_sm_scratch_free(scratch);
+}
+
 static int iso_add_sm(struct iso_sm_ctx *sctx, sc_card_t *card,
 		sc_apdu_t *apdu, sc_apdu_t **sm_apdu)
 {
+	struct iso_sm_scratch *scratch;
+	int r;
+
 	if (!card || !sctx)
 		return SC_ERROR_INVALID_ARGUMENTS;
 
@@ -641,14 +602,21 @@ static int iso_add_sm(struct iso_sm_ctx *sctx, sc_card_t *card,
 	if (sctx->pre_transmit)
 		LOG_TEST_RET(card->ctx, sctx->pre_transmit(card, sctx, apdu),
 				"Could not complete SM specific pre transmit routine");
-	LOG_TEST_RET(card->ctx, sm_encrypt(sctx, card, apdu, sm_apdu),
-			"Could not encrypt APDU");
+
+	scratch = iso_sm_scratch_get(sctx);
+	if (!scratch)
+		LOG_TEST_RET(card->ctx, SC_ERROR_OUT_OF_MEMORY,
+				"Could not allocate SM buffers");
+	r = sm_encrypt(sctx, card, scratch, apdu, sm_apdu);
+	if (r < 0)
+		iso_sm_scratch_put(scratch);
+	LOG_TEST_RET(card->ctx, r, "Could not encrypt APDU");
 
 	return SC_SUCCESS;
 }
 
 static int iso_rm_sm(struct iso_sm_ctx *sctx, sc_card_t *card,
-		sc_apdu_t *sm_apdu, sc_apdu_t *apdu)
+		struct iso_sm_scratch *scratch, sc_apdu_t *sm_apdu, sc_apdu_t *apdu)
 {
 	if (!sctx)
 		LOG_TEST_RET(card->ctx, SC_ERROR_INVALID_ARGUMENTS,
@@ -657,7 +625,7 @@ static int iso_rm_sm(struct iso_sm_ctx *sctx, sc_card_t *card,
 	if (sctx->post_transmit)
 		LOG_TEST_RET(card->ctx, sctx->post_transmit(card, sctx, sm_apdu),
 				"Could not complete SM specific post transmit routine");
-	LOG_TEST_RET(card->ctx, sm_decrypt(sctx, card, sm_apdu, apdu),
+	LOG_TEST_RET(card->ctx, sm_decrypt(sctx, card, scratch, sm_apdu, apdu),
 			"Could not decrypt APDU");
 	if (sctx->finish)
 		LOG_TEST_RET(card->ctx, sctx->finish(card, sctx, apdu),
@@ -683,21 +651,18 @@ int iso_get_sm_apdu(struct sc_card *card, struct sc_apdu *apdu, struct sc_apdu *
 
 int iso_free_sm_apdu(struct sc_card *card, struct sc_apdu *apdu, struct sc_apdu **sm_apdu)
 {
-	struct sc_apdu *p;
+	struct iso_sm_scratch *scratch;
 	int r;
 
-	if (!sm_apdu)
+	if (!sm_apdu || !*sm_apdu)
 		return SC_ERROR_INVALID_ARGUMENTS;
 
-	p = *sm_apdu;
+	/* the protected APDU is the first member of its buffers */
+	scratch = (struct iso_sm_scratch *) *sm_apdu;
 
-	r = iso_rm_sm(card->sm_ctx.info.cmd_data, card, p, apdu);
+	r = iso_rm_sm(card->sm_ctx.info.cmd_data, card, scratch, *sm_apdu, apdu);
 
-	if (p) {
-		free((unsigned char *) p->data);
-		free((unsigned char *) p->resp);
-	}
-	free(*sm_apdu);
+	iso_sm_scratch_put(scratch);
 	*sm_apdu = NULL;
 
 	return r;
@@ -720,6 +685,7 @@ struct iso_sm_ctx *iso_sm_ctx_create(void)
 	sctx->post_transmit = NULL;
 	sctx->finish = NULL;
 	sctx->clear_free = NULL;
+	sctx->scratch = NULL;
 
 	return sctx;
 }
@@ -728,6 +694,8 @@ void iso_sm_ctx_clear_free(struct iso_sm_ctx *sctx)
 {
 	if (sctx && sctx->clear_free)
 		sctx->clear_free(sctx);
+	if (sctx)
+		iso_sm_scratch_free(sctx->scratch);
 	free(sctx);
 }
 
@@ -739,6 +707,20 @@ int iso_sm_start(struct sc_card *card, struct iso_sm_ctx *sctx)
 	if (card->sm_ctx.ops.close)
 		card->sm_ctx.ops.close(card);
 
+	/* the buffers for the protected APDUs are allocated once per session
+	 * with room for the padding and the data objects around the data.
+	 * Without limits of the card they are sized for short APDUs and grow
+	 * when needed. */
+	if (sctx && !sctx->scratch) {
+		sctx->scratch = iso_sm_scratch_create(
+				(card->max_send_size ? card->max_send_size : SC_MAX_APDU_DATA_SIZE)
+				+ 4 * sctx->block_length + 32,
+				(card->max_recv_size ? card->max_recv_size : SC_MAX_APDU_RESP_SIZE)
+				+ 4 * sctx->block_length + 32);
+		if (!sctx->scratch)
+			return SC_ERROR_OUT_OF_MEMORY;
+	}
+
 	card->sm_ctx.info.cmd_data = sctx;
 	card->sm_ctx.ops.close = iso_sm_close;
 	card->sm_ctx.ops.free_sm_apdu = iso_free_sm_apdu;
@@ -50,6 +50,8 @@ extern "C" {
 /** @brief Padding indicator: use no padding */
 #define SM_NO_PADDING  0x02
 
+struct iso_sm_scratch;
+
 /** @brief Secure messaging context */
 struct iso_sm_ctx {
 	/** @brief data of the specific crypto implementation */
@@ -60,7 +62,11 @@ struct iso_sm_ctx {
 	/** @brief Pad to this block length */
 	size_t block_length;
 
-	/** @brief Call back function for authentication of data */
+	/** @brief Call back function for authentication of data
+	 *
+	 * For this and the en-/decryption call backs the output buffer may
+	 * hold the result of a previous call and should be reused with
+	 * \c realloc() */
 	int (*authenticate)(sc_card_t *card, const struct iso_sm_ctx *ctx,
 			const u8 *data, size_t datalen, u8 **outdata);
 	/** @brief Call back function for verifying authentication data */
@@ -87,6 +93,9 @@ struct iso_sm_ctx {
 
 	/** @brief Clears and frees private data */
 	void (*clear_free)(const struct iso_sm_ctx *ctx);
+
+	/** @brief Buffers for the protected APDUs, allocated by iso_sm_start() */
+	struct iso_sm_scratch *scratch;
 };
 
 /** 
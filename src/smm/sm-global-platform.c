@@ -182,6 +182,31 @@ sm_gp_get_mac(unsigned char *key, DES_cblock *icv,
 }
 
 
+/* sm_gp_get_mac() with the session MAC key, keyed once at the session
+ * initialization */
+static int
+sm_gp_get_session_mac(struct sm_gp_session *gp_session,
+		unsigned char *in, int in_len, DES_cblock *out)
+{
+	unsigned char block[SC_MAX_APDU_BUFFER_SIZE + 8];
+	int len, rv;
+
+	if (!gp_session->crypt)
+		return SC_ERROR_SM_NO_SESSION_KEYS;
+	if (in_len < 0 || in_len > SC_MAX_APDU_BUFFER_SIZE)
+		return SC_ERROR_INVALID_ARGUMENTS;
+
+	memcpy(block, in, in_len);
+	memcpy(block + in_len, "\x80\0\0\0\0\0\0\0", 8);
+	len = in_len + 8;
+	len -= (len%8);
+
+	rv = sc_sm_crypt_mac(gp_session->crypt, gp_session->mac_icv, block, len, *out);
+	sc_mem_clear(block, sizeof(block));
+	return rv < 0 ? rv : 0;
+}
+
+
 static int
 sm_gp_parse_init_data(struct sc_context *ctx, struct sm_gp_session *gp_session,
 		unsigned char *init_data, size_t init_len)
@@ -220,6 +245,12 @@ sm_gp_init_session(struct sc_context *ctx, struct sm_gp_session *gp_session,
 		LOG_TEST_RET(ctx, SC_ERROR_SM_NO_SESSION_KEYS, "SM GP init session: get session keys error");
 	memcpy(gp_session->session_kek, gp_keyset->kek, 16);
 
+	sc_sm_crypt_free(gp_session->crypt);
+	gp_session->crypt = sc_sm_crypt_create(SM_CRYPT_DES3_CBC, gp_session->session_enc,
+			SM_MAC_DES3_CBC, gp_session->session_mac);
+	if (!gp_session->crypt)
+		LOG_TEST_RET(ctx, SC_ERROR_INTERNAL, "SM GP init session: cannot create session ciphers");
+
 	sc_debug(ctx, SC_LOG_DEBUG_SM, "SM GP init session: session ENC: %s", sc_dump_hex(gp_session->session_enc, 16));
 	sc_debug(ctx, SC_LOG_DEBUG_SM, "SM GP init session: session MAC: %s", sc_dump_hex(gp_session->session_mac, 16));
 	sc_debug(ctx, SC_LOG_DEBUG_SM, "SM GP init session: session KEK: %s", sc_dump_hex(gp_session->session_kek, 16));
@@ -243,6 +274,8 @@ sm_gp_close_session(struct sc_context *ctx, struct sm_gp_session *gp_session)
 	free(gp_session->session_enc);
 	free(gp_session->session_mac);
 	free(gp_session->session_kek);
+	sc_sm_crypt_free(gp_session->crypt);
+	gp_session->crypt = NULL;
 }
 
 
@@ -300,7 +333,7 @@ sm_gp_external_authentication(struct sc_context *ctx, struct sm_info *sm_info,
 
 	memcpy(raw_apdu + offs, host_cryptogram, 8);
 	offs += 8;
-	rv = sm_gp_get_mac(gp_session->session_mac, &gp_session->mac_icv, raw_apdu, offs, &mac);
+	rv = sm_gp_get_session_mac(gp_session, raw_apdu, offs, &mac);
 	LOG_TEST_RET(ctx, rv, "SM GP authentication: get MAC error");
 
 	memcpy(new_rapdu->sbuf, host_cryptogram, 8);
@@ -312,14 +345,17 @@ sm_gp_external_authentication(struct sc_context *ctx, struct sm_info *sm_info,
 
 
 static int
-sm_gp_encrypt_command_data(struct sc_context *ctx, unsigned char *session_key,
+sm_gp_encrypt_command_data(struct sc_context *ctx, struct sm_gp_session *gp_session,
 		const unsigned char *in, size_t in_len, unsigned char **out, size_t *out_len)
 {
 	unsigned char *data = NULL;
+	size_t data_len;
 	int rv, len;
 
 	if (!out || !out_len)
 		LOG_TEST_RET(ctx, SC_ERROR_INVALID_ARGUMENTS, "SM GP encrypt command data error");
+	if (!gp_session->crypt)
+		LOG_TEST_RET(ctx, SC_ERROR_SM_NO_SESSION_KEYS, "SM GP encrypt command data: no session ciphers");
 
 	sc_debug(ctx, SC_LOG_DEBUG_SM,
 	       "SM GP encrypt command data(len:%"SC_FORMAT_LEN_SIZE_T"u,%p)",
@@ -340,9 +376,27 @@ sm_gp_encrypt_command_data(struct sc_context *ctx, unsigned char *session_key,
 	*data = in_len;
 	memcpy(data + 1, in, in_len);
 
-	rv = sm_encrypt_des_cbc3(ctx, session_key, data, in_len + 1, out, out_len, 1);
+	/* padded as by sm_encrypt_des_cbc3() without forced padding */
+	data_len = in_len + 1;
+	if (data_len % 8)
+		data[data_len] = 0x80;
+	data_len = (data_len + 7) & ~(size_t)7;
+
+	*out = malloc(data_len);
+	if (!*out)   {
+		free(data);
+		LOG_FUNC_RETURN(ctx, SC_ERROR_OUT_OF_MEMORY);
+	}
+
+	rv = sc_sm_crypt_encrypt(gp_session->crypt, NULL, data, data_len, *out);
+	sc_mem_clear(data, len);
 	free(data);
-	LOG_TEST_RET(ctx, rv, "SM GP encrypt command data: encryption error");
+	if (rv != SC_SUCCESS)   {
+		free(*out);
+		*out = NULL;
+		LOG_TEST_RET(ctx, rv, "SM GP encrypt command data: encryption error");
+	}
+	*out_len = data_len;
 
 	LOG_FUNC_RETURN(ctx, SC_SUCCESS);
 }
@@ -381,7 +435,7 @@ sm_gp_securize_apdu(struct sc_context *ctx, struct sm_info *sm_info,
 		if (!gp_session->session_enc)
 			LOG_TEST_RET(ctx, SC_ERROR_SM_INVALID_SESSION_KEY, "SM GP securize APDU: no ENC session key found");
 
-		if (sm_gp_encrypt_command_data(ctx, gp_session->session_enc, apdu->data, apdu->datalen, &encrypted, &encrypted_len))
+		if (sm_gp_encrypt_command_data(ctx, gp_session, apdu->data, apdu->datalen, &encrypted, &encrypted_len))
 			LOG_TEST_RET(ctx, SC_ERROR_SM_ENCRYPT_FAILED, "SM GP securize APDU: data encryption error");
 
 		if (encrypted_len + 8 > SC_MAX_APDU_BUFFER_SIZE)
@@ -403,7 +457,7 @@ sm_gp_securize_apdu(struct sc_context *ctx, struct sm_info *sm_info,
 
 	memcpy(buff + 5, apdu_data, apdu->datalen);
 
-	rv = sm_gp_get_mac(gp_session->session_mac, &gp_session->mac_icv, buff, 5 + apdu->datalen, &mac);
+	rv = sm_gp_get_session_mac(gp_session, buff, 5 + apdu->datalen, &mac);
 	LOG_TEST_RET(ctx, rv, "SM GP securize APDU: get MAC error");
 
 	if (gp_level == SM_GP_SECURITY_MAC)   {
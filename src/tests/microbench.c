@@ -0,0 +1,834 @@
+/*
+ * microbench.c: Micro-benchmarks of libopensc internals
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Measures the cost of the parsing, encoding and checksum paths which are
+ * run for every card, APDU or object, without a card or reader. Every case
+ * is first run until it takes the requested time, and then measured a few
+ * times with that number of operations, reporting the median and the
+ * fastest time per operation.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "libopensc/internal.h"
+#include "libopensc/pkcs15.h"
+/* internal functions that libopensc does not export */
+#include "libopensc/apdu.c"
+#include "libopensc/compression.c"
+#include "sm/sm-iso.c"
+
+/* Used by the transmit and cache paths of the included files, which are
+ * not measured. The benchmark runs in one thread. */
+size_t sc_get_max_send_size(const sc_card_t *card)
+{
+	return SC_MAX_APDU_DATA_SIZE;
+}
+
+void sc_invalidate_cache(struct sc_card *card)
+{
+}
+
+void sc_stats_count_apdu(sc_context_t *ctx, const sc_apdu_t *apdu)
+{
+}
+
+int sc_mutex_lock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
+
+int sc_mutex_unlock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
+
+/* Number of entries of the generated PrKDF and CDF */
+#define DF_ENTRIES 16
+#define MAX_RUNS 100
+#define DATA_LENGTH 1024
+#define SM_DATA_LENGTH 128
+#define SM_BLOCK_LENGTH 16
+#define SM_MAC_LENGTH 8
+
+typedef int (*decode_entry_func)(struct sc_pkcs15_card *, struct sc_pkcs15_object *,
+		const u8 **, size_t *);
+
+struct bench {
+	sc_context_t *ctx;
+	sc_reader_t reader;
+	sc_card_t card;
+	struct sc_pkcs15_card *p15card;
+	double seconds;
+	int runs;
+
+	u8 *prkdf, *cdf;
+	size_t prkdf_len, cdf_len;
+	/* the content of the file selected on the card */
+	const u8 *file;
+	size_t file_len;
+
+	u8 data[DATA_LENGTH];
+	u8 response[SC_MAX_APDU_RESP_SIZE];
+	u8 received[SC_MAX_APDU_RESP_SIZE];
+	sc_apdu_t apdu;
+	u8 *compressed;
+	size_t compressed_len;
+#ifdef ENABLE_SM
+	sc_card_t sm_card;
+	u8 sm_response[SC_MAX_EXT_APDU_RESP_SIZE];
+	size_t sm_response_len;
+#endif
+};
+
+struct bench_case {
+	const char *name;
+	int (*run)(struct bench *, unsigned long);
+};
+
+static const struct option options[] = {
+	{ "time",	1, NULL,	't' },
+	{ "runs",	1, NULL,	'r' },
+	{ "prkdf",	1, NULL,	'p' },
+	{ "cdf",	1, NULL,	'c' },
+	{ "list",	0, NULL,	'l' },
+	{ "help",	0, NULL,	'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+static double now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / frequency.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}
+
+static int append(u8 **buf, size_t *len, const u8 *data, size_t datalen)
+{
+	u8 *p = realloc(*buf, *len + datalen);
+
+	if (!p)
+		return SC_ERROR_OUT_OF_MEMORY;
+	memcpy(p + *len, data, datalen);
+	*buf = p;
+	*len += datalen;
+
+	return SC_SUCCESS;
+}
+
+static int load_file(const char *name, u8 **buf, size_t *len)
+{
+	FILE *f = fopen(name, "rb");
+	u8 chunk[4096];
+	size_t n;
+	int r = SC_SUCCESS;
+
+	if (!f) {
+		fprintf(stderr, "Failed to open %s\n", name);
+		return SC_ERROR_FILE_NOT_FOUND;
+	}
+	free(*buf);
+	*buf = NULL;
+	*len = 0;
+	while (r == SC_SUCCESS && (n = fread(chunk, 1, sizeof chunk, f)) > 0)
+		r = append(buf, len, chunk, n);
+	fclose(f);
+	if (r == SC_SUCCESS && *len == 0)
+		r = SC_ERROR_INVALID_DATA;
+
+	return r;
+}
+
+/* Encodes the DFs of a card with a key and a certificate per slot */
+static int build_dfs(struct bench *b)
+{
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_prkey_info prkey;
+	struct sc_pkcs15_cert_info cert;
+	u8 *buf;
+	size_t len;
+	int i, r;
+
+	for (i = 0; i < DF_ENTRIES; i++) {
+		memset(&obj, 0, sizeof obj);
+		memset(&prkey, 0, sizeof prkey);
+		snprintf(obj.label, sizeof obj.label, "Private key %d", i + 1);
+		obj.type = SC_PKCS15_TYPE_PRKEY_RSA;
+		obj.flags = SC_PKCS15_CO_FLAG_PRIVATE | SC_PKCS15_CO_FLAG_MODIFIABLE;
+		obj.auth_id.len = 1;
+		obj.auth_id.value[0] = 0x01;
+		obj.data = &prkey;
+		prkey.id.len = 20;
+		memset(prkey.id.value, i + 1, prkey.id.len);
+		prkey.usage = SC_PKCS15_PRKEY_USAGE_SIGN | SC_PKCS15_PRKEY_USAGE_DECRYPT;
+		prkey.access_flags = SC_PKCS15_PRKEY_ACCESS_SENSITIVE
+			| SC_PKCS15_PRKEY_ACCESS_ALWAYSSENSITIVE
+			| SC_PKCS15_PRKEY_ACCESS_NEVEREXTRACTABLE
+			| SC_PKCS15_PRKEY_ACCESS_LOCAL;
+		prkey.native = 1;
+		prkey.key_reference = i + 1;
+		prkey.modulus_length = 2048;
+		sc_format_path("3F0050154B00", &prkey.path);
+		prkey.path.value[prkey.path.len - 1] = i + 1;
+
+		r = sc_pkcs15_encode_prkdf_entry(b->ctx, &obj, &buf, &len);
+		if (r == SC_SUCCESS) {
+			r = append(&b->prkdf, &b->prkdf_len, buf, len);
+			free(buf);
+		}
+		if (r != SC_SUCCESS)
+			return r;
+
+		memset(&obj, 0, sizeof obj);
+		memset(&cert, 0, sizeof cert);
+		snprintf(obj.label, sizeof obj.label, "Certificate %d", i + 1);
+		obj.type = SC_PKCS15_TYPE_CERT_X509;
+		obj.flags = SC_PKCS15_CO_FLAG_MODIFIABLE;
+		obj.data = &cert;
+		cert.id = prkey.id;
+		sc_format_path("3F0050154300", &cert.path);
+		cert.path.value[cert.path.len - 1] = i + 1;
+
+		r = sc_pkcs15_encode_cdf_entry(b->ctx, &obj, &buf, &len);
+		if (r == SC_SUCCESS) {
+			r = append(&b->cdf, &b->cdf_len, buf, len);
+			free(buf);
+		}
+		if (r != SC_SUCCESS)
+			return r;
+	}
+
+	return SC_SUCCESS;
+}
+
+static int count_entries(struct bench *b, const u8 *df, size_t len, decode_entry_func decode)
+{
+	struct sc_pkcs15_object *obj;
+	int r, count = 0;
+
+	while (len && *df != 0x00) {
+		obj = calloc(1, sizeof *obj);
+		if (!obj)
+			return SC_ERROR_OUT_OF_MEMORY;
+		r = decode(b->p15card, obj, &df, &len);
+		if (r) {
+			free(obj);
+			if (r == SC_ERROR_ASN1_END_OF_CONTENTS)
+				break;
+			return r;
+		}
+		sc_pkcs15_free_object(obj);
+		count++;
+	}
+
+	return count;
+}
+
+/* The paths of the entries are relative to the application */
+static int set_app(struct bench *b)
+{
+	if (!b->p15card->file_app) {
+		b->p15card->file_app = sc_file_new();
+		if (!b->p15card->file_app)
+			return SC_ERROR_OUT_OF_MEMORY;
+		sc_format_path("3F005015", &b->p15card->file_app->path);
+	}
+
+	return SC_SUCCESS;
+}
+
+static int bench_decode(struct bench *b, unsigned long count,
+		const u8 *df, size_t len, decode_entry_func decode)
+{
+	unsigned long i;
+	int r;
+
+	for (i = 0; i < count; i++) {
+		r = count_entries(b, df, len, decode);
+		if (r < 0)
+			return r;
+	}
+
+	return SC_SUCCESS;
+}
+
+static int bench_prkdf_decode(struct bench *b, unsigned long count)
+{
+	return bench_decode(b, count, b->prkdf, b->prkdf_len, sc_pkcs15_decode_prkdf_entry);
+}
+
+static int bench_cdf_decode(struct bench *b, unsigned long count)
+{
+	return bench_decode(b, count, b->cdf, b->cdf_len, sc_pkcs15_decode_cdf_entry);
+}
+
+static int bench_select_file(sc_card_t *card, const sc_path_t *path, sc_file_t **file_out)
+{
+	struct bench *b = card->drv_data;
+	sc_file_t *file;
+
+	if (file_out) {
+		file = sc_file_new();
+		if (!file)
+			return SC_ERROR_OUT_OF_MEMORY;
+		file->path = *path;
+		file->type = SC_FILE_TYPE_WORKING_EF;
+		file->ef_structure = SC_FILE_EF_TRANSPARENT;
+		file->size = b->file_len;
+		*file_out = file;
+	}
+
+	return SC_SUCCESS;
+}
+
+static int bench_read_binary(sc_card_t *card, unsigned int idx, u8 *buf,
+		size_t count, unsigned long flags)
+{
+	struct bench *b = card->drv_data;
+
+	if (idx > b->file_len)
+		return SC_ERROR_INCORRECT_PARAMETERS;
+	if (count > b->file_len - idx)
+		count = b->file_len - idx;
+	memcpy(buf, b->file + idx, count);
+
+	return (int) count;
+}
+
+static int bench_parse_df(struct bench *b, unsigned long count,
+		const u8 *df, size_t len, unsigned int type)
+{
+	sc_path_t path;
+	unsigned long i;
+	int r;
+
+	b->file = df;
+	b->file_len = len;
+	sc_format_path("3F0050154400", &path);
+	for (i = 0; i < count; i++) {
+		r = set_app(b);
+		if (r == SC_SUCCESS)
+			r = sc_pkcs15_add_df(b->p15card, type, &path);
+		if (r == SC_SUCCESS)
+			r = sc_pkcs15_parse_df(b->p15card, b->p15card->df_list);
+		sc_pkcs15_card_clear(b->p15card);
+		if (r != SC_SUCCESS)
+			return r;
+	}
+
+	return SC_SUCCESS;
+}
+
+static int bench_prkdf_parse(struct bench *b, unsigned long count)
+{
+	return bench_parse_df(b, count, b->prkdf, b->prkdf_len, SC_PKCS15_PRKDF);
+}
+
+static int bench_cdf_parse(struct bench *b, unsigned long count)
+{
+	return bench_parse_df(b, count, b->cdf, b->cdf_len, SC_PKCS15_CDF);
+}
+
+static int bench_apdu2bytes(struct bench *b, unsigned long count)
+{
+	u8 out[SC_MAX_APDU_BUFFER_SIZE];
+	unsigned long i;
+	int r;
+
+	for (i = 0; i < count; i++) {
+		r = sc_apdu2bytes(b->ctx, &b->apdu, SC_PROTO_T1, out, sizeof out);
+		if (r != SC_SUCCESS)
+			return r;
+	}
+
+	return SC_SUCCESS;
+}
+
+static int bench_apdu_set_resp(struct bench *b, unsigned long count)
+{
+	unsigned long i;
+	int r;
+
+	b->apdu.resp = b->received;
+	for (i = 0; i < count; i++) {
+		b->apdu.resplen = sizeof b->received;
+		r = sc_apdu_set_resp(b->ctx, &b->apdu, b->response, sizeof b->response);
+		if (r != SC_SUCCESS)
+			return r;
+	}
+
+	return SC_SUCCESS;
+}
+
+static int bench_pkcs1_encode(struct bench *b, unsigned long count)
+{
+	u8 out[256];
+	size_t outlen;
+	unsigned long i;
+	int r;
+
+	for (i = 0; i < count; i++) {
+		outlen = sizeof out;
+		r = sc_pkcs1_encode(b->ctx, SC_ALGORITHM_RSA_PAD_PKCS1 | SC_ALGORITHM_RSA_HASH_SHA256,
+				b->data, 32, out, &outlen, 2048);
+		if (r != SC_SUCCESS)
+			return r;
+	}
+
+	return SC_SUCCESS;
+}
+
+#ifdef ENABLE_SM
+static int sm_crypt(sc_card_t *card, const struct iso_sm_ctx *ctx,
+		const u8 *in, size_t inlen, u8 **out)
+{
+	u8 *p;
+	size_t i;
+
+	p = realloc(*out, inlen ? inlen : 1);
+	if (!p)
+		return SC_ERROR_OUT_OF_MEMORY;
+	*out = p;
+	for (i = 0; i < inlen; i++)
+		p[i] = in[i] ^ 0x5A;
+
+	return (int) inlen;
+}
+
+static void sm_checksum(const u8 *data, size_t datalen, u8 *mac)
+{
+	size_t i;
+
+	memset(mac, 0, SM_MAC_LENGTH);
+	for (i = 0; i < datalen; i++)
+		mac[i % SM_MAC_LENGTH] ^= data[i];
+}
+
+static int sm_authenticate(sc_card_t *card, const struct iso_sm_ctx *ctx,
+		const u8 *data, size_t datalen, u8 **outdata)
+{
+	u8 *p = realloc(*outdata, SM_MAC_LENGTH);
+
+	if (!p)
+		return SC_ERROR_OUT_OF_MEMORY;
+	*outdata = p;
+	sm_checksum(data, datalen, p);
+
+	return SM_MAC_LENGTH;
+}
+
+static int sm_verify(sc_card_t *card, const struct iso_sm_ctx *ctx,
+		const u8 *mac, size_t maclen, const u8 *macdata, size_t macdatalen)
+{
+	u8 expected[SM_MAC_LENGTH];
+
+	sm_checksum(macdata, macdatalen, expected);
+	if (maclen != SM_MAC_LENGTH || memcmp(mac, expected, SM_MAC_LENGTH))
+		return SC_ERROR_OBJECT_NOT_VALID;
+
+	return SC_SUCCESS;
+}
+
+/* Builds the response of the card: cryptogram, status bytes and MAC */
+static size_t sm_response(const struct iso_sm_ctx *sctx,
+		const u8 *plain, size_t plainlen, u8 *resp, size_t resplen)
+{
+	u8 padded[SC_MAX_EXT_APDU_RESP_SIZE + SM_BLOCK_LENGTH], mac[SM_MAC_LENGTH];
+	u8 *p = resp;
+	size_t i, padded_len;
+
+	memcpy(padded, plain, plainlen);
+	padded_len = add_padding(sctx, padded, plainlen, sizeof padded);
+
+	sc_asn1_put_tag(0x87, NULL, padded_len + 1, p, resplen, &p);
+	*p++ = sctx->padding_indicator;
+	for (i = 0; i < padded_len; i++)
+		*p++ = padded[i] ^ 0x5A;
+	sc_asn1_put_tag(0x99, (const u8 *) "\x90\x00", 2,
+			p, resplen - (p - resp), &p);
+
+	memcpy(padded, resp, p - resp);
+	padded_len = add_padding(sctx, padded, p - resp, sizeof padded);
+	sm_checksum(padded, padded_len, mac);
+	sc_asn1_put_tag(0x8E, mac, SM_MAC_LENGTH, p, resplen - (p - resp), &p);
+
+	return p - resp;
+}
+
+/* Wraps and unwraps APDUs with the ISO SM layer, using trivial cipher and
+ * MAC call backs, so that only the cost of the framing is measured */
+static int sm_setup(struct bench *b)
+{
+	struct iso_sm_ctx *sctx;
+	int r;
+
+	b->sm_card.ctx = b->ctx;
+	b->sm_card.reader = &b->reader;
+	b->sm_card.caps = SC_CARD_CAP_APDU_EXT;
+
+	sctx = iso_sm_ctx_create();
+	if (!sctx)
+		return SC_ERROR_OUT_OF_MEMORY;
+	sctx->block_length = SM_BLOCK_LENGTH;
+	sctx->encrypt = sm_crypt;
+	sctx->decrypt = sm_crypt;
+	sctx->authenticate = sm_authenticate;
+	sctx->verify_authentication = sm_verify;
+	r = iso_sm_start(&b->sm_card, sctx);
+	if (r != SC_SUCCESS) {
+		iso_sm_ctx_clear_free(sctx);
+		return r;
+	}
+	b->sm_response_len = sm_response(sctx, b->data, SM_DATA_LENGTH,
+			b->sm_response, sizeof b->sm_response);
+
+	return SC_SUCCESS;
+}
+
+static int bench_sm(struct bench *b, unsigned long count)
+{
+	sc_card_t *card = &b->sm_card;
+	sc_apdu_t apdu, *sm_apdu;
+	u8 buf[SC_MAX_EXT_APDU_RESP_SIZE];
+	unsigned long i;
+	int r;
+
+	for (i = 0; i < count; i++) {
+		sc_format_apdu(card, &apdu, SC_APDU_CASE_4_SHORT, 0x2A, 0x80, 0x86);
+		apdu.data = b->data;
+		apdu.datalen = SM_DATA_LENGTH;
+		apdu.lc = SM_DATA_LENGTH;
+		apdu.le = SM_DATA_LENGTH;
+		apdu.resp = buf;
+		apdu.resplen = sizeof buf;
+
+		r = card->sm_ctx.ops.get_sm_apdu(card, &apdu, &sm_apdu);
+		if (r != SC_SUCCESS)
+			return r;
+
+		memcpy(sm_apdu->resp, b->sm_response, b->sm_response_len);
+		sm_apdu->resplen = b->sm_response_len;
+
+		r = card->sm_ctx.ops.free_sm_apdu(card, &apdu, &sm_apdu);
+		if (r != SC_SUCCESS)
+			return r;
+	}
+
+	return SC_SUCCESS;
+}
+#endif
+
+#ifdef ENABLE_ZLIB
+static int bench_decompress(struct bench *b, unsigned long count)
+{
+	u8 *out;
+	size_t outlen;
+	unsigned long i;
+	int r;
+
+	for (i = 0; i < count; i++) {
+		out = NULL;
+		r = sc_decompress_alloc(&out, &outlen, b->compressed, b->compressed_len, COMPRESSION_ZLIB);
+		if (r != SC_SUCCESS)
+			return r;
+		free(out);
+	}
+
+	return SC_SUCCESS;
+}
+#endif
+
+static int bench_crc32(struct bench *b, unsigned long count)
+{
+	unsigned long i;
+	unsigned crc = 0;
+
+	for (i = 0; i < count; i++)
+		crc += sc_crc32(b->data, sizeof b->data);
+
+	/* keep the compiler from dropping the calls */
+	return crc == 1 ? SC_ERROR_INTERNAL : SC_SUCCESS;
+}
+
+static const struct bench_case cases[] = {
+	{ "prkdf_decode",	bench_prkdf_decode },
+	{ "cdf_decode",		bench_cdf_decode },
+	{ "prkdf_parse_df",	bench_prkdf_parse },
+	{ "cdf_parse_df",	bench_cdf_parse },
+	{ "apdu2bytes",		bench_apdu2bytes },
+	{ "apdu_set_resp",	bench_apdu_set_resp },
+	{ "pkcs1_encode",	bench_pkcs1_encode },
+#ifdef ENABLE_SM
+	{ "sm_wrap_unwrap",	bench_sm },
+#endif
+#ifdef ENABLE_ZLIB
+	{ "decompress",		bench_decompress },
+#endif
+	{ "crc32",		bench_crc32 },
+	{ NULL, NULL }
+};
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int measure(struct bench *b, const struct bench_case *bc)
+{
+	double results[MAX_RUNS], start, seconds;
+	unsigned long count = 1;
+	int i, r;
+
+	/* warm up and find the number of operations filling the time */
+	for (;;) {
+		start = now();
+		r = bc->run(b, count);
+		seconds = now() - start;
+		if (r != SC_SUCCESS)
+			return r;
+		if (seconds >= b->seconds)
+			break;
+		if (seconds < b->seconds / 10)
+			count *= 10;
+		else
+			count = (unsigned long) (count * b->seconds / seconds) + 1;
+	}
+
+	for (i = 0; i < b->runs; i++) {
+		start = now();
+		r = bc->run(b, count);
+		seconds = now() - start;
+		if (r != SC_SUCCESS)
+			return r;
+		results[i] = seconds * 1000000000 / count;
+	}
+	qsort(results, b->runs, sizeof *results, compare_double);
+
+	printf("%-16s %14.1f %14.1f %12lu\n",
+			bc->name, results[b->runs / 2], results[0], count);
+
+	return SC_SUCCESS;
+}
+
+static int setup(struct bench *b, const char *prkdf_file, const char *cdf_file)
+{
+	static struct sc_reader_operations reader_ops;
+	static struct sc_card_operations ops;
+	static struct sc_card_driver driver = { "Benchmark", "bench", &ops, NULL, 0, NULL };
+	sc_context_param_t ctx_param;
+	size_t i;
+	int prkdf_entries, cdf_entries, r;
+
+	memset(&ctx_param, 0, sizeof ctx_param);
+	ctx_param.app_name = "microbench";
+	r = sc_context_create(&b->ctx, &ctx_param);
+	if (r != SC_SUCCESS)
+		return r;
+
+	ops.select_file = bench_select_file;
+	ops.read_binary = bench_read_binary;
+	b->reader.ops = &reader_ops;
+	b->reader.active_protocol = SC_PROTO_T1;
+	b->card.ctx = b->ctx;
+	b->card.reader = &b->reader;
+	b->card.driver = &driver;
+	b->card.ops = &ops;
+	b->card.drv_data = b;
+
+	b->p15card = sc_pkcs15_card_new();
+	if (!b->p15card)
+		return SC_ERROR_OUT_OF_MEMORY;
+	b->p15card->card = &b->card;
+	r = set_app(b);
+	if (r != SC_SUCCESS)
+		return r;
+
+	r = build_dfs(b);
+	if (r == SC_SUCCESS && prkdf_file)
+		r = load_file(prkdf_file, &b->prkdf, &b->prkdf_len);
+	if (r == SC_SUCCESS && cdf_file)
+		r = load_file(cdf_file, &b->cdf, &b->cdf_len);
+	if (r != SC_SUCCESS)
+		return r;
+	prkdf_entries = count_entries(b, b->prkdf, b->prkdf_len, sc_pkcs15_decode_prkdf_entry);
+	if (prkdf_entries < 0)
+		return prkdf_entries;
+	cdf_entries = count_entries(b, b->cdf, b->cdf_len, sc_pkcs15_decode_cdf_entry);
+	if (cdf_entries < 0)
+		return cdf_entries;
+
+	for (i = 0; i < sizeof b->data; i++)
+		b->data[i] = (u8) (i * 31 + (i >> 8));
+	for (i = 0; i < sizeof b->response; i++)
+		b->response[i] = (u8) i;
+	b->response[sizeof b->response - 2] = 0x90;
+	b->response[sizeof b->response - 1] = 0x00;
+	sc_format_apdu(&b->card, &b->apdu, SC_APDU_CASE_4_SHORT, 0x2A, 0x9E, 0x9A);
+	b->apdu.data = b->data;
+	b->apdu.datalen = SC_MAX_APDU_DATA_SIZE;
+	b->apdu.lc = SC_MAX_APDU_DATA_SIZE;
+	b->apdu.le = SC_MAX_APDU_RESP_SIZE - 2;
+
+#ifdef ENABLE_ZLIB
+	/* compressed certificates of real cards are DER as well */
+	b->compressed_len = b->cdf_len + b->cdf_len / 100 + 64;
+	b->compressed = malloc(b->compressed_len);
+	if (!b->compressed)
+		return SC_ERROR_OUT_OF_MEMORY;
+	r = sc_compress(b->compressed, &b->compressed_len, b->cdf, b->cdf_len, COMPRESSION_ZLIB);
+	if (r != SC_SUCCESS)
+		return r;
+#endif
+#ifdef ENABLE_SM
+	r = sm_setup(b);
+	if (r != SC_SUCCESS)
+		return r;
+#endif
+
+	printf("PrKDF: %d entries, %"SC_FORMAT_LEN_SIZE_T"u bytes\n",
+			prkdf_entries, b->prkdf_len);
+	printf("CDF: %d entries, %"SC_FORMAT_LEN_SIZE_T"u bytes\n",
+			cdf_entries, b->cdf_len);
+
+	return SC_SUCCESS;
+}
+
+static void cleanup(struct bench *b)
+{
+#ifdef ENABLE_SM
+	if (b->sm_card.sm_ctx.ops.close)
+		b->sm_card.sm_ctx.ops.close(&b->sm_card);
+#endif
+	if (b->p15card) {
+		b->p15card->card = NULL;
+		sc_pkcs15_card_free(b->p15card);
+	}
+	free(b->prkdf);
+	free(b->cdf);
+	free(b->compressed);
+	if (b->ctx)
+		sc_release_context(b->ctx);
+}
+
+static void usage(const char *name)
+{
+	const struct bench_case *bc;
+
+	fprintf(stderr,
+			"Usage: %s [options] [case...]\n"
+			"  -t, --time <ms>    time of every measured run (default 200)\n"
+			"  -r, --runs <n>     measured runs of every case (default 5, max. %d)\n"
+			"  -p, --prkdf <file> decode the content of this PrKDF\n"
+			"  -c, --cdf <file>   decode the content of this CDF\n"
+			"  -l, --list         list the cases\n"
+			"Cases:", name, MAX_RUNS);
+	for (bc = cases; bc->name; bc++)
+		fprintf(stderr, " %s", bc->name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench b;
+	const struct bench_case *bc;
+	const char *prkdf_file = NULL, *cdf_file = NULL;
+	int c, i, r;
+
+	memset(&b, 0, sizeof b);
+	b.seconds = 0.2;
+	b.runs = 5;
+	while ((c = getopt_long(argc, argv, "t:r:p:c:lh", options, NULL)) != -1) {
+		switch (c) {
+		case 't':
+			b.seconds = atoi(optarg) / 1000.0;
+			break;
+		case 'r':
+			b.runs = atoi(optarg);
+			break;
+		case 'p':
+			prkdf_file = optarg;
+			break;
+		case 'c':
+			cdf_file = optarg;
+			break;
+		case 'l':
+			for (bc = cases; bc->name; bc++)
+				printf("%s\n", bc->name);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (b.seconds <= 0 || b.runs < 1 || b.runs > MAX_RUNS) {
+		usage(argv[0]);
+		return 1;
+	}
+	for (i = optind; i < argc; i++) {
+		for (bc = cases; bc->name; bc++)
+			if (!strcmp(bc->name, argv[i]))
+				break;
+		if (!bc->name) {
+			fprintf(stderr, "Unknown case %s\n", argv[i]);
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	r = setup(&b, prkdf_file, cdf_file);
+	if (r != SC_SUCCESS) {
+		fprintf(stderr, "Failed to prepare the benchmarks: %s\n", sc_strerror(r));
+		cleanup(&b);
+		return 1;
+	}
+
+	printf("%-16s %14s %14s %12s\n", "case", "median ns/op", "fastest ns/op", "ops/run");
+	for (bc = cases; r == SC_SUCCESS && bc->name; bc++) {
+		if (optind < argc) {
+			for (i = optind; i < argc; i++)
+				if (!strcmp(bc->name, argv[i]))
+					break;
+			if (i == argc)
+				continue;
+		}
+		r = measure(&b, bc);
+		if (r != SC_SUCCESS)
+			fprintf(stderr, "%s failed: %s\n", bc->name, sc_strerror(r));
+	}
+
+	cleanup(&b);
+
+	return r == SC_SUCCESS ? 0 : 1;
+}
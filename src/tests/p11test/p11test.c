@@ -31,6 +31,8 @@
 #include "p11test_case_mechs.h"
 #include "p11test_case_wait.h"
 #include "p11test_case_pss_oaep.h"
+#include "p11test_case_perf.h"
+#include "p11test_case_fork.h"
 
 #define DEFAULT_P11LIB	"../../pkcs11/.libs/opensc-pkcs11.so"
 
@@ -40,13 +42,17 @@ token_info_t token;
 void display_usage() {
 	fprintf(stdout,
 		" Usage:\n"
-		"	./p11test [-m module_path] [-s slot_id] [-p pin]\n"
+		"	./p11test [-m module_path] [-s slot_id] [-p pin] [-P [-n count] [-t name=limit]]\n"
 		"		-m module_path	Path to tested module (e.g. /usr/lib64/opensc-pkcs11.so)\n"
 		"						Default is "DEFAULT_P11LIB"\n"
 		"		-p pin			Application PIN\n"
 		"		-s slot_id		Slot ID with the card\n"
 		"		-i				Wait for the card before running the test (interactive)\n"
 		"		-o				File to write a log in JSON\n"
+		"		-P				Run the performance tests instead of the functional ones\n"
+		"		-n count		Number of measured operations of every kind (default 20)\n"
+		"		-t name=limit	Fail if the median latency of an operation exceeds\n"
+		"						limit microseconds (can be repeated)\n"
 		"		-h				This help\n"
 		"\n");
 }
@@ -85,6 +91,30 @@ int main(int argc, char** argv) {
 		/* Verify that ECDH key derivation works */
 		cmocka_unit_test_setup_teardown(derive_tests,
 			user_login_setup, after_test_cleanup),
+
+		/* Verify that a forked child initializes the module again */
+		cmocka_unit_test_setup_teardown(fork_test,
+			user_login_setup, after_test_cleanup),
+	};
+	const struct CMUnitTest performance_tests[] = {
+		/* Collect the mechanisms to measure */
+		cmocka_unit_test_setup_teardown(supported_mechanisms_test,
+			token_setup, token_cleanup),
+
+		/* Latency of C_Initialize, C_OpenSession and C_Login */
+		cmocka_unit_test(perf_session_test),
+
+		/* Searching through many objects */
+		cmocka_unit_test_setup_teardown(perf_find_objects_test,
+			user_login_setup, after_test_cleanup),
+
+		/* Single-shot and multi-part signatures */
+		cmocka_unit_test_setup_teardown(perf_sign_test,
+			user_login_setup, after_test_cleanup),
+
+		/* Signatures in concurrent sessions */
+		cmocka_unit_test_setup_teardown(perf_sessions_test,
+			perf_threads_setup, after_test_cleanup),
 	};
 
 	token.library_path = NULL;
@@ -93,8 +123,11 @@ int main(int argc, char** argv) {
 	token.interactive = 0;
 	token.slot_id = (unsigned long) -1;
 	token.log.outfile = NULL;
+	token.perf = 0;
+	token.perf_iterations = 20;
+	token.num_perf_limits = 0;
 
-	while ((command = getopt(argc, argv, "?hm:s:p:io:")) != -1) {
+	while ((command = getopt(argc, argv, "?hm:s:p:io:Pn:t:")) != -1) {
 		switch (command) {
 			case 'o':
 				token.log.outfile = strdup(optarg);
@@ -112,6 +145,16 @@ int main(int argc, char** argv) {
 			case 'i':
 				token.interactive = 1;
 				break;
+			case 'P':
+				token.perf = 1;
+				break;
+			case 'n':
+				token.perf_iterations = atoi(optarg);
+				break;
+			case 't':
+				if (token.num_perf_limits < MAX_PERF_LIMITS)
+					token.perf_limits[token.num_perf_limits++] = optarg;
+				break;
 			case 'h':
 			case '?':
 				display_usage();
@@ -134,6 +177,10 @@ int main(int argc, char** argv) {
 	debug_print("Card info:\n\tPIN %s\n\tPIN LENGTH %lu\n\t",
 		token.pin, token.pin_length);
 
+	if (token.perf)
+		return cmocka_run_group_tests(performance_tests,
+			group_setup, group_teardown);
+
 	return cmocka_run_group_tests(readonly_tests_without_initialization,
 		group_setup, group_teardown);
 }
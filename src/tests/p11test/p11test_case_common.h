@@ -103,6 +103,10 @@ int is_pss_mechanism(CK_MECHANISM_TYPE mech);
 #define P11TEST_PASS(info) do { _P11TEST_FINALIZE(info, "pass"); } while(0);
 
 #define P11TEST_FAIL(info, msg, ...) do { \
+		if (info->log.fd && info->log.in_data) { \
+			fprintf(info->log.fd, "]"); \
+			info->log.in_data = 0; \
+		} \
 		if (info->log.fd && info->log.in_test) { \
 			fprintf(info->log.fd, ",\n\t\"fail_reason\": \"" msg "\"", ##__VA_ARGS__); \
 		} \
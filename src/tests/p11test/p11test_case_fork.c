@@ -0,0 +1,198 @@
+/*
+ * p11test_case_fork.c: Reinitialization of the module after fork()
+ *
+ * Copyright (C) 2026 OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The parent logs in and signs, then a child calls C_Initialize again. The
+ * child must neither inherit the login nor the PIN, so signing fails until
+ * it logs in itself, and the parent must still be able to sign afterwards.
+ * With OpenSC, enable reuse_tokens_after_fork to test the tokens kept from
+ * the parent instead of a complete reinitialization.
+ */
+
+#include "p11test_case_fork.h"
+#include "p11test_case_readonly.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Exit codes of the child */
+#define FORK_PASS	0
+#define FORK_FAIL	1
+#define FORK_SKIP	2
+
+/* Looks up the private key in the objects of the child */
+static CK_OBJECT_HANDLE find_private_key(test_cert_t *o, token_info_t *info)
+{
+	CK_FUNCTION_LIST_PTR fp = info->function_pointer;
+	CK_OBJECT_CLASS privateClass = CKO_PRIVATE_KEY;
+	CK_ATTRIBUTE filter[] = {
+		{CKA_CLASS, &privateClass, sizeof(privateClass)},
+		{CKA_ID, o->key_id, o->key_id_size},
+	};
+	CK_OBJECT_HANDLE handle = CK_INVALID_HANDLE;
+	CK_ULONG count = 0;
+
+	if (fp->C_FindObjectsInit(info->session_handle, filter, 2) != CKR_OK)
+		return CK_INVALID_HANDLE;
+	if (fp->C_FindObjects(info->session_handle, &handle, 1, &count) != CKR_OK
+			|| count != 1)
+		handle = CK_INVALID_HANDLE;
+	fp->C_FindObjectsFinal(info->session_handle);
+	return handle;
+}
+
+/* Runs in the child, which must not use the assertions of cmocka */
+static int fork_child(test_cert_t *o, test_mech_t *mech, int is_private,
+	token_info_t *info)
+{
+	CK_FUNCTION_LIST_PTR fp = info->function_pointer;
+	CK_SESSION_INFO session_info;
+	CK_RV rv;
+
+	rv = fp->C_Initialize(NULL_PTR);
+	if (rv == CKR_CRYPTOKI_ALREADY_INITIALIZED) {
+		fprintf(stderr, "  The module is not initialized again after fork()\n");
+		return FORK_SKIP;
+	} else if (rv != CKR_OK) {
+		fprintf(stderr, "  C_Initialize: rv = 0x%.8lX\n", rv);
+		return FORK_FAIL;
+	}
+
+	rv = fp->C_OpenSession(info->slot_id, CKF_SERIAL_SESSION,
+		NULL_PTR, NULL_PTR, &info->session_handle);
+	if (rv != CKR_OK) {
+		fprintf(stderr, "  C_OpenSession: rv = 0x%.8lX\n", rv);
+		return FORK_FAIL;
+	}
+
+	/* the login of the parent is not inherited */
+	rv = fp->C_GetSessionInfo(info->session_handle, &session_info);
+	if (rv != CKR_OK || session_info.state != CKS_RO_PUBLIC_SESSION) {
+		fprintf(stderr, "  Session of the child is logged in: rv = 0x%.8lX,"
+			" state %lu\n", rv, session_info.state);
+		return FORK_FAIL;
+	}
+
+	/* nor is the PIN cached for the key */
+	if (is_private && !o->always_auth
+			&& sign_verify_test(o, info, mech, 32, 0) > 0) {
+		fprintf(stderr, "  Signed with the key %s without login\n", o->id_str);
+		return FORK_FAIL;
+	}
+
+	rv = fp->C_Login(info->session_handle, CKU_USER, info->pin, info->pin_length);
+	if (rv != CKR_OK) {
+		fprintf(stderr, "  C_Login: rv = 0x%.8lX\n", rv);
+		return FORK_FAIL;
+	}
+	o->private_handle = find_private_key(o, info);
+	if (sign_verify_test(o, info, mech, 32, 0) <= 0) {
+		fprintf(stderr, "  Failed to sign with the key %s in the child\n", o->id_str);
+		return FORK_FAIL;
+	}
+
+	fp->C_Logout(info->session_handle);
+	fp->C_CloseSession(info->session_handle);
+	fp->C_Finalize(NULL_PTR);
+	return FORK_PASS;
+}
+#endif
+
+void fork_test(void **state)
+{
+	token_info_t *info = (token_info_t *) *state;
+#ifndef _WIN32
+	CK_FUNCTION_LIST_PTR fp = info->function_pointer;
+	CK_BBOOL is_private = CK_FALSE;
+	CK_ATTRIBUTE private_attr = {CKA_PRIVATE, &is_private, sizeof(is_private)};
+	test_cert_t *o = NULL;
+	test_mech_t *mech = NULL;
+	test_certs_t objects;
+	unsigned int i;
+	int j, status;
+	pid_t pid;
+
+	objects.count = 0;
+	objects.data = NULL;
+	search_for_all_objects(&objects, info);
+
+	P11TEST_START(info);
+	/* a key that signs in the parent, which also caches its PIN */
+	for (i = 0; i < objects.count && mech == NULL; i++) {
+		if (objects.data[i].private_handle == CK_INVALID_HANDLE)
+			continue;
+		for (j = 0; j < objects.data[i].num_mechs; j++) {
+			if ((objects.data[i].mechs[j].usage_flags & CKF_SIGN) == 0)
+				continue;
+			if (sign_verify_test(&objects.data[i], info,
+					&objects.data[i].mechs[j], 32, 0) > 0) {
+				o = &objects.data[i];
+				mech = &o->mechs[j];
+				break;
+			}
+		}
+	}
+	if (mech == NULL) {
+		fprintf(stderr, "No key to sign with. Skipping.\n");
+		clean_all_objects(&objects);
+		P11TEST_SKIP(info);
+	}
+	if (fp->C_GetAttributeValue(info->session_handle, o->private_handle,
+			&private_attr, 1) != CKR_OK)
+		is_private = CK_FALSE;
+
+	/* nothing buffered is written twice */
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid == 0) {
+		test_cert_t child_o = *o;
+		test_mech_t child_mech = *mech;
+
+		_exit(fork_child(&child_o, &child_mech, is_private, info));
+	} else if (pid < 0) {
+		clean_all_objects(&objects);
+		P11TEST_FAIL(info, "fork() failed");
+	}
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+		clean_all_objects(&objects);
+		P11TEST_FAIL(info, "The child did not exit");
+	}
+	if (WEXITSTATUS(status) == FORK_SKIP) {
+		clean_all_objects(&objects);
+		P11TEST_SKIP(info);
+	} else if (WEXITSTATUS(status) != FORK_PASS) {
+		clean_all_objects(&objects);
+		P11TEST_FAIL(info, "The token did not work in the child");
+	}
+
+	/* the child left the session and the card of the parent alone */
+	if (sign_verify_test(o, info, mech, 32, 0) <= 0) {
+		clean_all_objects(&objects);
+		P11TEST_FAIL(info, "Failed to sign in the parent after fork()");
+	}
+
+	clean_all_objects(&objects);
+	P11TEST_PASS(info);
+#else
+	P11TEST_START(info);
+	fprintf(stderr, "fork() is not available. Skipping.\n");
+	P11TEST_SKIP(info);
+#endif
+}
@@ -0,0 +1,568 @@
+/*
+ * p11test_case_perf.c: Performance measurements of common operations
+ *
+ * Copyright (C) 2026 OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Every measurement is reported with its median and 95th percentile
+ * latency and its throughput. The median can be limited with -t on the
+ * command line, which makes the test fail if the limit is exceeded.
+ */
+
+#include "p11test_case_perf.h"
+#include "p11test_loader.h"
+
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/* Session objects created to search through */
+#define PERF_OBJECTS		1000
+/* Maximum number of threads with a session each */
+#define PERF_MAX_THREADS	4
+/* Size of the data signed with hashing mechanisms and of its parts */
+#define PERF_DATA_LENGTH	1024
+#define PERF_PART_LENGTH	256
+
+static unsigned long long perf_now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (unsigned long long) (now.QuadPart / (double) freq.QuadPart * 1000000000);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static int perf_compare(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *) a;
+	unsigned long long y = *(const unsigned long long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Limit of the median latency in microseconds from "-t name=limit" */
+static unsigned long perf_limit(const char *name)
+{
+	size_t i, len = strlen(name);
+
+	for (i = 0; i < token.num_perf_limits; i++) {
+		if (strncmp(token.perf_limits[i], name, len) == 0
+				&& token.perf_limits[i][len] == '=')
+			return strtoul(token.perf_limits[i] + len + 1, NULL, 10);
+	}
+	return 0;
+}
+
+static void perf_header(token_info_t *info)
+{
+	printf("[ %-20s ] [ COUNT ] [ MEDIAN US ] [ P95 US ] [   OPS/S  ] [ LIMIT US ]\n",
+		"OPERATION");
+	P11TEST_DATA_ROW(info, 6,
+		's', "OPERATION",
+		's', "COUNT",
+		's', "MEDIAN US",
+		's', "P95 US",
+		's', "OPS/S",
+		's', "LIMIT US");
+}
+
+/**
+ * Prints the latencies of count operations that took elapsed nanoseconds
+ * together and returns 1 if the median is above its limit
+ */
+static int perf_report(token_info_t *info, const char *name,
+	unsigned long long *samples, unsigned int count, unsigned long long elapsed)
+{
+	unsigned long median, p95, limit = perf_limit(name);
+	double ops;
+
+	if (count == 0)
+		return 0;
+	qsort(samples, count, sizeof *samples, perf_compare);
+	median = samples[(count - 1) / 2] / 1000;
+	p95 = samples[(count * 95 + 99) / 100 - 1] / 1000;
+	ops = elapsed ? count * 1e9 / elapsed : 0;
+
+	printf("[ %-20s ] [ %5u ] [ %9lu ] [ %6lu ] [ %8.1f ] [ %8lu ]%s\n",
+		name, count, median, p95, ops, limit,
+		limit && median > limit ? " SLOW" : "");
+	P11TEST_DATA_ROW(info, 6,
+		's', name,
+		'd', (int) count,
+		'd', (int) median,
+		'd', (int) p95,
+		'd', (int) ops,
+		'd', (int) limit);
+
+	return limit && median > limit;
+}
+
+static unsigned long long *perf_samples(unsigned int count)
+{
+	unsigned long long *samples = calloc(count ? count : 1, sizeof *samples);
+
+	if (samples == NULL) {
+		fail_msg("Out of memory");
+		exit(1);
+	}
+	return samples;
+}
+
+void perf_session_test(void **state)
+{
+	token_info_t *info = (token_info_t *) *state;
+	CK_FUNCTION_LIST_PTR fp = info->function_pointer;
+	unsigned int i, n = token.perf_iterations;
+	unsigned long long *init, *slots, *open, *login;
+	unsigned long long t, init_time = 0, slots_time = 0, open_time = 0, login_time = 0;
+	CK_SESSION_HANDLE session;
+	CK_ULONG count;
+	CK_RV rv;
+	int fails = 0;
+
+	P11TEST_START(info);
+	init = perf_samples(n);
+	slots = perf_samples(n);
+	open = perf_samples(n);
+	login = perf_samples(n);
+
+	for (i = 0; i < n; i++) {
+		t = perf_now();
+		rv = fp->C_Initialize(NULL_PTR);
+		init[i] = perf_now() - t;
+		init_time += init[i];
+		if (rv != CKR_OK)
+			P11TEST_FAIL(info, "C_Initialize: rv = 0x%.8lX", rv);
+
+		t = perf_now();
+		rv = fp->C_GetSlotList(CK_TRUE, NULL_PTR, &count);
+		slots[i] = perf_now() - t;
+		slots_time += slots[i];
+		if (rv != CKR_OK)
+			P11TEST_FAIL(info, "C_GetSlotList: rv = 0x%.8lX", rv);
+		if (i == 0 && get_slot_with_card(info))
+			P11TEST_FAIL(info, "There is no card present in reader");
+
+		t = perf_now();
+		rv = fp->C_OpenSession(info->slot_id, CKF_SERIAL_SESSION,
+			NULL_PTR, NULL_PTR, &session);
+		open[i] = perf_now() - t;
+		open_time += open[i];
+		if (rv != CKR_OK)
+			P11TEST_FAIL(info, "C_OpenSession: rv = 0x%.8lX", rv);
+
+		t = perf_now();
+		rv = fp->C_Login(session, CKU_USER, token.pin, token.pin_length);
+		login[i] = perf_now() - t;
+		login_time += login[i];
+		if (rv != CKR_OK)
+			P11TEST_FAIL(info, "C_Login: rv = 0x%.8lX", rv);
+
+		fp->C_Logout(session);
+		fp->C_CloseSession(session);
+		fp->C_Finalize(NULL_PTR);
+	}
+
+	perf_header(info);
+	fails += perf_report(info, "initialize", init, n, init_time);
+	fails += perf_report(info, "get_slot_list", slots, n, slots_time);
+	fails += perf_report(info, "open_session", open, n, open_time);
+	fails += perf_report(info, "login", login, n, login_time);
+
+	free(init);
+	free(slots);
+	free(open);
+	free(login);
+	if (fails)
+		P11TEST_FAIL(info, "%d operations are slower than their limit", fails);
+	P11TEST_PASS(info);
+}
+
+/* Searches the objects matching the template and returns their number */
+static CK_ULONG perf_find(token_info_t *info, CK_ATTRIBUTE *template, CK_ULONG template_len)
+{
+	CK_FUNCTION_LIST_PTR fp = info->function_pointer;
+	CK_OBJECT_HANDLE handles[64];
+	CK_ULONG count, found = 0;
+	CK_RV rv;
+
+	rv = fp->C_FindObjectsInit(info->session_handle, template, template_len);
+	if (rv != CKR_OK)
+		P11TEST_FAIL(info, "C_FindObjectsInit: rv = 0x%.8lX", rv);
+	do {
+		rv = fp->C_FindObjects(info->session_handle, handles, 64, &count);
+		if (rv != CKR_OK)
+			P11TEST_FAIL(info, "C_FindObjects: rv = 0x%.8lX", rv);
+		found += count;
+	} while (count > 0);
+	fp->C_FindObjectsFinal(info->session_handle);
+
+	return found;
+}
+
+void perf_find_objects_test(void **state)
+{
+	token_info_t *info = (token_info_t *) *state;
+	CK_FUNCTION_LIST_PTR fp = info->function_pointer;
+	CK_OBJECT_CLASS data_class = CKO_DATA;
+	CK_BBOOL false_value = CK_FALSE;
+	char label[32];
+	CK_ATTRIBUTE object_template[] = {
+		{ CKA_CLASS, &data_class, sizeof(data_class) },
+		{ CKA_TOKEN, &false_value, sizeof(false_value) },
+		{ CKA_LABEL, label, 0 },
+	};
+	CK_OBJECT_HANDLE *handles;
+	unsigned int i, created, n = token.perf_iterations;
+	unsigned long long *all, *one, t, all_time = 0, one_time = 0;
+	CK_ULONG found = 0;
+	int fails = 0;
+
+	P11TEST_START(info);
+	handles = calloc(PERF_OBJECTS, sizeof *handles);
+	if (handles == NULL)
+		P11TEST_FAIL(info, "Out of memory");
+	for (created = 0; created < PERF_OBJECTS; created++) {
+		snprintf(label, sizeof label, "p11test perf %u", created);
+		object_template[2].ulValueLen = strlen(label);
+		if (fp->C_CreateObject(info->session_handle, object_template, 3,
+				&handles[created]) != CKR_OK)
+			break;
+	}
+	if (created == 0)
+		printf(" [WARN] Session objects are not supported, searching the token objects only\n");
+
+	all = perf_samples(n);
+	one = perf_samples(n);
+	for (i = 0; i < n; i++) {
+		t = perf_now();
+		found = perf_find(info, NULL_PTR, 0);
+		all[i] = perf_now() - t;
+		all_time += all[i];
+	}
+	if (created > 0) {
+		snprintf(label, sizeof label, "p11test perf %u", created / 2);
+		object_template[2].ulValueLen = strlen(label);
+		for (i = 0; i < n; i++) {
+			t = perf_now();
+			if (perf_find(info, &object_template[2], 1) != 1)
+				P11TEST_FAIL(info, "Object \"%s\" not found", label);
+			one[i] = perf_now() - t;
+			one_time += one[i];
+		}
+	}
+
+	for (i = 0; i < created; i++)
+		fp->C_DestroyObject(info->session_handle, handles[i]);
+
+	printf(" Searched %lu objects, %u of them created for the test\n", found, created);
+	perf_header(info);
+	fails += perf_report(info, "find_all", all, n, all_time);
+	if (created > 0)
+		fails += perf_report(info, "find_label", one, n, one_time);
+
+	free(all);
+	free(one);
+	free(handles);
+	if (fails)
+		P11TEST_FAIL(info, "%d operations are slower than their limit", fails);
+	P11TEST_PASS(info);
+}
+
+static int perf_hash_mechanism(CK_MECHANISM_TYPE mech)
+{
+	return mech == CKM_SHA1_RSA_PKCS || mech == CKM_SHA256_RSA_PKCS
+		|| mech == CKM_SHA384_RSA_PKCS || mech == CKM_SHA512_RSA_PKCS
+		|| mech == CKM_ECDSA_SHA1 || mech == CKM_ECDSA_SHA256
+		|| mech == CKM_ECDSA_SHA384 || mech == CKM_ECDSA_SHA512;
+}
+
+/**
+ * Finds a signature key, that does not need authentication for every use,
+ * with a mechanism that hashes the data or one that does not
+ */
+static test_cert_t *perf_sign_key(test_certs_t *objects, int hashing, CK_MECHANISM_TYPE *mech)
+{
+	unsigned int i;
+	int j;
+
+	for (i = 0; i < objects->count; i++) {
+		test_cert_t *o = &objects->data[i];
+
+		if (o->private_handle == CK_INVALID_HANDLE || !o->sign || o->always_auth)
+			continue;
+		for (j = 0; j < o->num_mechs; j++) {
+			if ((o->mechs[j].usage_flags & CKF_SIGN) == 0)
+				continue;
+			if (hashing ? perf_hash_mechanism(o->mechs[j].mech)
+					: o->mechs[j].mech == CKM_RSA_PKCS || o->mechs[j].mech == CKM_ECDSA) {
+				*mech = o->mechs[j].mech;
+				return o;
+			}
+		}
+	}
+	return NULL;
+}
+
+/* Signs the data at once or in parts of PERF_PART_LENGTH */
+static CK_RV perf_sign(token_info_t *info, CK_SESSION_HANDLE session, test_cert_t *o,
+	CK_MECHANISM_TYPE mech_type, CK_BYTE *data, CK_ULONG data_len, int multipart)
+{
+	CK_FUNCTION_LIST_PTR fp = info->function_pointer;
+	CK_MECHANISM mech = { mech_type, NULL_PTR, 0 };
+	CK_BYTE sign[1024];
+	CK_ULONG sign_len = sizeof sign, offset;
+	CK_RV rv;
+
+	rv = fp->C_SignInit(session, &mech, o->private_handle);
+	if (rv != CKR_OK)
+		return rv;
+	if (!multipart)
+		return fp->C_Sign(session, data, data_len, sign, &sign_len);
+	for (offset = 0; offset < data_len && rv == CKR_OK; offset += PERF_PART_LENGTH)
+		rv = fp->C_SignUpdate(session, data + offset,
+			data_len - offset < PERF_PART_LENGTH ? data_len - offset : PERF_PART_LENGTH);
+	if (rv != CKR_OK)
+		return rv;
+	return fp->C_SignFinal(session, sign, &sign_len);
+}
+
+/* Measures n signatures of a kind and reports them under name */
+static int perf_sign_report(token_info_t *info, const char *name, test_cert_t *o,
+	CK_MECHANISM_TYPE mech, CK_ULONG data_len, int multipart)
+{
+	CK_BYTE data[PERF_DATA_LENGTH];
+	unsigned int i, n = token.perf_iterations;
+	unsigned long long *samples, t, elapsed = 0;
+	CK_RV rv;
+	int fails;
+
+	memset(data, 0xA5, sizeof data);
+	samples = perf_samples(n);
+	for (i = 0; i < n; i++) {
+		t = perf_now();
+		rv = perf_sign(info, info->session_handle, o, mech, data, data_len, multipart);
+		samples[i] = perf_now() - t;
+		elapsed += samples[i];
+		if (rv != CKR_OK)
+			P11TEST_FAIL(info, "%s with key %s: rv = 0x%.8lX", name, o->id_str, rv);
+	}
+	fails = perf_report(info, name, samples, n, elapsed);
+	free(samples);
+	return fails;
+}
+
+void perf_sign_test(void **state)
+{
+	token_info_t *info = (token_info_t *) *state;
+	test_certs_t objects;
+	test_cert_t *o, *hashing;
+	CK_MECHANISM_TYPE mech, hash_mech;
+	int fails = 0;
+
+	objects.count = 0;
+	objects.data = NULL;
+
+	P11TEST_START(info);
+	search_for_all_objects(&objects, info);
+	o = perf_sign_key(&objects, 0, &mech);
+	hashing = perf_sign_key(&objects, 1, &hash_mech);
+	if (o == NULL && hashing == NULL) {
+		clean_all_objects(&objects);
+		printf(" [WARN] No key to sign with\n");
+		P11TEST_SKIP(info);
+	}
+	perf_header(info);
+
+	if (o != NULL) {
+		debug_print("Signing with key %s and %s", o->id_str, get_mechanism_name(mech));
+		fails += perf_sign_report(info, "sign", o, mech, 32, 0);
+	}
+	/* the same data at once and in parts */
+	if (hashing != NULL) {
+		debug_print("Signing with key %s and %s", hashing->id_str,
+			get_mechanism_name(hash_mech));
+		fails += perf_sign_report(info, "sign_hash", hashing, hash_mech,
+			PERF_DATA_LENGTH, 0);
+		fails += perf_sign_report(info, "sign_multipart", hashing, hash_mech,
+			PERF_DATA_LENGTH, 1);
+	}
+
+	clean_all_objects(&objects);
+	if (fails)
+		P11TEST_FAIL(info, "%d operations are slower than their limit", fails);
+	P11TEST_PASS(info);
+}
+
+/* Initializes the module for the use from several threads and logs in */
+int perf_threads_setup(void **state)
+{
+	token_info_t *info = (token_info_t *) *state;
+	CK_FUNCTION_LIST_PTR fp = info->function_pointer;
+	CK_C_INITIALIZE_ARGS args = { NULL_PTR, NULL_PTR, NULL_PTR, NULL_PTR,
+		CKF_OS_LOCKING_OK, NULL_PTR };
+	CK_RV rv;
+
+	rv = fp->C_Initialize(&args);
+	if (rv != CKR_OK) {
+		fail_msg("Could not initialize CRYPTOKI for threads: rv = 0x%.8lX\n", rv);
+		exit(1);
+	}
+	if (get_slot_with_card(info)) {
+		fail_msg("There is no card present in reader.\n");
+		exit(1);
+	}
+	rv = fp->C_OpenSession(info->slot_id, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+		NULL_PTR, NULL_PTR, &info->session_handle);
+	if (rv != CKR_OK) {
+		fail_msg("Could not open session to token.\n");
+		exit(1);
+	}
+	rv = fp->C_Login(info->session_handle, CKU_USER, token.pin, token.pin_length);
+	if (rv != CKR_OK) {
+		fail_msg("Could not login to token with user PIN '%s'\n", token.pin);
+		exit(1);
+	}
+
+	return 0;
+}
+
+/* Signatures of one thread in a session of its own */
+typedef struct {
+	token_info_t *info;
+	test_cert_t *key;
+	CK_MECHANISM_TYPE mech;
+	CK_SESSION_HANDLE session;
+	unsigned long long *samples;
+	CK_RV rv;
+} perf_thread_t;
+
+#ifdef _WIN32
+static DWORD WINAPI perf_thread(LPVOID arg)
+#else
+static void *perf_thread(void *arg)
+#endif
+{
+	perf_thread_t *thread = arg;
+	CK_BYTE data[32];
+	unsigned int i;
+	unsigned long long t;
+
+	memset(data, 0xA5, sizeof data);
+	for (i = 0; i < token.perf_iterations; i++) {
+		t = perf_now();
+		thread->rv = perf_sign(thread->info, thread->session, thread->key,
+			thread->mech, data, sizeof data, 0);
+		thread->samples[i] = perf_now() - t;
+		if (thread->rv != CKR_OK)
+			break;
+	}
+	return 0;
+}
+
+void perf_sessions_test(void **state)
+{
+	token_info_t *info = (token_info_t *) *state;
+	CK_FUNCTION_LIST_PTR fp = info->function_pointer;
+	test_certs_t objects;
+	test_cert_t *o;
+	CK_MECHANISM_TYPE mech;
+	perf_thread_t threads[PERF_MAX_THREADS];
+#ifdef _WIN32
+	HANDLE handles[PERF_MAX_THREADS];
+#else
+	pthread_t handles[PERF_MAX_THREADS];
+#endif
+	unsigned int n = token.perf_iterations;
+	unsigned long long *samples, t;
+	char name[32];
+	int count, i, started, fails = 0;
+	CK_RV rv;
+
+	objects.count = 0;
+	objects.data = NULL;
+
+	P11TEST_START(info);
+	search_for_all_objects(&objects, info);
+	o = perf_sign_key(&objects, 0, &mech);
+	if (o == NULL) {
+		clean_all_objects(&objects);
+		printf(" [WARN] No key to sign with\n");
+		P11TEST_SKIP(info);
+	}
+	debug_print("Signing with key %s and %s", o->id_str, get_mechanism_name(mech));
+	perf_header(info);
+
+	samples = perf_samples(n * PERF_MAX_THREADS);
+	for (count = 1; count <= PERF_MAX_THREADS; count *= 2) {
+		for (i = 0; i < count; i++) {
+			threads[i].info = info;
+			threads[i].key = o;
+			threads[i].mech = mech;
+			threads[i].samples = samples + i * n;
+			threads[i].rv = CKR_OK;
+			rv = fp->C_OpenSession(info->slot_id, CKF_SERIAL_SESSION,
+				NULL_PTR, NULL_PTR, &threads[i].session);
+			if (rv != CKR_OK)
+				P11TEST_FAIL(info, "C_OpenSession: rv = 0x%.8lX", rv);
+		}
+
+		t = perf_now();
+		for (i = 0; i < count; i++) {
+#ifdef _WIN32
+			handles[i] = CreateThread(NULL, 0, perf_thread, &threads[i], 0, NULL);
+			started = handles[i] != NULL;
+#else
+			started = pthread_create(&handles[i], NULL, perf_thread, &threads[i]) == 0;
+#endif
+			if (!started)
+				P11TEST_FAIL(info, "Could not start thread %d", i);
+		}
+		for (i = 0; i < count; i++) {
+#ifdef _WIN32
+			WaitForSingleObject(handles[i], INFINITE);
+			CloseHandle(handles[i]);
+#else
+			pthread_join(handles[i], NULL);
+#endif
+		}
+		t = perf_now() - t;
+
+		for (i = 0; i < count; i++) {
+			fp->C_CloseSession(threads[i].session);
+			if (threads[i].rv != CKR_OK)
+				P11TEST_FAIL(info, "Signature in thread %d: rv = 0x%.8lX", i, threads[i].rv);
+		}
+		snprintf(name, sizeof name, "sign_sessions_%d", count);
+		fails += perf_report(info, name, samples, n * count, t);
+	}
+
+	free(samples);
+	clean_all_objects(&objects);
+	if (fails)
+		P11TEST_FAIL(info, "%d operations are slower than their limit", fails);
+	P11TEST_PASS(info);
+}
@@ -32,6 +32,7 @@
 #include "libopensc/sc-ossl-compat.h"
 
 #define MAX_MECHS 200
+#define MAX_PERF_LIMITS 32
 
 #ifndef NDEBUG
 	#define debug_print(fmt, ...) \
@@ -76,6 +77,11 @@ typedef struct {
 	unsigned int interactive;
 	log_context_t log;
 
+	unsigned int perf;
+	unsigned int perf_iterations;
+	char *perf_limits[MAX_PERF_LIMITS];
+	size_t num_perf_limits;
+
 	test_mech_t rsa_mechs[MAX_MECHS];
 	size_t  num_rsa_mechs;
 	test_mech_t	ec_mechs[MAX_MECHS];
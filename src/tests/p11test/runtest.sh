@@ -140,6 +140,9 @@ if [[ "$PKCS11SPY" -ne "" ]]; then
 else
 	#bash
 	$VALGRIND ./p11test -m "$P11LIB" -o test.json -p $PIN
+	if [[ -n "$PERF" ]]; then
+		./p11test -m "$P11LIB" -P -o perf.json -p $PIN $PERF_LIMITS
+	fi
 fi
 
 card_cleanup "$@"
@@ -1,9 +1,16 @@
 TOPDIR = ..\..\..
 
-TARGETS = asn1 compression
+TARGETS = apdu asn1 asn1_compiled cert_cache compression crc32 hist_bytes pincache sm_resume
 
-OBJECTS = asn1.obj \
-	compression.obj
+OBJECTS = apdu.obj \
+	asn1.obj \
+	asn1_compiled.obj \
+	cert_cache.obj \
+	compression.obj \
+	crc32.obj \
+	hist_bytes.obj \
+	pincache.obj \
+	sm_resume.obj
 	$(TOPDIR)\win32\versioninfo.res
 
 all: $(TARGETS)
@@ -0,0 +1,345 @@
+/*
+ * apdu.c: Unit tests for GET RESPONSE and command chaining
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "torture.h"
+#include "libopensc/opensc.h"
+#include "libopensc/cards.h"
+
+#define MAX_APDUS	8
+
+/*
+ * The reader answers for a card that returns the data of GET DATA only with
+ * GET RESPONSE, and collects the data of PUT DATA across chained APDUs.
+ */
+struct stub_apdu {
+	u8 cla;
+	u8 ins;
+	size_t lc;
+	size_t le;
+	const u8 *resp;
+};
+
+static struct {
+	/* response to GET DATA */
+	u8 data[600];
+	size_t data_len;
+	size_t data_pos;
+	/* data collected from PUT DATA */
+	u8 received[600];
+	size_t received_len;
+	/* status word of the n-th PUT DATA, 0x9000 if not set */
+	unsigned int put_sw[MAX_APDUS];
+	size_t put_count;
+	/* what the reader was asked */
+	struct stub_apdu apdus[MAX_APDUS];
+	size_t apdu_count;
+	size_t chain_calls;
+} stub;
+
+static void stub_set_sw(sc_apdu_t *apdu, unsigned int sw)
+{
+	apdu->sw1 = sw >> 8;
+	apdu->sw2 = sw & 0xFF;
+}
+
+static void stub_card(sc_apdu_t *apdu)
+{
+	size_t left;
+
+	assert_true(stub.apdu_count < MAX_APDUS);
+	stub.apdus[stub.apdu_count].cla = apdu->cla;
+	stub.apdus[stub.apdu_count].ins = apdu->ins;
+	stub.apdus[stub.apdu_count].lc = apdu->lc;
+	stub.apdus[stub.apdu_count].le = apdu->le;
+	stub.apdus[stub.apdu_count].resp = apdu->resp;
+	stub.apdu_count++;
+
+	apdu->resplen = 0;
+	switch (apdu->ins) {
+	case 0xCA:
+		/* GET DATA: the data is only available with GET RESPONSE */
+		stub.data_pos = 0;
+		stub_set_sw(apdu, 0x6100 | (stub.data_len >= 256 ? 0 : stub.data_len));
+		break;
+	case 0xC0:
+		left = stub.data_len - stub.data_pos;
+		if (left > (apdu->le ? apdu->le : 256))
+			left = apdu->le ? apdu->le : 256;
+		memcpy(apdu->resp, stub.data + stub.data_pos, left);
+		apdu->resplen = left;
+		stub.data_pos += left;
+		left = stub.data_len - stub.data_pos;
+		if (left == 0)
+			stub_set_sw(apdu, 0x9000);
+		else
+			stub_set_sw(apdu, 0x6100 | (left >= 256 ? 0 : left));
+		break;
+	case 0xDA:
+		/* PUT DATA */
+		assert_true(stub.received_len + apdu->datalen <= sizeof(stub.received));
+		memcpy(stub.received + stub.received_len, apdu->data, apdu->datalen);
+		stub.received_len += apdu->datalen;
+		stub_set_sw(apdu, stub.put_sw[stub.put_count] ? stub.put_sw[stub.put_count] : 0x9000);
+		stub.put_count++;
+		break;
+	default:
+		stub_set_sw(apdu, 0x6D00);
+	}
+}
+
+static int stub_transmit(sc_reader_t *reader, sc_apdu_t *apdu)
+{
+	stub_card(apdu);
+	return SC_SUCCESS;
+}
+
+static int stub_transmit_chain(sc_reader_t *reader, sc_apdu_t *apdus, size_t count)
+{
+	size_t i;
+
+	stub.chain_calls++;
+	for (i = 0; i < count; i++) {
+		stub_card(&apdus[i]);
+		if (apdus[i].sw1 != 0x90 && apdus[i].sw1 != 0x61)
+			return (int)(i + 1);
+	}
+	return (int)count;
+}
+
+static struct sc_reader_operations reader_ops = { .transmit = stub_transmit };
+static struct sc_card_operations card_ops;
+
+struct test_state {
+	sc_context_t *ctx;
+	sc_reader_t reader;
+	sc_card_t card;
+};
+
+static int setup_card(void **state)
+{
+	struct test_state *ts = calloc(1, sizeof *ts);
+	size_t i;
+	int rv;
+
+	assert_non_null(ts);
+	rv = sc_establish_context(&ts->ctx, "apdu");
+	assert_int_equal(rv, SC_SUCCESS);
+
+	card_ops = *sc_get_iso7816_driver()->ops;
+	reader_ops.transmit_chain = NULL;
+	ts->reader.ctx = ts->ctx;
+	ts->reader.ops = &reader_ops;
+	ts->reader.active_protocol = SC_PROTO_T0;
+	ts->card.ctx = ts->ctx;
+	ts->card.reader = &ts->reader;
+	ts->card.ops = &card_ops;
+	ts->card.type = SC_CARD_TYPE_UNKNOWN;
+
+	memset(&stub, 0, sizeof stub);
+	for (i = 0; i < sizeof stub.data; i++)
+		stub.data[i] = (u8)(i * 7 + 1);
+
+	*state = ts;
+	return 0;
+}
+
+static int teardown_card(void **state)
+{
+	struct test_state *ts = *state;
+	int rv;
+
+	rv = sc_release_context(ts->ctx);
+	assert_int_equal(rv, SC_SUCCESS);
+	free(ts);
+
+	return 0;
+}
+
+static int get_data(sc_card_t *card, u8 *buf, size_t buflen, size_t *resplen)
+{
+	sc_apdu_t apdu;
+	int rv;
+
+	sc_format_apdu(card, &apdu, SC_APDU_CASE_2_SHORT, 0xCA, 0x01, 0x02);
+	apdu.le = 256;
+	apdu.resp = buf;
+	apdu.resplen = buflen;
+	rv = sc_transmit_apdu(card, &apdu);
+	if (rv == SC_SUCCESS) {
+		assert_int_equal(apdu.sw1, 0x90);
+		assert_int_equal(apdu.sw2, 0x00);
+		*resplen = apdu.resplen;
+	}
+	return rv;
+}
+
+static void torture_get_response_direct(void **state)
+{
+	struct test_state *ts = *state;
+	u8 buf[600];
+	size_t resplen = 0, i;
+	int rv;
+
+	stub.data_len = 600;
+	rv = get_data(&ts->card, buf, sizeof buf, &resplen);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(resplen, 600);
+	assert_memory_equal(buf, stub.data, 600);
+
+	/* GET DATA and three GET RESPONSE of 256, 256 and 88 bytes */
+	assert_int_equal(stub.apdu_count, 4);
+	assert_int_equal(stub.apdus[1].le, 256);
+	assert_int_equal(stub.apdus[2].le, 256);
+	assert_int_equal(stub.apdus[3].le, 88);
+	/* all of them written straight to the caller's buffer */
+	for (i = 1; i < stub.apdu_count; i++) {
+		assert_int_equal(stub.apdus[i].ins, 0xC0);
+		assert_true(stub.apdus[i].resp >= buf && stub.apdus[i].resp < buf + sizeof buf);
+	}
+	assert_true(stub.apdus[1].resp == buf);
+	assert_true(stub.apdus[3].resp == buf + 512);
+}
+
+static void torture_get_response_short_buffer(void **state)
+{
+	struct test_state *ts = *state;
+	u8 buf[300 + 16];
+	size_t resplen = 0, i;
+	int rv;
+
+	memset(buf, 0xAA, sizeof buf);
+	stub.data_len = 600;
+	rv = get_data(&ts->card, buf, 300, &resplen);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(resplen, 300);
+	assert_memory_equal(buf, stub.data, 300);
+	/* nothing is written past the caller's buffer */
+	for (i = 300; i < sizeof buf; i++)
+		assert_int_equal(buf[i], 0xAA);
+
+	/* the first chunk fits, the last one goes through a bounce buffer */
+	assert_int_equal(stub.apdu_count, 3);
+	assert_true(stub.apdus[1].resp == buf);
+	assert_true(stub.apdus[2].resp < buf || stub.apdus[2].resp >= buf + sizeof buf);
+}
+
+static void torture_get_response_short_data(void **state)
+{
+	struct test_state *ts = *state;
+	u8 buf[256];
+	size_t resplen = 0;
+	int rv;
+
+	/* 61 20: fewer bytes than requested */
+	stub.data_len = 0x20;
+	rv = get_data(&ts->card, buf, sizeof buf, &resplen);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(resplen, 0x20);
+	assert_memory_equal(buf, stub.data, 0x20);
+	assert_int_equal(stub.apdu_count, 2);
+	assert_int_equal(stub.apdus[1].le, 0x20);
+	assert_true(stub.apdus[1].resp == buf);
+}
+
+static int put_data(sc_card_t *card, const u8 *data, size_t len)
+{
+	sc_apdu_t apdu;
+
+	sc_format_apdu(card, &apdu, SC_APDU_CASE_3_SHORT, 0xDA, 0x01, 0x02);
+	apdu.flags |= SC_APDU_FLAGS_CHAINING;
+	apdu.data = data;
+	apdu.datalen = apdu.lc = len;
+	return sc_transmit_apdu(card, &apdu);
+}
+
+static void check_chain(size_t len)
+{
+	size_t i, count = (len + 254) / 255;
+
+	assert_int_equal(stub.apdu_count, count);
+	for (i = 0; i < count; i++) {
+		assert_int_equal(stub.apdus[i].ins, 0xDA);
+		assert_int_equal(stub.apdus[i].cla, i + 1 < count ? 0x10 : 0x00);
+		assert_int_equal(stub.apdus[i].lc, i + 1 < count ? 255 : len - 255 * i);
+	}
+	assert_int_equal(stub.received_len, len);
+	assert_memory_equal(stub.received, stub.data, len);
+}
+
+static void torture_chaining(void **state)
+{
+	struct test_state *ts = *state;
+	int rv;
+
+	rv = put_data(&ts->card, stub.data, 600);
+	assert_int_equal(rv, SC_SUCCESS);
+	check_chain(600);
+	assert_int_equal(stub.chain_calls, 0);
+}
+
+static void torture_chaining_transmit_chain(void **state)
+{
+	struct test_state *ts = *state;
+	int rv;
+
+	/* the same APDUs, the intermediate ones sent in one go */
+	reader_ops.transmit_chain = stub_transmit_chain;
+	rv = put_data(&ts->card, stub.data, 600);
+	assert_int_equal(rv, SC_SUCCESS);
+	check_chain(600);
+	assert_int_equal(stub.chain_calls, 1);
+}
+
+static void torture_chaining_error(void **state)
+{
+	struct test_state *ts = *state;
+	int rv, with_chain;
+
+	for (with_chain = 0; with_chain < 2; with_chain++) {
+		memset(stub.apdus, 0, sizeof stub.apdus);
+		stub.apdu_count = stub.put_count = stub.received_len = 0;
+		reader_ops.transmit_chain = with_chain ? stub_transmit_chain : NULL;
+
+		/* the second segment is refused, the last one is not sent */
+		stub.put_sw[1] = 0x6A80;
+		rv = put_data(&ts->card, stub.data, 600);
+		assert_int_equal(rv, SC_ERROR_INCORRECT_PARAMETERS);
+		assert_int_equal(stub.apdu_count, 2);
+		assert_int_equal(stub.apdus[1].cla, 0x10);
+	}
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(torture_get_response_direct,
+				setup_card, teardown_card),
+		cmocka_unit_test_setup_teardown(torture_get_response_short_buffer,
+				setup_card, teardown_card),
+		cmocka_unit_test_setup_teardown(torture_get_response_short_data,
+				setup_card, teardown_card),
+		cmocka_unit_test_setup_teardown(torture_chaining,
+				setup_card, teardown_card),
+		cmocka_unit_test_setup_teardown(torture_chaining_transmit_chain,
+				setup_card, teardown_card),
+		cmocka_unit_test_setup_teardown(torture_chaining_error,
+				setup_card, teardown_card),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -439,6 +439,174 @@ static void torture_asn1_decode_entry_bit_string_ni(void **state)
 	assert_memory_equal(bit_string + 1, result, resultlen/8);
 }
 
+static void torture_asn1_decode_entry_octet_string_borrow(void **state)
+{
+	sc_context_t *ctx = *state;
+	/* Skipped the Tag and Length (0x04, 0x02) */
+	const u8 octet_string[] = {0x00, 0x80};
+	struct sc_asn1_entry asn1_struct[2] = {
+		{ "direct", SC_ASN1_OCTET_STRING, SC_ASN1_TAG_OCTET_STRING,
+			SC_ASN1_ALLOC | SC_ASN1_BORROW | SC_ASN1_UNSIGNED, NULL, NULL },
+		{ NULL, 0, 0, 0, NULL, NULL }
+	};
+	u8 *result = NULL;
+	size_t resultlen = 0;
+	int rv;
+
+	/* the value points into the input, after the padding zero */
+	sc_format_asn1_entry(asn1_struct, &result, &resultlen, 0);
+	rv = asn1_decode_entry(ctx, asn1_struct, octet_string, sizeof(octet_string), DEPTH);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(resultlen, 1);
+	assert_ptr_equal(result, octet_string + 1);
+}
+
+/* sc_asn1_decode_compiled() */
+static const struct sc_asn1_compiled c_asn1_test_com_obj[] = {
+	SC_ASN1_COMPILED_STRUCT("commonObjectAttributes", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0,
+		sc_asn1_compiled_com_obj_attr),
+	SC_ASN1_COMPILED_END
+};
+
+static void torture_asn1_decode_compiled_com_obj_attr(void **state)
+{
+	sc_context_t *ctx = *state;
+	/* label "Key", flags private|modifiable, authId 45 and two rules */
+	const u8 data[] = {0x30, 0x20, 0x0C, 0x03, 0x4B, 0x65, 0x79, 0x03, 0x02, 0x06, 0xC0,
+		0x04, 0x01, 0x45, 0x30, 0x12, 0x30, 0x07, 0x03, 0x02, 0x07, 0x80, 0x04, 0x01, 0x01,
+		0x30, 0x07, 0x03, 0x02, 0x06, 0x40, 0x04, 0x01, 0x02};
+	struct sc_pkcs15_object obj;
+	void *bases[] = { &obj };
+	const u8 *p = NULL;
+	size_t left = 0;
+	int rv;
+
+	memset(&obj, 0, sizeof(obj));
+	rv = sc_asn1_decode_compiled(ctx, c_asn1_test_com_obj, bases, 0, NULL,
+			data, sizeof(data), &p, &left);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_ptr_equal(p, data + sizeof(data));
+	assert_int_equal(left, 0);
+	assert_string_equal(obj.label, "Key");
+	assert_int_equal(obj.flags, 3);
+	assert_int_equal(obj.auth_id.len, 1);
+	assert_int_equal(obj.auth_id.value[0], 0x45);
+	assert_int_equal(obj.access_rules[0].access_mode, 1);
+	assert_int_equal(obj.access_rules[0].auth_id.len, 1);
+	assert_int_equal(obj.access_rules[0].auth_id.value[0], 0x01);
+	assert_int_equal(obj.access_rules[1].access_mode, 2);
+	assert_int_equal(obj.access_rules[1].auth_id.value[0], 0x02);
+	assert_int_equal(obj.access_rules[2].access_mode, 0);
+}
+
+static void torture_asn1_decode_compiled_optional(void **state)
+{
+	sc_context_t *ctx = *state;
+	/* all members of CommonObjectAttributes are optional */
+	const u8 data[] = {0x30, 0x00};
+	struct sc_pkcs15_object obj;
+	void *bases[] = { &obj };
+	int rv;
+
+	memset(&obj, 0, sizeof(obj));
+	rv = sc_asn1_decode_compiled(ctx, c_asn1_test_com_obj, bases, 0, NULL,
+			data, sizeof(data), NULL, NULL);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(obj.label[0], 0);
+	assert_int_equal(obj.auth_id.len, 0);
+}
+
+struct test_compiled {
+	int version;
+	int values[3];
+	u8 name[8];
+	size_t name_len;
+};
+
+static const struct sc_asn1_compiled c_asn1_test_values[] = {
+	{ "value", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, SC_ASN1_OPTIONAL, NULL,
+		0, offsetof(struct test_compiled, values), SC_ASN1_NO_OUTPUT, 0, 3, sizeof(int), 0x02 },
+	SC_ASN1_COMPILED_END
+};
+
+static const struct sc_asn1_compiled c_asn1_test_seq[] = {
+	{ "version", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, 0, NULL,
+		0, offsetof(struct test_compiled, version), SC_ASN1_NO_OUTPUT, 0, 0, 0, 0x01 },
+	SC_ASN1_COMPILED_STRUCT("values", SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0, c_asn1_test_values),
+	SC_ASN1_COMPILED_BUFFER("name", SC_ASN1_OCTET_STRING, SC_ASN1_CTX | 0, SC_ASN1_OPTIONAL,
+		0, offsetof(struct test_compiled, name), offsetof(struct test_compiled, name_len), 8),
+	SC_ASN1_COMPILED_END
+};
+
+static const struct sc_asn1_compiled c_asn1_test_choice[] = {
+	{ "integer", SC_ASN1_INTEGER, SC_ASN1_TAG_INTEGER, 0, NULL,
+		0, offsetof(struct test_compiled, version), SC_ASN1_NO_OUTPUT, 0, 0, 0, 0x04 },
+	{ "sequence", SC_ASN1_STRUCT, SC_ASN1_TAG_SEQUENCE | SC_ASN1_CONS, 0, c_asn1_test_seq,
+		0, SC_ASN1_NO_OUTPUT, SC_ASN1_NO_OUTPUT, 0, 0, 0, 0x08 },
+	SC_ASN1_COMPILED_END
+};
+
+static void torture_asn1_decode_compiled_repeat(void **state)
+{
+	sc_context_t *ctx = *state;
+	/* SEQUENCE { 1, SEQUENCE OF { 7, 8 }, [0] 'AB' } */
+	const u8 data[] = {0x30, 0x0F, 0x02, 0x01, 0x01, 0x30, 0x06, 0x02, 0x01, 0x07,
+		0x02, 0x01, 0x08, 0x80, 0x02, 0x41, 0x42};
+	struct test_compiled out;
+	void *bases[] = { &out };
+	unsigned int present = 0;
+	int rv;
+
+	memset(&out, 0, sizeof(out));
+	rv = sc_asn1_decode_compiled_choice(ctx, c_asn1_test_choice, bases, 0, &present,
+			data, sizeof(data), NULL, NULL);
+	assert_int_equal(rv, 1);
+	assert_int_equal(present, 0x01 | 0x02 | 0x08);
+	assert_int_equal(out.version, 1);
+	assert_int_equal(out.values[0], 7);
+	assert_int_equal(out.values[1], 8);
+	assert_int_equal(out.values[2], 0);
+	assert_int_equal(out.name_len, 2);
+	assert_memory_equal(out.name, "AB", 2);
+}
+
+static void torture_asn1_decode_compiled_choice(void **state)
+{
+	sc_context_t *ctx = *state;
+	const u8 data[] = {0x02, 0x01, 0x05};
+	const u8 no_match[] = {0x04, 0x01, 0x05};
+	struct test_compiled out;
+	void *bases[] = { &out };
+	unsigned int present = 0;
+	int rv;
+
+	memset(&out, 0, sizeof(out));
+	rv = sc_asn1_decode_compiled_choice(ctx, c_asn1_test_choice, bases, 0, &present,
+			data, sizeof(data), NULL, NULL);
+	assert_int_equal(rv, 0);
+	assert_int_equal(present, 0x04);
+	assert_int_equal(out.version, 5);
+
+	rv = sc_asn1_decode_compiled_choice(ctx, c_asn1_test_choice, bases, 0, &present,
+			no_match, sizeof(no_match), NULL, NULL);
+	assert_int_equal(rv, SC_ERROR_ASN1_OBJECT_NOT_FOUND);
+}
+
+static void torture_asn1_decode_compiled_missing(void **state)
+{
+	sc_context_t *ctx = *state;
+	/* the mandatory "values" is missing */
+	const u8 data[] = {0x30, 0x03, 0x02, 0x01, 0x01};
+	struct test_compiled out;
+	void *bases[] = { &out };
+	int rv;
+
+	memset(&out, 0, sizeof(out));
+	rv = sc_asn1_decode_compiled(ctx, c_asn1_test_choice + 1, bases, 0, NULL,
+			data, sizeof(data), NULL, NULL);
+	assert_int_equal(rv, SC_ERROR_ASN1_OBJECT_NOT_FOUND);
+}
+
 
 int main(void)
 {
@@ -495,6 +663,8 @@ int main(void)
 			setup_sc_context, teardown_sc_context),
 		cmocka_unit_test_setup_teardown(torture_asn1_decode_entry_octet_string_pre_allocated_truncate,
 			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_asn1_decode_entry_octet_string_borrow,
+			setup_sc_context, teardown_sc_context),
 		/* decode_entry(): BIT STRING */
 		cmocka_unit_test_setup_teardown(torture_asn1_decode_entry_bit_string_empty,
 			setup_sc_context, teardown_sc_context),
@@ -502,6 +672,17 @@ int main(void)
 			setup_sc_context, teardown_sc_context),
 		cmocka_unit_test_setup_teardown(torture_asn1_decode_entry_bit_string_ni,
 			setup_sc_context, teardown_sc_context),
+		/* decode_compiled() */
+		cmocka_unit_test_setup_teardown(torture_asn1_decode_compiled_com_obj_attr,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_asn1_decode_compiled_optional,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_asn1_decode_compiled_repeat,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_asn1_decode_compiled_choice,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_asn1_decode_compiled_missing,
+			setup_sc_context, teardown_sc_context),
 	};
 
 	rc = cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,571 @@
+/*
+ * asn1_compiled.c: Differential tests of the compiled PKCS#15 DF decoders
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Every entry is encoded with the PKCS#15 encoder, then decoded once with
+ * sc_asn1_decode() and the sc_asn1_entry templates, and once with
+ * sc_asn1_decode_compiled() and the tables compiled from them. Both have
+ * to produce the same structures, so the tables can not drift from the
+ * templates the encoders still use.
+ */
+
+#include "torture.h"
+#include "libopensc/log.c"
+#include "libopensc/asn1.c"
+#include "libopensc/pkcs15-cert.c"
+#include "libopensc/pkcs15-cert-cache.c"
+#include "libopensc/pkcs15-prkey.c"
+#include "common/lru.c"
+#include "common/compat_strlcpy.c"
+
+/* libopensc does not export its locking, and the test runs in one thread */
+int sc_mutex_lock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
+
+int sc_mutex_unlock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
+
+/* The entries are decoded from buffers of the test, never from a DF */
+int sc_pkcs15_can_borrow(struct sc_pkcs15_card *p15card, const u8 *in)
+{
+	return 0;
+}
+
+/* Only used for certificates, which are not parsed here */
+int sc_pkcs15_pubkey_from_spki_fields(struct sc_context *ctx, struct sc_pkcs15_pubkey **outpubkey,
+		u8 *buf, size_t buflen, int depth)
+{
+	return SC_ERROR_NOT_SUPPORTED;
+}
+
+static int setup_sc_context(void **state)
+{
+	sc_context_t *ctx = NULL;
+	int rv;
+
+	rv = sc_establish_context(&ctx, "asn1_compiled");
+	assert_non_null(ctx);
+	assert_int_equal(rv, SC_SUCCESS);
+
+	*state = ctx;
+
+	return 0;
+}
+
+static int teardown_sc_context(void **state)
+{
+	sc_context_t *ctx = *state;
+	int rv;
+
+	rv = sc_release_context(ctx);
+	assert_int_equal(rv, SC_SUCCESS);
+
+	return 0;
+}
+
+static void set_path(struct sc_path *path, const char *str)
+{
+	sc_format_path(str, path);
+}
+
+static void set_id(struct sc_pkcs15_id *id, u8 value)
+{
+	id->len = 1;
+	id->value[0] = value;
+}
+
+/* CDF */
+struct cdf_decoded {
+	int rv;
+	size_t left;
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_cert_info info;
+	struct cdf_cred_ident cred_ident;
+};
+
+static void cdf_decode_interpreted(sc_context_t *ctx, const u8 *buf, size_t buflen,
+		struct cdf_decoded *out)
+{
+	struct sc_asn1_entry	asn1_cred_ident[3], asn1_com_cert_attr[4],
+				asn1_x509_cert_attr[2], asn1_type_cert_attr[2],
+				asn1_cert[2], asn1_x509_cert_value_choice[3];
+	struct sc_asn1_pkcs15_object cert_obj = {
+		&out->obj, asn1_com_cert_attr, NULL, asn1_type_cert_attr };
+	size_t id_value_len = sizeof(out->cred_ident.id_value);
+
+	sc_copy_asn1_entry(c_asn1_cred_ident, asn1_cred_ident);
+	sc_copy_asn1_entry(c_asn1_com_cert_attr, asn1_com_cert_attr);
+	sc_copy_asn1_entry(c_asn1_x509_cert_attr, asn1_x509_cert_attr);
+	sc_copy_asn1_entry(c_asn1_x509_cert_value_choice, asn1_x509_cert_value_choice);
+	sc_copy_asn1_entry(c_asn1_type_cert_attr, asn1_type_cert_attr);
+	sc_copy_asn1_entry(c_asn1_cert, asn1_cert);
+
+	sc_format_asn1_entry(asn1_cred_ident + 0, &out->cred_ident.id_type, NULL, 0);
+	sc_format_asn1_entry(asn1_cred_ident + 1, out->cred_ident.id_value, &id_value_len, 0);
+	sc_format_asn1_entry(asn1_com_cert_attr + 0, &out->info.id, NULL, 0);
+	sc_format_asn1_entry(asn1_com_cert_attr + 1, &out->info.authority, NULL, 0);
+	sc_format_asn1_entry(asn1_com_cert_attr + 2, asn1_cred_ident, NULL, 0);
+	sc_format_asn1_entry(asn1_x509_cert_attr + 0, asn1_x509_cert_value_choice, NULL, 0);
+	sc_format_asn1_entry(asn1_x509_cert_value_choice + 0, &out->info.path, NULL, 0);
+	sc_format_asn1_entry(asn1_x509_cert_value_choice + 1,
+			&out->info.value.value, &out->info.value.len, 0);
+	sc_format_asn1_entry(asn1_type_cert_attr + 0, asn1_x509_cert_attr, NULL, 0);
+	sc_format_asn1_entry(asn1_cert + 0, &cert_obj, NULL, 0);
+
+	memset(out, 0, sizeof(*out));
+	out->left = buflen;
+	out->rv = sc_asn1_decode(ctx, asn1_cert, buf, buflen, NULL, &out->left);
+	if (asn1_com_cert_attr[2].flags & SC_ASN1_PRESENT)
+		out->cred_ident.id_value_len = id_value_len;
+}
+
+static void cdf_decode_compiled(sc_context_t *ctx, const u8 *buf, size_t buflen,
+		struct cdf_decoded *out)
+{
+	void *bases[] = { &out->obj, &out->info, &out->cred_ident };
+
+	memset(out, 0, sizeof(*out));
+	out->left = buflen;
+	out->rv = sc_asn1_decode_compiled(ctx, c_asn1_compiled_cert, bases, 0, NULL,
+			buf, buflen, NULL, &out->left);
+}
+
+static void cdf_compare(sc_context_t *ctx, const u8 *buf, size_t buflen)
+{
+	struct cdf_decoded interpreted, compiled;
+
+	cdf_decode_interpreted(ctx, buf, buflen, &interpreted);
+	cdf_decode_compiled(ctx, buf, buflen, &compiled);
+
+	assert_int_equal(interpreted.rv, SC_SUCCESS);
+	assert_int_equal(compiled.rv, interpreted.rv);
+	assert_int_equal(compiled.left, interpreted.left);
+
+	assert_int_equal(compiled.info.value.len, interpreted.info.value.len);
+	if (interpreted.info.value.len)
+		assert_memory_equal(compiled.info.value.value, interpreted.info.value.value,
+				interpreted.info.value.len);
+	free(compiled.info.value.value);
+	free(interpreted.info.value.value);
+	compiled.info.value.value = interpreted.info.value.value = NULL;
+
+	assert_memory_equal(&compiled.obj, &interpreted.obj, sizeof(compiled.obj));
+	assert_memory_equal(&compiled.info, &interpreted.info, sizeof(compiled.info));
+	assert_memory_equal(&compiled.cred_ident, &interpreted.cred_ident, sizeof(compiled.cred_ident));
+}
+
+static void cdf_encode_compare(sc_context_t *ctx, struct sc_pkcs15_object *obj)
+{
+	u8 *buf = NULL;
+	size_t buflen = 0;
+	int rv;
+
+	rv = sc_pkcs15_encode_cdf_entry(ctx, obj, &buf, &buflen);
+	assert_int_equal(rv, SC_SUCCESS);
+	cdf_compare(ctx, buf, buflen);
+	free(buf);
+}
+
+static void torture_compiled_cdf_path(void **state)
+{
+	sc_context_t *ctx = *state;
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_cert_info info;
+
+	memset(&obj, 0, sizeof(obj));
+	memset(&info, 0, sizeof(info));
+	obj.data = &info;
+	strcpy(obj.label, "Certificate");
+	obj.flags = SC_PKCS15_CO_FLAG_MODIFIABLE;
+	set_id(&obj.auth_id, 0x01);
+	set_id(&info.id, 0x45);
+	info.authority = 1;
+	set_path(&info.path, "3F0050154331");
+
+	cdf_encode_compare(ctx, &obj);
+}
+
+static void torture_compiled_cdf_direct(void **state)
+{
+	sc_context_t *ctx = *state;
+	u8 value[] = { 0x30, 0x03, 0x02, 0x01, 0x01 };
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_cert_info info;
+
+	/* no label, authority or authId */
+	memset(&obj, 0, sizeof(obj));
+	memset(&info, 0, sizeof(info));
+	obj.data = &info;
+	set_id(&info.id, 0x46);
+	info.value.value = value;
+	info.value.len = sizeof(value);
+
+	cdf_encode_compare(ctx, &obj);
+}
+
+static void torture_compiled_cdf_access_rules(void **state)
+{
+	sc_context_t *ctx = *state;
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_cert_info info;
+
+	memset(&obj, 0, sizeof(obj));
+	memset(&info, 0, sizeof(info));
+	obj.data = &info;
+	strcpy(obj.label, "CA");
+	obj.flags = SC_PKCS15_CO_FLAG_PRIVATE;
+	obj.user_consent = 1;
+	obj.access_rules[0].access_mode = SC_PKCS15_ACCESS_RULE_MODE_READ;
+	set_id(&obj.access_rules[0].auth_id, 0x02);
+	obj.access_rules[1].access_mode = SC_PKCS15_ACCESS_RULE_MODE_UPDATE;
+	set_id(&obj.access_rules[1].auth_id, 0x03);
+	set_id(&info.id, 0x47);
+	set_path(&info.path, "3F005015");
+
+	cdf_encode_compare(ctx, &obj);
+}
+
+static void torture_compiled_cdf_identifier(void **state)
+{
+	sc_context_t *ctx = *state;
+	/* the encoder does not write the identifier of commonCertificateAttributes */
+	const u8 data[] = {0x30, 0x1D, 0x30, 0x00, 0x30, 0x0F, 0x04, 0x01, 0x45, 0x30,
+		0x0A, 0x02, 0x01, 0x02, 0x04, 0x05, 0x01, 0x02, 0x03, 0x04, 0x05, 0xA1,
+		0x08, 0x30, 0x06, 0x30, 0x04, 0x04, 0x02, 0x3F, 0x00};
+
+	cdf_compare(ctx, data, sizeof(data));
+}
+
+/* PrKDF */
+struct prkdf_decoded {
+	int rv;
+	size_t left;
+	unsigned int present;
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_prkey_info info;
+	int gostr3410_params[3];
+};
+
+static void prkdf_decode_interpreted(sc_context_t *ctx, const u8 *buf, size_t buflen,
+		struct prkdf_decoded *out)
+{
+	struct sc_pkcs15_prkey_info *info = &out->info;
+	size_t usage_len = sizeof(info->usage);
+	size_t af_len = sizeof(info->access_flags);
+	struct sc_asn1_entry asn1_com_key_attr[C_ASN1_COM_KEY_ATTR_SIZE];
+	struct sc_asn1_entry asn1_com_prkey_attr[C_ASN1_COM_PRKEY_ATTR_SIZE];
+	struct sc_asn1_entry asn1_rsakey_attr[C_ASN1_RSAKEY_ATTR_SIZE];
+	struct sc_asn1_entry asn1_prk_rsa_attr[C_ASN1_PRK_RSA_ATTR_SIZE];
+	struct sc_asn1_entry asn1_dsakey_attr[C_ASN1_DSAKEY_ATTR_SIZE];
+	struct sc_asn1_entry asn1_prk_dsa_attr[C_ASN1_PRK_DSA_ATTR_SIZE];
+	struct sc_asn1_entry asn1_dsakey_i_p_attr[C_ASN1_DSAKEY_I_P_ATTR_SIZE];
+	struct sc_asn1_entry asn1_dsakey_value_attr[C_ASN1_DSAKEY_VALUE_ATTR_SIZE];
+	struct sc_asn1_entry asn1_gostr3410key_attr[C_ASN1_GOSTR3410KEY_ATTR_SIZE];
+	struct sc_asn1_entry asn1_prk_gostr3410_attr[C_ASN1_PRK_GOSTR3410_ATTR_SIZE];
+	struct sc_asn1_entry asn1_ecckey_attr[C_ASN1_ECCKEY_ATTR];
+	struct sc_asn1_entry asn1_prk_ecc_attr[C_ASN1_PRK_ECC_ATTR];
+	struct sc_asn1_entry asn1_prkey[C_ASN1_PRKEY_SIZE];
+	struct sc_asn1_entry asn1_supported_algorithms[C_ASN1_SUPPORTED_ALGORITHMS_SIZE];
+	struct sc_asn1_pkcs15_object rsa_prkey_obj = {&out->obj, asn1_com_key_attr, asn1_com_prkey_attr, asn1_prk_rsa_attr};
+	struct sc_asn1_pkcs15_object dsa_prkey_obj = {&out->obj, asn1_com_key_attr, asn1_com_prkey_attr, asn1_prk_dsa_attr};
+	struct sc_asn1_pkcs15_object gostr3410_prkey_obj = {&out->obj, asn1_com_key_attr, asn1_com_prkey_attr, asn1_prk_gostr3410_attr};
+	struct sc_asn1_pkcs15_object ecc_prkey_obj = {&out->obj, asn1_com_key_attr, asn1_com_prkey_attr, asn1_prk_ecc_attr};
+	int i;
+
+	sc_copy_asn1_entry(c_asn1_prkey, asn1_prkey);
+	sc_copy_asn1_entry(c_asn1_supported_algorithms, asn1_supported_algorithms);
+	sc_copy_asn1_entry(c_asn1_prk_rsa_attr, asn1_prk_rsa_attr);
+	sc_copy_asn1_entry(c_asn1_rsakey_attr, asn1_rsakey_attr);
+	sc_copy_asn1_entry(c_asn1_prk_dsa_attr, asn1_prk_dsa_attr);
+	sc_copy_asn1_entry(c_asn1_dsakey_attr, asn1_dsakey_attr);
+	sc_copy_asn1_entry(c_asn1_dsakey_value_attr, asn1_dsakey_value_attr);
+	sc_copy_asn1_entry(c_asn1_dsakey_i_p_attr, asn1_dsakey_i_p_attr);
+	sc_copy_asn1_entry(c_asn1_prk_gostr3410_attr, asn1_prk_gostr3410_attr);
+	sc_copy_asn1_entry(c_asn1_gostr3410key_attr, asn1_gostr3410key_attr);
+	sc_copy_asn1_entry(c_asn1_prk_ecc_attr, asn1_prk_ecc_attr);
+	sc_copy_asn1_entry(c_asn1_ecckey_attr, asn1_ecckey_attr);
+	sc_copy_asn1_entry(c_asn1_com_prkey_attr, asn1_com_prkey_attr);
+	sc_copy_asn1_entry(c_asn1_com_key_attr, asn1_com_key_attr);
+
+	sc_format_asn1_entry(asn1_prkey + 0, &rsa_prkey_obj, NULL, 0);
+	sc_format_asn1_entry(asn1_prkey + 1, &ecc_prkey_obj, NULL, 0);
+	sc_format_asn1_entry(asn1_prkey + 2, &dsa_prkey_obj, NULL, 0);
+	sc_format_asn1_entry(asn1_prkey + 3, &gostr3410_prkey_obj, NULL, 0);
+
+	sc_format_asn1_entry(asn1_prk_rsa_attr + 0, asn1_rsakey_attr, NULL, 0);
+	sc_format_asn1_entry(asn1_prk_dsa_attr + 0, asn1_dsakey_attr, NULL, 0);
+	sc_format_asn1_entry(asn1_prk_gostr3410_attr + 0, asn1_gostr3410key_attr, NULL, 0);
+	sc_format_asn1_entry(asn1_prk_ecc_attr + 0, asn1_ecckey_attr, NULL, 0);
+
+	sc_format_asn1_entry(asn1_rsakey_attr + 0, &info->path, NULL, 0);
+	sc_format_asn1_entry(asn1_rsakey_attr + 1, &info->modulus_length, NULL, 0);
+
+	sc_format_asn1_entry(asn1_dsakey_attr + 0, asn1_dsakey_value_attr, NULL, 0);
+	sc_format_asn1_entry(asn1_dsakey_value_attr + 0, &info->path, NULL, 0);
+	sc_format_asn1_entry(asn1_dsakey_value_attr + 1, asn1_dsakey_i_p_attr, NULL, 0);
+	sc_format_asn1_entry(asn1_dsakey_i_p_attr + 0, &info->path, NULL, 0);
+
+	sc_format_asn1_entry(asn1_gostr3410key_attr + 0, &info->path, NULL, 0);
+	sc_format_asn1_entry(asn1_gostr3410key_attr + 1, &out->gostr3410_params[0], NULL, 0);
+	sc_format_asn1_entry(asn1_gostr3410key_attr + 2, &out->gostr3410_params[1], NULL, 0);
+	sc_format_asn1_entry(asn1_gostr3410key_attr + 3, &out->gostr3410_params[2], NULL, 0);
+
+	sc_format_asn1_entry(asn1_ecckey_attr + 0, &info->path, NULL, 0);
+	sc_format_asn1_entry(asn1_ecckey_attr + 1, &info->field_length, NULL, 0);
+
+	sc_format_asn1_entry(asn1_com_key_attr + 0, &info->id, NULL, 0);
+	sc_format_asn1_entry(asn1_com_key_attr + 1, &info->usage, &usage_len, 0);
+	sc_format_asn1_entry(asn1_com_key_attr + 2, &info->native, NULL, 0);
+	sc_format_asn1_entry(asn1_com_key_attr + 3, &info->access_flags, &af_len, 0);
+	sc_format_asn1_entry(asn1_com_key_attr + 4, &info->key_reference, NULL, 0);
+	for (i = 0; i < SC_MAX_SUPPORTED_ALGORITHMS && (asn1_supported_algorithms + i)->name; i++)
+		sc_format_asn1_entry(asn1_supported_algorithms + i, &info->algo_refs[i], NULL, 0);
+	sc_format_asn1_entry(asn1_com_key_attr + 5, asn1_supported_algorithms, NULL, 0);
+
+	sc_format_asn1_entry(asn1_com_prkey_attr + 0, &info->subject.value, &info->subject.len, 0);
+
+	memset(out, 0, sizeof(*out));
+	info->key_reference = -1;
+	info->native = 1;
+	out->left = buflen;
+	out->rv = sc_asn1_decode_choice(ctx, asn1_prkey, buf, buflen, NULL, &out->left);
+
+	if (asn1_prkey[0].flags & SC_ASN1_PRESENT)
+		out->present |= PRKDF_PRESENT_RSA;
+	if (asn1_prkey[1].flags & SC_ASN1_PRESENT)
+		out->present |= PRKDF_PRESENT_ECC;
+	if (asn1_prkey[2].flags & SC_ASN1_PRESENT)
+		out->present |= PRKDF_PRESENT_DSA;
+	if (asn1_prkey[3].flags & SC_ASN1_PRESENT)
+		out->present |= PRKDF_PRESENT_GOSTR3410;
+	if (asn1_dsakey_i_p_attr[0].flags & SC_ASN1_PRESENT)
+		out->present |= PRKDF_PRESENT_DSA_PROTECTED;
+}
+
+static void prkdf_decode_compiled(sc_context_t *ctx, const u8 *buf, size_t buflen,
+		struct prkdf_decoded *out)
+{
+	void *bases[] = { &out->obj, &out->info, out->gostr3410_params };
+
+	memset(out, 0, sizeof(*out));
+	out->info.key_reference = -1;
+	out->info.native = 1;
+	out->left = buflen;
+	out->rv = sc_asn1_decode_compiled_choice(ctx, c_asn1_compiled_prkey, bases, 0, &out->present,
+			buf, buflen, NULL, &out->left);
+}
+
+static void prkdf_compare(sc_context_t *ctx, const u8 *buf, size_t buflen,
+		unsigned int expected)
+{
+	struct prkdf_decoded interpreted, compiled;
+
+	prkdf_decode_interpreted(ctx, buf, buflen, &interpreted);
+	prkdf_decode_compiled(ctx, buf, buflen, &compiled);
+
+	assert_true(interpreted.rv >= 0);
+	assert_int_equal(compiled.rv, interpreted.rv);
+	assert_int_equal(compiled.left, interpreted.left);
+	assert_int_equal(interpreted.present, expected);
+	assert_int_equal(compiled.present, interpreted.present);
+
+	assert_int_equal(compiled.info.subject.len, interpreted.info.subject.len);
+	if (interpreted.info.subject.len)
+		assert_memory_equal(compiled.info.subject.value, interpreted.info.subject.value,
+				interpreted.info.subject.len);
+	free(compiled.info.subject.value);
+	free(interpreted.info.subject.value);
+	compiled.info.subject.value = interpreted.info.subject.value = NULL;
+
+	assert_memory_equal(&compiled.obj, &interpreted.obj, sizeof(compiled.obj));
+	assert_memory_equal(&compiled.info, &interpreted.info, sizeof(compiled.info));
+	assert_memory_equal(compiled.gostr3410_params, interpreted.gostr3410_params,
+			sizeof(compiled.gostr3410_params));
+}
+
+static void prkdf_encode_compare(sc_context_t *ctx, struct sc_pkcs15_object *obj,
+		unsigned int expected)
+{
+	u8 *buf = NULL;
+	size_t buflen = 0;
+	int rv;
+
+	rv = sc_pkcs15_encode_prkdf_entry(ctx, obj, &buf, &buflen);
+	assert_int_equal(rv, SC_SUCCESS);
+	prkdf_compare(ctx, buf, buflen, expected);
+	free(buf);
+}
+
+static void torture_compiled_prkdf_rsa(void **state)
+{
+	sc_context_t *ctx = *state;
+	u8 subject[] = { 0x31, 0x0B, 0x30, 0x09, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0C, 0x02, 0x4B, 0x31 };
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_prkey_info info;
+
+	memset(&obj, 0, sizeof(obj));
+	memset(&info, 0, sizeof(info));
+	obj.type = SC_PKCS15_TYPE_PRKEY_RSA;
+	obj.data = &info;
+	strcpy(obj.label, "Signature key");
+	obj.flags = SC_PKCS15_CO_FLAG_PRIVATE;
+	set_id(&obj.auth_id, 0x01);
+	set_id(&info.id, 0x45);
+	info.usage = SC_PKCS15_PRKEY_USAGE_SIGN | SC_PKCS15_PRKEY_USAGE_NONREPUDIATION;
+	info.access_flags = SC_PKCS15_PRKEY_ACCESS_SENSITIVE | SC_PKCS15_PRKEY_ACCESS_NEVEREXTRACTABLE;
+	info.native = 0;
+	info.key_reference = 0x82;
+	info.algo_refs[0] = 0x12;
+	info.algo_refs[1] = 0x34;
+	info.subject.value = subject;
+	info.subject.len = sizeof(subject);
+	info.modulus_length = 2048;
+	set_path(&info.path, "3F0050154B01");
+
+	prkdf_encode_compare(ctx, &obj, PRKDF_PRESENT_RSA);
+}
+
+static void torture_compiled_prkdf_rsa_minimal(void **state)
+{
+	sc_context_t *ctx = *state;
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_prkey_info info;
+
+	/* no label, native, accessFlags, keyReference, algReference or subject */
+	memset(&obj, 0, sizeof(obj));
+	memset(&info, 0, sizeof(info));
+	obj.type = SC_PKCS15_TYPE_PRKEY_RSA;
+	obj.data = &info;
+	set_id(&info.id, 0x46);
+	info.usage = SC_PKCS15_PRKEY_USAGE_DECRYPT;
+	info.native = 1;
+	info.key_reference = -1;
+	info.modulus_length = 1024;
+
+	prkdf_encode_compare(ctx, &obj, PRKDF_PRESENT_RSA);
+}
+
+static void torture_compiled_prkdf_ec(void **state)
+{
+	sc_context_t *ctx = *state;
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_prkey_info info;
+
+	/* private without authId, the access rules name the PIN */
+	memset(&obj, 0, sizeof(obj));
+	memset(&info, 0, sizeof(info));
+	obj.type = SC_PKCS15_TYPE_PRKEY_EC;
+	obj.data = &info;
+	strcpy(obj.label, "EC key");
+	obj.flags = SC_PKCS15_CO_FLAG_PRIVATE | SC_PKCS15_CO_FLAG_MODIFIABLE;
+	obj.access_rules[0].access_mode = SC_PKCS15_ACCESS_RULE_MODE_PSO_CDS;
+	set_id(&obj.access_rules[0].auth_id, 0x02);
+	set_id(&info.id, 0x47);
+	info.usage = SC_PKCS15_PRKEY_USAGE_SIGN | SC_PKCS15_PRKEY_USAGE_DERIVE;
+	info.native = 1;
+	info.key_reference = 0;
+	info.field_length = 256;
+	set_path(&info.path, "3F0050154B02");
+
+	prkdf_encode_compare(ctx, &obj, PRKDF_PRESENT_ECC);
+}
+
+static void torture_compiled_prkdf_dsa(void **state)
+{
+	sc_context_t *ctx = *state;
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_prkey_info info;
+
+	memset(&obj, 0, sizeof(obj));
+	memset(&info, 0, sizeof(info));
+	obj.type = SC_PKCS15_TYPE_PRKEY_DSA;
+	obj.data = &info;
+	set_id(&info.id, 0x48);
+	info.usage = SC_PKCS15_PRKEY_USAGE_SIGN;
+	info.native = 1;
+	info.key_reference = 1;
+	set_path(&info.path, "3F0050154B03");
+
+	prkdf_encode_compare(ctx, &obj, PRKDF_PRESENT_DSA);
+}
+
+static void torture_compiled_prkdf_dsa_protected(void **state)
+{
+	sc_context_t *ctx = *state;
+	/* the encoder adds an empty path before the indirect-protected value */
+	const u8 data[] = {0xA2, 0x1E, 0x30, 0x00, 0x30, 0x0A, 0x04, 0x01, 0x48, 0x03,
+		0x02, 0x05, 0x20, 0x02, 0x01, 0x01, 0xA1, 0x0E, 0x30, 0x0C, 0xA1, 0x0A,
+		0x30, 0x08, 0x04, 0x06, 0x3F, 0x00, 0x50, 0x15, 0x4B, 0x03};
+
+	prkdf_compare(ctx, data, sizeof(data), PRKDF_PRESENT_DSA | PRKDF_PRESENT_DSA_PROTECTED);
+}
+
+static void torture_compiled_prkdf_gostr3410(void **state)
+{
+	sc_context_t *ctx = *state;
+	struct sc_pkcs15_keyinfo_gostparams params = { 1, 2, 3 };
+	struct sc_pkcs15_object obj;
+	struct sc_pkcs15_prkey_info info;
+
+	memset(&obj, 0, sizeof(obj));
+	memset(&info, 0, sizeof(info));
+	obj.type = SC_PKCS15_TYPE_PRKEY_GOSTR3410;
+	obj.data = &info;
+	set_id(&info.id, 0x49);
+	info.usage = SC_PKCS15_PRKEY_USAGE_SIGN;
+	info.native = 1;
+	info.key_reference = 2;
+	info.params.data = &params;
+	info.params.len = sizeof(params);
+	set_path(&info.path, "3F0050154B04");
+
+	prkdf_encode_compare(ctx, &obj, PRKDF_PRESENT_GOSTR3410);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(torture_compiled_cdf_path,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_compiled_cdf_direct,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_compiled_cdf_access_rules,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_compiled_cdf_identifier,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_compiled_prkdf_rsa,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_compiled_prkdf_rsa_minimal,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_compiled_prkdf_ec,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_compiled_prkdf_dsa,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_compiled_prkdf_dsa_protected,
+			setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_compiled_prkdf_gostr3410,
+			setup_sc_context, teardown_sc_context),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,262 @@
+/*
+ * cert_cache.c: Unit tests for the parsed certificate cache
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "torture.h"
+#include "libopensc/pkcs15-cert-cache.c"
+#include "common/lru.c"
+
+/* libopensc does not export its locking, and the test runs in one thread */
+int sc_mutex_lock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
+
+int sc_mutex_unlock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
+
+/* Generated using
+ * $ openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 \
+ *       -nodes -subj "/CN=cache" -outform DER -out cert.der
+ */
+static u8 cert_der[] = {
+	0x30, 0x82, 0x01, 0x75, 0x30, 0x82, 0x01, 0x1b, 0xa0, 0x03, 0x02, 0x01,
+	0x02, 0x02, 0x14, 0x25, 0x26, 0xda, 0x6e, 0x06, 0xfe, 0x6d, 0x38, 0x0a,
+	0x71, 0x6b, 0x11, 0x51, 0x70, 0x25, 0x4c, 0xbe, 0x07, 0x65, 0x70, 0x30,
+	0x0a, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02, 0x30,
+	0x10, 0x31, 0x0e, 0x30, 0x0c, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0c, 0x05,
+	0x63, 0x61, 0x63, 0x68, 0x65, 0x30, 0x1e, 0x17, 0x0d, 0x32, 0x36, 0x31,
+	0x30, 0x31, 0x38, 0x31, 0x35, 0x33, 0x37, 0x31, 0x32, 0x5a, 0x17, 0x0d,
+	0x33, 0x36, 0x31, 0x30, 0x31, 0x35, 0x31, 0x35, 0x33, 0x37, 0x31, 0x32,
+	0x5a, 0x30, 0x10, 0x31, 0x0e, 0x30, 0x0c, 0x06, 0x03, 0x55, 0x04, 0x03,
+	0x0c, 0x05, 0x63, 0x61, 0x63, 0x68, 0x65, 0x30, 0x59, 0x30, 0x13, 0x06,
+	0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01, 0x06, 0x08, 0x2a, 0x86,
+	0x48, 0xce, 0x3d, 0x03, 0x01, 0x07, 0x03, 0x42, 0x00, 0x04, 0xf6, 0xe9,
+	0x7d, 0x17, 0x39, 0x84, 0x1d, 0xc2, 0x82, 0xfe, 0xd1, 0xaf, 0x9a, 0xc8,
+	0xea, 0xcc, 0x82, 0x70, 0x00, 0xd4, 0xdc, 0xf7, 0x26, 0xea, 0x97, 0xcc,
+	0xea, 0x7c, 0x10, 0x73, 0x60, 0xbe, 0x19, 0x9a, 0x2d, 0x3e, 0xf1, 0x81,
+	0x52, 0xd2, 0xa5, 0x81, 0x93, 0x54, 0x78, 0x6f, 0xed, 0x2d, 0x1e, 0x2c,
+	0xc6, 0x21, 0x51, 0x74, 0xad, 0x45, 0x68, 0x40, 0x28, 0x46, 0x33, 0x99,
+	0x69, 0x1d, 0xa3, 0x53, 0x30, 0x51, 0x30, 0x1d, 0x06, 0x03, 0x55, 0x1d,
+	0x0e, 0x04, 0x16, 0x04, 0x14, 0xa0, 0x0a, 0x7e, 0x98, 0x1a, 0x00, 0xb0,
+	0xda, 0xf8, 0x4c, 0x00, 0x7c, 0x7e, 0x29, 0xbf, 0x71, 0x08, 0x5c, 0x17,
+	0xa5, 0x30, 0x1f, 0x06, 0x03, 0x55, 0x1d, 0x23, 0x04, 0x18, 0x30, 0x16,
+	0x80, 0x14, 0xa0, 0x0a, 0x7e, 0x98, 0x1a, 0x00, 0xb0, 0xda, 0xf8, 0x4c,
+	0x00, 0x7c, 0x7e, 0x29, 0xbf, 0x71, 0x08, 0x5c, 0x17, 0xa5, 0x30, 0x0f,
+	0x06, 0x03, 0x55, 0x1d, 0x13, 0x01, 0x01, 0xff, 0x04, 0x05, 0x30, 0x03,
+	0x01, 0x01, 0xff, 0x30, 0x0a, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d,
+	0x04, 0x03, 0x02, 0x03, 0x48, 0x00, 0x30, 0x45, 0x02, 0x20, 0x02, 0x17,
+	0xfd, 0x07, 0xa0, 0x28, 0x93, 0xd9, 0xcf, 0x61, 0x27, 0xa3, 0x9e, 0x57,
+	0xea, 0x69, 0x46, 0xc6, 0x1d, 0x94, 0xfe, 0x5e, 0xcb, 0x18, 0xa9, 0x36,
+	0x37, 0x8b, 0xfd, 0x56, 0x5e, 0xa6, 0x02, 0x21, 0x00, 0xcd, 0x2e, 0x8d,
+	0x09, 0xf2, 0x9e, 0x5c, 0x95, 0xd3, 0x9f, 0xed, 0xed, 0x01, 0xa9, 0x94,
+	0x19, 0xf5, 0x04, 0x50, 0xbe, 0x63, 0x5c, 0xfa, 0x75, 0xe8, 0x0d, 0x62,
+	0xda, 0x62, 0x56, 0x70, 0x7e
+};
+
+static int setup_sc_context(void **state)
+{
+	sc_context_t *ctx = NULL;
+	int rv;
+
+	rv = sc_establish_context(&ctx, "cert_cache");
+	assert_non_null(ctx);
+	assert_int_equal(rv, SC_SUCCESS);
+
+	*state = ctx;
+
+	return 0;
+}
+
+static int teardown_sc_context(void **state)
+{
+	sc_context_t *ctx = *state;
+	int rv;
+
+	rv = sc_release_context(ctx);
+	assert_int_equal(rv, SC_SUCCESS);
+
+	return 0;
+}
+
+/* Disable the cache the way opensc.conf would */
+static int setup_sc_context_disabled(void **state)
+{
+	const char conf[] = "app default { framework pkcs15 { use_certificate_cache = false; } }\n";
+	char path[] = "/tmp/cert_cache_XXXXXX";
+	int fd;
+
+	fd = mkstemp(path);
+	assert_int_not_equal(fd, -1);
+	assert_int_equal(write(fd, conf, sizeof conf - 1), sizeof conf - 1);
+	close(fd);
+
+	setenv("OPENSC_CONF", path, 1);
+	setup_sc_context(state);
+	unsetenv("OPENSC_CONF");
+	unlink(path);
+
+	return 0;
+}
+
+static void torture_cert_cache_hit(void **state)
+{
+	sc_context_t *ctx = *state;
+	struct sc_pkcs15_der der = { cert_der, sizeof cert_der };
+	struct sc_pkcs15_pubkey *key1 = NULL, *key2 = NULL;
+	struct sc_pkcs15_cert *cert = NULL;
+	int rv;
+
+	rv = sc_pkcs15_pubkey_from_cert(ctx, &der, &key1);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_non_null(ctx->cert_cache);
+	assert_int_equal(ctx->cert_cache->count, 1);
+
+	rv = sc_pkcs15_cert_cache_get(ctx, &der, &cert);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(cert->data.len, sizeof cert_der);
+	sc_pkcs15_free_certificate(cert);
+
+	/* the second lookup is served from the cache, without a new entry */
+	rv = sc_pkcs15_pubkey_from_cert(ctx, &der, &key2);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(ctx->cert_cache->count, 1);
+	assert_int_equal(key2->algorithm, SC_ALGORITHM_EC);
+	assert_int_equal(key2->u.ec.ecpointQ.len, key1->u.ec.ecpointQ.len);
+	assert_memory_equal(key2->u.ec.ecpointQ.value, key1->u.ec.ecpointQ.value,
+			key1->u.ec.ecpointQ.len);
+	assert_string_equal(key2->u.ec.params.named_curve, key1->u.ec.params.named_curve);
+
+	sc_pkcs15_free_pubkey(key1);
+	sc_pkcs15_free_pubkey(key2);
+}
+
+static void torture_cert_cache_full_der(void **state)
+{
+	sc_context_t *ctx = *state;
+	u8 other[sizeof cert_der];
+	struct sc_pkcs15_der der = { cert_der, sizeof cert_der };
+	struct sc_pkcs15_der der_other = { other, sizeof other };
+	struct sc_pkcs15_cert parsed = { .data = der }, *cert = NULL;
+	int rv;
+
+	sc_pkcs15_cert_cache_put(ctx, &der, &parsed);
+	rv = sc_pkcs15_cert_cache_get(ctx, &der, &cert);
+	assert_int_equal(rv, SC_SUCCESS);
+	sc_pkcs15_free_certificate(cert);
+	cert = NULL;
+
+	/* same length, differing only in the last byte (the signature) */
+	memcpy(other, cert_der, sizeof other);
+	other[sizeof other - 1] ^= 0x01;
+	rv = sc_pkcs15_cert_cache_get(ctx, &der_other, &cert);
+	assert_int_equal(rv, SC_ERROR_OBJECT_NOT_FOUND);
+	assert_null(cert);
+}
+
+static void torture_cert_cache_lru(void **state)
+{
+	sc_context_t *ctx = *state;
+	u8 blobs[SC_PKCS15_CERT_CACHE_MAX + 1][sizeof cert_der + 2];
+	struct sc_pkcs15_der der = { cert_der, sizeof cert_der };
+	struct sc_pkcs15_der blob;
+	struct sc_pkcs15_cert parsed = { .data = der }, *cert = NULL;
+	size_t i;
+	int rv;
+
+	/* distinct card files: the certificate with two bytes of trailing data */
+	for (i = 0; i < SC_PKCS15_CERT_CACHE_MAX; i++) {
+		memcpy(blobs[i], cert_der, sizeof cert_der);
+		blobs[i][sizeof cert_der] = i >> 8;
+		blobs[i][sizeof cert_der + 1] = i & 0xff;
+		blob.value = blobs[i];
+		blob.len = sizeof blobs[i];
+		sc_pkcs15_cert_cache_put(ctx, &blob, &parsed);
+	}
+	assert_int_equal(ctx->cert_cache->count, SC_PKCS15_CERT_CACHE_MAX);
+
+	/* touch the oldest entry, so the second oldest is the one evicted */
+	blob.value = blobs[0];
+	rv = sc_pkcs15_cert_cache_get(ctx, &blob, &cert);
+	assert_int_equal(rv, SC_SUCCESS);
+	sc_pkcs15_free_certificate(cert);
+	cert = NULL;
+
+	memcpy(blobs[i], cert_der, sizeof cert_der);
+	blobs[i][sizeof cert_der] = 0xff;
+	blobs[i][sizeof cert_der + 1] = 0xff;
+	blob.value = blobs[i];
+	sc_pkcs15_cert_cache_put(ctx, &blob, &parsed);
+	assert_int_equal(ctx->cert_cache->count, SC_PKCS15_CERT_CACHE_MAX);
+
+	blob.value = blobs[1];
+	rv = sc_pkcs15_cert_cache_get(ctx, &blob, &cert);
+	assert_int_equal(rv, SC_ERROR_OBJECT_NOT_FOUND);
+
+	blob.value = blobs[0];
+	rv = sc_pkcs15_cert_cache_get(ctx, &blob, &cert);
+	assert_int_equal(rv, SC_SUCCESS);
+	sc_pkcs15_free_certificate(cert);
+
+	blob.value = blobs[SC_PKCS15_CERT_CACHE_MAX];
+	rv = sc_pkcs15_cert_cache_get(ctx, &blob, &cert);
+	assert_int_equal(rv, SC_SUCCESS);
+	sc_pkcs15_free_certificate(cert);
+}
+
+static void torture_cert_cache_disabled(void **state)
+{
+	sc_context_t *ctx = *state;
+	struct sc_pkcs15_der der = { cert_der, sizeof cert_der };
+	struct sc_pkcs15_cert keyless = { .data = der };
+	struct sc_pkcs15_pubkey *key = NULL;
+	int rv;
+
+	/* an entry without a key would fail the lookup if it was used */
+	sc_pkcs15_cert_cache_put(ctx, &der, &keyless);
+	assert_int_equal(ctx->cert_cache->count, 1);
+
+	rv = sc_pkcs15_pubkey_from_cert(ctx, &der, &key);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_non_null(key);
+	assert_int_equal(ctx->cert_cache->count, 1);
+	sc_pkcs15_free_pubkey(key);
+}
+
+int main(void)
+{
+	int rc;
+	struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(torture_cert_cache_hit,
+				setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_cert_cache_full_der,
+				setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_cert_cache_lru,
+				setup_sc_context, teardown_sc_context),
+		cmocka_unit_test_setup_teardown(torture_cert_cache_disabled,
+				setup_sc_context_disabled, teardown_sc_context),
+	};
+
+	rc = cmocka_run_group_tests(tests, NULL, NULL);
+	return rc;
+}
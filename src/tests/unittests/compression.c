@@ -22,6 +22,18 @@
 #include "torture.h"
 #include "libopensc/log.c"
 #include "libopensc/compression.c"
+#include "common/lru.c"
+
+/* libopensc does not export its locking, and the test runs in one thread */
+int sc_mutex_lock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
+
+int sc_mutex_unlock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
 
 /* The data from fuzzer has valid header (0x1f, 0x8b), but anything
  * after that is just garbage. The first call to inflate()
@@ -198,6 +210,59 @@ static void torture_compression_decompress_alloc_invalid_suffix(void **state)
 
 
 
+/* Decompress with the cache of a context */
+static void torture_compression_decompress_alloc_cached(void **state)
+{
+	sc_context_t *ctx = NULL;
+	u8 *buf = NULL;
+	size_t buflen = 0;
+	sc_stats_t stats;
+	int rv;
+
+	rv = sc_establish_context(&ctx, "compression");
+	assert_int_equal(rv, SC_SUCCESS);
+
+	rv = sc_decompress_alloc_cached(ctx, &buf, &buflen, valid_data, sizeof(valid_data), COMPRESSION_AUTO, 0);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(buflen, 5);
+	assert_memory_equal(buf, "test\x0a", 5);
+	free(buf);
+	buf = NULL;
+
+	/* the second call is served from the cache */
+	rv = sc_decompress_alloc_cached(ctx, &buf, &buflen, valid_data, sizeof(valid_data), COMPRESSION_AUTO, 0);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(buflen, 5);
+	assert_memory_equal(buf, "test\x0a", 5);
+	free(buf);
+	buf = NULL;
+
+	/* a wrong size hint is not fatal, on data that is not in the cache yet */
+	rv = sc_decompress_alloc_cached(ctx, &buf, &buflen, invalid_suffix_data, sizeof(invalid_suffix_data), COMPRESSION_AUTO, 1);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(buflen, 5);
+	assert_memory_equal(buf, "test\x0a", 5);
+	free(buf);
+	buf = NULL;
+
+	rv = sc_decompress_alloc_cached(ctx, &buf, &buflen, valid_zlib_data, sizeof(valid_zlib_data), COMPRESSION_AUTO, 2);
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(buflen, 5);
+	assert_memory_equal(buf, "test\x0a", 5);
+	free(buf);
+	buf = NULL;
+
+	rv = sc_decompress_alloc_cached(ctx, &buf, &buflen, invalid_data, sizeof(invalid_data), COMPRESSION_AUTO, 0);
+	assert_int_equal(rv, SC_ERROR_UNKNOWN_DATA_RECEIVED);
+	assert_null(buf);
+
+	sc_ctx_get_stats(ctx, &stats);
+	assert_int_equal(stats.decompress_cache_hits, 1);
+	assert_int_equal(stats.decompress_cache_misses, 4);
+
+	sc_release_context(ctx);
+}
+
 /* Decompress without allocation */
 static void torture_compression_decompress_empty(void **state)
 {
@@ -336,6 +401,7 @@ int main(void)
 		cmocka_unit_test(torture_compression_decompress_alloc_invalid),
 		cmocka_unit_test(torture_compression_decompress_alloc_invalid_suffix),
 		cmocka_unit_test(torture_compression_decompress_alloc_valid),
+		cmocka_unit_test(torture_compression_decompress_alloc_cached),
 		/* Decompress */
 		cmocka_unit_test(torture_compression_decompress_empty),
 		cmocka_unit_test(torture_compression_decompress_gzip_empty),
@@ -0,0 +1,80 @@
+/*
+ * crc32.c: Unit tests for the CRC-32 checksum
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "torture.h"
+#include "libopensc/crc32.c"
+
+/* The bit by bit computation the tables and instructions have to match */
+static unsigned reference_crc32(const unsigned char *value, size_t len)
+{
+	uint32_t crc = 0xffffffff;
+	size_t i;
+	int j;
+
+	for (i = 0; i < len; i++) {
+		crc ^= value[i];
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+	}
+
+	return (crc ^ 0xffffffff) % 0xffff;
+}
+
+static void torture_crc32_empty(void **state)
+{
+	assert_int_equal(sc_crc32(NULL, 0), 0);
+	assert_int_equal(sc_crc32((const unsigned char *) "", 0), 0);
+}
+
+static void torture_crc32_check_value(void **state)
+{
+	/* CRC-32 of "123456789" is 0xCBF43926 */
+	assert_int_equal(sc_crc32((const unsigned char *) "123456789", 9),
+			0xCBF43926 % 0xffff);
+}
+
+static void torture_crc32_lengths(void **state)
+{
+	unsigned char buf[1024 + 16];
+	size_t i, offset, len;
+
+	for (i = 0; i < sizeof buf; i++)
+		buf[i] = (unsigned char) (i * 167 + (i >> 7));
+
+	/* all tails and alignments of the folded and sliced parts */
+	for (offset = 0; offset < 16; offset++) {
+		for (len = 0; len <= 1024; len++) {
+			assert_int_equal(sc_crc32(buf + offset, len),
+					reference_crc32(buf + offset, len));
+		}
+	}
+}
+
+int main(void)
+{
+	int rc;
+	struct CMUnitTest tests[] = {
+		cmocka_unit_test(torture_crc32_empty),
+		cmocka_unit_test(torture_crc32_check_value),
+		cmocka_unit_test(torture_crc32_lengths),
+	};
+
+	rc = cmocka_run_group_tests(tests, NULL, NULL);
+	return rc;
+}
@@ -0,0 +1,94 @@
+/*
+ * hist_bytes.c: Unit tests for the card capabilities in ATR historical bytes
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "torture.h"
+#include "libopensc/sc.c"
+
+/* Parse a T=1 ATR built around @hist and check it for extended Lc/Le */
+static int atr_apdu_ext(const u8 *hist, size_t hist_len)
+{
+	sc_reader_t reader;
+	u8 *p, tck = 0;
+	size_t i;
+
+	memset(&reader, 0, sizeof reader);
+
+	/* TS, T0 (TD1 present), TD1 (TD2 present, T=0), TD2 (T=1) */
+	p = reader.atr.value;
+	*p++ = 0x3B;
+	*p++ = 0x80 | hist_len;
+	*p++ = 0x80;
+	*p++ = 0x01;
+	memcpy(p, hist, hist_len);
+	p += hist_len;
+	for (i = 1; i < (size_t) (p - reader.atr.value); i++)
+		tck ^= reader.atr.value[i];
+	*p++ = tck;
+	reader.atr.len = p - reader.atr.value;
+
+	assert_int_equal(_sc_parse_atr(&reader), SC_SUCCESS);
+	assert_int_equal(reader.atr_info.hist_bytes_len, hist_len);
+
+	return _sc_hist_bytes_apdu_ext(&reader);
+}
+
+#define TORTURE_HIST_BYTES(name, hist, expected) \
+	static void torture_hist_bytes_##name(void **state) \
+	{ \
+		const u8 data[] = hist; \
+		assert_int_equal(atr_apdu_ext(data, sizeof(data) - 1), expected); \
+	}
+
+/* Compact TLV without status indicator, third software function table */
+TORTURE_HIST_BYTES(ext, "\x80\x73\x00\x00\x40", 1)
+/* The same without extended Lc/Le */
+TORTURE_HIST_BYTES(no_ext, "\x80\x73\x00\x00\x00", 0)
+/* Card capabilities after a card service data object */
+TORTURE_HIST_BYTES(ext_second, "\x80\x31\xC0\x73\x00\x00\x40", 1)
+/* Only the first two tables of the card capabilities */
+TORTURE_HIST_BYTES(short_caps, "\x80\x72\x00\x40", 0)
+/* Card capabilities cut off by the end of the historical bytes */
+TORTURE_HIST_BYTES(truncated, "\x80\x73\x00\x40", 0)
+/* Compact TLV with the status indicator in the last three bytes */
+TORTURE_HIST_BYTES(status, "\x00\x73\x00\x00\x40\x00\x90\x00", 1)
+/* The status indicator is not part of the compact TLV objects */
+TORTURE_HIST_BYTES(status_only, "\x00\x73\x00\x40", 0)
+/* Proprietary category indicator */
+TORTURE_HIST_BYTES(proprietary, "\x10\x73\x00\x00\x40", 0)
+/* Category indicator only */
+TORTURE_HIST_BYTES(empty, "\x80", 0)
+
+int main(void)
+{
+	int rc;
+	struct CMUnitTest tests[] = {
+		cmocka_unit_test(torture_hist_bytes_ext),
+		cmocka_unit_test(torture_hist_bytes_no_ext),
+		cmocka_unit_test(torture_hist_bytes_ext_second),
+		cmocka_unit_test(torture_hist_bytes_short_caps),
+		cmocka_unit_test(torture_hist_bytes_truncated),
+		cmocka_unit_test(torture_hist_bytes_status),
+		cmocka_unit_test(torture_hist_bytes_status_only),
+		cmocka_unit_test(torture_hist_bytes_proprietary),
+		cmocka_unit_test(torture_hist_bytes_empty),
+	};
+
+	rc = cmocka_run_group_tests(tests, NULL, NULL);
+	return rc;
+}
@@ -0,0 +1,311 @@
+/*
+ * pincache.c: Unit tests for the invalidation of cached PINs
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "torture.h"
+#include "libopensc/pkcs15-pin.c"
+
+#define PIN		"123456"
+#define PIN_REFERENCE	0x81
+
+/* libopensc does not export its locking, and the test runs in one thread */
+int sc_mutex_lock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
+
+int sc_mutex_unlock(const sc_context_t *ctx, void *mutex)
+{
+	return SC_SUCCESS;
+}
+
+/* Neither are the helpers keeping the cached PIN */
+void sc_pkcs15_free_object_content(struct sc_pkcs15_object *obj)
+{
+	free(obj->content.value);
+	obj->content.value = NULL;
+	obj->content.len = 0;
+}
+
+int sc_pkcs15_allocate_object_content(struct sc_context *ctx, struct sc_pkcs15_object *obj,
+		const unsigned char *value, size_t len)
+{
+	sc_pkcs15_free_object_content(obj);
+	obj->content.value = malloc(len);
+	if (obj->content.value == NULL)
+		return SC_ERROR_OUT_OF_MEMORY;
+	memcpy(obj->content.value, value, len);
+	obj->content.len = len;
+	return SC_SUCCESS;
+}
+
+/* What the card answers and what it was asked */
+static struct {
+	int get_info_rv;
+	int logged_in;
+	int verify_count;
+	int get_info_count;
+} card_state;
+
+static int pin_cmd(struct sc_card *card, struct sc_pin_cmd_data *data, int *tries_left)
+{
+	switch (data->cmd) {
+	case SC_PIN_CMD_VERIFY:
+		card_state.verify_count++;
+		if (data->pin_reference != PIN_REFERENCE || data->pin1.len != strlen(PIN)
+				|| memcmp(data->pin1.data, PIN, data->pin1.len))
+			return SC_ERROR_PIN_CODE_INCORRECT;
+		card_state.logged_in = SC_PIN_STATE_LOGGED_IN;
+		return SC_SUCCESS;
+	case SC_PIN_CMD_GET_INFO:
+		card_state.get_info_count++;
+		if (card_state.get_info_rv == SC_SUCCESS)
+			data->pin1.logged_in = card_state.logged_in;
+		return card_state.get_info_rv;
+	}
+	return SC_ERROR_NOT_SUPPORTED;
+}
+
+static struct sc_reader_operations reader_ops;
+static struct sc_card_operations card_ops = { .pin_cmd = pin_cmd };
+
+struct test_state {
+	sc_context_t *ctx;
+	struct sc_reader reader;
+	struct sc_card card;
+	struct sc_pkcs15_card *p15card;
+	struct sc_pkcs15_object *pin_obj;
+	struct sc_pkcs15_object *key_obj;
+};
+
+static int setup_pincache(void **state)
+{
+	struct test_state *ts = calloc(1, sizeof *ts);
+	struct sc_pkcs15_auth_info *auth_info;
+	struct sc_pkcs15_prkey_info *key_info;
+	int rv;
+
+	assert_non_null(ts);
+	rv = sc_establish_context(&ts->ctx, "pincache");
+	assert_int_equal(rv, SC_SUCCESS);
+
+	ts->reader.ctx = ts->ctx;
+	ts->reader.ops = &reader_ops;
+	ts->card.ctx = ts->ctx;
+	ts->card.reader = &ts->reader;
+	ts->card.ops = &card_ops;
+	/* the PIN is refreshed with the card locked */
+	ts->card.lock_count = 1;
+
+	ts->p15card = sc_pkcs15_card_new();
+	assert_non_null(ts->p15card);
+	ts->p15card->card = &ts->card;
+	ts->p15card->opts.use_pin_cache = 1;
+	ts->p15card->opts.pin_cache_counter = 100;
+
+	ts->pin_obj = calloc(1, sizeof(struct sc_pkcs15_object));
+	auth_info = calloc(1, sizeof(struct sc_pkcs15_auth_info));
+	assert_non_null(ts->pin_obj);
+	assert_non_null(auth_info);
+	ts->pin_obj->type = SC_PKCS15_TYPE_AUTH_PIN;
+	ts->pin_obj->data = auth_info;
+	strcpy(ts->pin_obj->label, "User PIN");
+	auth_info->auth_type = SC_PKCS15_PIN_AUTH_TYPE_PIN;
+	auth_info->auth_method = SC_AC_CHV;
+	auth_info->auth_id.len = 1;
+	auth_info->auth_id.value[0] = 0x01;
+	auth_info->attrs.pin.reference = PIN_REFERENCE;
+	auth_info->attrs.pin.min_length = 4;
+	auth_info->attrs.pin.max_length = 8;
+	auth_info->attrs.pin.type = SC_PKCS15_PIN_TYPE_ASCII_NUMERIC;
+	rv = sc_pkcs15_add_object(ts->p15card, ts->pin_obj);
+	assert_int_equal(rv, SC_SUCCESS);
+
+	ts->key_obj = calloc(1, sizeof(struct sc_pkcs15_object));
+	key_info = calloc(1, sizeof(struct sc_pkcs15_prkey_info));
+	assert_non_null(ts->key_obj);
+	assert_non_null(key_info);
+	ts->key_obj->type = SC_PKCS15_TYPE_PRKEY_RSA;
+	ts->key_obj->data = key_info;
+	ts->key_obj->auth_id = auth_info->auth_id;
+	rv = sc_pkcs15_add_object(ts->p15card, ts->key_obj);
+	assert_int_equal(rv, SC_SUCCESS);
+
+	memset(&card_state, 0, sizeof card_state);
+	card_state.logged_in = SC_PIN_STATE_LOGGED_OUT;
+
+	/* the PIN is cached by a successful verification */
+	rv = sc_pkcs15_verify_pin(ts->p15card, ts->pin_obj, (const u8 *)PIN, strlen(PIN));
+	assert_int_equal(rv, SC_SUCCESS);
+	assert_int_equal(card_state.verify_count, 1);
+	assert_int_equal(ts->pin_obj->content.len, strlen(PIN));
+	card_state.verify_count = 0;
+
+	*state = ts;
+	return 0;
+}
+
+static int teardown_pincache(void **state)
+{
+	struct test_state *ts = *state;
+	int rv;
+
+	ts->p15card->card = NULL;
+	sc_pkcs15_card_free(ts->p15card);
+	rv = sc_release_context(ts->ctx);
+	assert_int_equal(rv, SC_SUCCESS);
+	free(ts);
+
+	return 0;
+}
+
+static void torture_pincache_stamp(void **state)
+{
+	struct test_state *ts = *state;
+	struct sc_pkcs15_auth_info *auth_info = ts->pin_obj->data;
+
+	assert_int_equal(auth_info->verified_resets, ts->card.reset_count);
+	assert_int_equal(auth_info->verified_transaction, ts->card.transaction_count);
+
+	/* a changed or unblocked PIN is stamped the same way */
+	ts->card.reset_count = 3;
+	ts->card.transaction_count = 7;
+	sc_pkcs15_pincache_add(ts->p15card, ts->pin_obj, (const u8 *)PIN, strlen(PIN));
+	assert_int_equal(auth_info->verified_resets, 3);
+	assert_int_equal(auth_info->verified_transaction, 7);
+}
+
+static void torture_pincache_unchanged(void **state)
+{
+	struct test_state *ts = *state;
+
+	ts->p15card->opts.pin_state_probe = 1;
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 0);
+	assert_int_equal(card_state.verify_count, 0);
+	assert_int_equal(card_state.get_info_count, 0);
+}
+
+static void torture_pincache_reset(void **state)
+{
+	struct test_state *ts = *state;
+	struct sc_pkcs15_auth_info *auth_info = ts->pin_obj->data;
+
+	ts->card.reset_count++;
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 1);
+	assert_int_equal(card_state.verify_count, 1);
+	assert_int_equal(card_state.get_info_count, 0);
+	assert_int_equal(auth_info->verified_resets, ts->card.reset_count);
+
+	/* verified again, nothing more to do */
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 0);
+	assert_int_equal(card_state.verify_count, 1);
+}
+
+static void torture_pincache_transaction_no_probe(void **state)
+{
+	struct test_state *ts = *state;
+
+	ts->card.transaction_count++;
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 0);
+	assert_int_equal(card_state.verify_count, 0);
+	assert_int_equal(card_state.get_info_count, 0);
+}
+
+static void torture_pincache_probe_logged_in(void **state)
+{
+	struct test_state *ts = *state;
+	struct sc_pkcs15_auth_info *auth_info = ts->pin_obj->data;
+
+	ts->p15card->opts.pin_state_probe = 1;
+	card_state.logged_in = SC_PIN_STATE_LOGGED_IN;
+	ts->card.transaction_count++;
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 0);
+	assert_int_equal(card_state.get_info_count, 1);
+	assert_int_equal(card_state.verify_count, 0);
+	assert_int_equal(auth_info->verified_transaction, ts->card.transaction_count);
+
+	/* the state is not asked again within the same transaction */
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 0);
+	assert_int_equal(card_state.get_info_count, 1);
+}
+
+static void torture_pincache_probe_logged_out(void **state)
+{
+	struct test_state *ts = *state;
+	struct sc_pkcs15_auth_info *auth_info = ts->pin_obj->data;
+
+	ts->p15card->opts.pin_state_probe = 1;
+	card_state.logged_in = SC_PIN_STATE_LOGGED_OUT;
+	ts->card.transaction_count++;
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 1);
+	assert_int_equal(card_state.get_info_count, 1);
+	assert_int_equal(card_state.verify_count, 1);
+	assert_int_equal(auth_info->verified_transaction, ts->card.transaction_count);
+}
+
+static void torture_pincache_probe_not_supported(void **state)
+{
+	struct test_state *ts = *state;
+
+	ts->p15card->opts.pin_state_probe = 1;
+	card_state.get_info_rv = SC_ERROR_NOT_SUPPORTED;
+	ts->card.transaction_count++;
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 0);
+	assert_int_equal(card_state.get_info_count, 1);
+	assert_int_equal(ts->p15card->opts.pin_state_probe, 0);
+
+	/* the card is not asked again */
+	ts->card.transaction_count++;
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 0);
+	assert_int_equal(card_state.get_info_count, 1);
+	assert_int_equal(card_state.verify_count, 0);
+}
+
+static void torture_pincache_cleared(void **state)
+{
+	struct test_state *ts = *state;
+
+	/* without a cached PIN the card is left alone */
+	sc_pkcs15_pincache_clear(ts->p15card);
+	ts->card.reset_count++;
+	assert_int_equal(sc_pkcs15_pincache_refresh(ts->p15card, ts->key_obj), 0);
+	assert_int_equal(card_state.verify_count, 0);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(torture_pincache_stamp,
+				setup_pincache, teardown_pincache),
+		cmocka_unit_test_setup_teardown(torture_pincache_unchanged,
+				setup_pincache, teardown_pincache),
+		cmocka_unit_test_setup_teardown(torture_pincache_reset,
+				setup_pincache, teardown_pincache),
+		cmocka_unit_test_setup_teardown(torture_pincache_transaction_no_probe,
+				setup_pincache, teardown_pincache),
+		cmocka_unit_test_setup_teardown(torture_pincache_probe_logged_in,
+				setup_pincache, teardown_pincache),
+		cmocka_unit_test_setup_teardown(torture_pincache_probe_logged_out,
+				setup_pincache, teardown_pincache),
+		cmocka_unit_test_setup_teardown(torture_pincache_probe_not_supported,
+				setup_pincache, teardown_pincache),
+		cmocka_unit_test_setup_teardown(torture_pincache_cleared,
+				setup_pincache, teardown_pincache),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
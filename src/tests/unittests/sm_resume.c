@@ -0,0 +1,222 @@
+/*
+ * sm_resume.c: Unit tests for resuming SM sessions after a card reset
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "torture.h"
+#include "libopensc/opensc.h"
+
+/*
+ * The reader reports a reset for the first transactions, the SM operations
+ * of the card count their calls and answer as configured.
+ */
+static struct {
+	/* transactions that report a reset */
+	int resets;
+	int lock_calls;
+	/* result of the resume operation */
+	int resume_result;
+	int resume_calls;
+	int open_calls;
+} stub;
+
+static int stub_lock(sc_reader_t *reader)
+{
+	stub.lock_calls++;
+	if (stub.resets > 0) {
+		stub.resets--;
+		return SC_ERROR_CARD_RESET;
+	}
+	return SC_SUCCESS;
+}
+
+static int stub_unlock(sc_reader_t *reader)
+{
+	return SC_SUCCESS;
+}
+
+static int stub_resume(sc_card_t *card)
+{
+	stub.resume_calls++;
+	return stub.resume_result;
+}
+
+static int stub_open(sc_card_t *card)
+{
+	stub.open_calls++;
+	return SC_SUCCESS;
+}
+
+static struct sc_reader_operations reader_ops = {
+	.lock = stub_lock,
+	.unlock = stub_unlock,
+};
+static struct sc_card_operations card_ops;
+
+struct test_state {
+	sc_context_t *ctx;
+	sc_reader_t reader;
+	sc_card_t card;
+};
+
+static int setup_card(void **state)
+{
+	struct test_state *ts = calloc(1, sizeof *ts);
+	int rv;
+
+	assert_non_null(ts);
+	rv = sc_establish_context(&ts->ctx, "sm_resume");
+	assert_int_equal(rv, SC_SUCCESS);
+	sc_ctx_reset_stats(ts->ctx);
+
+	ts->reader.ctx = ts->ctx;
+	ts->reader.ops = &reader_ops;
+	ts->card.ctx = ts->ctx;
+	ts->card.reader = &ts->reader;
+	ts->card.ops = &card_ops;
+	ts->card.sm_ctx.sm_mode = SM_MODE_TRANSMIT;
+	ts->card.sm_ctx.ops.resume = stub_resume;
+	ts->card.sm_ctx.ops.open = stub_open;
+
+	memset(&stub, 0, sizeof stub);
+
+	*state = ts;
+	return 0;
+}
+
+static int teardown_card(void **state)
+{
+	struct test_state *ts = *state;
+	int rv;
+
+	rv = sc_release_context(ts->ctx);
+	assert_int_equal(rv, SC_SUCCESS);
+	free(ts);
+
+	return 0;
+}
+
+static void lock_unlock(sc_card_t *card)
+{
+	assert_int_equal(sc_lock(card), SC_SUCCESS);
+	assert_int_equal(sc_unlock(card), SC_SUCCESS);
+	assert_int_equal(card->lock_count, 0);
+}
+
+static void check_stats(sc_context_t *ctx, unsigned long long resumed,
+	unsigned long long reopened)
+{
+	sc_stats_t stats;
+
+	assert_int_equal(sc_ctx_get_stats(ctx, &stats), SC_SUCCESS);
+	assert_int_equal(stats.sm_resumed, resumed);
+	assert_int_equal(stats.sm_reopened, reopened);
+}
+
+static void torture_sm_no_reset(void **state)
+{
+	struct test_state *ts = *state;
+
+	lock_unlock(&ts->card);
+	assert_int_equal(stub.lock_calls, 1);
+	assert_int_equal(ts->card.reset_count, 0);
+	assert_int_equal(stub.resume_calls, 0);
+	assert_int_equal(stub.open_calls, 0);
+	check_stats(ts->ctx, 0, 0);
+}
+
+static void torture_sm_resumed(void **state)
+{
+	struct test_state *ts = *state;
+
+	/* the session survived: it is not opened again */
+	stub.resets = 1;
+	stub.resume_result = SC_SUCCESS;
+	lock_unlock(&ts->card);
+	assert_int_equal(stub.lock_calls, 2);
+	assert_int_equal(ts->card.reset_count, 1);
+	assert_int_equal(stub.resume_calls, 1);
+	assert_int_equal(stub.open_calls, 0);
+	check_stats(ts->ctx, 1, 0);
+
+	/* the next transaction without reset leaves the session alone */
+	lock_unlock(&ts->card);
+	assert_int_equal(stub.resume_calls, 1);
+	assert_int_equal(stub.open_calls, 0);
+	check_stats(ts->ctx, 1, 0);
+}
+
+static void torture_sm_reopened(void **state)
+{
+	struct test_state *ts = *state;
+
+	/* the card lost the session keys */
+	stub.resets = 1;
+	stub.resume_result = SC_ERROR_SM_NOT_INITIALIZED;
+	lock_unlock(&ts->card);
+	assert_int_equal(ts->card.reset_count, 1);
+	assert_int_equal(stub.resume_calls, 1);
+	assert_int_equal(stub.open_calls, 1);
+	check_stats(ts->ctx, 0, 1);
+}
+
+static void torture_sm_reopened_without_resume(void **state)
+{
+	struct test_state *ts = *state;
+
+	/* drivers without the resume operation always open a new session */
+	ts->card.sm_ctx.ops.resume = NULL;
+	stub.resets = 2;
+	lock_unlock(&ts->card);
+	assert_int_equal(stub.lock_calls, 3);
+	assert_int_equal(ts->card.reset_count, 1);
+	assert_int_equal(stub.open_calls, 1);
+	check_stats(ts->ctx, 0, 1);
+}
+
+static void torture_sm_nested_lock(void **state)
+{
+	struct test_state *ts = *state;
+
+	/* only the outermost lock starts a transaction */
+	assert_int_equal(sc_lock(&ts->card), SC_SUCCESS);
+	stub.resets = 1;
+	assert_int_equal(sc_lock(&ts->card), SC_SUCCESS);
+	assert_int_equal(sc_unlock(&ts->card), SC_SUCCESS);
+	assert_int_equal(sc_unlock(&ts->card), SC_SUCCESS);
+	assert_int_equal(stub.lock_calls, 1);
+	assert_int_equal(stub.resume_calls, 0);
+	assert_int_equal(stub.open_calls, 0);
+	check_stats(ts->ctx, 0, 0);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(torture_sm_no_reset,
+				setup_card, teardown_card),
+		cmocka_unit_test_setup_teardown(torture_sm_resumed,
+				setup_card, teardown_card),
+		cmocka_unit_test_setup_teardown(torture_sm_reopened,
+				setup_card, teardown_card),
+		cmocka_unit_test_setup_teardown(torture_sm_reopened_without_resume,
+				setup_card, teardown_card),
+		cmocka_unit_test_setup_teardown(torture_sm_nested_lock,
+				setup_card, teardown_card),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
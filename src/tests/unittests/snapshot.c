@@ -0,0 +1,398 @@
+/*
+ * snapshot.c: Unit tests for configuration snapshots
+ *
+ * Copyright (C) 2026  OpenSC Project developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "torture.h"
+#include "libopensc/opensc.h"
+#include "scconf/scconf.c"
+#include "scconf/snapshot.c"
+#include "common/lru.c"
+
+static const char conf_string[] =
+	"# comments are not kept\n"
+	"app default {\n"
+	"	debug = 3;\n"
+	"	reader_driver pcsc {\n"
+	"		max_send_size = 255;\n"
+	"	}\n"
+	"	card_drivers = old, internal;\n"
+	"	framework pkcs15 {\n"
+	"		builtin_emulators = openpgp;\n"
+	"	}\n"
+	"}\n"
+	"app \"pkcs15-init\" {\n"
+	"	pin_cache = no;\n"
+	"}\n";
+
+static scconf_context *parse(const char *string)
+{
+	scconf_context *conf = scconf_new(NULL);
+
+	assert_non_null(conf);
+	assert_int_equal(scconf_parse_string(conf, string), 1);
+	return conf;
+}
+
+static void save(const scconf_context *conf, unsigned char **data, size_t *len)
+{
+	assert_int_equal(scconf_snapshot_save(conf, data, len), 1);
+	assert_non_null(*data);
+	assert_true(*len > 0);
+}
+
+static const char *app_str(const scconf_context *conf, const char *app, const char *key)
+{
+	scconf_block **blocks;
+	const char *value = NULL;
+
+	blocks = scconf_find_blocks(conf, NULL, "app", app);
+	if (blocks && blocks[0])
+		value = scconf_get_str(blocks[0], key, NULL);
+	free(blocks);
+	return value;
+}
+
+static void torture_snapshot_round_trip(void **state)
+{
+	scconf_context *conf = parse(conf_string), *copy = scconf_new(NULL);
+	unsigned char *data = NULL, *data2 = NULL;
+	size_t len = 0, len2 = 0;
+	scconf_block **blocks;
+	const scconf_list *list;
+
+	save(conf, &data, &len);
+	assert_non_null(copy);
+	assert_int_equal(scconf_snapshot_load(copy, data, len), 1);
+
+	/* the same configuration is found in the loaded image */
+	assert_string_equal(app_str(copy, "default", "debug"), "3");
+	assert_string_equal(app_str(copy, "pkcs15-init", "pin_cache"), "no");
+	blocks = scconf_find_blocks(copy, NULL, "app", "default");
+	assert_non_null(blocks);
+	assert_non_null(blocks[0]);
+	list = scconf_find_list(blocks[0], "card_drivers");
+	assert_non_null(list);
+	assert_string_equal(list->data, "old");
+	assert_non_null(list->next);
+	assert_string_equal(list->next->data, "internal");
+	assert_null(list->next->next);
+	assert_int_equal(scconf_get_int(scconf_find_block(copy, blocks[0], "reader_driver"),
+			"max_send_size", 0), 255);
+	free(blocks);
+
+	/* and stored again, the image does not change */
+	save(copy, &data2, &len2);
+	assert_int_equal(len2, len);
+	assert_memory_equal(data2, data, len);
+
+	free(data);
+	free(data2);
+	scconf_free(conf);
+	scconf_free(copy);
+}
+
+/* A failing load must leave the configuration as it was */
+static void load_fails(scconf_context *conf, const unsigned char *data, size_t len)
+{
+	scconf_block *root = conf->root;
+
+	assert_int_equal(scconf_snapshot_load(conf, data, len), 0);
+	assert_true(conf->root == root);
+	assert_string_equal(app_str(conf, "default", "debug"), "3");
+}
+
+static void put_be32(unsigned char *p, size_t value)
+{
+	p[0] = (value >> 24) & 0xff;
+	p[1] = (value >> 16) & 0xff;
+	p[2] = (value >> 8) & 0xff;
+	p[3] = value & 0xff;
+}
+
+/* An image of blocks named "b" nested depth times, returns its length */
+static size_t nested(unsigned char *buf, size_t depth)
+{
+	size_t len = 0, i;
+
+	for (i = 0; i < depth; i++) {
+		/* no names, one item: a block */
+		if (buf) {
+			put_be32(buf + len, 0);
+			put_be32(buf + len + 4, 1);
+			put_be32(buf + len + 8, SCCONF_ITEM_TYPE_BLOCK);
+			put_be32(buf + len + 12, 1);
+			buf[len + 16] = 'b';
+		}
+		len += 17;
+	}
+	/* the innermost block is empty */
+	if (buf) {
+		put_be32(buf + len, 0);
+		put_be32(buf + len + 4, 0);
+	}
+	return len + 8;
+}
+
+static void torture_snapshot_truncated(void **state)
+{
+	scconf_context *conf = parse(conf_string);
+	unsigned char *data = NULL;
+	size_t len = 0, i;
+
+	save(conf, &data, &len);
+	for (i = 0; i < len; i++)
+		load_fails(conf, data, i);
+
+	free(data);
+	scconf_free(conf);
+}
+
+static void torture_snapshot_malformed(void **state)
+{
+	scconf_context *conf = parse(conf_string), *small = parse("key = value;\n");
+	unsigned char *data = NULL, *buf;
+	size_t len = 0;
+
+	/* trailing data */
+	save(conf, &data, &len);
+	buf = malloc(len + 1);
+	assert_non_null(buf);
+	memcpy(buf, data, len);
+	buf[len] = 0;
+	load_fails(conf, buf, len + 1);
+	free(buf);
+	free(data);
+
+	/* root: no names, one item of type 0 (a comment) */
+	save(small, &data, &len);
+	assert_int_equal(len, 4 + 4 + 4 + 4 + 3 + 4 + 4 + 5);
+	put_be32(data + 8, 0);
+	load_fails(conf, data, len);
+
+	/* a string longer than the image */
+	put_be32(data + 8, SCCONF_ITEM_TYPE_VALUE);
+	put_be32(data + 12, 0xFFFFFFFF);
+	load_fails(conf, data, len);
+
+	/* more values than the image holds */
+	put_be32(data + 12, 3);
+	put_be32(data + 19, 0x7FFFFFFF);
+	load_fails(conf, data, len);
+	free(data);
+
+	/* blocks nested as deep as accepted, and one level deeper */
+	buf = malloc(nested(NULL, SCCONF_SNAPSHOT_MAX_DEPTH + 1));
+	assert_non_null(buf);
+	len = nested(buf, SCCONF_SNAPSHOT_MAX_DEPTH);
+	assert_int_equal(scconf_snapshot_load(small, buf, len), 1);
+	len = nested(buf, SCCONF_SNAPSHOT_MAX_DEPTH + 1);
+	load_fails(conf, buf, len);
+	free(buf);
+
+	scconf_free(small);
+	scconf_free(conf);
+}
+
+/*
+ * Snapshots used by sc_establish_context(), in a cache directory below a
+ * temporary HOME. Each test stores a snapshot of a configuration that
+ * differs from the file: its "marker" tells whether the snapshot was used.
+ */
+struct snapshot_state {
+	char home[64];
+	char conf_path[96];
+	char snapshot_path[512];
+};
+
+static int setup_snapshot_dir(void **state)
+{
+	struct snapshot_state *st = calloc(1, sizeof *st);
+	struct utimbuf times;
+	sc_context_t *ctx = NULL;
+	char cache_dir[160];
+	struct dirent *entry;
+	DIR *dir;
+	FILE *f;
+
+	assert_non_null(st);
+	strcpy(st->home, "/tmp/snapshot_XXXXXX");
+	assert_non_null(mkdtemp(st->home));
+	snprintf(st->conf_path, sizeof st->conf_path, "%s/opensc.conf", st->home);
+	f = fopen(st->conf_path, "w");
+	assert_non_null(f);
+	fputs("app default { marker = file; }\n", f);
+	fclose(f);
+	/* a file changed just now is not stored */
+	times.actime = times.modtime = time(NULL) - 60;
+	assert_int_equal(utime(st->conf_path, &times), 0);
+
+	setenv("HOME", st->home, 1);
+	setenv("OPENSC_CONF", st->conf_path, 1);
+	setenv("OPENSC_CONF_SNAPSHOT", "1", 1);
+
+	/* the first context stores the snapshot */
+	assert_int_equal(sc_establish_context(&ctx, "snapshot"), SC_SUCCESS);
+	assert_string_equal(app_str(ctx->conf, "default", "marker"), "file");
+	sc_release_context(ctx);
+
+	snprintf(cache_dir, sizeof cache_dir, "%s/.eid/cache", st->home);
+	dir = opendir(cache_dir);
+	assert_non_null(dir);
+	while ((entry = readdir(dir)) != NULL) {
+		if (!strncmp(entry->d_name, "opensc-conf-", 12))
+			snprintf(st->snapshot_path, sizeof st->snapshot_path, "%s/%s",
+					cache_dir, entry->d_name);
+	}
+	closedir(dir);
+	assert_true(st->snapshot_path[0] != '\0');
+
+	*state = st;
+	return 0;
+}
+
+static int teardown_snapshot_dir(void **state)
+{
+	struct snapshot_state *st = *state;
+	char path[128];
+
+	unlink(st->snapshot_path);
+	unlink(st->conf_path);
+	snprintf(path, sizeof path, "%s/.eid/cache", st->home);
+	rmdir(path);
+	snprintf(path, sizeof path, "%s/.eid", st->home);
+	rmdir(path);
+	rmdir(st->home);
+	unsetenv("OPENSC_CONF_SNAPSHOT");
+	unsetenv("OPENSC_CONF");
+	free(st);
+
+	return 0;
+}
+
+/* Replaces the body of the stored snapshot, keeping its header */
+static void write_snapshot(struct snapshot_state *st, const char *string, mode_t mode)
+{
+	scconf_context *conf = parse(string);
+	unsigned char *data = NULL;
+	char header[512];
+	size_t len = 0;
+	FILE *f;
+
+	f = fopen(st->snapshot_path, "rb");
+	assert_non_null(f);
+	assert_non_null(fgets(header, sizeof header, f));
+	fclose(f);
+
+	save(conf, &data, &len);
+	f = fopen(st->snapshot_path, "wb");
+	assert_non_null(f);
+	fputs(header, f);
+	assert_int_equal(fwrite(data, 1, len, f), len);
+	fclose(f);
+	assert_int_equal(chmod(st->snapshot_path, mode), 0);
+
+	free(data);
+	scconf_free(conf);
+}
+
+static const char *context_marker(void)
+{
+	static char marker[32];
+	sc_context_t *ctx = NULL;
+	const char *value;
+
+	assert_int_equal(sc_establish_context(&ctx, "snapshot"), SC_SUCCESS);
+	value = app_str(ctx->conf, "default", "marker");
+	assert_non_null(value);
+	strncpy(marker, value, sizeof marker - 1);
+	sc_release_context(ctx);
+	return marker;
+}
+
+static void torture_snapshot_used(void **state)
+{
+	struct snapshot_state *st = *state;
+
+	write_snapshot(st, "app default { marker = snapshot; }\n", 0600);
+	assert_string_equal(context_marker(), "snapshot");
+}
+
+static void torture_snapshot_writable(void **state)
+{
+	struct snapshot_state *st = *state;
+
+	write_snapshot(st, "app default { marker = snapshot; }\n", 0620);
+	assert_string_equal(context_marker(), "file");
+
+	write_snapshot(st, "app default { marker = snapshot; }\n", 0602);
+	assert_string_equal(context_marker(), "file");
+}
+
+static void torture_snapshot_owner(void **state)
+{
+	struct snapshot_state *st = *state;
+
+	/* only root can give the file away */
+	if (geteuid() != 0)
+		skip();
+	write_snapshot(st, "app default { marker = snapshot; }\n", 0600);
+	assert_int_equal(chown(st->snapshot_path, 1, (gid_t) -1), 0);
+	assert_string_equal(context_marker(), "file");
+}
+
+static void torture_snapshot_corrupted(void **state)
+{
+	struct snapshot_state *st = *state;
+	char header[512];
+	FILE *f;
+
+	/* a valid header with a truncated image */
+	write_snapshot(st, "app default { marker = snapshot; }\n", 0600);
+	f = fopen(st->snapshot_path, "rb");
+	assert_non_null(f);
+	assert_non_null(fgets(header, sizeof header, f));
+	fclose(f);
+	assert_int_equal(truncate(st->snapshot_path, strlen(header) + 10), 0);
+	assert_string_equal(context_marker(), "file");
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(torture_snapshot_round_trip),
+		cmocka_unit_test(torture_snapshot_truncated),
+		cmocka_unit_test(torture_snapshot_malformed),
+		cmocka_unit_test_setup_teardown(torture_snapshot_used,
+				setup_snapshot_dir, teardown_snapshot_dir),
+		cmocka_unit_test_setup_teardown(torture_snapshot_writable,
+				setup_snapshot_dir, teardown_snapshot_dir),
+		cmocka_unit_test_setup_teardown(torture_snapshot_owner,
+				setup_snapshot_dir, teardown_snapshot_dir),
+		cmocka_unit_test_setup_teardown(torture_snapshot_corrupted,
+				setup_snapshot_dir, teardown_snapshot_dir),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
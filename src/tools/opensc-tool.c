@@ -46,13 +46,15 @@ static int	opt_wait = 0;
 static char **	opt_apdus;
 static char	*opt_reader;
 static int	opt_apdu_count = 0;
+static int	opt_stats = 0;
 static int	verbose = 0;
 
 enum {
 	OPT_SERIAL = 0x100,
 	OPT_LIST_ALG,
 	OPT_VERSION,
-	OPT_RESET
+	OPT_RESET,
+	OPT_STATS
 };
 
 static const struct option options[] = {
@@ -72,6 +74,7 @@ static const struct option options[] = {
 	{ "card-driver",	1, NULL,		'c' },
 	{ "list-algorithms",    0, NULL,	OPT_LIST_ALG },
 	{ "wait",		0, NULL,		'w' },
+	{ "stats",		0, NULL,	OPT_STATS   },
 	{ "verbose",		0, NULL,		'v' },
 	{ NULL, 0, NULL, 0 }
 };
@@ -93,6 +96,7 @@ static const char *option_help[] = {
 	"Forces the use of driver <arg> [auto-detect; '?' for list]",
 	"Lists algorithms supported by card",
 	"Wait for a card to be inserted",
+	"Prints performance counters when done",
 	"Verbose operation. Use several times to enable debug output.",
 };
 
@@ -677,6 +681,24 @@ static int card_reset(const char *reset_type)
 	return 0;
 }
 
+static void print_stats(void)
+{
+	sc_stats_t stats;
+	char *buf;
+	size_t len;
+
+	if (sc_ctx_get_stats(ctx, &stats) != SC_SUCCESS)
+		return;
+
+	len = sc_stats_print(&stats, NULL, 0) + 1;
+	buf = malloc(len);
+	if (buf == NULL)
+		return;
+	sc_stats_print(&stats, buf, len);
+	printf("%s", buf);
+	free(buf);
+}
+
 int main(int argc, char *argv[])
 {
 	int err = 0, r, c, long_optind = 0;
@@ -788,6 +810,9 @@ int main(int argc, char *argv[])
 			do_list_algorithms = 1;
 			action_count++;
 			break;
+		case OPT_STATS:
+			opt_stats = 1;
+			break;
 		case OPT_RESET:
 			do_reset = 1;
 			opt_reset_type = optarg;
@@ -922,6 +947,8 @@ int main(int argc, char *argv[])
 	}
 end:
 	sc_disconnect_card(card);
+	if (opt_stats)
+		print_stats();
 	sc_release_context(ctx);
 	return err;
 }
@@ -22,6 +22,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -160,7 +161,14 @@ enum {
 	OPT_SIGNATURE_FILE,
 	OPT_ALWAYS_AUTH,
 	OPT_ALLOWED_MECHANISMS,
-	OPT_OBJECT_INDEX
+	OPT_OBJECT_INDEX,
+	OPT_ALL_READERS,
+	OPT_JOBS,
+	OPT_BENCHMARK,
+	OPT_SESSIONS,
+	OPT_ITERATIONS,
+	OPT_DURATION,
+	OPT_WARM_UP
 };
 
 static const struct option options[] = {
@@ -214,6 +222,8 @@ static const struct option options[] = {
 	{ "slot-index",		1, NULL,		OPT_SLOT_INDEX },
 	{ "object-index",		1, NULL,		OPT_OBJECT_INDEX },
 	{ "token-label",	1, NULL,		OPT_TOKEN_LABEL },
+	{ "all-readers",	0, NULL,		OPT_ALL_READERS },
+	{ "jobs",		1, NULL,		OPT_JOBS },
 	{ "set-id",		1, NULL,		'e' },
 	{ "attr-from",		1, NULL,		OPT_ATTR_FROM },
 	{ "input-file",		1, NULL,		'i' },
@@ -235,6 +245,11 @@ static const struct option options[] = {
 	{ "test-fork",		0, NULL,		OPT_TEST_FORK },
 #endif
 	{ "generate-random",	1, NULL,		OPT_GENERATE_RANDOM },
+	{ "benchmark",		1, NULL,		OPT_BENCHMARK },
+	{ "sessions",		1, NULL,		OPT_SESSIONS },
+	{ "iterations",		1, NULL,		OPT_ITERATIONS },
+	{ "duration",		1, NULL,		OPT_DURATION },
+	{ "warm-up",		1, NULL,		OPT_WARM_UP },
 
 	{ NULL, 0, NULL, 0 }
 };
@@ -290,6 +305,8 @@ static const char *option_help[] = {
 	"Specify the index of the slot to use",
 	"Specify the index of the object to use",
 	"Specify the token label of the slot to use",
+	"List the objects of the tokens in all slots, as one JSON object per line",
+	"Number of slots to use in parallel with --all-readers, or threads with --benchmark",
 	"Set the CKA_ID of an object, <args>= the (new) CKA_ID",
 	"Use <arg> to create some attributes when writing an object",
 	"Specify the input file",
@@ -310,7 +327,12 @@ static const char *option_help[] = {
 #ifndef _WIN32
 	"Test forking and calling C_Initialize() in the child",
 #endif
-	"Generate given amount of random data"
+	"Generate given amount of random data",
+	"Measure an operation (sign, verify, decrypt, derive, digest, find-objects, get-attribute)",
+	"Number of sessions to use with --benchmark (default: one per thread)",
+	"Number of operations per thread with --benchmark",
+	"Number of seconds to run --benchmark (default: 10, unless --iterations is given)",
+	"Number of operations per thread before the measurement with --benchmark (default: 1)"
 };
 
 static const char *	app_name = "pkcs11-tool"; /* for utils.c */
@@ -328,6 +350,12 @@ static CK_ULONG		opt_slot_index = 0;
 static int		opt_slot_index_set = 0;
 static CK_ULONG		opt_object_index = 0;
 static int		opt_object_index_set = 0;
+static int		opt_all_readers = 0;
+static int		opt_jobs = 1;
+static int		opt_bench_sessions = 0;
+static unsigned long	opt_bench_iterations = 0;
+static unsigned long	opt_bench_duration = 0;
+static unsigned long	opt_bench_warm_up = 1;
 static CK_MECHANISM_TYPE opt_mechanism = 0;
 static int		opt_mechanism_used = 0;
 static const char *	opt_file_to_write = NULL;
@@ -420,6 +448,7 @@ static void		list_slots(int, int, int);
 static void		show_token(CK_SLOT_ID);
 static void		list_mechs(CK_SLOT_ID);
 static void		list_objects(CK_SESSION_HANDLE, CK_OBJECT_CLASS);
+static int		list_all_slots(int, int);
 static int		login(CK_SESSION_HANDLE, int);
 static void		init_token(CK_SLOT_ID);
 static void		init_pin(CK_SLOT_ID, CK_SESSION_HANDLE);
@@ -472,6 +501,7 @@ static void		test_ec(CK_SLOT_ID slot, CK_SESSION_HANDLE session);
 static void		test_fork(void);
 #endif
 static void		generate_random(CK_SESSION_HANDLE session);
+static int		benchmark(CK_SLOT_ID slot, CK_SESSION_HANDLE session, const char *operation);
 static CK_RV		find_object_with_attributes(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE *out,
 				CK_ATTRIBUTE *attrs, CK_ULONG attrsLen, CK_ULONG obj_index);
 static CK_ULONG		get_private_key_length(CK_SESSION_HANDLE sess, CK_OBJECT_HANDLE prkey);
@@ -598,6 +628,7 @@ int main(int argc, char * argv[])
 	int do_unlock_pin = 0;
 	int action_count = 0;
 	int do_generate_random = 0;
+	const char *opt_benchmark = NULL;
 	char *s = NULL;
 	CK_RV rv;
 
@@ -823,6 +854,12 @@ int main(int argc, char * argv[])
 			}
 			opt_token_label = optarg;
 			break;
+		case OPT_ALL_READERS:
+			opt_all_readers = 1;
+			break;
+		case OPT_JOBS:
+			opt_jobs = util_get_jobs(optarg);
+			break;
 		case OPT_MODULE:
 			opt_module = optarg;
 			break;
@@ -924,6 +961,23 @@ int main(int argc, char * argv[])
 			do_generate_random = 1;
 			action_count++;
 			break;
+		case OPT_BENCHMARK:
+			need_session |= NEED_SESSION_RO;
+			opt_benchmark = optarg;
+			action_count++;
+			break;
+		case OPT_SESSIONS:
+			opt_bench_sessions = (int) util_get_number(optarg, 1, INT_MAX, "number of sessions");
+			break;
+		case OPT_ITERATIONS:
+			opt_bench_iterations = util_get_number(optarg, 1, INT_MAX, "number of operations");
+			break;
+		case OPT_DURATION:
+			opt_bench_duration = util_get_number(optarg, 1, INT_MAX, "duration");
+			break;
+		case OPT_WARM_UP:
+			opt_bench_warm_up = util_get_number(optarg, 0, INT_MAX, "number of warm-up operations");
+			break;
 		case OPT_ALWAYS_AUTH:
 			opt_always_auth = 1;
 			break;
@@ -972,7 +1026,16 @@ int main(int argc, char * argv[])
 			util_fatal("Failed to load pkcs11 module");
 	}
 
-	rv = p11->C_Initialize(NULL);
+	if (opt_jobs > 1) {
+		/* the module is used from several threads */
+		CK_C_INITIALIZE_ARGS init_args;
+
+		memset(&init_args, 0, sizeof init_args);
+		init_args.flags = CKF_OS_LOCKING_OK;
+		rv = p11->C_Initialize(&init_args);
+	} else {
+		rv = p11->C_Initialize(NULL);
+	}
 	if (rv == CKR_CRYPTOKI_ALREADY_INITIALIZED)
 		fprintf(stderr, "\n*** Cryptoki library has already been initialized ***\n");
 	else if (rv != CKR_OK)
@@ -999,6 +1062,25 @@ int main(int argc, char * argv[])
 		goto end;
 	}
 
+	if (opt_all_readers) {
+		if (action_count > do_list_slots + do_list_objects + do_read_object
+				|| opt_slot_set || opt_slot_description || opt_slot_index_set
+				|| opt_token_label || opt_jobs < 1) {
+			fprintf(stderr, "--all-readers only lists or reads objects, "
+					"without selecting a slot, with at least one job\n");
+			err = 1;
+			goto end;
+		}
+		if (opt_login && opt_pin == NULL) {
+			/* an empty PIN would use up a retry on every token */
+			fprintf(stderr, "--all-readers needs --pin with --login\n");
+			err = 1;
+			goto end;
+		}
+		err = list_all_slots(opt_login, do_read_object);
+		goto end;
+	}
+
 	if (!opt_slot_set && (action_count > do_list_slots)) {
 		if (opt_slot_description) {
 			if (!find_slot_by_description(opt_slot_description, &opt_slot)) {
@@ -1213,6 +1295,9 @@ int main(int argc, char * argv[])
 		generate_random(session);
 	}
 
+	if (opt_benchmark)
+		err = benchmark(opt_slot, session, opt_benchmark);
+
 end:
 	if (session != CK_INVALID_HANDLE) {
 		rv = p11->C_CloseSession(session);
@@ -3666,6 +3751,245 @@ static void list_objects(CK_SESSION_HANDLE sess, CK_OBJECT_CLASS  object_class)
 	p11->C_FindObjectsFinal(sess);
 }
 
+struct slot_list {
+	CK_RV *results;
+	int login;
+	int read_values;
+};
+
+/* Appends an attribute of an object, if it is available */
+static void json_attribute(struct util_json *json, const char *name,
+		CK_SESSION_HANDLE sess, CK_OBJECT_HANDLE obj, CK_ATTRIBUTE_TYPE type, int hex)
+{
+	CK_ATTRIBUTE attr = { type, NULL, 0 };
+
+	if (p11->C_GetAttributeValue(sess, obj, &attr, 1) != CKR_OK
+			|| attr.ulValueLen == (CK_ULONG)(-1))
+		return;
+	attr.pValue = malloc(attr.ulValueLen ? attr.ulValueLen : 1);
+	if (attr.pValue == NULL) {
+		json->error = 1;
+		return;
+	}
+	if (p11->C_GetAttributeValue(sess, obj, &attr, 1) == CKR_OK
+			&& attr.ulValueLen != (CK_ULONG)(-1)) {
+		util_json_printf(json, ",\"%s\":", name);
+		if (hex)
+			util_json_hex(json, attr.pValue, attr.ulValueLen);
+		else
+			util_json_string(json, attr.pValue, attr.ulValueLen);
+	}
+	free(attr.pValue);
+}
+
+/* Appends a blank padded string of a slot or token info */
+static void json_padded(struct util_json *json, const char *name,
+		const CK_UTF8CHAR *str, size_t len)
+{
+	while (len > 0 && (str[len - 1] == ' ' || str[len - 1] == '\0'))
+		len--;
+	util_json_printf(json, "\"%s\":", name);
+	util_json_string(json, (const char *) str, len);
+}
+
+static const char *json_class_name(CK_OBJECT_CLASS cls)
+{
+	switch (cls) {
+	case CKO_CERTIFICATE:
+		return "cert";
+	case CKO_PRIVATE_KEY:
+		return "privkey";
+	case CKO_PUBLIC_KEY:
+		return "pubkey";
+	case CKO_SECRET_KEY:
+		return "secrkey";
+	case CKO_DATA:
+		return "data";
+	}
+	return NULL;
+}
+
+/* Whether the CKA_VALUE of an object is read with --read-object */
+static int json_read_value(CK_SESSION_HANDLE sess, CK_OBJECT_HANDLE obj,
+		CK_OBJECT_CLASS cls)
+{
+	CK_ATTRIBUTE attr = { 0, NULL, 0 };
+	unsigned char id[sizeof opt_object_id];
+	char label[256];
+	int match = 1;
+
+	if (cls != CKO_CERTIFICATE && cls != CKO_DATA && cls != CKO_PUBLIC_KEY)
+		return 0;
+	if (opt_object_id_len) {
+		attr.type = CKA_ID;
+		attr.pValue = id;
+		attr.ulValueLen = sizeof id;
+		match = p11->C_GetAttributeValue(sess, obj, &attr, 1) == CKR_OK
+			&& attr.ulValueLen == opt_object_id_len
+			&& memcmp(id, opt_object_id, opt_object_id_len) == 0;
+	}
+	if (match && opt_object_label) {
+		attr.type = CKA_LABEL;
+		attr.pValue = label;
+		attr.ulValueLen = sizeof label;
+		match = p11->C_GetAttributeValue(sess, obj, &attr, 1) == CKR_OK
+			&& attr.ulValueLen == strlen(opt_object_label)
+			&& memcmp(label, opt_object_label, attr.ulValueLen) == 0;
+	}
+	return match;
+}
+
+static CK_RV json_slot_objects(struct util_json *json, CK_SESSION_HANDLE sess,
+		int read_values)
+{
+	CK_OBJECT_HANDLE objects[32];
+	CK_ULONG i, count;
+	CK_RV rv;
+	int first = 1;
+
+	rv = p11->C_FindObjectsInit(sess, NULL, 0);
+	if (rv != CKR_OK)
+		return rv;
+	util_json_printf(json, ",\"objects\":[");
+	do {
+		rv = p11->C_FindObjects(sess, objects, 32, &count);
+		if (rv != CKR_OK)
+			break;
+		for (i = 0; i < count; i++) {
+			CK_OBJECT_CLASS cls;
+			CK_ATTRIBUTE attr = { CKA_CLASS, &cls, sizeof cls };
+			const char *name;
+
+			if (p11->C_GetAttributeValue(sess, objects[i], &attr, 1) != CKR_OK)
+				continue;
+			if ((int) opt_object_class != -1 && cls != opt_object_class)
+				continue;
+			util_json_printf(json, "%s{\"class\":", first ? "" : ",");
+			first = 0;
+			name = json_class_name(cls);
+			if (name)
+				util_json_printf(json, "\"%s\"", name);
+			else
+				util_json_printf(json, "%lu", cls);
+			json_attribute(json, "label", sess, objects[i], CKA_LABEL, 0);
+			json_attribute(json, "id", sess, objects[i], CKA_ID, 1);
+			if (read_values && json_read_value(sess, objects[i], cls))
+				json_attribute(json, "value", sess, objects[i], CKA_VALUE, 1);
+			util_json_printf(json, "}");
+		}
+	} while (count > 0);
+	util_json_printf(json, "]");
+	p11->C_FindObjectsFinal(sess);
+	return rv;
+}
+
+/* Lists the objects of the token in one slot with a session of its own, so
+ * that several slots can be used in parallel. Nothing in here may use a
+ * static buffer, prompt for a PIN or exit on errors. */
+static void list_slot_json(int index, void *arg)
+{
+	struct slot_list *list = arg;
+	CK_SLOT_ID slot = p11_slots[index];
+	CK_SESSION_HANDLE sess = CK_INVALID_HANDLE;
+	CK_SLOT_INFO slot_info;
+	CK_TOKEN_INFO token_info;
+	struct util_json json;
+	const char *stage = "slot";
+	unsigned long long start, t_open = 0, t_login = 0, t_objects = 0;
+	CK_RV rv;
+
+	memset(&json, 0, sizeof json);
+	util_json_printf(&json, "{\"slot\":%lu", slot);
+
+	start = util_timestamp();
+	rv = p11->C_GetSlotInfo(slot, &slot_info);
+	if (rv == CKR_OK) {
+		util_json_printf(&json, ",");
+		json_padded(&json, "slot_description", slot_info.slotDescription,
+				sizeof slot_info.slotDescription);
+		if (!(slot_info.flags & CKF_TOKEN_PRESENT))
+			rv = CKR_TOKEN_NOT_PRESENT;
+	}
+
+	if (rv == CKR_OK) {
+		stage = "token";
+		rv = p11->C_GetTokenInfo(slot, &token_info);
+	}
+	if (rv == CKR_OK) {
+		util_json_printf(&json, ",\"token\":{");
+		json_padded(&json, "label", token_info.label, sizeof token_info.label);
+		util_json_printf(&json, ",");
+		json_padded(&json, "manufacturer", token_info.manufacturerID,
+				sizeof token_info.manufacturerID);
+		util_json_printf(&json, ",");
+		json_padded(&json, "model", token_info.model, sizeof token_info.model);
+		util_json_printf(&json, ",");
+		json_padded(&json, "serial", token_info.serialNumber,
+				sizeof token_info.serialNumber);
+		util_json_printf(&json, ",\"flags\":%lu}", token_info.flags);
+
+		stage = "session";
+		rv = p11->C_OpenSession(slot, CKF_SERIAL_SESSION, NULL, NULL, &sess);
+		t_open = util_timestamp();
+	}
+
+	if (rv == CKR_OK && list->login) {
+		stage = "login";
+		rv = p11->C_Login(sess, opt_login_type == -1 ? CKU_USER : (CK_USER_TYPE) opt_login_type,
+				(CK_UTF8CHAR *) opt_pin, strlen(opt_pin));
+		t_login = util_timestamp();
+	}
+
+	if (rv == CKR_OK) {
+		stage = "objects";
+		rv = json_slot_objects(&json, sess, list->read_values);
+		t_objects = util_timestamp();
+	}
+
+	if (rv != CKR_OK)
+		util_json_printf(&json, ",\"error\":\"%s\",\"stage\":\"%s\"",
+				CKR2Str(rv), stage);
+	util_json_printf(&json, ",\"time_us\":{");
+	if (t_open)
+		util_json_printf(&json, "\"open\":%llu,", t_open - start);
+	if (t_login)
+		util_json_printf(&json, "\"login\":%llu,", t_login - t_open);
+	if (t_objects)
+		util_json_printf(&json, "\"objects\":%llu,",
+				t_objects - (t_login ? t_login : t_open));
+	util_json_printf(&json, "\"total\":%llu}}", util_timestamp() - start);
+
+	if (sess != CK_INVALID_HANDLE)
+		p11->C_CloseSession(sess);
+
+	if (util_json_flush(&json, stdout) != 0 && rv == CKR_OK)
+		rv = CKR_HOST_MEMORY;
+	list->results[index] = rv;
+}
+
+static int list_all_slots(int login, int read_values)
+{
+	struct slot_list list;
+	CK_ULONG i;
+	int err = 0;
+
+	list.results = calloc(p11_num_slots, sizeof *list.results);
+	if (list.results == NULL)
+		return 1;
+	list.login = login;
+	list.read_values = read_values;
+
+	util_run_jobs(opt_jobs, (int) p11_num_slots, list_slot_json, &list);
+
+	for (i = 0; i < p11_num_slots; i++) {
+		/* empty slots are expected */
+		if (list.results[i] != CKR_OK && list.results[i] != CKR_TOKEN_NOT_PRESENT)
+			err = 1;
+	}
+	free(list.results);
+	return err;
+}
+
 static void show_object(CK_SESSION_HANDLE sess, CK_OBJECT_HANDLE obj)
 {
 	CK_OBJECT_CLASS	cls = getCLASS(sess, obj);
@@ -6406,6 +6730,406 @@ static void generate_random(CK_SESSION_HANDLE session)
 	free(buf);
 }
 
+enum {
+	BENCH_SIGN,
+	BENCH_VERIFY,
+	BENCH_DECRYPT,
+	BENCH_DERIVE,
+	BENCH_DIGEST,
+	BENCH_FIND_OBJECTS,
+	BENCH_GET_ATTRIBUTE
+};
+
+static const char *bench_names[] = {
+	"sign", "verify", "decrypt", "derive", "digest", "find-objects", "get-attribute", NULL
+};
+
+/* Mechanism capabilities needed by the operations, if they use a mechanism */
+static const CK_FLAGS bench_mech_flags[] = {
+	CKF_SIGN, CKF_VERIFY, CKF_DECRYPT, CKF_DERIVE, CKF_DIGEST, 0, 0
+};
+
+/* Measurements of one benchmark thread, in nanoseconds */
+struct bench_thread {
+	unsigned long long *latencies;
+	unsigned long count, size;
+	unsigned long long start, end;
+	CK_RV rv;
+};
+
+struct bench_ctx {
+	int type;
+	CK_SESSION_HANDLE *sessions;
+	int sessions_count, threads_count;
+	CK_OBJECT_HANDLE key;
+	CK_MECHANISM mech;
+	CK_RSA_PKCS_PSS_PARAMS pss_params;
+	CK_ECDH1_DERIVE_PARAMS ecdh_params;
+	CK_ULONG derive_len;
+	CK_BYTE *point;
+	CK_ATTRIBUTE find_template[3];
+	CK_ULONG find_template_len;
+	unsigned char data[1024], sig[1024];
+	CK_ULONG data_len, sig_len;
+	struct bench_thread *threads;
+};
+
+/* Runs the measured operation once */
+static CK_RV bench_once(struct bench_ctx *bench, CK_SESSION_HANDLE sess)
+{
+	unsigned char out[1024];
+	CK_ULONG out_len = sizeof out;
+	CK_RV rv = CKR_OK;
+
+	switch (bench->type) {
+	case BENCH_SIGN:
+		rv = p11->C_SignInit(sess, &bench->mech, bench->key);
+		if (rv == CKR_OK)
+			rv = p11->C_Sign(sess, bench->data, bench->data_len, out, &out_len);
+		break;
+	case BENCH_VERIFY:
+		rv = p11->C_VerifyInit(sess, &bench->mech, bench->key);
+		if (rv == CKR_OK)
+			rv = p11->C_Verify(sess, bench->data, bench->data_len,
+					bench->sig, bench->sig_len);
+		break;
+	case BENCH_DECRYPT:
+		rv = p11->C_DecryptInit(sess, &bench->mech, bench->key);
+		if (rv == CKR_OK)
+			rv = p11->C_Decrypt(sess, bench->data, bench->data_len, out, &out_len);
+		break;
+	case BENCH_DERIVE: {
+		CK_OBJECT_CLASS cls = CKO_SECRET_KEY;
+		CK_KEY_TYPE type = CKK_GENERIC_SECRET;
+		CK_BBOOL false = FALSE;
+		CK_ATTRIBUTE template[] = {
+			{ CKA_TOKEN, &false, sizeof(false) },
+			{ CKA_CLASS, &cls, sizeof(cls) },
+			{ CKA_KEY_TYPE, &type, sizeof(type) },
+			{ CKA_VALUE_LEN, &bench->derive_len, sizeof(bench->derive_len) }
+		};
+		CK_OBJECT_HANDLE newkey = CK_INVALID_HANDLE;
+
+		rv = p11->C_DeriveKey(sess, &bench->mech, bench->key,
+				template, sizeof template / sizeof *template, &newkey);
+		if (rv == CKR_OK)
+			p11->C_DestroyObject(sess, newkey);
+		break;
+	}
+	case BENCH_DIGEST:
+		rv = p11->C_DigestInit(sess, &bench->mech);
+		if (rv == CKR_OK)
+			rv = p11->C_Digest(sess, bench->data, bench->data_len, out, &out_len);
+		break;
+	case BENCH_FIND_OBJECTS: {
+		CK_OBJECT_HANDLE objects[32];
+		CK_ULONG count;
+
+		rv = p11->C_FindObjectsInit(sess, bench->find_template, bench->find_template_len);
+		if (rv != CKR_OK)
+			break;
+		do {
+			rv = p11->C_FindObjects(sess, objects, 32, &count);
+		} while (rv == CKR_OK && count > 0);
+		p11->C_FindObjectsFinal(sess);
+		break;
+	}
+	case BENCH_GET_ATTRIBUTE: {
+		CK_OBJECT_CLASS cls;
+		CK_ATTRIBUTE attrs[] = {
+			{ CKA_CLASS, &cls, sizeof(cls) },
+			{ CKA_ID, NULL, 0 },
+			{ CKA_LABEL, NULL, 0 }
+		};
+
+		rv = p11->C_GetAttributeValue(sess, bench->key, attrs, 3);
+		break;
+	}
+	}
+	return rv;
+}
+
+/* Runs the operation on the sessions of one thread, which are the ones with
+ * the index of the thread modulo the number of threads */
+static void bench_job(int index, void *arg)
+{
+	struct bench_ctx *bench = arg;
+	struct bench_thread *thread = &bench->threads[index];
+	int own = (bench->sessions_count - index + bench->threads_count - 1) / bench->threads_count;
+	unsigned long i, n = 0;
+	unsigned long long t;
+	CK_RV rv = CKR_OK;
+
+#define BENCH_SESSION() bench->sessions[index + (int) (n++ % own) * bench->threads_count]
+	for (i = 0; i < opt_bench_warm_up && rv == CKR_OK; i++)
+		rv = bench_once(bench, BENCH_SESSION());
+
+	thread->start = util_timestamp_ns();
+	for (i = 0; rv == CKR_OK; i++) {
+		if (opt_bench_iterations && i >= opt_bench_iterations)
+			break;
+		t = util_timestamp_ns();
+		if (opt_bench_duration && t - thread->start >= opt_bench_duration * 1000000000ULL)
+			break;
+		rv = bench_once(bench, BENCH_SESSION());
+		t = util_timestamp_ns() - t;
+		if (rv != CKR_OK)
+			break;
+		if (thread->count == thread->size) {
+			unsigned long size = thread->size ? 2 * thread->size : 1024;
+			unsigned long long *p = realloc(thread->latencies, size * sizeof *p);
+
+			if (p == NULL) {
+				rv = CKR_HOST_MEMORY;
+				break;
+			}
+			thread->latencies = p;
+			thread->size = size;
+		}
+		thread->latencies[thread->count++] = t;
+	}
+#undef BENCH_SESSION
+	thread->end = util_timestamp_ns();
+	thread->rv = rv;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *) a;
+	unsigned long long y = *(const unsigned long long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Nearest rank percentile of the sorted latencies */
+static unsigned long long bench_percentile(const unsigned long long *latencies,
+		unsigned long count, unsigned int percent)
+{
+	unsigned long rank = (count * percent + 99) / 100;
+
+	return latencies[rank ? rank - 1 : 0];
+}
+
+static unsigned long bench_read_file(const char *name, unsigned char *buf, size_t size)
+{
+	int fd, r;
+
+	if ((fd = open(name, O_RDONLY|O_BINARY)) < 0)
+		util_fatal("Cannot open %s: %m", name);
+	r = read(fd, buf, size);
+	if (r < 0)
+		util_fatal("Cannot read from %s: %m", name);
+	close(fd);
+	return r;
+}
+
+/* Prepares the key and the data of the operation in the main thread, where
+ * errors are fatal */
+static void bench_setup(CK_SLOT_ID slot, CK_SESSION_HANDLE session, struct bench_ctx *bench)
+{
+	const unsigned char *id = opt_object_id_len ? opt_object_id : NULL;
+	CK_OBJECT_HANDLE other;
+	CK_RV rv;
+
+	if (bench_mech_flags[bench->type]) {
+		if (!opt_mechanism_used
+				&& !find_mechanism(slot, bench_mech_flags[bench->type], NULL, 0, &opt_mechanism))
+			util_fatal("No mechanism to %s found", bench_names[bench->type]);
+		bench->mech.mechanism = opt_mechanism;
+	}
+
+	bench->data_len = bench->type == BENCH_DIGEST ? sizeof bench->data : 32;
+	pseudo_randomize(bench->data, bench->data_len);
+	if (opt_input)
+		bench->data_len = bench_read_file(opt_input, bench->data, sizeof bench->data);
+
+	switch (bench->type) {
+	case BENCH_SIGN:
+	case BENCH_DECRYPT:
+	case BENCH_DERIVE:
+		if (!find_object(session, CKO_PRIVATE_KEY, &bench->key, id, opt_object_id_len, 0))
+			util_fatal("Private key not found");
+		break;
+	case BENCH_VERIFY:
+		if (!find_object(session, CKO_PUBLIC_KEY, &bench->key, id, opt_object_id_len, 0))
+			util_fatal("Public key not found");
+		break;
+	case BENCH_GET_ATTRIBUTE:
+		if (!find_object(session, (int) opt_object_class == -1 ? CKO_PRIVATE_KEY : opt_object_class,
+					&bench->key, id, opt_object_id_len, 0))
+			util_fatal("Object not found");
+		break;
+	}
+
+	switch (bench->type) {
+	case BENCH_SIGN:
+	case BENCH_VERIFY:
+		if (opt_mechanism == CKM_RSA_PKCS_PSS || opt_mechanism == CKM_SHA1_RSA_PKCS_PSS
+				|| opt_mechanism == CKM_SHA224_RSA_PKCS_PSS || opt_mechanism == CKM_SHA256_RSA_PKCS_PSS
+				|| opt_mechanism == CKM_SHA384_RSA_PKCS_PSS || opt_mechanism == CKM_SHA512_RSA_PKCS_PSS) {
+			unsigned long hashlen = parse_pss_params(session, bench->key,
+					&bench->mech, &bench->pss_params);
+
+			if (opt_mechanism == CKM_RSA_PKCS_PSS && !opt_input)
+				bench->data_len = hashlen;
+		}
+		break;
+	case BENCH_DECRYPT:
+		if (!opt_input)
+			util_fatal("The cryptogram to decrypt has to be given with --input-file");
+		break;
+	}
+
+	if (bench->type == BENCH_VERIFY) {
+		if (opt_signature_file) {
+			bench->sig_len = bench_read_file(opt_signature_file, bench->sig, sizeof bench->sig);
+		} else {
+			/* sign the data with the matching private key */
+			if (!find_object(session, CKO_PRIVATE_KEY, &other, id, opt_object_id_len, 0))
+				util_fatal("Private key to create the signature not found, use --signature-file");
+			bench->sig_len = sizeof bench->sig;
+			rv = p11->C_SignInit(session, &bench->mech, other);
+			if (rv == CKR_OK)
+				rv = p11->C_Sign(session, bench->data, bench->data_len, bench->sig, &bench->sig_len);
+			if (rv != CKR_OK)
+				p11_fatal("C_Sign", rv);
+		}
+	}
+
+	if (bench->type == BENCH_DERIVE) {
+		/* agree on a secret with the own public key */
+		CK_ULONG point_len;
+		const u8 *p;
+		size_t len;
+
+		if (!find_object(session, CKO_PUBLIC_KEY, &other, id, opt_object_id_len, 0))
+			util_fatal("Public key not found");
+		bench->point = getEC_POINT(session, other, &point_len);
+		if (bench->point == NULL)
+			util_fatal("Public key has no EC point");
+		p = sc_asn1_find_tag(NULL, bench->point, point_len, SC_ASN1_TAG_OCTET_STRING, &len);
+		if (p == NULL || len == 0)
+			util_fatal("EC point is not an octet string");
+		/* the x coordinate of an uncompressed point */
+		bench->derive_len = (len - 1) / 2;
+		bench->ecdh_params.kdf = CKD_NULL;
+		if (opt_derive_pass_der) {
+			bench->ecdh_params.pPublicData = bench->point;
+			bench->ecdh_params.ulPublicDataLen = point_len;
+		} else {
+			bench->ecdh_params.pPublicData = (CK_BYTE_PTR) p;
+			bench->ecdh_params.ulPublicDataLen = len;
+		}
+		bench->mech.pParameter = &bench->ecdh_params;
+		bench->mech.ulParameterLen = sizeof bench->ecdh_params;
+	}
+
+	if (bench->type == BENCH_FIND_OBJECTS) {
+		if ((int) opt_object_class != -1)
+			FILL_ATTR(bench->find_template[bench->find_template_len++],
+					CKA_CLASS, &opt_object_class, sizeof opt_object_class);
+		if (opt_object_id_len)
+			FILL_ATTR(bench->find_template[bench->find_template_len++],
+					CKA_ID, opt_object_id, opt_object_id_len);
+		if (opt_object_label)
+			FILL_ATTR(bench->find_template[bench->find_template_len++],
+					CKA_LABEL, opt_object_label, strlen(opt_object_label));
+	}
+}
+
+/* Measures the throughput and latency of an operation with --jobs threads,
+ * each using its own share of the sessions */
+static int benchmark(CK_SLOT_ID slot, CK_SESSION_HANDLE session, const char *operation)
+{
+	struct bench_ctx bench;
+	unsigned long long *latencies, start = ~0ULL, end = 0, sum = 0;
+	unsigned long i, count = 0;
+	CK_RV rv = CKR_OK;
+	int t, errors = 0;
+
+	memset(&bench, 0, sizeof bench);
+	for (bench.type = 0; bench_names[bench.type]; bench.type++)
+		if (strcmp(operation, bench_names[bench.type]) == 0)
+			break;
+	if (bench_names[bench.type] == NULL)
+		util_fatal("Unknown benchmark \"%s\"", operation);
+	bench.threads_count = opt_jobs;
+	bench.sessions_count = opt_bench_sessions ? opt_bench_sessions : opt_jobs;
+	if (bench.threads_count < 1 || bench.sessions_count < bench.threads_count)
+		util_fatal("Every one of the --jobs threads needs at least one of the --sessions");
+	if (!opt_bench_iterations && !opt_bench_duration)
+		opt_bench_duration = 10;
+
+	bench_setup(slot, session, &bench);
+
+	bench.sessions = calloc(bench.sessions_count, sizeof *bench.sessions);
+	bench.threads = calloc(bench.threads_count, sizeof *bench.threads);
+	if (bench.sessions == NULL || bench.threads == NULL)
+		util_fatal("out of memory");
+	for (t = 0; t < bench.sessions_count; t++) {
+		rv = p11->C_OpenSession(slot, CKF_SERIAL_SESSION, NULL, NULL, &bench.sessions[t]);
+		if (rv != CKR_OK)
+			p11_fatal("C_OpenSession", rv);
+	}
+
+	printf("Benchmark of %s", bench_names[bench.type]);
+	if (bench_mech_flags[bench.type])
+		printf(" with %s", p11_mechanism_to_name(bench.mech.mechanism));
+	printf(": %d thread(s), %d session(s), %lu warm-up operation(s) per thread\n",
+			bench.threads_count, bench.sessions_count, opt_bench_warm_up);
+	fflush(stdout);
+
+	util_run_jobs(bench.threads_count, bench.threads_count, bench_job, &bench);
+
+	for (t = 0; t < bench.sessions_count; t++)
+		p11->C_CloseSession(bench.sessions[t]);
+
+	for (t = 0; t < bench.threads_count; t++) {
+		count += bench.threads[t].count;
+		if (bench.threads[t].start < start)
+			start = bench.threads[t].start;
+		if (bench.threads[t].end > end)
+			end = bench.threads[t].end;
+		if (bench.threads[t].rv != CKR_OK) {
+			fprintf(stderr, "Thread %d failed: %s (0x%lx)\n", t,
+					CKR2Str(bench.threads[t].rv), bench.threads[t].rv);
+			errors++;
+		}
+	}
+
+	latencies = malloc((count ? count : 1) * sizeof *latencies);
+	if (latencies == NULL)
+		util_fatal("out of memory");
+	for (count = 0, t = 0; t < bench.threads_count; t++) {
+		for (i = 0; i < bench.threads[t].count; i++) {
+			latencies[count++] = bench.threads[t].latencies[i];
+			sum += bench.threads[t].latencies[i];
+		}
+		free(bench.threads[t].latencies);
+	}
+
+	if (count > 0 && end > start) {
+		qsort(latencies, count, sizeof *latencies, bench_compare);
+		printf("%lu operations in %.3f s: %.1f ops/s\n", count,
+				(end - start) / 1e9, count * 1e9 / (end - start));
+		printf("latency (us): min %.1f, avg %.1f, p50 %.1f, p95 %.1f, p99 %.1f, max %.1f\n",
+				latencies[0] / 1e3, sum / 1e3 / count,
+				bench_percentile(latencies, count, 50) / 1e3,
+				bench_percentile(latencies, count, 95) / 1e3,
+				bench_percentile(latencies, count, 99) / 1e3,
+				latencies[count - 1] / 1e3);
+	} else {
+		printf("No operation completed\n");
+		errors++;
+	}
+
+	free(latencies);
+	free(bench.point);
+	free(bench.threads);
+	free(bench.sessions);
+	return errors ? 1 : 0;
+}
+
 static const char *p11_flag_names(struct flag_info *list, CK_FLAGS value)
 {
 	static char	buffer[1024];
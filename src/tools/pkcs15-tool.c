@@ -77,6 +77,8 @@ static const char * opt_puk = NULL;
 static int	compact = 0;
 static int	verbose = 0;
 static int opt_use_pinpad = 0;
+static int opt_all_readers = 0;
+static int opt_jobs = 1;
 #if defined(ENABLE_OPENSSL) && (defined(_WIN32) || defined(HAVE_INTTYPES_H))
 static int opt_rfc4716 = 0;
 #endif
@@ -108,6 +110,8 @@ enum {
 	OPT_PRINT_VERSION,
 	OPT_LIST_INFO,
 	OPT_READ_CERT,
+	OPT_ALL_READERS,
+	OPT_JOBS,
 };
 
 #define NELEMENTS(x)	(sizeof(x)/sizeof((x)[0]))
@@ -139,6 +143,8 @@ static const struct option options[] = {
 	{ "test-update",	no_argument, NULL,		'T' },
 	{ "update",		no_argument, NULL,		'U' },
 	{ "reader",		required_argument, NULL,	OPT_READER },
+	{ "all-readers",	no_argument, NULL,		OPT_ALL_READERS },
+	{ "jobs",		required_argument, NULL,	OPT_JOBS },
 	{ "pin",		required_argument, NULL,	OPT_PIN },
 	{ "new-pin",		required_argument, NULL,	OPT_NEWPIN },
 	{ "puk",		required_argument, NULL,	OPT_PUK },
@@ -181,6 +187,8 @@ static const char *option_help[] = {
 	"Test if the card needs a security update",
 	"Update the card with a security update",
 	"Uses reader number <arg>",
+	"List the tokens in all readers, as one JSON object per line",
+	"Number of readers to use in parallel with --all-readers",
 	"Specify PIN",
 	"Specify New PIN (when changing or unblocking)",
 	"Specify Unblock PIN",
@@ -2098,6 +2106,292 @@ end:
 	return 0;
 }
 
+/* Contents of a token that are listed with --all-readers */
+#define JSON_PINS		0x01
+#define JSON_PRIVATE_KEYS	0x02
+#define JSON_PUBLIC_KEYS	0x04
+#define JSON_SECRET_KEYS	0x08
+#define JSON_CERTIFICATES	0x10
+#define JSON_DATA_OBJECTS	0x20
+
+struct token_list {
+	char **readers;
+	int *results;
+	unsigned int contents;
+};
+
+static void json_id(struct util_json *json, const char *name, const struct sc_pkcs15_id *id)
+{
+	util_json_printf(json, ",\"%s\":", name);
+	util_json_hex(json, id->value, id->len);
+}
+
+static void json_path(struct util_json *json, const struct sc_path *path)
+{
+	const char *str = sc_print_path(path);
+
+	util_json_printf(json, ",\"path\":");
+	util_json_string(json, str, strlen(str));
+}
+
+static void json_object(struct util_json *json, struct sc_pkcs15_card *p15,
+		const struct sc_pkcs15_object *obj)
+{
+	util_json_printf(json, "{\"label\":");
+	util_json_string(json, obj->label, sizeof obj->label);
+	if (obj->auth_id.len)
+		json_id(json, "auth_id", &obj->auth_id);
+
+	switch (obj->type & SC_PKCS15_TYPE_CLASS_MASK) {
+	case SC_PKCS15_TYPE_AUTH: {
+		const struct sc_pkcs15_auth_info *info = obj->data;
+
+		json_id(json, "id", &info->auth_id);
+		if (info->auth_type == SC_PKCS15_PIN_AUTH_TYPE_PIN)
+			util_json_printf(json, ",\"reference\":%d,\"flags\":%u",
+					info->attrs.pin.reference, info->attrs.pin.flags);
+		if (info->tries_left >= 0)
+			util_json_printf(json, ",\"tries_left\":%d", info->tries_left);
+		break;
+	}
+	case SC_PKCS15_TYPE_PRKEY: {
+		const struct sc_pkcs15_prkey_info *info = obj->data;
+
+		json_id(json, "id", &info->id);
+		util_json_printf(json, ",\"type\":\"%s\",\"usage\":%u,\"bits\":%"SC_FORMAT_LEN_SIZE_T"u",
+				key_types[7 & obj->type], info->usage,
+				info->modulus_length ? info->modulus_length : info->field_length);
+		json_path(json, &info->path);
+		break;
+	}
+	case SC_PKCS15_TYPE_PUBKEY: {
+		const struct sc_pkcs15_pubkey_info *info = obj->data;
+
+		json_id(json, "id", &info->id);
+		util_json_printf(json, ",\"type\":\"%s\",\"usage\":%u,\"bits\":%"SC_FORMAT_LEN_SIZE_T"u",
+				key_types[7 & obj->type], info->usage,
+				info->modulus_length ? info->modulus_length : info->field_length);
+		json_path(json, &info->path);
+		break;
+	}
+	case SC_PKCS15_TYPE_SKEY: {
+		const struct sc_pkcs15_skey_info *info = obj->data;
+
+		json_id(json, "id", &info->id);
+		util_json_printf(json, ",\"usage\":%u,\"bits\":%"SC_FORMAT_LEN_SIZE_T"u",
+				info->usage, info->value_len);
+		break;
+	}
+	case SC_PKCS15_TYPE_CERT: {
+		struct sc_pkcs15_cert_info *info = obj->data;
+		struct sc_pkcs15_cert *cert;
+		struct sc_pkcs15_id id;
+
+		json_id(json, "id", &info->id);
+		util_json_printf(json, ",\"authority\":%s", info->authority ? "true" : "false");
+		json_path(json, &info->path);
+		if (opt_cert) {
+			id.len = SC_PKCS15_MAX_ID_SIZE;
+			sc_pkcs15_hex_string_to_id(opt_cert, &id);
+			if (sc_pkcs15_compare_id(&id, &info->id) == 1
+					&& sc_pkcs15_read_certificate(p15, info, &cert) == SC_SUCCESS) {
+				util_json_printf(json, ",\"value\":");
+				util_json_hex(json, cert->data.value, cert->data.len);
+				sc_pkcs15_free_certificate(cert);
+			}
+		}
+		break;
+	}
+	case SC_PKCS15_TYPE_DATA_OBJECT: {
+		const struct sc_pkcs15_data_info *info = obj->data;
+		int i;
+
+		util_json_printf(json, ",\"application\":");
+		util_json_string(json, info->app_label, sizeof info->app_label);
+		if (sc_valid_oid(&info->app_oid)) {
+			util_json_printf(json, ",\"oid\":\"");
+			for (i = 0; i < SC_MAX_OBJECT_ID_OCTETS && info->app_oid.value[i] != -1; i++)
+				util_json_printf(json, "%s%d", i ? "." : "", info->app_oid.value[i]);
+			util_json_printf(json, "\"");
+		}
+		json_path(json, &info->path);
+		break;
+	}
+	}
+	util_json_printf(json, "}");
+}
+
+static int json_objects(struct util_json *json, struct sc_pkcs15_card *p15,
+		unsigned int type, const char *name)
+{
+	struct sc_pkcs15_object *objs[32];
+	int i, count;
+
+	count = sc_pkcs15_get_objects(p15, type, objs, 32);
+	if (count < 0)
+		return count;
+	util_json_printf(json, ",\"%s\":[", name);
+	for (i = 0; i < count; i++) {
+		if (i)
+			util_json_printf(json, ",");
+		json_object(json, p15, objs[i]);
+	}
+	util_json_printf(json, "]");
+	return SC_SUCCESS;
+}
+
+/* Lists the token of one reader, with its own context and card, so that
+ * several readers can be used in parallel */
+static void list_token_json(int index, void *arg)
+{
+	struct token_list *list = arg;
+	const char *reader_name = list->readers[index];
+	struct sc_context *tctx = NULL;
+	struct sc_card *tcard = NULL;
+	struct sc_pkcs15_card *tp15card = NULL;
+	struct sc_reader *reader;
+	sc_context_param_t ctx_param;
+	struct util_json json;
+	const char *stage = "connect";
+	unsigned long long start, t_connect, t_bind = 0, t_objects = 0;
+	int r;
+
+	memset(&json, 0, sizeof json);
+	util_json_printf(&json, "{\"reader\":");
+	util_json_string(&json, reader_name, strlen(reader_name));
+
+	start = util_timestamp();
+	memset(&ctx_param, 0, sizeof(ctx_param));
+	ctx_param.app_name = app_name;
+	r = sc_context_create(&tctx, &ctx_param);
+	if (r == SC_SUCCESS) {
+		reader = sc_ctx_get_reader_by_name(tctx, reader_name);
+		if (reader == NULL)
+			r = SC_ERROR_READER_DETACHED;
+		else if (sc_detect_card_presence(reader) <= 0)
+			r = SC_ERROR_CARD_NOT_PRESENT;
+		else
+			r = sc_connect_card(reader, &tcard);
+	}
+	t_connect = util_timestamp();
+
+	if (r == SC_SUCCESS) {
+		util_json_printf(&json, ",\"atr\":");
+		util_json_hex(&json, tcard->atr.value, tcard->atr.len);
+		util_json_printf(&json, ",\"card\":");
+		util_json_string(&json, tcard->name, tcard->name ? strlen(tcard->name) : 0);
+
+		stage = "bind";
+		if (opt_bind_to_aid) {
+			struct sc_aid aid;
+
+			aid.len = sizeof(aid.value);
+			if (sc_hex_to_bin(opt_bind_to_aid, aid.value, &aid.len))
+				r = SC_ERROR_INVALID_ARGUMENTS;
+			else
+				r = sc_pkcs15_bind(tcard, &aid, &tp15card);
+		} else {
+			r = sc_pkcs15_bind(tcard, NULL, &tp15card);
+		}
+		t_bind = util_timestamp();
+	}
+
+	if (r == SC_SUCCESS) {
+		const char *label = tp15card->tokeninfo->label;
+		const char *serial = tp15card->tokeninfo->serial_number;
+		const char *manufacturer = tp15card->tokeninfo->manufacturer_id;
+
+		if (opt_no_cache)
+			tp15card->opts.use_file_cache = 0;
+		util_json_printf(&json, ",\"token\":{\"label\":");
+		util_json_string(&json, label, label ? strlen(label) : 0);
+		util_json_printf(&json, ",\"serial\":");
+		util_json_string(&json, serial, serial ? strlen(serial) : 0);
+		util_json_printf(&json, ",\"manufacturer\":");
+		util_json_string(&json, manufacturer, manufacturer ? strlen(manufacturer) : 0);
+		util_json_printf(&json, ",\"flags\":%u}", tp15card->tokeninfo->flags);
+
+		stage = "objects";
+		if (list->contents & JSON_PINS)
+			r = json_objects(&json, tp15card, SC_PKCS15_TYPE_AUTH_PIN, "pins");
+		if (r == SC_SUCCESS && list->contents & JSON_PRIVATE_KEYS)
+			r = json_objects(&json, tp15card, SC_PKCS15_TYPE_PRKEY, "private_keys");
+		if (r == SC_SUCCESS && list->contents & JSON_PUBLIC_KEYS)
+			r = json_objects(&json, tp15card, SC_PKCS15_TYPE_PUBKEY, "public_keys");
+		if (r == SC_SUCCESS && list->contents & JSON_SECRET_KEYS)
+			r = json_objects(&json, tp15card, SC_PKCS15_TYPE_SKEY, "secret_keys");
+		if (r == SC_SUCCESS && list->contents & JSON_CERTIFICATES)
+			r = json_objects(&json, tp15card, SC_PKCS15_TYPE_CERT_X509, "certificates");
+		if (r == SC_SUCCESS && list->contents & JSON_DATA_OBJECTS)
+			r = json_objects(&json, tp15card, SC_PKCS15_TYPE_DATA_OBJECT, "data_objects");
+		t_objects = util_timestamp();
+	}
+
+	if (r != SC_SUCCESS) {
+		const char *error = sc_strerror(r);
+
+		util_json_printf(&json, ",\"error\":");
+		util_json_string(&json, error, strlen(error));
+		util_json_printf(&json, ",\"stage\":\"%s\"", stage);
+	}
+	util_json_printf(&json, ",\"time_us\":{\"connect\":%llu", t_connect - start);
+	if (t_bind)
+		util_json_printf(&json, ",\"bind\":%llu", t_bind - t_connect);
+	if (t_objects)
+		util_json_printf(&json, ",\"objects\":%llu", t_objects - t_bind);
+	util_json_printf(&json, ",\"total\":%llu}}", util_timestamp() - start);
+
+	if (tp15card)
+		sc_pkcs15_unbind(tp15card);
+	if (tcard)
+		sc_disconnect_card(tcard);
+	if (tctx)
+		sc_release_context(tctx);
+
+	if (util_json_flush(&json, stdout) != 0 && r == SC_SUCCESS)
+		r = SC_ERROR_OUT_OF_MEMORY;
+	list->results[index] = r;
+}
+
+static int list_all_tokens(unsigned int contents)
+{
+	struct token_list list;
+	unsigned int i, count;
+	int err = 0;
+
+	count = sc_ctx_get_reader_count(ctx);
+	if (count == 0) {
+		fprintf(stderr, "No smart card readers found.\n");
+		return 1;
+	}
+	list.readers = calloc(count, sizeof *list.readers);
+	list.results = calloc(count, sizeof *list.results);
+	list.contents = contents;
+	if (!list.readers || !list.results) {
+		free(list.readers);
+		free(list.results);
+		return 1;
+	}
+	for (i = 0; i < count; i++) {
+		list.readers[i] = strdup(sc_ctx_get_reader(ctx, i)->name);
+		if (!list.readers[i])
+			err = 1;
+	}
+
+	if (!err)
+		util_run_jobs(opt_jobs, count, list_token_json, &list);
+
+	for (i = 0; i < count; i++) {
+		/* empty readers are expected */
+		if (list.results[i] != SC_SUCCESS && list.results[i] != SC_ERROR_CARD_NOT_PRESENT)
+			err = 1;
+		free(list.readers[i]);
+	}
+	free(list.readers);
+	free(list.results);
+	return err;
+}
+
 int main(int argc, char *argv[])
 {
 	int err = 0, r, c, long_optind = 0;
@@ -2273,6 +2567,12 @@ int main(int argc, char *argv[])
 		case OPT_READER:
 			opt_reader = optarg;
 			break;
+		case OPT_ALL_READERS:
+			opt_all_readers = 1;
+			break;
+		case OPT_JOBS:
+			opt_jobs = util_get_jobs(optarg);
+			break;
 		case OPT_PIN:
 			util_get_pin(optarg, &opt_pin);
 			break;
@@ -2343,6 +2643,50 @@ int main(int argc, char *argv[])
 		action_count--;
 	}
 
+	if (opt_all_readers) {
+		unsigned int contents = 0;
+
+		if (do_list_info)
+			action_count--;
+		if (do_dump) {
+			contents |= JSON_PINS | JSON_PRIVATE_KEYS | JSON_PUBLIC_KEYS
+				| JSON_SECRET_KEYS | JSON_CERTIFICATES | JSON_DATA_OBJECTS;
+			action_count--;
+		}
+		if (do_list_pins) {
+			contents |= JSON_PINS;
+			action_count--;
+		}
+		if (do_list_prkeys) {
+			contents |= JSON_PRIVATE_KEYS;
+			action_count--;
+		}
+		if (do_list_pubkeys) {
+			contents |= JSON_PUBLIC_KEYS;
+			action_count--;
+		}
+		if (do_list_skeys) {
+			contents |= JSON_SECRET_KEYS;
+			action_count--;
+		}
+		if (do_list_certs || do_read_cert) {
+			contents |= JSON_CERTIFICATES;
+			action_count -= do_list_certs + do_read_cert;
+		}
+		if (do_list_data_objects) {
+			contents |= JSON_DATA_OBJECTS;
+			action_count--;
+		}
+		if (action_count > 0 || opt_reader || opt_wait || opt_jobs < 1) {
+			fprintf(stderr, "--all-readers only lists the tokens, "
+					"without --reader and --wait, with at least one job\n");
+			err = 1;
+			goto end;
+		}
+		err = list_all_tokens(contents);
+		goto end;
+	}
+
 	err = util_connect_card_ex(ctx, &card, opt_reader, opt_wait, 0, verbose);
 	if (err)
 		goto end;
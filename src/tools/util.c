@@ -23,10 +23,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
 #ifndef _WIN32
 #include <termios.h>
+#include <pthread.h>
+#include <time.h>
 #else
 #include <conio.h>
+#include <windows.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
 #endif
 #include <ctype.h>
 #include "util.h"
@@ -506,3 +514,274 @@ util_get_pin(const char *input, const char **pin)
 	}
 	return pinlen;
 }
+
+unsigned long long
+util_timestamp_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (unsigned long long) (now.QuadPart / (double) freq.QuadPart * 1000000000);
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+	return (unsigned long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return ((unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec) * 1000;
+#endif
+}
+
+unsigned long long
+util_timestamp(void)
+{
+	return util_timestamp_ns() / 1000;
+}
+
+struct util_jobs {
+	int count;
+	void (*job)(int index, void *arg);
+	void *arg;
+#ifdef _WIN32
+	volatile LONG next;
+#else
+	int next;
+	pthread_mutex_t lock;
+#endif
+};
+
+static int
+util_next_job(struct util_jobs *jobs)
+{
+	int index;
+
+#ifdef _WIN32
+	index = InterlockedIncrement(&jobs->next) - 1;
+#else
+	pthread_mutex_lock(&jobs->lock);
+	index = jobs->next++;
+	pthread_mutex_unlock(&jobs->lock);
+#endif
+	return index < jobs->count ? index : -1;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI
+#else
+static void *
+#endif
+util_job_thread(void *arg)
+{
+	struct util_jobs *jobs = arg;
+	int index;
+
+	while ((index = util_next_job(jobs)) >= 0)
+		jobs->job(index, jobs->arg);
+
+	return 0;
+}
+
+void
+util_run_jobs(int jobs, int count, void (*job)(int index, void *arg), void *arg)
+{
+	struct util_jobs queue;
+#ifdef _WIN32
+	HANDLE *threads;
+#else
+	pthread_t *threads;
+#endif
+	int i, started = 0;
+
+	queue.count = count;
+	queue.job = job;
+	queue.arg = arg;
+	queue.next = 0;
+
+	if (jobs > count)
+		jobs = count;
+	threads = jobs > 1 ? calloc(jobs, sizeof *threads) : NULL;
+	if (threads == NULL) {
+		/* run everything in this thread */
+		for (i = 0; i < count; i++)
+			job(i, arg);
+		return;
+	}
+
+#ifdef _WIN32
+	for (i = 0; i < jobs; i++) {
+		threads[started] = CreateThread(NULL, 0, util_job_thread, &queue, 0, NULL);
+		if (threads[started] != NULL)
+			started++;
+	}
+	if (started == 0)
+		util_job_thread(&queue);
+	/* no more than MAXIMUM_WAIT_OBJECTS handles can be waited for at once */
+	for (i = 0; i < started; i += MAXIMUM_WAIT_OBJECTS) {
+		DWORD n = started - i < MAXIMUM_WAIT_OBJECTS ? started - i : MAXIMUM_WAIT_OBJECTS;
+
+		WaitForMultipleObjects(n, threads + i, TRUE, INFINITE);
+	}
+	for (i = 0; i < started; i++)
+		CloseHandle(threads[i]);
+#else
+	pthread_mutex_init(&queue.lock, NULL);
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&threads[started], NULL, util_job_thread, &queue) == 0)
+			started++;
+	}
+	if (started == 0)
+		util_job_thread(&queue);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&queue.lock);
+#endif
+	free(threads);
+}
+
+long
+util_get_number(const char *arg, long min, long max, const char *name)
+{
+	char *end = NULL;
+	long value;
+
+	errno = 0;
+	value = strtol(arg, &end, 10);
+	if (errno != 0 || end == arg || *end != '\0' || value < min || value > max)
+		util_fatal("Invalid %s \"%s\"", name, arg);
+	return value;
+}
+
+int
+util_get_jobs(const char *arg)
+{
+	return (int) util_get_number(arg, 1, INT_MAX, "number of jobs");
+}
+
+static void
+util_json_append(struct util_json *json, const char *data, size_t len)
+{
+	if (json->error)
+		return;
+	if (json->size - json->len <= len) {
+		size_t size = json->size ? json->size : 1024;
+		char *p;
+
+		while (size - json->len <= len)
+			size *= 2;
+		p = realloc(json->data, size);
+		if (p == NULL) {
+			json->error = 1;
+			return;
+		}
+		json->data = p;
+		json->size = size;
+	}
+	memcpy(json->data + json->len, data, len);
+	json->len += len;
+	json->data[json->len] = '\0';
+}
+
+void
+util_json_printf(struct util_json *json, const char *fmt, ...)
+{
+	char buf[256];
+	va_list ap;
+	int r;
+
+	va_start(ap, fmt);
+	r = vsnprintf(buf, sizeof buf, fmt, ap);
+	va_end(ap);
+	if (r < 0 || (size_t) r >= sizeof buf) {
+		json->error = 1;
+		return;
+	}
+	util_json_append(json, buf, r);
+}
+
+/* Length of the valid UTF-8 sequence at the start of s, or 0 */
+static size_t
+util_utf8_len(const unsigned char *s, size_t len)
+{
+	size_t n, i;
+	unsigned long c;
+
+	if (s[0] < 0xc2 || s[0] > 0xf4)
+		return 0;
+	n = s[0] < 0xe0 ? 2 : s[0] < 0xf0 ? 3 : 4;
+	if (n > len)
+		return 0;
+	c = s[0] & (0x7f >> n);
+	for (i = 1; i < n; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+		c = (c << 6) | (s[i] & 0x3f);
+	}
+	/* overlong forms, surrogates and code points above U+10FFFF */
+	if ((n == 3 && c < 0x800) || (c >= 0xd800 && c <= 0xdfff)
+			|| (n == 4 && (c < 0x10000 || c > 0x10ffff)))
+		return 0;
+	return n;
+}
+
+void
+util_json_string(struct util_json *json, const char *str, size_t len)
+{
+	size_t i, n;
+
+	util_json_append(json, "\"", 1);
+	for (i = 0; str != NULL && i < len && str[i] != '\0'; i++) {
+		unsigned char c = (unsigned char) str[i];
+
+		if (c == '"' || c == '\\') {
+			char esc[2] = { '\\', (char) c };
+			util_json_append(json, esc, 2);
+		} else if (c < 0x20) {
+			util_json_printf(json, "\\u%04x", c);
+		} else if (c < 0x80) {
+			util_json_append(json, str + i, 1);
+		} else if ((n = util_utf8_len((const unsigned char *) str + i, len - i)) > 0) {
+			util_json_append(json, str + i, n);
+			i += n - 1;
+		} else {
+			/* not UTF-8, which JSON requires, so taken as Latin-1 */
+			util_json_printf(json, "\\u%04x", c);
+		}
+	}
+	util_json_append(json, "\"", 1);
+}
+
+void
+util_json_hex(struct util_json *json, const u8 *data, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i;
+
+	util_json_append(json, "\"", 1);
+	for (i = 0; i < len; i++) {
+		char buf[2] = { hex[data[i] >> 4], hex[data[i] & 0x0f] };
+		util_json_append(json, buf, 2);
+	}
+	util_json_append(json, "\"", 1);
+}
+
+int
+util_json_flush(struct util_json *json, FILE *f)
+{
+	int r = -1;
+
+	util_json_append(json, "\n", 1);
+	if (!json->error) {
+		/* a single write, so that lines of several threads do not mix */
+		if (fwrite(json->data, 1, json->len, f) == json->len && fflush(f) == 0)
+			r = 0;
+	}
+	free(json->data);
+	memset(json, 0, sizeof *json);
+	return r;
+}
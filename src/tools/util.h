@@ -60,6 +60,35 @@ int util_getpass (char **lineptr, size_t *n, FILE *stream);
  */
 size_t util_get_pin(const char *input, const char **pin);
 
+/* Monotonic time in microseconds, for timing of operations */
+unsigned long long util_timestamp(void);
+/* The same in nanoseconds, for short operations */
+unsigned long long util_timestamp_ns(void);
+
+/* Calls job(index, arg) for every index below count from up to jobs
+ * threads and waits for all of them to finish */
+void util_run_jobs(int jobs, int count, void (*job)(int index, void *arg), void *arg);
+/* Parses the argument of --jobs, exits unless it is a positive number */
+int util_get_jobs(const char *arg);
+/* Parses a decimal option argument, exits unless it is between min and max */
+long util_get_number(const char *arg, long min, long max, const char *name);
+
+/* Buffer for a JSON document that is written at once */
+struct util_json {
+	char *data;
+	size_t len, size;
+	int error;
+};
+
+void util_json_printf(struct util_json *json, const char *fmt, ...);
+/* Appends a JSON string of len bytes from str, escaping bytes that are
+ * not valid UTF-8 */
+void util_json_string(struct util_json *json, const char *str, size_t len);
+/* Appends a JSON string with the hexadecimal encoding of data */
+void util_json_hex(struct util_json *json, const u8 *data, size_t len);
+/* Writes the document as a single line to f and frees the buffer */
+int util_json_flush(struct util_json *json, FILE *f);
+
 #ifdef __cplusplus
 }
 #endif